@@ -22,6 +22,7 @@
 #include "Common/Uncompress.h"
 #include "Common/IOUtil.h"
 #include "DataLayer/FastaReader.h"
+#include "DataLayer/ParallelFastaReader.h"
 #include <iostream>
 #include <vector>
 
@@ -81,24 +82,17 @@ namespace Bloom {
 		assert(!path.empty());
 		if (verbose)
 			std::cerr << "Reading `" << path << "'...\n";
-		FastaReader in(path.c_str(), FastaReader::FOLD_CASE);
+#if _OPENMP
+		unsigned threads = omp_get_max_threads();
+#else
+		unsigned threads = 1;
+#endif
+		ParallelFastaReader in(path.c_str(), FastaReader::FOLD_CASE,
+				threads);
 		uint64_t count = 0;
 #pragma omp parallel
-		for (std::vector<std::string> buffer(taskIOBufferSize);;) {
-			buffer.clear();
-			size_t bufferSize = 0;
-			bool good = true;
-#pragma omp critical(in)
-			for (; good && bufferSize < taskIOBufferSize;) {
-				std::string seq;
-				good = in >> seq;
-				if (good) {
-					buffer.push_back(seq);
-					bufferSize += seq.length();
-				}
-			}
-			if (buffer.size() == 0)
-				break;
+		for (std::vector<std::string> buffer;
+				in.readBatch(buffer, taskIOBufferSize) > 0;) {
 			for (size_t j = 0; j < buffer.size(); j++) {
 				loadSeq(bloomFilter, k, buffer.at(j));
 				if (verbose)
@@ -138,6 +138,51 @@ class BloomFilter
 		assert(in);
 	}
 
+	/**
+	 * Combine the bit array of a serialized bloom filter, such as a
+	 * memory-mapped bloom filter file, with this bloom filter.
+	 * Whole-filter OR and AND are done in parallel with
+	 * `#pragma omp parallel' when OpenMP is enabled.
+	 *
+	 * @param header header of the serialized bloom filter
+	 * @param bits bit array following the header
+	 */
+	void combine(const Bloom::FileHeader& header, const char* bits,
+		BitwiseOp op)
+	{
+		if (op == BITWISE_OVERWRITE) {
+			m_hashSeed = header.hashSeed;
+			if (m_size != header.fullBloomSize)
+				resize(header.fullBloomSize);
+		} else if (m_hashSeed != header.hashSeed
+				|| m_size != header.fullBloomSize) {
+			std::cerr << "error: can't union/intersect bloom filters with "
+				<< "different hash seeds or sizes\n";
+			exit(EXIT_FAILURE);
+		}
+
+		size_t numBits = header.endBitPos - header.startBitPos + 1;
+		if (header.startBitPos % 8 != 0 || numBits % 8 != 0) {
+			copyBits(const_cast<char*>(bits), m_array, numBits,
+				header.startBitPos, op);
+			return;
+		}
+
+		const size_t chunkSize = 1 << 20;
+		char* dest = m_array + header.startBitPos / 8;
+		size_t bytes = numBits / 8;
+		ptrdiff_t chunks = (bytes + chunkSize - 1) / chunkSize;
+#pragma omp parallel for
+		for (ptrdiff_t i = 0; i < chunks; i++) {
+			size_t offset = i * chunkSize;
+			size_t n = std::min(chunkSize, bytes - offset);
+			if (op == BITWISE_OVERWRITE)
+				memcpy(dest + offset, bits + offset, n);
+			else
+				combineBytes(dest + offset, bits + offset, n, op);
+		}
+	}
+
 	/** Write a bloom filter to a stream. */
 	void write(std::ostream& out) const
 	{
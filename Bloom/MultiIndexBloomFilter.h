@@ -0,0 +1,327 @@
+/**
+ * A multi-index Bloom filter (MIBF), which associates each k-mer with
+ * the ID of the sequence it came from.
+ */
+#ifndef MULTIINDEXBLOOMFILTER_H
+#define MULTIINDEXBLOOMFILTER_H 1
+
+#include "BloomDBG/RollingHashIterator.h"
+#include "Common/BitUtil.h"
+#include "Common/IOUtil.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * A multi-index Bloom filter, after the MIBloomFilter of BTL
+ * (vendor/btl_bloomfilter/MIBloomFilter.hpp), without its dependency
+ * on SDSL.
+ *
+ * The filter is built in two stages. In the first stage, the k-mers
+ * of all of the target sequences are inserted into a bit vector.
+ * In the second stage, a rank table is computed over the bit vector,
+ * and an ID is stored at the rank of each set bit. An ID slot is
+ * claimed by the first target to reach it. A k-mer that cannot hold
+ * any slot for its target is shared by several targets, and all of
+ * its slots are marked saturated.
+ */
+class MultiIndexBloomFilter
+{
+  public:
+	typedef uint64_t hash_t;
+	typedef uint32_t id_t;
+
+	/** High bit of an ID slot, set when the slot is saturated */
+	static const id_t SATURATED = id_t(1) << 31;
+	static const id_t ID_MASK = SATURATED - 1;
+
+	/** Number of bits per rank sample */
+	static const size_t BLOCK_BITS = 512;
+	static const size_t BLOCK_WORDS = BLOCK_BITS / 64;
+
+	static const char* magic() { return "[ABySSMIBloomFilter_v1]"; }
+
+	MultiIndexBloomFilter()
+	  : m_size(0)
+	  , m_hashNum(0)
+	  , m_kmerSize(0)
+	{}
+
+	/**
+	 * Constructor.
+	 * @param size number of bits, rounded up to a multiple of 64
+	 */
+	MultiIndexBloomFilter(size_t size, unsigned hashNum, unsigned kmerSize)
+	  : m_bits((size + 63) / 64)
+	  , m_size(m_bits.size() * 64)
+	  , m_hashNum(hashNum)
+	  , m_kmerSize(kmerSize)
+	{
+		assert(hashNum > 0);
+	}
+
+	unsigned getKmerSize() const { return m_kmerSize; }
+	unsigned getHashNum() const { return m_hashNum; }
+	const std::string& spacedSeed() const { return m_spacedSeed; }
+	void setSpacedSeed(const std::string& seed) { m_spacedSeed = seed; }
+
+	/** Return the number of bits of the bit vector. */
+	size_t size() const { return m_size; }
+
+	/** Return the number of set bits, which is the number of ID slots. */
+	size_t popCount() const { return m_data.size(); }
+
+	/** Return the estimated false positive rate of the bit vector. */
+	double FPR() const
+	{
+		size_t pop = 0;
+		for (size_t i = 0; i < m_bits.size(); ++i)
+			pop += popcount(m_bits[i]);
+		return std::pow((double)pop / m_size, m_hashNum);
+	}
+
+	/** Return the number of IDs, not including the null ID 0. */
+	size_t numIDs() const { return m_names.size(); }
+
+	/** Return the name of the specified ID. */
+	const std::string& name(id_t id) const
+	{
+		assert(id > 0 && id <= m_names.size());
+		return m_names[id - 1];
+	}
+
+	/** Add a name and return its ID. */
+	id_t addName(const std::string& name)
+	{
+		m_names.push_back(name);
+		assert(m_names.size() < ID_MASK);
+		return m_names.size();
+	}
+
+	/** Stage 1: insert the hash values of a k-mer into the bit vector. */
+	void insert(const hash_t* hashes)
+	{
+		assert(m_data.empty());
+		for (unsigned i = 0; i < m_hashNum; ++i) {
+			size_t pos = hashes[i] % m_size;
+			uint64_t bit = uint64_t(1) << (pos % 64);
+			if ((m_bits[pos / 64] & bit) == 0)
+				__sync_fetch_and_or(&m_bits[pos / 64], bit);
+		}
+	}
+
+	/** Compute the rank table and allocate the ID slots. */
+	void finalize()
+	{
+		computeRanks();
+		m_data.assign(m_ranks.back(), 0);
+	}
+
+	/**
+	 * Stage 2: store the ID of a k-mer in its unclaimed slots. If the
+	 * k-mer cannot hold any slot, saturate its slots.
+	 * @return whether the k-mer holds at least one slot
+	 */
+	bool insert(const hash_t* hashes, id_t id)
+	{
+		assert(!m_data.empty());
+		assert(id > 0 && id <= ID_MASK);
+		bool held = false, saturated = true;
+		for (unsigned i = 0; i < m_hashNum; ++i) {
+			id_t* p = &m_data[rank(hashes[i] % m_size)];
+			id_t old = *p;
+			if (old == 0)
+				old = __sync_val_compare_and_swap(p, 0, id);
+			if (old == 0 || (old & ID_MASK) == id)
+				held = true;
+			else if ((old & SATURATED) == 0)
+				saturated = false;
+		}
+		if (!held && !saturated) {
+			for (unsigned i = 0; i < m_hashNum; ++i)
+				__sync_fetch_and_or(&m_data[rank(hashes[i] % m_size)], SATURATED);
+		}
+		return held;
+	}
+
+	/**
+	 * Get the IDs of the slots of a k-mer.
+	 * @param[out] ids the IDs; saturated slots have the SATURATED bit set
+	 * @return false if the k-mer is not in the bit vector
+	 */
+	bool at(const hash_t* hashes, std::vector<id_t>& ids) const
+	{
+		ids.clear();
+		for (unsigned i = 0; i < m_hashNum; ++i) {
+			size_t pos = hashes[i] % m_size;
+			if ((m_bits[pos / 64] & uint64_t(1) << (pos % 64)) == 0) {
+				ids.clear();
+				return false;
+			}
+			ids.push_back(m_data[rank(pos)]);
+		}
+		return true;
+	}
+
+	/**
+	 * Assign a sequence to the ID supported by the most k-mers. Each
+	 * k-mer votes once for each distinct unsaturated ID in its slots.
+	 * @param[out] hits number of k-mers that vote for the best ID
+	 * @param[out] kmers number of k-mers of the sequence
+	 * @return the best ID, or 0 if the sequence has fewer than
+	 * `minHits' hits or the best ID is tied
+	 */
+	id_t classify(const std::string& seq, unsigned minHits, unsigned& hits, unsigned& kmers) const
+	{
+		typedef std::vector<std::pair<id_t, unsigned> > Votes;
+		Votes votes;
+		std::vector<id_t> ids;
+		kmers = 0;
+		for (RollingHashIterator it(seq, m_hashNum, m_kmerSize); it != RollingHashIterator::end();
+		     ++it, ++kmers) {
+			if (!at(*it, ids))
+				continue;
+			for (unsigned i = 0; i < ids.size(); ++i) {
+				id_t id = ids[i];
+				if (id == 0 || (id & SATURATED) || std::find(ids.begin(), ids.begin() + i, id) !=
+				                                        ids.begin() + i)
+					continue;
+				Votes::iterator v = votes.begin();
+				while (v != votes.end() && v->first != id)
+					++v;
+				if (v == votes.end())
+					votes.push_back(std::make_pair(id, 1));
+				else
+					++v->second;
+			}
+		}
+
+		id_t best = 0;
+		hits = 0;
+		bool tie = false;
+		for (Votes::const_iterator v = votes.begin(); v != votes.end(); ++v) {
+			if (v->second > hits) {
+				best = v->first;
+				hits = v->second;
+				tie = false;
+			} else if (v->second == hits) {
+				tie = true;
+			}
+		}
+		return tie || hits < minHits || hits == 0 ? 0 : best;
+	}
+
+	/** Return the number of set bits before the specified position. */
+	size_t rank(size_t pos) const
+	{
+		size_t word = pos / 64;
+		size_t r = m_ranks[pos / BLOCK_BITS];
+		for (size_t i = word / BLOCK_WORDS * BLOCK_WORDS; i < word; ++i)
+			r += popcount(m_bits[i]);
+		return r + popcount(m_bits[word] & ((uint64_t(1) << (pos % 64)) - 1));
+	}
+
+	/** Write the filter to a stream. */
+	void write(std::ostream& out) const
+	{
+		out << magic() << '\n'
+		    << "\tBloomFilterSize = " << m_size << '\n'
+		    << "\tHashNum = " << m_hashNum << '\n'
+		    << "\tKmerSize = " << m_kmerSize << '\n'
+		    << "\tSpacedSeed = " << (m_spacedSeed.empty() ? "none" : m_spacedSeed) << '\n'
+		    << "\tPopCount = " << m_data.size() << '\n'
+		    << "\tIDCount = " << m_names.size() << '\n'
+		    << "[HeaderEnd]\n";
+		for (size_t i = 0; i < m_names.size(); ++i)
+			out << m_names[i] << '\n';
+		out.write(reinterpret_cast<const char*>(m_bits.data()), m_bits.size() * sizeof m_bits[0]);
+		out.write(reinterpret_cast<const char*>(m_data.data()), m_data.size() * sizeof m_data[0]);
+	}
+
+	/** Read the filter from a stream. */
+	void read(std::istream& in)
+	{
+		std::string line;
+		if (!getline(in, line))
+			return;
+		if (line != magic()) {
+			std::cerr << "error: expected a multi-index Bloom filter and saw `" << line
+			          << "'\n";
+			exit(EXIT_FAILURE);
+		}
+		size_t popCount = 0, numIDs = 0;
+		while (getline(in, line) && line != "[HeaderEnd]") {
+			std::istringstream ss(line);
+			std::string key;
+			ss >> key >> expect(" = ");
+			if (key == "BloomFilterSize")
+				ss >> m_size;
+			else if (key == "HashNum")
+				ss >> m_hashNum;
+			else if (key == "KmerSize")
+				ss >> m_kmerSize;
+			else if (key == "SpacedSeed")
+				ss >> m_spacedSeed;
+			else if (key == "PopCount")
+				ss >> popCount;
+			else if (key == "IDCount")
+				ss >> numIDs;
+		}
+		if (m_spacedSeed == "none")
+			m_spacedSeed.clear();
+		assert(m_size % 64 == 0);
+
+		m_names.resize(numIDs);
+		for (size_t i = 0; i < numIDs; ++i)
+			getline(in, m_names[i]);
+		m_bits.resize(m_size / 64);
+		in.read(reinterpret_cast<char*>(m_bits.data()), m_bits.size() * sizeof m_bits[0]);
+		m_data.resize(popCount);
+		in.read(reinterpret_cast<char*>(m_data.data()), m_data.size() * sizeof m_data[0]);
+		if (in)
+			computeRanks();
+		assert(!in || m_ranks.back() == popCount);
+	}
+
+	friend std::istream& operator>>(std::istream& in, MultiIndexBloomFilter& o)
+	{
+		o.read(in);
+		return in;
+	}
+
+	friend std::ostream& operator<<(std::ostream& out, const MultiIndexBloomFilter& o)
+	{
+		o.write(out);
+		return out;
+	}
+
+  private:
+	/** Compute the number of set bits before each block. */
+	void computeRanks()
+	{
+		size_t blocks = (m_bits.size() + BLOCK_WORDS - 1) / BLOCK_WORDS;
+		m_ranks.assign(blocks + 1, 0);
+		for (size_t i = 0; i < m_bits.size(); ++i)
+			m_ranks[i / BLOCK_WORDS + 1] += popcount(m_bits[i]);
+		for (size_t i = 1; i <= blocks; ++i)
+			m_ranks[i] += m_ranks[i - 1];
+	}
+
+	std::vector<uint64_t> m_bits;
+	std::vector<size_t> m_ranks;
+	std::vector<id_t> m_data;
+	std::vector<std::string> m_names;
+	size_t m_size;
+	unsigned m_hashNum;
+	unsigned m_kmerSize;
+	std::string m_spacedSeed;
+};
+
+#endif
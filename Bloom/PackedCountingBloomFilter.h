@@ -0,0 +1,344 @@
+/**
+ * A counting Bloom filter with saturating 4-bit or 8-bit counters
+ * packed into 64-bit words.
+ */
+#ifndef PACKEDCOUNTINGBLOOMFILTER_H
+#define PACKEDCOUNTINGBLOOMFILTER_H 1
+
+#include "Common/BitUtil.h"
+#include "Common/IOUtil.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * Header section of a serialized counting Bloom filter. The format is
+ * that of the BTL CountingBloomFilter, so that 8-bit filters can be
+ * read by either implementation.
+ */
+struct CountingBloomHeader
+{
+	/** number of counters */
+	size_t size;
+	size_t sizeInBytes;
+	unsigned hashNum;
+	unsigned kmerSize;
+	unsigned bitsPerCounter;
+
+	static const char* magic() { return "[BTLCountingBloomFilter_v1]"; }
+
+	CountingBloomHeader()
+	  : size(0)
+	  , sizeInBytes(0)
+	  , hashNum(0)
+	  , kmerSize(0)
+	  , bitsPerCounter(8)
+	{}
+
+	friend std::ostream& operator<<(std::ostream& out, const CountingBloomHeader& o)
+	{
+		return out << magic() << '\n'
+		           << "\tBloomFilterSize = " << o.size << '\n'
+		           << "\tHashNum = " << o.hashNum << '\n'
+		           << "\tKmerSize = " << o.kmerSize << '\n'
+		           << "\tBloomFilterSizeInBytes = " << o.sizeInBytes << '\n'
+		           << "\tBitsPerCounter = " << o.bitsPerCounter << '\n'
+		           << "[HeaderEnd]\n";
+	}
+
+	friend std::istream& operator>>(std::istream& in, CountingBloomHeader& o)
+	{
+		std::string line;
+		if (!getline(in, line))
+			return in;
+		if (line != magic()) {
+			std::cerr << "error: expected a counting Bloom filter and saw `" << line
+			          << "'\n";
+			exit(EXIT_FAILURE);
+		}
+		while (getline(in, line) && line != "[HeaderEnd]") {
+			std::istringstream ss(line);
+			std::string key;
+			ss >> key >> expect(" = ");
+			if (key == "BloomFilterSize")
+				ss >> o.size;
+			else if (key == "HashNum")
+				ss >> o.hashNum;
+			else if (key == "KmerSize")
+				ss >> o.kmerSize;
+			else if (key == "BloomFilterSizeInBytes")
+				ss >> o.sizeInBytes;
+			else if (key == "BitsPerCounter")
+				ss >> o.bitsPerCounter;
+		}
+		return in;
+	}
+};
+
+/**
+ * Return whether the stream is positioned at a counting Bloom filter
+ * rather than a konnector-style Bloom filter.
+ */
+static inline bool
+isCountingBloom(std::istream& in)
+{
+	return in.peek() == CountingBloomHeader::magic()[0];
+}
+
+/**
+ * Exit with an error unless the file is a counting Bloom filter with
+ * the specified number of bits per counter. The BTL
+ * CountingBloomFilter does not check the counter size of the header,
+ * and would read a 4-bit filter past the end of its counters.
+ */
+static inline void
+checkCountingBloomBits(const std::string& path, unsigned bits)
+{
+	std::ifstream in(path.c_str());
+	assert_good(in, path);
+	CountingBloomHeader header;
+	in >> header;
+	assert_good(in, path);
+	if (header.bitsPerCounter != bits) {
+		std::cerr << "error: `" << path << "': expected a counting Bloom filter with " << bits
+		          << " bits per counter and saw " << header.bitsPerCounter << '\n';
+		exit(EXIT_FAILURE);
+	}
+}
+
+/**
+ * A counting Bloom filter with `Bits' bits per counter. Counters
+ * saturate at 2^Bits - 1. Inserts use a conservative update: only the
+ * counters equal to the minimum count of the element are incremented,
+ * using an atomic compare-and-swap, so that many threads may insert
+ * concurrently.
+ *
+ * The counters are stored little-end first within each 64-bit word,
+ * so on a little-endian host an 8-bit filter has the same layout as
+ * the BTL CountingBloomFilter<uint8_t>.
+ */
+template<unsigned Bits>
+class PackedCountingBloomFilter
+{
+  public:
+	typedef uint64_t hash_t;
+	typedef uint64_t word_t;
+
+	static const unsigned COUNTERS_PER_WORD = 64 / Bits;
+	static const unsigned MAX_COUNT = (1U << Bits) - 1;
+
+	PackedCountingBloomFilter()
+	  : m_size(0)
+	  , m_hashNum(0)
+	  , m_kmerSize(0)
+	  , m_countThreshold(0)
+	{}
+
+	/**
+	 * Constructor.
+	 * @param sizeInBytes size of the filter, rounded up to a multiple
+	 * of 8 bytes
+	 */
+	PackedCountingBloomFilter(
+	    size_t sizeInBytes,
+	    unsigned hashNum,
+	    unsigned kmerSize,
+	    unsigned countThreshold)
+	  : m_words((sizeInBytes + 7) / 8)
+	  , m_size(m_words.size() * COUNTERS_PER_WORD)
+	  , m_hashNum(hashNum)
+	  , m_kmerSize(kmerSize)
+	  , m_countThreshold(countThreshold)
+	{
+		assert(hashNum > 0);
+	}
+
+	/** Load a counting Bloom filter from a file. */
+	PackedCountingBloomFilter(const std::string& path, unsigned countThreshold)
+	  : m_countThreshold(countThreshold)
+	{
+		std::ifstream in(path.c_str());
+		assert_good(in, path);
+		read(in);
+		assert_good(in, path);
+	}
+
+	/** Return the count of the specified counter. */
+	unsigned count(size_t i) const
+	{
+		assert(i < m_size);
+		return m_words[i / COUNTERS_PER_WORD] >> (i % COUNTERS_PER_WORD * Bits) & MAX_COUNT;
+	}
+
+	/** Return the approximate count of an element. */
+	unsigned minCount(const hash_t* hashes) const
+	{
+#if __GNUC__ && __x86_64__
+		if (hasAvx2)
+			return minCountAvx2(hashes);
+#endif
+		unsigned min = MAX_COUNT;
+		for (unsigned i = 0; i < m_hashNum; ++i) {
+			unsigned c = count(hashes[i] % m_size);
+			if (c < min)
+				min = c;
+		}
+		return min;
+	}
+
+	/** Return whether the count of an element is at least the threshold. */
+	bool contains(const hash_t* hashes) const
+	{
+		return minCount(hashes) >= m_countThreshold;
+	}
+
+	/** Increment the minimum counters of an element. */
+	void insert(const hash_t* hashes)
+	{
+		unsigned minVal = minCount(hashes);
+		if (minVal == MAX_COUNT)
+			return;
+		for (unsigned i = 0; i < m_hashNum; ++i) {
+			size_t pos = hashes[i] % m_size;
+			word_t* p = &m_words[pos / COUNTERS_PER_WORD];
+			unsigned shift = pos % COUNTERS_PER_WORD * Bits;
+			for (word_t old = *p;;) {
+				// another thread may have incremented this counter
+				if ((old >> shift & MAX_COUNT) != minVal)
+					break;
+				word_t prev = __sync_val_compare_and_swap(p, old, old + (word_t(1) << shift));
+				if (prev == old)
+					break;
+				old = prev;
+			}
+		}
+	}
+
+	unsigned getKmerSize() const { return m_kmerSize; }
+	unsigned getHashNum() const { return m_hashNum; }
+	unsigned threshold() const { return m_countThreshold; }
+	size_t size() const { return m_size; }
+	size_t sizeInBytes() const { return m_words.size() * sizeof(word_t); }
+
+	/** Return the number of non-zero counters. */
+	size_t popCount() const { return countAtLeast(1); }
+
+	/** Return the number of counters that are at least the threshold. */
+	size_t filtered_popcount() const { return countAtLeast(m_countThreshold); }
+
+	double FPR() const { return std::pow((double)popCount() / m_size, m_hashNum); }
+
+	double filtered_FPR() const
+	{
+		return std::pow((double)filtered_popcount() / m_size, m_hashNum);
+	}
+
+	/** Read a counting Bloom filter from a stream. */
+	void read(std::istream& in)
+	{
+		CountingBloomHeader header;
+		in >> header;
+		if (in)
+			read(in, header);
+	}
+
+	/**
+	 * Read the counters of a counting Bloom filter whose header has
+	 * already been read from the stream.
+	 */
+	void read(std::istream& in, const CountingBloomHeader& header)
+	{
+		if (header.bitsPerCounter != Bits) {
+			std::cerr << "error: expected a counting Bloom filter with " << Bits
+			          << " bits per counter and saw " << header.bitsPerCounter << '\n';
+			exit(EXIT_FAILURE);
+		}
+		m_hashNum = header.hashNum;
+		m_kmerSize = header.kmerSize;
+		m_words.resize((header.sizeInBytes + 7) / 8);
+		m_size = header.size;
+		assert(m_size <= m_words.size() * COUNTERS_PER_WORD);
+		in.read(reinterpret_cast<char*>(m_words.data()), header.sizeInBytes);
+	}
+
+	/** Write a counting Bloom filter to a stream. */
+	void write(std::ostream& out) const
+	{
+		CountingBloomHeader header;
+		header.size = m_size;
+		header.sizeInBytes = sizeInBytes();
+		header.hashNum = m_hashNum;
+		header.kmerSize = m_kmerSize;
+		header.bitsPerCounter = Bits;
+		out << header;
+		out.write(reinterpret_cast<const char*>(m_words.data()), sizeInBytes());
+	}
+
+	friend std::istream& operator>>(std::istream& in, PackedCountingBloomFilter& o)
+	{
+		o.read(in);
+		return in;
+	}
+
+	friend std::ostream& operator<<(std::ostream& out, const PackedCountingBloomFilter& o)
+	{
+		o.write(out);
+		return out;
+	}
+
+  private:
+	size_t countAtLeast(unsigned threshold) const
+	{
+		size_t n = 0;
+		for (size_t i = 0; i < m_size; ++i)
+			n += count(i) >= threshold;
+		return n;
+	}
+
+#if __GNUC__ && __x86_64__
+	/**
+	 * Return the minimum count of an element, gathering the counter
+	 * words of four hash functions at a time.
+	 */
+	__attribute__((target("avx2"))) unsigned minCountAvx2(const hash_t* hashes) const
+	{
+		const long long* base = reinterpret_cast<const long long*>(m_words.data());
+		const __m256i mask = _mm256_set1_epi64x(MAX_COUNT);
+		__m256i min = mask;
+		for (unsigned i = 0; i < m_hashNum; i += 4) {
+			long long index[4], shift[4];
+			for (unsigned j = 0; j < 4; ++j) {
+				// pad the last group with the first hash function
+				size_t pos = hashes[i + j < m_hashNum ? i + j : 0] % m_size;
+				index[j] = pos / COUNTERS_PER_WORD;
+				shift[j] = pos % COUNTERS_PER_WORD * Bits;
+			}
+			__m256i words = _mm256_i64gather_epi64(
+			    base, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(index)), 8);
+			__m256i counts = _mm256_and_si256(
+			    _mm256_srlv_epi64(
+			        words, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(shift))),
+			    mask);
+			min = _mm256_blendv_epi8(min, counts, _mm256_cmpgt_epi64(min, counts));
+		}
+		uint64_t lanes[4];
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), min);
+		return std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+	}
+#endif
+
+	std::vector<word_t> m_words;
+	size_t m_size;
+	unsigned m_hashNum;
+	unsigned m_kmerSize;
+	unsigned m_countThreshold;
+};
+
+#endif
@@ -8,32 +8,44 @@
 #include "Bloom/CascadingBloomFilter.h"
 #include "Bloom/CascadingBloomFilterWindow.h"
 #include "Bloom/HashAgnosticCascadingBloom.h"
+#include "Bloom/MultiIndexBloomFilter.h"
+#include "Bloom/PackedCountingBloomFilter.h"
 #include "Bloom/RollingBloomDBGVisitor.h"
 #include "BloomDBG/BloomIO.h"
+#include "BloomDBG/MaskedKmer.h"
 #include "BloomDBG/RollingBloomDBG.h"
 #include "BloomDBG/RollingHashIterator.h"
 #include "Common/BitUtil.h"
 #include "Common/Kmer.h"
 #include "Common/KmerIterator.h"
+#include "Common/Gzip.h"
+#include "Common/MappedFile.h"
 #include "Common/Options.h"
+#include "Common/OrderedWriter.h"
+#include "Common/SignalHandler.h"
 #include "Common/StringUtil.h"
 #include "Common/UnorderedSet.h"
 #include "DataLayer/FastaConcat.h"
 #include "DataLayer/FastaReader.h"
 #include "DataLayer/Options.h"
+#include "DataLayer/ReadBatchReader.h"
 #include "Graph/ExtendPath.h"
 #include "Graph/Path.h"
 #include "Konnector/DBGBloom.h"
 #include "config.h"
 #include "vendor/btl_bloomfilter/BloomFilter.hpp"
-#include "vendor/btl_bloomfilter/CountingBloomFilter.hpp"
 
+#include <algorithm>
+#include <cctype>
 #include <cmath>
 #include <cstdlib>
 #include <fstream>
 #include <getopt.h>
 #include <iostream>
+#include <signal.h>
 #include <sstream>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #if _OPENMP
 #include "Bloom/ConcurrentBloomFilter.h"
@@ -63,9 +75,15 @@ static const char USAGE_MESSAGE[] =
     "Usage 4: " PROGRAM " info [GLOBAL_OPTS] [COMMAND_OPTS] <BLOOM_FILE>\n"
     "Usage 5: " PROGRAM " compare [GLOBAL_OPTS] [COMMAND_OPTS] <BLOOM_FILE_1> <BLOOM_FILE_2>\n"
     "Usage 6: " PROGRAM " graph [GLOBAL_OPTS] [COMMAND_OPTS] <BLOOM_FILE>\n"
+    "Usage 7: " PROGRAM " concat [GLOBAL_OPTS] [COMMAND_OPTS] <OUTPUT_BLOOM_FILE> "
+                        "<WINDOW_FILE_1> [WINDOW_FILE_2]...\n"
     "Usage 8: " PROGRAM " kmers [GLOBAL_OPTS] [COMMAND_OPTS] <BLOOM_FILE> <READS_FILE>\n"
     "Usage 9: " PROGRAM
     " trim [GLOBAL_OPTS] [COMMAND_OPTS] <BLOOM_FILE> <READS_FILE> [READS_FILE_2]... > trimmed.fq\n"
+    "Usage 10: " PROGRAM " mibf-build [GLOBAL_OPTS] [COMMAND_OPTS] <OUTPUT_MIBF_FILE> "
+                         "<TARGETS_FILE_1> [TARGETS_FILE_2]...\n"
+    "Usage 11: " PROGRAM " mibf-classify [GLOBAL_OPTS] [COMMAND_OPTS] <MIBF_FILE> "
+                         "<READS_FILE_1> [READS_FILE_2]... > assignments.tsv\n"
     "\n"
     "Build and manipulate Bloom filter files.\n"
     "\n"
@@ -100,17 +118,30 @@ static const char USAGE_MESSAGE[] =
                   "  -q, --trim-quality=N       trim bases from the ends of reads whose\n"
                   "                             quality is less than the threshold\n"
                   "  -t, --bloom-type=STR       'konnector', 'rolling-hash', or 'counting' [konnector]\n"
+                  "      --counter-bits=N       bits per counter of a `-t counting' Bloom\n"
+                  "                             filter: 4 or 8 [8]\n"
                   "      --standard-quality     zero quality is `!' (33)\n"
                   "                             default for FASTQ and SAM files\n"
                   "      --illumina-quality     zero quality is `@' (64)\n"
                   "                             default for qseq and export files\n"
                   "  -w, --window M/N           build a bloom filter for subwindow M of N\n"
+                  "  -w, --window N             build all N subwindows, one process per\n"
+                  "                             subwindow, and concatenate them\n"
+                  "  -P, --processes=N          with `-w N', build N subwindows at a time [1]\n"
+                  "\n"
+                  " Options for `" PROGRAM " union' and `" PROGRAM " intersect':\n"
+                  "\n"
+                  "  -j, --threads=N            use N parallel threads [1]\n"
+                  "\n"
+                  " Options for `" PROGRAM " concat':\n"
+                  "\n"
+                  "  -B, --buffer-size=N        read and merge N bytes of each window\n"
+                  "                             file at a time [100000]\n"
                   "\n"
-                  " Options for `" PROGRAM " union': (none)\n"
-                  " Options for `" PROGRAM " intersect': (none)\n"
                   " Options for `" PROGRAM " info': (none)\n"
                   " Options for `" PROGRAM " compare':\n"
                   "\n"
+                  "  -j, --threads=N            use N parallel threads [1]\n"
                   "  -m, --method=`String'      choose distance calculation method \n"
                   "                             [`jaccard'(default), `forbes', `czekanowski']\n"
                   "\n"
@@ -127,11 +158,50 @@ static const char USAGE_MESSAGE[] =
                   " Options for `" PROGRAM " kmers':\n"
                   "\n"
                   "  -r, --inverse              get k-mers that are *NOT* in the bloom filter\n"
+                  "  -c, --min-count=N          for a counting bloom filter, get k-mers with\n"
+                  "                             a count of at least N, and output the\n"
+                  "                             approximate count of each k-mer [1]\n"
                   "  --bed                      output k-mers in BED format\n"
                   "  --fasta                    output k-mers in FASTA format [default]\n"
                   "  --raw                      output k-mers in raw format (one per line)\n"
                   "\n"
-                  " Options for `" PROGRAM " trim': (none)\n"
+                  " Options for `" PROGRAM " trim':\n"
+                  "\n"
+                  "  -c, --min-count=N          for a counting bloom filter, trim the ends\n"
+                  "                             of reads whose k-mers have a count less\n"
+                  "                             than N [2]\n"
+                  "  -j, --threads=N            use N parallel threads [1]\n"
+                  "  -o, --output=FILE          write the trimmed reads to FILE, which is\n"
+                  "                             compressed if its name ends in .gz.\n"
+                  "                             Specify twice with --paired to write the\n"
+                  "                             mates to separate files [stdout]\n"
+                  "      --paired               read the files two at a time as the first\n"
+                  "                             and second reads of pairs, and discard a\n"
+                  "                             pair when either read is trimmed away.\n"
+                  "                             Pairs are interleaved unless two output\n"
+                  "                             files are given\n"
+                  "\n"
+                  " Options for `" PROGRAM " mibf-build':\n"
+                  "\n"
+                  "  -b, --bloom-size=N         size of the bit vector [500M]\n"
+                  "  -H, --num-hashes=N         number of hash functions [1]\n"
+                  "  -j, --threads=N            use N parallel threads [1]\n"
+                  "  -s, --spaced-seed=STR      bitmask of k-mer positions to hash,\n"
+                  "                             such as 1101011, which should be\n"
+                  "                             symmetric\n"
+                  "\n"
+                  " Index the k-mers of each target sequence, such as a contig or a\n"
+                  " scaffold, with its ID in a multi-index Bloom filter.\n"
+                  "\n"
+                  " Options for `" PROGRAM " mibf-classify':\n"
+                  "\n"
+                  "  -c, --min-count=N          assign a read to a target only when at least\n"
+                  "                             N k-mers of the read support it [1]\n"
+                  "  -j, --threads=N            use N parallel threads [1]\n"
+                  "\n"
+                  " Assign each read to the target supported by the most k-mers. Print\n"
+                  " the read ID, the target ID (`*' if unassigned or tied), the number\n"
+                  " of supporting k-mers and the number of k-mers of the read.\n"
                   "\n"
                   "Report bugs to <" PACKAGE_BUGREPORT ">.\n";
 ;
@@ -177,6 +247,24 @@ size_t hashSeed = 0;
 /** Number of hash functions (only works with `-t rolling-hash') */
 unsigned numHashes = 1;
 
+/** Output files of `trim' */
+vector<string> outputPaths;
+
+/** Read the input files of `trim' as pairs of mate files */
+bool paired = false;
+
+/** Spaced seed of a multi-index Bloom filter */
+string spacedSeed;
+
+/** Bits per counter of a counting Bloom filter */
+unsigned counterBits = 8;
+
+/**
+ * Minimum count of a k-mer in a counting Bloom filter for
+ * `kmers' and `trim' (0 for the default of the command)
+ */
+unsigned minCount = 0;
+
 /** The size of a k-mer. */
 unsigned k;
 
@@ -220,6 +308,10 @@ unsigned windowIndex = 0;
   ("N" for -w option) */
 unsigned windows = 0;
 
+/** Number of windows to build concurrently when building
+  all windows of a bloom filter (-P option) */
+unsigned processes = 1;
+
 /* Method for similarity or distance calculation.
  -m option
  */
@@ -239,7 +331,7 @@ vector<FilePath> rootFastas;
 OutputFormat format = FASTA;
 }
 
-static const char shortopts[] = "a:A:b:B:d:f:h:H:j:k:l:L:m:n:q:rR:vt:w:";
+static const char shortopts[] = "a:A:b:B:c:d:f:h:H:j:k:l:L:m:n:o:P:q:rR:s:vt:w:";
 
 enum
 {
@@ -247,12 +339,19 @@ enum
 	OPT_VERSION,
 	OPT_BED,
 	OPT_FASTA,
-	OPT_RAW
+	OPT_RAW,
+	OPT_COUNTER_BITS,
+	OPT_PAIRED
 };
 
 static const struct option longopts[] = {
 	{ "bloom-size", required_argument, NULL, 'b' },
 	{ "bloom-type", required_argument, NULL, 't' },
+	{ "counter-bits", required_argument, NULL, OPT_COUNTER_BITS },
+	{ "min-count", required_argument, NULL, 'c' },
+	{ "spaced-seed", required_argument, NULL, 's' },
+	{ "output", required_argument, NULL, 'o' },
+	{ "paired", no_argument, NULL, OPT_PAIRED },
 	{ "buffer-size", required_argument, NULL, 'B' },
 	{ "depth", required_argument, NULL, 'd' },
 	{ "hash-seed", required_argument, NULL, 'h' },
@@ -266,6 +365,7 @@ static const struct option longopts[] = {
 	{ "trim-masked", no_argument, &opt::trimMasked, 1 },
 	{ "no-trim-masked", no_argument, &opt::trimMasked, 0 },
 	{ "num-locks", required_argument, NULL, 'n' },
+	{ "processes", required_argument, NULL, 'P' },
 	{ "trim-quality", required_argument, NULL, 'q' },
 	{ "standard-quality", no_argument, &opt::qualityOffset, 33 },
 	{ "illumina-quality", no_argument, &opt::qualityOffset, 64 },
@@ -379,6 +479,66 @@ closeOutputStream(ostream* out, const string& path)
 	delete ofs;
 }
 
+/**
+ * Memory-map a bloom filter file and read its header.
+ * @return a pointer to the bit array that follows the header, or NULL
+ * if the file cannot be mapped, such as standard input or a
+ * compressed file
+ */
+static inline const char*
+mapBloomFile(const string& path, MappedFile& file, Bloom::FileHeader& header)
+{
+	if (path == "-")
+		return NULL;
+	file.open(path, MappedFile::SEQUENTIAL);
+
+	// a compressed file does not start with the version number
+	if (file.size() == 0 || !isdigit(file.data()[0])) {
+		file.close();
+		return NULL;
+	}
+
+	const size_t maxHeaderSize = 1024;
+	istringstream in(string(file.data(), min(file.size(), maxHeaderSize)));
+	header = Bloom::readHeader(in);
+	assert_good(in, path);
+	size_t offset = in.tellg();
+	size_t bytes = (header.endBitPos - header.startBitPos + 8) / 8;
+	if (offset + bytes != file.size()) {
+		file.close();
+		return NULL;
+	}
+	return file.data() + offset;
+}
+
+/**
+ * Read a bloom filter file from a stream into memory.
+ * Used for files that cannot be memory-mapped.
+ * @return a pointer to the bit array
+ */
+static inline const char*
+readBloomFile(const string& path, vector<char>& buffer, Bloom::FileHeader& header)
+{
+	istream* in = openInputStream(path);
+	assert_good(*in, path);
+	header = Bloom::readHeader(*in);
+	buffer.resize((header.endBitPos - header.startBitPos + 8) / 8);
+	in->read(buffer.data(), buffer.size());
+	assert_good(*in, path);
+	closeInputStream(in, path);
+	return buffer.data();
+}
+
+/** Set the number of OpenMP threads from the -j option. */
+static inline void
+setThreads()
+{
+#if _OPENMP
+	if (opt::threads > 0)
+		omp_set_num_threads(opt::threads);
+#endif
+}
+
 template<typename CBF>
 void
 initBloomFilterLevels(CBF& bf)
@@ -601,12 +761,13 @@ buildRollingHashBloom(size_t bits, string outputPath, int argc, char** argv)
 }
 
 /** Build a Counting Bloom filter (used by `abyss-bloom-dbg`) */
+template<unsigned Bits>
 static inline void
 buildCountingBloom(size_t bytes, string outputPath, int argc, char** argv)
 {
 
 	/* use cascading Bloom filter to remove error k-mers */
-	CountingBloomFilter<uint8_t> countingBloom(bytes, opt::numHashes, opt::k, 0);
+	PackedCountingBloomFilter<Bits> countingBloom(bytes, opt::numHashes, opt::k, 0);
 
 	/* load reads into Bloom filter */
 	for (int i = optind; i < argc; ++i)
@@ -618,6 +779,276 @@ buildCountingBloom(size_t bytes, string outputPath, int argc, char** argv)
 	writeBloom(countingBloom, outputPath);
 }
 
+/**
+ * Write a stream of bits to an output stream. Each write may end
+ * part way through a byte, so that bloom filter windows whose
+ * boundaries are not byte-aligned can be concatenated.
+ */
+class BitStreamWriter
+{
+  public:
+	BitStreamWriter(ostream& out)
+	  : m_out(out)
+	  , m_carry(0)
+	  , m_carryBits(0)
+	{}
+
+	/**
+	 * Append the first `bits' bits of a byte array, starting from
+	 * the most significant bit of the first byte.
+	 */
+	void write(const char* p, size_t bits)
+	{
+		size_t bytes = bits / 8;
+		if (m_carryBits == 0) {
+			m_out.write(p, bytes);
+		} else {
+			m_buffer.resize(bytes);
+			for (size_t i = 0; i < bytes; i++) {
+				unsigned char x = p[i];
+				m_buffer[i] = m_carry | x >> m_carryBits;
+				m_carry = x << (8 - m_carryBits);
+			}
+			m_out.write(m_buffer.data(), bytes);
+		}
+
+		unsigned lastBits = bits % 8;
+		if (lastBits == 0)
+			return;
+		unsigned char x = p[bytes] & 0xFF << (8 - lastBits);
+		m_carry |= x >> m_carryBits;
+		if (m_carryBits + lastBits >= 8) {
+			m_out.put(m_carry);
+			m_carry = x << (8 - m_carryBits);
+			m_carryBits = m_carryBits + lastBits - 8;
+		} else {
+			m_carryBits += lastBits;
+		}
+	}
+
+	/** Write the final partial byte, padded with zeros. */
+	void flush()
+	{
+		if (m_carryBits > 0)
+			m_out.put(m_carry);
+		m_carry = 0;
+		m_carryBits = 0;
+		m_out.flush();
+	}
+
+  private:
+	ostream& m_out;
+	vector<char> m_buffer;
+	unsigned char m_carry;
+	unsigned m_carryBits;
+};
+
+/** A bloom filter window file that is read as a stream. */
+struct WindowFile
+{
+	string path;
+	istream* in;
+	Bloom::FileHeader header;
+
+	bool operator<(const WindowFile& o) const
+	{
+		return header.startBitPos < o.header.startBitPos;
+	}
+};
+
+/**
+ * Concatenate bloom filter window files (`build -w M/N') into a
+ * complete bloom filter file. The windows are streamed through
+ * buffers of opt::bufferSize bytes, so the complete bloom filter is
+ * never held in memory. Window files for the same window, built from
+ * different reads, are combined with a bitwise OR.
+ */
+static void
+concatWindows(const vector<string>& paths, const string& outputPath)
+{
+	assert(!paths.empty());
+
+	vector<WindowFile> windows(paths.size());
+	for (size_t i = 0; i < paths.size(); i++) {
+		WindowFile& w = windows[i];
+		w.path = paths[i];
+		w.in = openInputStream(w.path);
+		assert_good(*w.in, w.path);
+		w.header = Bloom::readHeader(*w.in);
+		assert_good(*w.in, w.path);
+		if (w.header.fullBloomSize != windows.front().header.fullBloomSize ||
+		    w.header.hashSeed != windows.front().header.hashSeed) {
+			cerr << PROGRAM ": `" << w.path << "': bloom filter size or "
+			     << "hash seed differs from `" << windows.front().path << "'\n";
+			exit(EXIT_FAILURE);
+		}
+	}
+	stable_sort(windows.begin(), windows.end());
+
+	Bloom::FileHeader header = windows.front().header;
+	header.startBitPos = 0;
+	header.endBitPos = header.fullBloomSize - 1;
+
+	if (opt::verbose)
+		cerr << "Writing concatenated bloom filter to `" << outputPath << "'...\n";
+
+	ostream* out = openOutputStream(outputPath);
+	assert_good(*out, outputPath);
+	Bloom::writeHeader(*out, header);
+
+	BitStreamWriter writer(*out);
+	vector<char> buffer(opt::bufferSize), other(opt::bufferSize);
+	size_t nextBitPos = 0;
+	for (size_t i = 0; i < windows.size();) {
+		// the window files covering the same range of bits
+		size_t j = i + 1;
+		for (; j < windows.size() &&
+		       windows[j].header.startBitPos == windows[i].header.startBitPos;
+		     j++) {
+			if (windows[j].header.endBitPos != windows[i].header.endBitPos) {
+				cerr << PROGRAM ": `" << windows[j].path << "' and `" << windows[i].path
+				     << "' are overlapping windows\n";
+				exit(EXIT_FAILURE);
+			}
+		}
+
+		const Bloom::FileHeader& h = windows[i].header;
+		if (h.startBitPos != nextBitPos) {
+			cerr << PROGRAM ": "
+			     << (h.startBitPos < nextBitPos ? "overlapping windows" : "missing window")
+			     << " at bit " << min(h.startBitPos, nextBitPos) << '\n';
+			exit(EXIT_FAILURE);
+		}
+		if (opt::verbose)
+			cerr << "Copying bits " << h.startBitPos << "-" << h.endBitPos << " from "
+			     << j - i << " file(s)...\n";
+
+		size_t bits = h.endBitPos - h.startBitPos + 1;
+		for (size_t done = 0; done < bits;) {
+			size_t chunkBits = min(opt::bufferSize * 8, bits - done);
+			size_t chunkBytes = (chunkBits + 7) / 8;
+			for (size_t k = i; k < j; k++) {
+				char* p = k == i ? buffer.data() : other.data();
+				windows[k].in->read(p, chunkBytes);
+				assert_good(*windows[k].in, windows[k].path);
+				if (k > i)
+					combineBytes(buffer.data(), p, chunkBytes, BITWISE_OR);
+			}
+			writer.write(buffer.data(), chunkBits);
+			done += chunkBits;
+		}
+		assert_good(*out, outputPath);
+
+		for (size_t k = i; k < j; k++)
+			closeInputStream(windows[k].in, windows[k].path);
+		nextBitPos = h.endBitPos + 1;
+		i = j;
+	}
+
+	if (nextBitPos != header.fullBloomSize) {
+		cerr << PROGRAM ": missing window at bit " << nextBitPos << '\n';
+		exit(EXIT_FAILURE);
+	}
+
+	writer.flush();
+	assert_good(*out, outputPath);
+	closeOutputStream(out, outputPath);
+}
+
+/** Remove the window files. */
+static void
+removeWindows(const vector<string>& windowPaths)
+{
+	for (vector<string>::const_iterator it = windowPaths.begin(); it != windowPaths.end(); ++it)
+		unlink(it->c_str());
+}
+
+/**
+ * Stop the running children that build windows, remove the window
+ * files, and exit with a failure.
+ */
+static void
+abortWindows(const vector<pid_t>& children, const vector<string>& windowPaths)
+{
+	for (vector<pid_t>::const_iterator it = children.begin(); it != children.end(); ++it)
+		kill(*it, SIGTERM);
+	for (vector<pid_t>::const_iterator it = children.begin(); it != children.end(); ++it)
+		waitpid(*it, NULL, 0);
+	removeWindows(windowPaths);
+	exit(EXIT_FAILURE);
+}
+
+/**
+ * Build all windows of a konnector-style Bloom filter in child
+ * processes, opt::processes at a time, and concatenate them. The
+ * memory used is that of opt::processes windows rather than that of
+ * the complete bloom filter.
+ */
+static void
+buildKonnectorBloomWindows(size_t bits, const string& outputPath, int argc, char** argv)
+{
+	ostringstream prefix;
+	if (outputPath == "-")
+		prefix << PROGRAM "-" << getpid();
+	else
+		prefix << outputPath;
+
+	vector<string> windowPaths;
+	for (unsigned i = 1; i <= opt::windows; i++) {
+		ostringstream path;
+		path << prefix.str() << ".w" << i;
+		windowPaths.push_back(path.str());
+	}
+
+	// Reap the children here rather than in the SIGCHLD handler,
+	// which would discard their exit status.
+	signal(SIGCHLD, SIG_DFL);
+
+	// The running children
+	vector<pid_t> children;
+	for (unsigned i = 1; i <= opt::windows || !children.empty();) {
+		if (i <= opt::windows && children.size() < opt::processes) {
+			if (opt::verbose)
+				cerr << "Building window " << i << "/" << opt::windows << " of bloom filter...\n";
+			pid_t pid = fork();
+			if (pid == -1) {
+				perror(PROGRAM ": fork");
+				abortWindows(children, windowPaths);
+			}
+			if (pid == 0) {
+				signalInit();
+				opt::windowIndex = i;
+				buildKonnectorBloom(bits, windowPaths[i - 1], argc, argv);
+				exit(EXIT_SUCCESS);
+			}
+			children.push_back(pid);
+			i++;
+			continue;
+		}
+
+		int status;
+		pid_t pid = wait(&status);
+		if (pid == -1) {
+			perror(PROGRAM ": wait");
+			abortWindows(children, windowPaths);
+		}
+		vector<pid_t>::iterator child = find(children.begin(), children.end(), pid);
+		if (child == children.end())
+			continue;
+		children.erase(child);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			cerr << PROGRAM ": failed to build a bloom filter window (PID " << pid << ")\n";
+			abortWindows(children, windowPaths);
+		}
+	}
+
+	signalInit();
+
+	concatWindows(windowPaths, outputPath);
+
+	removeWindows(windowPaths);
+}
+
 /**
  * Build Bloom filter file of type 'konnector', 'rolling-hash' or 'counting', as
  * per `-t` option.
@@ -676,9 +1107,17 @@ build(int argc, char** argv)
 			opt::bloomType = strToBloomType(str);
 		} break;
 		case 'w':
-			arg >> opt::windowIndex;
-			arg >> expect("/");
 			arg >> opt::windows;
+			if (!arg.eof() && arg.peek() == '/') {
+				opt::windowIndex = opt::windows;
+				arg >> expect("/") >> opt::windows;
+			}
+			break;
+		case 'P':
+			arg >> opt::processes;
+			break;
+		case OPT_COUNTER_BITS:
+			arg >> opt::counterBits;
 			break;
 		}
 		if (optarg != NULL && (!arg.eof() || arg.fail())) {
@@ -711,15 +1150,17 @@ build(int argc, char** argv)
 		opt::numHashes = 1;
 	}
 
+	if (opt::counterBits != 4 && opt::counterBits != 8) {
+		cerr << PROGRAM ": --counter-bits must be 4 or 8\n";
+		dieWithUsageError();
+	}
+
 	if (opt::bloomType == BT_COUNTING && (opt::levels != 1)) {
 		cerr << PROGRAM ": warning: -l option has no effect"
 		                " when using `-t counting'\n";
 	}
 
-#if _OPENMP
-	if (opt::threads > 0)
-		omp_set_num_threads(opt::threads);
-#endif
+	setThreads();
 
 	// bloom filter size in bits and bytes
 	size_t bits = opt::bloomSize * 8;
@@ -733,6 +1174,21 @@ build(int argc, char** argv)
 		dieWithUsageError();
 	}
 
+	if (opt::windowIndex > opt::windows) {
+		cerr << PROGRAM ": M must not be greater than N for -w M/N\n";
+		dieWithUsageError();
+	}
+
+	if (opt::windows != 0 && opt::bloomType != BT_KONNECTOR) {
+		cerr << PROGRAM ": -w can only be used with `-t konnector'\n";
+		dieWithUsageError();
+	}
+
+	if (opt::processes == 0) {
+		cerr << PROGRAM ": -P must be at least 1\n";
+		dieWithUsageError();
+	}
+
 	if (argc - optind < 2) {
 		cerr << PROGRAM ": missing arguments\n";
 		dieWithUsageError();
@@ -751,13 +1207,18 @@ build(int argc, char** argv)
 	}
 
 	assert(opt::bloomType != BT_UNKNOWN);
-	if (opt::bloomType == BT_KONNECTOR) {
+	if (opt::bloomType == BT_KONNECTOR && opt::windows != 0 && opt::windowIndex == 0) {
+		buildKonnectorBloomWindows(bits, outputPath, argc, argv);
+	} else if (opt::bloomType == BT_KONNECTOR) {
 		buildKonnectorBloom(bits, outputPath, argc, argv);
 	} else if (opt::bloomType == BT_ROLLING_HASH) {
 		buildRollingHashBloom(bits, outputPath, argc, argv);
 	} else {
 		assert(opt::bloomType == BT_COUNTING);
-		buildCountingBloom(bytes, outputPath, argc, argv);
+		if (opt::counterBits == 4)
+			buildCountingBloom<4>(bytes, outputPath, argc, argv);
+		else
+			buildCountingBloom<8>(bytes, outputPath, argc, argv);
 	}
 
 	return 0;
@@ -768,11 +1229,28 @@ combine(int argc, char** argv, BitwiseOp readOp)
 {
 	parseGlobalOpts(argc, argv);
 
+	for (int c; (c = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1;) {
+		istringstream arg(optarg != NULL ? optarg : "");
+		switch (c) {
+		case '?':
+			dieWithUsageError();
+		case 'j':
+			arg >> opt::threads;
+			break;
+		}
+		if (optarg != NULL && (!arg.eof() || arg.fail())) {
+			cerr << PROGRAM ": invalid option: `-" << (char)c << optarg << "'\n";
+			exit(EXIT_FAILURE);
+		}
+	}
+
 	if (argc - optind < 3) {
 		cerr << PROGRAM ": missing arguments\n";
 		dieWithUsageError();
 	}
 
+	setThreads();
+
 	string outputPath(argv[optind]);
 	optind++;
 
@@ -782,12 +1260,19 @@ combine(int argc, char** argv, BitwiseOp readOp)
 		string path(argv[i]);
 		if (opt::verbose)
 			std::cerr << "Loading bloom filter from `" << path << "'...\n";
-		istream* in = openInputStream(path);
-		assert_good(*in, path);
 		BitwiseOp op = (i > optind) ? readOp : BITWISE_OVERWRITE;
-		bloom.read(*in, op);
-		assert_good(*in, path);
-		closeInputStream(in, path);
+		MappedFile file;
+		Bloom::FileHeader header;
+		const char* bits = mapBloomFile(path, file, header);
+		if (bits != NULL) {
+			bloom.combine(header, bits, op);
+		} else {
+			istream* in = openInputStream(path);
+			assert_good(*in, path);
+			bloom.read(*in, op);
+			assert_good(*in, path);
+			closeInputStream(in, path);
+		}
 	}
 
 	if (opt::verbose) {
@@ -819,6 +1304,42 @@ combine(int argc, char** argv, BitwiseOp readOp)
 	return 0;
 }
 
+/**
+ * Concatenate bloom filter windows into a complete bloom filter.
+ */
+int
+concat(int argc, char** argv)
+{
+	parseGlobalOpts(argc, argv);
+
+	for (int c; (c = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1;) {
+		istringstream arg(optarg != NULL ? optarg : "");
+		switch (c) {
+		case '?':
+			dieWithUsageError();
+		case 'B':
+			arg >> opt::bufferSize;
+			break;
+		}
+		if (optarg != NULL && (!arg.eof() || arg.fail())) {
+			cerr << PROGRAM ": invalid option: `-" << (char)c << optarg << "'\n";
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (argc - optind < 2) {
+		cerr << PROGRAM ": missing arguments\n";
+		dieWithUsageError();
+	}
+
+	string outputPath(argv[optind]);
+	optind++;
+
+	concatWindows(vector<string>(argv + optind, argv + argc), outputPath);
+
+	return 0;
+}
+
 int
 info(int argc, char** argv)
 {
@@ -857,6 +1378,9 @@ compare(int argc, char** argv)
 		case '?':
 			cerr << PROGRAM ": unrecognized option: `-" << optopt << "'" << endl;
 			dieWithUsageError();
+		case 'j':
+			arg >> opt::threads;
+			break;
 		case 'm':
 			arg >> opt::method;
 			break;
@@ -870,45 +1394,42 @@ compare(int argc, char** argv)
 			std::cerr << "Invalid method: " << opt::method << std::endl;
 	}
 
+	if (argc - optind < 2) {
+		cerr << PROGRAM ": missing arguments\n";
+		dieWithUsageError();
+	}
+
+	setThreads();
+
 	// Set method strin
 	string method(opt::method);
 	if (opt::verbose)
 		std::cerr << "Computing distance for 2"
 		          << " samples...\n";
-	// Get both paths and open istreams
-	Konnector::BloomFilter bloomA;
+	// Get both paths and map the bit arrays
 	string pathA(argv[optind]);
-	Konnector::BloomFilter bloomB;
 	string pathB(argv[optind + 1]);
 	if (opt::verbose)
 		std::cerr << "Loading bloom filters from " << pathA << " and " << pathB << "...\n";
-	istream* inA = openInputStream(pathA);
-	istream* inB = openInputStream(pathB);
-	// Assert state of streams
-	assert_good(*inA, pathA);
-	assert_good(*inB, pathB);
-	// Not sure this conversion is needed, check docs
-	std::istream& tA = *inA;
-	std::istream& tB = *inB;
-	// Need to read header for bit start and end info
-	Bloom::FileHeader headerA = Bloom::readHeader(tA);
-	Bloom::FileHeader headerB = Bloom::readHeader(tB);
-	// Need to assert after every read operation
-	assert(tA);
-	assert(tB);
-
-	const size_t IO_BUFFER_SIZE = 32 * 1024;
-	unsigned char mask = 1;
+	MappedFile fileA, fileB;
+	vector<char> bufferA, bufferB;
+	Bloom::FileHeader headerA, headerB;
+	const char* bitsA = mapBloomFile(pathA, fileA, headerA);
+	if (bitsA == NULL)
+		bitsA = readBloomFile(pathA, bufferA, headerA);
+	const char* bitsB = mapBloomFile(pathB, fileB, headerB);
+	if (bitsB == NULL)
+		bitsB = readBloomFile(pathB, bufferB, headerB);
+
 	// The number of total bits in the vector
-	size_t bitsA = headerA.endBitPos - headerA.startBitPos + 1;
-	size_t bitsB = headerB.endBitPos - headerB.startBitPos + 1;
+	size_t bits = headerA.endBitPos - headerA.startBitPos + 1;
 	// They need to be the same size to be comparable
-	if (bitsA != bitsB) {
+	if (bits != headerB.endBitPos - headerB.startBitPos + 1) {
 		std::cerr << "Bit sizes of arrays not equal" << std::endl;
 		exit(EXIT_FAILURE);
 	}
 	if (opt::verbose)
-		std::cerr << "Bits: " << bitsA << std::endl;
+		std::cerr << "Bits: " << bits << std::endl;
 	/* As in Choi et al. (2010),
 	 a - cases where both bits are set (1/1)
 	 b - cases where bits are set in the first but nor the second (1/0)
@@ -919,38 +1440,19 @@ compare(int argc, char** argv)
 	unsigned long b = 0;
 	unsigned long c = 0;
 	unsigned long d = 0;
-	// Iteratively compare bits
-	for (size_t i = 0; i < bitsA;) {
-		char bufferA[IO_BUFFER_SIZE];
-		char bufferB[IO_BUFFER_SIZE];
-		// The number of bits in the buffer is its size * 8 except for the last iteration
-		size_t bitsRead = std::min(IO_BUFFER_SIZE * 8, bitsA - i);
-		size_t bytesRead = (bitsRead + 7) / 8;
-		// Read bytes from the the istream and immediately assert
-		tA.read(bufferA, bytesRead);
-		tB.read(bufferB, bytesRead);
-		assert(tA);
-		assert(tB);
-		// For each byte in the buffer, compare bits
-		for (size_t j = 0; j < IO_BUFFER_SIZE; j++) {
-			// Compare bit-wise
-			for (int bit = 0; bit < 8; bit++) {
-				bool f = (bufferA[j] & (mask << bit)) != 0;
-				bool s = (bufferB[j] & (mask << bit)) != 0;
-				if (f == 1 && s == 1) {
-					a++;
-				} else if (f == 1 && s == 0) {
-					b++;
-				} else if (f == 0 && s == 1) {
-					c++;
-				} else
-					d++;
-			}
-		}
-		i += bitsRead;
+	// Compare the bit arrays in chunks of whole bytes, one chunk per thread
+	const size_t chunkBits = 8 << 20;
+	ptrdiff_t chunks = (bits + chunkBits - 1) / chunkBits;
+#pragma omp parallel for reduction(+ : a, b, c, d)
+	for (ptrdiff_t i = 0; i < chunks; i++) {
+		size_t offset = i * (chunkBits / 8);
+		BitCounts counts = compareBits(
+		    bitsA + offset, bitsB + offset, std::min(chunkBits, bits - i * chunkBits));
+		a += counts.both;
+		b += counts.first;
+		c += counts.second;
+		d += counts.neither;
 	}
-	assert(tA);
-	assert(tB);
 	// Result output:
 	std::cout << "1/1: " << a << "\n1/0: " << b << "\n0/1: " << c << "\n0/0: " << d << std::endl;
 	if (method == "jaccard") {
@@ -967,11 +1469,6 @@ compare(int argc, char** argv)
 		    (n * a - ((a + b) * (a + c))) / (n * std::min(a + b, a + c) - ((a + b) * (a + c)));
 		std::cout << "Forbes similarity: " << Dist << std::endl;
 	}
-	// Check and clean up
-	assert_good(tA, pathA);
-	assert_good(tA, pathB);
-	closeInputStream(inA, pathA);
-	closeInputStream(inB, pathB);
 
 	return 1;
 }
@@ -1152,6 +1649,58 @@ graph(int argc, char** argv)
 	return 0;
 }
 
+/**
+ * Print the k-mers of the FASTA file whose count in a counting Bloom
+ * filter is at least `opt::minCount' (default 1), together with their
+ * approximate counts.
+ */
+template<unsigned Bits>
+static void
+countKmers(istream& in, const CountingBloomHeader& header, const string& fasta)
+{
+	PackedCountingBloomFilter<Bits> bloom;
+	bloom.read(in, header);
+	assert(in);
+
+	unsigned k = bloom.getKmerSize();
+	if (opt::k > 0 && opt::k != k) {
+		cerr << PROGRAM ": k-mer size of bloom filter (" << k << ") does not match -k"
+		     << opt::k << '\n';
+		exit(EXIT_FAILURE);
+	}
+	unsigned minCount = opt::minCount > 0 ? opt::minCount : 1;
+
+	if (opt::verbose)
+		std::cerr << "Reading `" << fasta << "'...\n";
+	FastaReader fastaIn(fasta.c_str(), FastaReader::FOLD_CASE);
+
+	size_t seqCount = 0;
+	for (FastaRecord rec; fastaIn >> rec; ++seqCount) {
+		const string& seq = rec.seq;
+		for (RollingHashIterator it(seq, bloom.getHashNum(), k); it != RollingHashIterator::end();
+		     ++it) {
+			unsigned count = bloom.minCount(*it);
+			if ((count >= minCount) == opt::inverse)
+				continue;
+			size_t i = it.pos();
+			if (opt::format == FASTA) {
+				cout << ">" << rec.id << ":seq:" << seqCount << ":kmer:" << i << ' ' << count
+				     << "\n" << seq.substr(i, k) << "\n";
+			} else if (opt::format == BED) {
+				cout << rec.id << "\t" << i << "\t" << i + k - 1 << "\t" << seq.substr(i, k)
+				     << "\t" << count << "\n";
+			} else {
+				cout << seq.substr(i, k) << "\t" << count << "\n";
+			}
+		}
+		if (opt::verbose && seqCount % 1000 == 0)
+			cerr << "processed " << seqCount << " sequences" << endl;
+	}
+	assert(fastaIn.eof());
+	if (opt::verbose)
+		cerr << "processed " << seqCount << " sequences" << endl;
+}
+
 int
 memberOf(int argc, char** argv)
 {
@@ -1168,6 +1717,8 @@ memberOf(int argc, char** argv)
 		case 'r':
 			opt::inverse = true;
 			break;
+		case 'c':
+			arg >> opt::minCount;
 			break;
 		case OPT_BED:
 			opt::format = BED;
@@ -1192,9 +1743,19 @@ memberOf(int argc, char** argv)
 
 	istream* in = openInputStream(path);
 	assert_good(*in, path);
+	assert(!fasta.empty());
+	if (isCountingBloom(*in)) {
+		CountingBloomHeader header;
+		*in >> header;
+		assert_good(*in, path);
+		if (header.bitsPerCounter == 4)
+			countKmers<4>(*in, header, fasta);
+		else
+			countKmers<8>(*in, header, fasta);
+		return 0;
+	}
 	*in >> bloom;
 
-	assert(!fasta.empty());
 	if (opt::verbose)
 		std::cerr << "Reading `" << fasta << "'...\n";
 	FastaReader _in(fasta.c_str(), FastaReader::FOLD_CASE);
@@ -1289,6 +1850,209 @@ calcLeftTrim(
 	return k + it.pos() - 1;
 }
 
+/** Trim reads at the tips of a Bloom filter de Bruijn graph. */
+class TipTrimmer
+{
+  public:
+	TipTrimmer(const Konnector::BloomFilter& bloom, unsigned k, size_t minBranchLen)
+	  : m_bloom(bloom)
+	  , m_k(k)
+	  , m_minBranchLen(minBranchLen)
+	{}
+
+	/**
+	 * Trim a read.
+	 * @return false if the whole read was trimmed away
+	 */
+	bool operator()(FastqRecord& rec) const
+	{
+		Sequence& seq = rec.seq;
+
+		// can't trim if read length < k
+		if (seq.size() < m_k)
+			return true;
+
+		// start pos for trimmed read
+		unsigned startPos = calcLeftTrim(seq, m_k, m_bloom, m_minBranchLen);
+		// end pos for trimmed read
+		unsigned endPos =
+		    seq.length() - 1 - calcLeftTrim(reverseComplement(seq), m_k, m_bloom, m_minBranchLen);
+
+		// if whole read was trimmed away
+		if (endPos < startPos)
+			return false;
+
+		unsigned trimmedLen = endPos - startPos + 1;
+		seq = seq.substr(startPos, trimmedLen);
+		if (!rec.qual.empty())
+			rec.qual = rec.qual.substr(startPos, trimmedLen);
+		return true;
+	}
+
+  private:
+	const Konnector::BloomFilter& m_bloom;
+	unsigned m_k;
+	size_t m_minBranchLen;
+};
+
+/**
+ * Trim the ends of reads whose k-mers have a count less than a
+ * threshold in a counting Bloom filter.
+ */
+template<unsigned Bits>
+class CountTrimmer
+{
+  public:
+	CountTrimmer(const PackedCountingBloomFilter<Bits>& bloom, unsigned minCount)
+	  : m_bloom(bloom)
+	  , m_minCount(minCount)
+	{}
+
+	/**
+	 * Trim a read to the span of its first to its last solid k-mer.
+	 * @return false if the read has no solid k-mer
+	 */
+	bool operator()(FastqRecord& rec) const
+	{
+		unsigned k = m_bloom.getKmerSize();
+		Sequence& seq = rec.seq;
+		if (seq.size() < k)
+			return true;
+
+		size_t startPos = string::npos, endPos = 0;
+		for (RollingHashIterator it(seq, m_bloom.getHashNum(), k);
+		     it != RollingHashIterator::end();
+		     ++it) {
+			if (m_bloom.minCount(*it) < m_minCount)
+				continue;
+			if (startPos == string::npos)
+				startPos = it.pos();
+			endPos = it.pos() + k;
+		}
+		if (startPos == string::npos)
+			return false;
+
+		seq = seq.substr(startPos, endPos - startPos);
+		if (!rec.qual.empty())
+			rec.qual = rec.qual.substr(startPos, endPos - startPos);
+		return true;
+	}
+
+  private:
+	const PackedCountingBloomFilter<Bits>& m_bloom;
+	unsigned m_minCount;
+};
+
+/**
+ * Trim the reads of the input files in parallel and write them in
+ * their input order. The reads are read in batches, which are trimmed,
+ * formatted and, for an output file ending in `.gz', compressed by the
+ * worker threads. With paired input, a pair is discarded when either
+ * read is trimmed away.
+ */
+template<typename Trimmer>
+static void
+trimFiles(const Trimmer& trimmer, int argc, char** argv)
+{
+	const size_t BATCH_BASES = 4000000;
+
+	if (opt::outputPaths.empty())
+		opt::outputPaths.push_back("-");
+	unsigned numOutputs = opt::outputPaths.size();
+	if (numOutputs > (opt::paired ? 2U : 1U)) {
+		cerr << PROGRAM ": too many output files\n";
+		dieWithUsageError();
+	}
+
+	ostream* outs[2] = { NULL, NULL };
+	OrderedWriter* writers[2] = { NULL, NULL };
+	bool gzip[2] = { false, false };
+	for (unsigned j = 0; j < numOutputs; ++j) {
+		const string& path = opt::outputPaths[j];
+		outs[j] = openOutputStream(path);
+		assert_good(*outs[j], path);
+		writers[j] = new OrderedWriter(*outs[j]);
+		gzip[j] = endsWith(path, ".gz");
+	}
+
+	ReadBatchReader reader(argv + optind, argv + argc, opt::paired);
+	size_t nextBatch = 0, readCount = 0;
+
+#pragma omp parallel
+	for (vector<FastqRecord> reads[2];;) {
+		bool good;
+		size_t batch;
+#pragma omp critical(in)
+		{
+			good = reader.read(reads, BATCH_BASES);
+			batch = nextBatch++;
+		}
+		if (!good)
+			break;
+
+		ostringstream out[2];
+		for (size_t i = 0; i < reads[0].size(); ++i) {
+			bool keep = trimmer(reads[0][i]);
+			if (opt::paired)
+				keep = trimmer(reads[1][i]) && keep;
+			if (!keep)
+				continue;
+			out[0] << reads[0][i];
+			if (opt::paired)
+				out[numOutputs - 1] << reads[1][i];
+		}
+
+		string chunks[2];
+		for (unsigned j = 0; j < numOutputs; ++j) {
+			chunks[j] = out[j].str();
+			if (gzip[j])
+				chunks[j] = gzipCompress(chunks[j]);
+		}
+
+#pragma omp critical(out)
+		{
+			for (unsigned j = 0; j < numOutputs; ++j) {
+				writers[j]->write(batch, chunks[j]);
+				assert_good(*outs[j], opt::outputPaths[j]);
+			}
+			size_t prev = readCount;
+			readCount += reads[0].size() + reads[1].size();
+			if (opt::verbose && prev / 100000 != readCount / 100000)
+				cerr << "Processed " << readCount << " reads" << endl;
+		}
+	}
+
+	for (unsigned j = 0; j < numOutputs; ++j) {
+		assert(writers[j]->pending() == 0);
+		delete writers[j];
+		outs[j]->flush();
+		assert_good(*outs[j], opt::outputPaths[j]);
+		closeOutputStream(outs[j], opt::outputPaths[j]);
+	}
+
+	if (opt::verbose)
+		cerr << "Processed " << readCount << " reads" << endl;
+}
+
+/**
+ * Trim the ends of reads whose k-mers have a count less than
+ * `opt::minCount' (default 2) in a counting Bloom filter. Reads with
+ * no such k-mer are discarded.
+ */
+template<unsigned Bits>
+static void
+trimCounting(istream& bloomIn, const CountingBloomHeader& header, int argc, char** argv)
+{
+	PackedCountingBloomFilter<Bits> bloom;
+	bloom.read(bloomIn, header);
+	assert(bloomIn);
+	if (opt::verbose)
+		printCountingBloomStats(cerr, bloom);
+
+	unsigned minCount = opt::minCount > 0 ? opt::minCount : 2;
+	trimFiles(CountTrimmer<Bits>(bloom, minCount), argc, argv);
+}
+
 /**
  * Trim reads that corresponds to tips in the Bloom filter
  * de Bruijn graph.
@@ -1300,21 +2064,61 @@ trim(int argc, char** argv)
 	parseGlobalOpts(argc, argv);
 	unsigned k = opt::k;
 
+	for (int c; (c = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1;) {
+		istringstream arg(optarg != NULL ? optarg : "");
+		switch (c) {
+		case '?':
+			cerr << PROGRAM ": unrecognized option: `-" << optopt << "'" << endl;
+			dieWithUsageError();
+		case 'c':
+			arg >> opt::minCount;
+			break;
+		case 'j':
+			arg >> opt::threads;
+			break;
+		case 'o': {
+			string path;
+			arg >> path;
+			opt::outputPaths.push_back(path);
+			break;
+		}
+		case OPT_PAIRED:
+			opt::paired = true;
+			break;
+		}
+		if (optarg != NULL && (!arg.eof() || arg.fail())) {
+			cerr << PROGRAM ": invalid option: `-" << (char)c << optarg << "'\n";
+			exit(EXIT_FAILURE);
+		}
+	}
+
 	// arg 1: Bloom filter
 	// args 2-n: FASTA/FASTQ files
 	if (argc - optind < 2) {
 		cerr << PROGRAM ": missing arguments\n";
 		dieWithUsageError();
 	}
+	setThreads();
 
 	// load Bloom filter de Bruijn graph
 	string bloomPath(argv[optind++]);
 	if (opt::verbose)
 		cerr << "Loading bloom filter from `" << bloomPath << "'...\n";
 
-	Konnector::BloomFilter bloom;
 	istream* in = openInputStream(bloomPath);
 	assert_good(*in, bloomPath);
+	if (isCountingBloom(*in)) {
+		CountingBloomHeader header;
+		*in >> header;
+		assert_good(*in, bloomPath);
+		if (header.bitsPerCounter == 4)
+			trimCounting<4>(*in, header, argc, argv);
+		else
+			trimCounting<8>(*in, header, argc, argv);
+		return 0;
+	}
+
+	Konnector::BloomFilter bloom;
 	bloom.read(*in);
 	assert_good(*in, bloomPath);
 
@@ -1329,55 +2133,232 @@ trim(int argc, char** argv)
 	if (opt::verbose >= 2)
 		cerr << "min length threshold for true branches (k-mers): " << minBranchLen << endl;
 
-	size_t readCount = 0;
+	trimFiles(TipTrimmer(bloom, k, minBranchLen), argc, argv);
 
-	// trim reads and print to STDOUT
-	for (int i = optind; i < argc; ++i) {
+	// success
+	return 0;
+}
 
-		if (opt::verbose)
-			cerr << "Reading `" << argv[i] << "'..." << endl;
+/**
+ * Store the IDs of the target sequences of a FASTA file in a
+ * multi-index Bloom filter, in parallel.
+ */
+static void
+loadTargetIDs(MultiIndexBloomFilter& mibf, const string& path)
+{
+	const size_t BUFFER_SIZE = 1000000;
+	typedef vector<pair<MultiIndexBloomFilter::id_t, string> > Buffer;
 
-		FastaReader in(argv[i], FastaReader::FOLD_CASE);
-		for (FastqRecord rec; in >> rec; ++readCount) {
+	if (opt::verbose)
+		cerr << "Indexing `" << path << "'..." << endl;
+
+	FastaReader in(path.c_str(), FastaReader::FOLD_CASE);
+#pragma omp parallel
+	for (Buffer buffer;;) {
+		buffer.clear();
+		size_t bufferSize = 0;
+		bool good = true;
+#pragma omp critical(in)
+		for (FastaRecord rec; good && bufferSize < BUFFER_SIZE;) {
+			good = in >> rec;
+			if (good) {
+				buffer.push_back(make_pair(mibf.addName(rec.id), rec.seq));
+				bufferSize += rec.seq.length();
+			}
+		}
+		if (buffer.empty())
+			break;
+		for (Buffer::const_iterator it = buffer.begin(); it != buffer.end(); ++it) {
+			for (RollingHashIterator kmer(it->second, mibf.getHashNum(), mibf.getKmerSize());
+			     kmer != RollingHashIterator::end();
+			     ++kmer)
+				mibf.insert(*kmer, it->first);
+		}
+	}
+	assert(in.eof());
+}
 
-			Sequence& seq = rec.seq;
-			string& qual = rec.qual;
+/**
+ * Build a multi-index Bloom filter of target sequences, such as
+ * contigs or scaffolds.
+ */
+int
+mibfBuild(int argc, char** argv)
+{
+	parseGlobalOpts(argc, argv);
 
-			// can't trim if read length < k; just echo
-			// back to STDOUT
-			if (seq.size() < k) {
-				cout << rec;
-				continue;
-			}
+	for (int c; (c = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1;) {
+		istringstream arg(optarg != NULL ? optarg : "");
+		switch (c) {
+		case '?':
+			cerr << PROGRAM ": unrecognized option: `-" << optopt << "'" << endl;
+			dieWithUsageError();
+		case 'b':
+			opt::bloomSize = SIToBytes(arg);
+			break;
+		case 'H':
+			arg >> opt::numHashes;
+			break;
+		case 'j':
+			arg >> opt::threads;
+			break;
+		case 's':
+			arg >> opt::spacedSeed;
+			break;
+		}
+		if (optarg != NULL && (!arg.eof() || arg.fail())) {
+			cerr << PROGRAM ": invalid option: `-" << (char)c << optarg << "'\n";
+			exit(EXIT_FAILURE);
+		}
+	}
 
-			// start pos for trimmed read
-			unsigned startPos = calcLeftTrim(seq, k, bloom, minBranchLen);
-			// end pos for trimmed read
-			unsigned endPos =
-			    seq.length() - 1 - calcLeftTrim(reverseComplement(seq), k, bloom, minBranchLen);
+	if (!opt::spacedSeed.empty() && opt::spacedSeed.length() != opt::k) {
+		cerr << PROGRAM ": the length of the spaced seed must be equal to k\n";
+		dieWithUsageError();
+	}
+	if (opt::numHashes == 0) {
+		cerr << PROGRAM ": number of hash functions must be at least 1\n";
+		dieWithUsageError();
+	}
+	if (argc - optind < 2) {
+		cerr << PROGRAM ": missing arguments\n";
+		dieWithUsageError();
+	}
+	setThreads();
 
-			// if whole read was trimmed away
-			if (endPos < startPos)
-				continue;
+	string outputPath(argv[optind++]);
+	MaskedKmer::setMask(opt::spacedSeed);
+	MultiIndexBloomFilter mibf(opt::bloomSize * 8, opt::numHashes, opt::k);
+	mibf.setSpacedSeed(opt::spacedSeed);
 
-			// output trimmed read
-			unsigned trimmedLen = endPos - startPos + 1;
-			seq = seq.substr(startPos, trimmedLen);
-			qual = qual.substr(startPos, trimmedLen);
-			cout << rec;
+	// stage 1: k-mers of all targets
+	for (int i = optind; i < argc; ++i)
+		BloomDBG::loadFile(mibf, argv[i], opt::verbose);
+	mibf.finalize();
 
-			if (opt::verbose && (readCount + 1) % 100000 == 0)
-				cerr << "Processed " << (readCount + 1) << " reads" << endl;
+	// stage 2: target IDs
+	for (int i = optind; i < argc; ++i)
+		loadTargetIDs(mibf, argv[i]);
 
-		} // for each read
-		assert(in.eof());
+	if (opt::verbose)
+		cerr << "Indexed " << mibf.numIDs() << " targets\n"
+		     << "Bloom size (bits): " << mibf.size() << "\n"
+		     << "Bloom popcount (bits): " << mibf.popCount() << "\n"
+		     << "Bloom filter FPR: " << setprecision(3) << 100 * mibf.FPR() << "%\n";
+
+	writeBloom(mibf, outputPath);
+	return 0;
+}
 
-	} // for each input FASTA/FASTQ file
+/**
+ * Assign reads to the targets of a multi-index Bloom filter.
+ */
+int
+mibfClassify(int argc, char** argv)
+{
+	const size_t BUFFER_SIZE = 1000;
+
+	parseGlobalOpts(argc, argv);
+
+	for (int c; (c = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1;) {
+		istringstream arg(optarg != NULL ? optarg : "");
+		switch (c) {
+		case '?':
+			cerr << PROGRAM ": unrecognized option: `-" << optopt << "'" << endl;
+			dieWithUsageError();
+		case 'c':
+			arg >> opt::minCount;
+			break;
+		case 'j':
+			arg >> opt::threads;
+			break;
+		}
+		if (optarg != NULL && (!arg.eof() || arg.fail())) {
+			cerr << PROGRAM ": invalid option: `-" << (char)c << optarg << "'\n";
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (argc - optind < 2) {
+		cerr << PROGRAM ": missing arguments\n";
+		dieWithUsageError();
+	}
+	setThreads();
 
+	string path(argv[optind++]);
 	if (opt::verbose)
-		cerr << "Processed " << readCount << " reads" << endl;
+		cerr << "Loading bloom filter from `" << path << "'...\n";
+	MultiIndexBloomFilter mibf;
+	istream* in = openInputStream(path);
+	assert_good(*in, path);
+	*in >> mibf;
+	assert_good(*in, path);
+	closeInputStream(in, path);
 
-	// success
+	if (opt::k != mibf.getKmerSize()) {
+		cerr << PROGRAM ": k-mer size of bloom filter (" << mibf.getKmerSize()
+		     << ") does not match -k" << opt::k << '\n';
+		exit(EXIT_FAILURE);
+	}
+	MaskedKmer::setMask(mibf.spacedSeed());
+	unsigned minHits = opt::minCount > 0 ? opt::minCount : 1;
+
+	// Write the batches in the order of the reads, whatever the number
+	// of threads.
+	OrderedWriter writer(cout);
+	size_t nextBatch = 0;
+
+	size_t readCount = 0, assignedCount = 0;
+	for (int i = optind; i < argc; ++i) {
+		if (opt::verbose)
+			cerr << "Reading `" << argv[i] << "'..." << endl;
+
+		FastaReader in(argv[i], FastaReader::FOLD_CASE);
+#pragma omp parallel
+		for (vector<FastaRecord> buffer;;) {
+			buffer.clear();
+			size_t batch = 0;
+#pragma omp critical(in)
+			{
+				bool good = true;
+				for (FastaRecord rec; good && buffer.size() < BUFFER_SIZE;) {
+					good = in >> rec;
+					if (good)
+						buffer.push_back(rec);
+				}
+				// An empty batch is not numbered, so that the
+				// batches of the next file follow without a gap.
+				if (!buffer.empty())
+					batch = nextBatch++;
+			}
+			if (buffer.empty())
+				break;
+
+			ostringstream out;
+			size_t assigned = 0;
+			for (vector<FastaRecord>::const_iterator it = buffer.begin(); it != buffer.end();
+			     ++it) {
+				unsigned hits, kmers;
+				MultiIndexBloomFilter::id_t id = mibf.classify(it->seq, minHits, hits, kmers);
+				out << it->id << '\t' << (id > 0 ? mibf.name(id) : "*") << '\t' << hits
+				    << '\t' << kmers << '\n';
+				assigned += id > 0;
+			}
+			string chunk = out.str();
+#pragma omp critical(out)
+			{
+				writer.write(batch, chunk);
+				assert_good(cout, "stdout");
+				readCount += buffer.size();
+				assignedCount += assigned;
+			}
+		}
+		assert(in.eof());
+	}
+	assert(writer.pending() == 0);
+
+	if (opt::verbose)
+		cerr << "Assigned " << assignedCount << " of " << readCount << " reads\n";
 	return 0;
 }
 
@@ -1403,6 +2384,8 @@ main(int argc, char** argv)
 		return combine(argc, argv, BITWISE_OR);
 	} else if (command == "intersect") {
 		return combine(argc, argv, BITWISE_AND);
+	} else if (command == "concat") {
+		return concat(argc, argv);
 	} else if (command == "info") {
 		return info(argc, argv);
 	} else if (command == "compare") {
@@ -1413,6 +2396,10 @@ main(int argc, char** argv)
 		return memberOf(argc, argv);
 	} else if (command == "trim") {
 		return trim(argc, argv);
+	} else if (command == "mibf-build") {
+		return mibfBuild(argc, argv);
+	} else if (command == "mibf-classify") {
+		return mibfClassify(argc, argv);
 	}
 
 	cerr << PROGRAM ": unrecognized command: `" << command << "'" << endl;
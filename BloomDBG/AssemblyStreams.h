@@ -1,8 +1,68 @@
 #ifndef _ASSEMBLY_STREAMS_H_
 #define _ASSEMBLY_STREAMS_H_
 
+#include "Common/BufferedWriter.h"
+#include "Common/OrderedWriter.h"
+#include <cassert>
+#include <ostream>
+#include <string>
+
 namespace BloomDBG {
 
+	/**
+	 * Write the contigs to the main FASTA output in the order of
+	 * their IDs. The threads format their contigs in parallel, and an
+	 * OrderedWriter collects them in order into chunks, which are
+	 * handed whole to the output stage of the BufferedWriter.
+	 * Callers serialize calls to write.
+	 */
+	class ContigWriter
+	{
+	  public:
+		explicit ContigWriter(BufferedWriter& out)
+			: m_out(out), m_buf(m_chunk), m_stream(&m_buf),
+			m_order(m_stream), m_firstID(0) {}
+
+		/** Set the ID of the next contig to write. */
+		void start(size_t contigID)
+		{
+			assert(m_order.pending() == 0 && m_chunk.empty());
+			m_firstID = contigID - m_order.next();
+		}
+
+		/** Write the FASTA record of the specified contig. The
+		 * record is swapped out of `record'. */
+		void write(size_t contigID, std::string& record)
+		{
+			m_order.write(contigID - m_firstID, record);
+			if (m_chunk.size() >= CHUNK_SIZE)
+				m_out.writeChunk(m_chunk);
+		}
+
+		/** Hand the remaining contigs to the output. */
+		void flush()
+		{
+			assert(m_order.pending() == 0);
+			m_out.writeChunk(m_chunk);
+		}
+
+	  private:
+		ContigWriter(const ContigWriter&);
+		ContigWriter& operator=(const ContigWriter&);
+
+		/** The size of a chunk that is handed to the output */
+		static const size_t CHUNK_SIZE = 1 << 20;
+
+		BufferedWriter& m_out;
+		std::string m_chunk;
+		StringAppendBuf m_buf;
+		std::ostream m_stream;
+		OrderedWriter m_order;
+
+		/** The ID of the contig of index 0 of m_order */
+		size_t m_firstID;
+	};
+
 	/** Bundles together input and output streams used during assembly */
 	template <typename InputStreamT>
 	struct AssemblyStreams
@@ -10,7 +70,9 @@ namespace BloomDBG {
 		/** input reads stream */
 		InputStreamT&  in;
 		/** main FASTA output */
-		std::ostream& out;
+		BufferedWriter& out;
+		/** writes the contigs to `out' in the order of their IDs */
+		ContigWriter contigs;
 		/** duplicated FASTA output for checkpointing */
 		std::ostream& checkpointOut;
 		/** trace file output for debugging */
@@ -18,10 +80,10 @@ namespace BloomDBG {
 		/** outcomes of processing each read */
 		std::ostream& readLogOut;
 
-		AssemblyStreams(InputStreamT& in, std::ostream& out,
+		AssemblyStreams(InputStreamT& in, BufferedWriter& out,
 			std::ostream& checkpointOut, std::ostream& traceOut,
 			std::ostream& readLogOut) :
-			in(in), out(out), checkpointOut(checkpointOut),
+			in(in), out(out), contigs(out), checkpointOut(checkpointOut),
 			traceOut(traceOut), readLogOut(readLogOut) {}
 	};
 
@@ -4,8 +4,13 @@
 #include "BloomDBG/RollingHash.h"
 #include "BloomDBG/RollingHashIterator.h"
 #include "DataLayer/FastaReader.h"
+#include "DataLayer/ParallelFastaReader.h"
 #include "vendor/btl_bloomfilter/BloomFilter.hpp"
 
+#if _OPENMP
+# include <omp.h>
+#endif
+
 namespace BloomDBG {
 
 /**
@@ -58,24 +63,16 @@ loadFile(BF& bloom, const std::string& path, bool verbose = false)
 	if (verbose)
 		std::cerr << "Reading `" << path << "'..." << std::endl;
 
-	FastaReader in(path.c_str(), FastaReader::FOLD_CASE);
+#if _OPENMP
+	unsigned threads = omp_get_max_threads();
+#else
+	unsigned threads = 1;
+#endif
+	ParallelFastaReader in(path.c_str(), FastaReader::FOLD_CASE, threads);
 	uint64_t readCount = 0;
 #pragma omp parallel
-	for (std::vector<std::string> buffer(BUFFER_SIZE);;) {
-		buffer.clear();
-		size_t bufferSize = 0;
-		bool good = true;
-#pragma omp critical(in)
-		for (; good && bufferSize < BUFFER_SIZE;) {
-			std::string seq;
-			good = in >> seq;
-			if (good) {
-				buffer.push_back(seq);
-				bufferSize += seq.length();
-			}
-		}
-		if (buffer.size() == 0)
-			break;
+	for (std::vector<std::string> buffer;
+			in.readBatch(buffer, BUFFER_SIZE) > 0;) {
 		for (size_t j = 0; j < buffer.size(); j++) {
 			loadSeq(bloom, buffer.at(j));
 			if (verbose)
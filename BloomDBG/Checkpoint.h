@@ -9,6 +9,7 @@
 #include <cstdio>
 #include <fstream>
 #include <iostream>
+#include <vector>
 
 namespace BloomDBG {
 const std::string CHECKPOINT_FASTA_EXT = ".contigs.fa";
@@ -223,8 +224,13 @@ resumeFromCheckpoint(
 		          << "from `" << fastaPath << "'" << std::endl;
 	std::ifstream prevContigs(fastaPath.c_str());
 	assert_good(prevContigs, fastaPath);
-	streams.out << prevContigs.rdbuf();
-	assert(streams.out);
+	std::vector<char> buf(1 << 20);
+	std::string chunk;
+	while (prevContigs.read(&buf[0], buf.size()) || prevContigs.gcount() > 0) {
+		chunk.assign(&buf[0], prevContigs.gcount());
+		streams.out.writeChunk(chunk);
+	}
+	assert(prevContigs.eof());
 }
 
 /** Delete a file if it exists */
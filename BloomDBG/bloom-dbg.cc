@@ -1,5 +1,6 @@
 #include "config.h"
 
+#include "Bloom/PackedCountingBloomFilter.h"
 #include "BloomDBG/AssemblyCounters.h"
 #include "BloomDBG/AssemblyParams.h"
 #include "BloomDBG/Checkpoint.h"
@@ -236,7 +237,7 @@ initGlobals(const BloomDBG::AssemblyParams& params)
  * Resume assembly from previously saved checkpoint.
  */
 void
-resumeAssemblyFromCheckpoint(int argc, char** argv, BloomDBG::AssemblyParams& params, ostream& out)
+resumeAssemblyFromCheckpoint(int argc, char** argv, BloomDBG::AssemblyParams& params, BufferedWriter& out)
 {
 	assert(params.checkpointsEnabled() && checkpointExists(params));
 
@@ -299,7 +300,7 @@ resumeAssemblyFromCheckpoint(int argc, char** argv, BloomDBG::AssemblyParams& pa
  * is constructed using `abyss-bloom build -t rolling-hash`.)
  */
 void
-prebuiltBloomAssembly(int argc, char** argv, BloomDBG::AssemblyParams& params, ostream& out)
+prebuiltBloomAssembly(int argc, char** argv, BloomDBG::AssemblyParams& params, BufferedWriter& out)
 {
 	/* load prebuilt Bloom filter from file */
 
@@ -307,7 +308,9 @@ prebuiltBloomAssembly(int argc, char** argv, BloomDBG::AssemblyParams& params, o
 	if (params.verbose)
 		cerr << "Loading prebuilt Bloom filter from `" << params.bloomPath << "'" << endl;
 
-	/* load the Bloom filter from file */
+	/* load the Bloom filter from file, which must have the counter
+	 * size of CountingBloomFilterType */
+	checkCountingBloomBits(params.bloomPath, 8 * sizeof(BloomCounterType));
 	CountingBloomFilterType bloom(params.bloomPath, params.minCov);
 
 	if (params.verbose)
@@ -346,7 +349,7 @@ prebuiltBloomAssembly(int argc, char** argv, BloomDBG::AssemblyParams& params, o
  * Load the reads into a counting Bloom filter and do the assembly.
  */
 void
-countingBloomAssembly(int argc, char** argv, const BloomDBG::AssemblyParams& params, ostream& out)
+countingBloomAssembly(int argc, char** argv, const BloomDBG::AssemblyParams& params, BufferedWriter& out)
 {
 	/* init global vars for k-mer size and spaced seed pattern */
 
@@ -535,12 +538,7 @@ main(int argc, char** argv)
 #endif
 
 	/* print contigs to STDOUT unless -o option was set */
-	ofstream outputFile;
-	if (!params.outputPath.empty()) {
-		outputFile.open(params.outputPath.c_str());
-		assert_good(outputFile, params.outputPath);
-	}
-	ostream& out = params.outputPath.empty() ? cout : outputFile;
+	BufferedWriter out(params.outputPath.empty() ? "-" : params.outputPath);
 
 	/* load the Bloom filter and do the assembly */
 	if (params.checkpointsEnabled() && checkpointExists(params))
@@ -551,8 +549,7 @@ main(int argc, char** argv)
 		countingBloomAssembly(argc, argv, params, out);
 
 	/* cleanup */
-	if (!params.outputPath.empty())
-		outputFile.close();
+	out.close();
 
 	return EXIT_SUCCESS;
 }
@@ -11,6 +11,7 @@
 #include "BloomDBG/RollingBloomDBG.h"
 #include "BloomDBG/RollingHash.h"
 #include "BloomDBG/RollingHashIterator.h"
+#include "Common/BufferedWriter.h"
 #include "Common/Hash.h"
 #include "Common/IOUtil.h"
 #include "Common/Sequence.h"
@@ -18,6 +19,7 @@
 #include "Common/UnorderedSet.h"
 #include "DataLayer/FastaConcat.h"
 #include "DataLayer/FastaReader.h"
+#include "DataLayer/ParallelFastaReader.h"
 #include "Graph/BreadthFirstSearch.h"
 #include "Graph/ExtendPath.h"
 #include "Graph/Path.h"
@@ -594,14 +596,11 @@ outputContig(
 	rec.redundant = redundant;
 
 	if (!redundant) {
+		rec.length = seq.length();
+		rec.coverage = getSeqAbsoluteKmerCoverage(seq, solidKmerSet);
+
 #pragma omp critical(fasta)
 		{
-			rec.length = seq.length();
-			rec.coverage = getSeqAbsoluteKmerCoverage(seq, solidKmerSet);
-
-			/* add contig to output FASTA */
-			printContig(seq, rec.length, rec.coverage, counters.contigID, rec.readID, params.k, streams.out);
-
 			/* add contig to checkpoint FASTA file */
 			if (params.checkpointsEnabled())
 				printContig(seq, rec.length, rec.coverage, counters.contigID, rec.readID, params.k, streams.checkpointOut);
@@ -611,6 +610,14 @@ outputContig(
 			counters.contigID++;
 			counters.basesAssembled += seq.length();
 		}
+
+		/* format the contig outside of the critical sections, and
+		 * add it to the output FASTA in the order of contig IDs */
+		std::ostringstream fasta;
+		printContig(seq, rec.length, rec.coverage, rec.contigID, rec.readID, params.k, fasta);
+		std::string record = fasta.str();
+#pragma omp critical(contigOut)
+		streams.contigs.write(rec.contigID, record);
 	}
 
 #pragma omp critical(trace)
@@ -880,29 +887,16 @@ processRead(
 }
 
 /**
- * Perform a Bloom-filter-based de Bruijn graph assembly.
- * Contigs are generated by extending reads left/right within
- * the de Bruijn graph, up to the next branching point or dead end.
- * Short branches due to Bloom filter false positives are
- * ignored.
- *
- * @param argc number of input FASTA files
- * @param argv array of input FASTA filenames
- * @param genomeSize approx genome size
- * @param goodKmerSet Bloom filter containing k-mers that
- * occur more than once in the input data
- * @param out output stream for contigs (FASTA)
- * @param verbose set to true to print progress messages to
- * STDERR
+ * Perform a Bloom-filter-based de Bruijn graph assembly
+ * of the reads of the specified input stream.
  */
-template<typename SolidKmerSetT>
+template<typename InputReadStreamT, typename SolidKmerSetT>
 inline static void
 assemble(
-    int argc,
-    char** argv,
+    InputReadStreamT& in,
     SolidKmerSetT& solidKmerSet,
     const AssemblyParams& params,
-    std::ostream& out)
+    BufferedWriter& out)
 {
 	/* k-mers in previously assembled contigs */
 	BloomFilter assembledKmerSet(
@@ -911,9 +905,6 @@ assemble(
 	/* counters for progress messages */
 	AssemblyCounters counters;
 
-	/* input reads */
-	FastaConcat in(argv, argv + argc, FastaReader::FOLD_CASE);
-
 	/* duplicate FASTA output for checkpoints */
 	std::ofstream checkpointOut;
 	if (params.checkpointsEnabled()) {
@@ -942,12 +933,92 @@ assemble(
 	}
 
 	/* bundle output streams */
-	AssemblyStreams<FastaConcat> streams(in, out, checkpointOut, traceOut, readLogOut);
+	AssemblyStreams<InputReadStreamT> streams(in, out, checkpointOut, traceOut, readLogOut);
 
 	/* run the assembly */
 	assemble(solidKmerSet, assembledKmerSet, counters, params, streams);
 }
 
+/**
+ * Perform a Bloom-filter-based de Bruijn graph assembly.
+ * Contigs are generated by extending reads left/right within
+ * the de Bruijn graph, up to the next branching point or dead end.
+ * Short branches due to Bloom filter false positives are
+ * ignored.
+ *
+ * @param argc number of input FASTA files
+ * @param argv array of input FASTA filenames
+ * @param genomeSize approx genome size
+ * @param goodKmerSet Bloom filter containing k-mers that
+ * occur more than once in the input data
+ * @param out output stream for contigs (FASTA)
+ * @param verbose set to true to print progress messages to
+ * STDERR
+ */
+template<typename SolidKmerSetT>
+inline static void
+assemble(
+    int argc,
+    char** argv,
+    SolidKmerSetT& solidKmerSet,
+    const AssemblyParams& params,
+    BufferedWriter& out)
+{
+	if (params.checkpointsEnabled()) {
+		/* read the input in order, so that a checkpoint marks
+		 * the position at which to resume */
+		FastaConcat in(argv, argv + argc, FastaReader::FOLD_CASE);
+		assemble(in, solidKmerSet, params, out);
+	} else {
+#if _OPENMP
+		unsigned threads = omp_get_max_threads();
+#else
+		unsigned threads = 1;
+#endif
+		ParallelFastaReader in(argv, argv + argc,
+		    FastaReader::FOLD_CASE, threads);
+		assemble(in, solidKmerSet, params, out);
+	}
+}
+
+/**
+ * Read a batch of reads totalling at least `maxBases` bases,
+ * stopping at the next checkpoint.
+ */
+template<typename InputReadStreamT>
+inline static void
+readBatch(
+    InputReadStreamT& in,
+    std::vector<FastaRecord>& buffer,
+    size_t maxBases,
+    size_t& readsUntilCheckpoint)
+{
+	buffer.clear();
+#pragma omp critical(in)
+	for (size_t bases = 0; bases < maxBases && readsUntilCheckpoint > 0;) {
+		FastaRecord rec;
+		if (!(in >> rec))
+			break;
+		--readsUntilCheckpoint;
+		bases += rec.seq.length();
+		buffer.push_back(rec);
+	}
+}
+
+/**
+ * Read a batch of reads from the partition of the calling thread.
+ * The input is read out of order, so checkpoints are disabled.
+ */
+inline static void
+readBatch(
+    ParallelFastaReader& in,
+    std::vector<FastaRecord>& buffer,
+    size_t maxBases,
+    size_t& /* readsUntilCheckpoint */)
+{
+	in.readBatch(buffer, maxBases);
+}
+
 /**
  * Perform a Bloom-filter-based de Bruijn graph assembly.
  * Contigs are generated by extending reads left/right within
@@ -986,6 +1057,7 @@ assemble(
 
 	InputReadStreamT& in = streams.in;
 	std::ostream& checkpointOut = streams.checkpointOut;
+	streams.contigs.start(counters.contigID);
 
 	KmerHash contigEndKmers;
 	contigEndKmers.rehash((size_t)pow(2, 28));
@@ -1010,20 +1082,7 @@ assemble(
 #pragma omp parallel
 		for (std::vector<FastaRecord> buffer;;) {
 			/* read sequences in batches to reduce I/O contention */
-			buffer.clear();
-			size_t bufferSize;
-			bool good = true;
-#pragma omp critical(in)
-			for (bufferSize = 0; bufferSize < SEQ_BUFFER_SIZE && readsUntilCheckpoint > 0;) {
-				FastaRecord rec;
-				good = in >> rec;
-				if (!good)
-					break;
-#pragma omp atomic
-				readsUntilCheckpoint--;
-				buffer.push_back(rec);
-				bufferSize += rec.seq.length();
-			}
+			readBatch(in, buffer, SEQ_BUFFER_SIZE, readsUntilCheckpoint);
 			if (buffer.size() == 0)
 				break;
 
@@ -1075,6 +1134,7 @@ assemble(
 	} /* for each batch of reads between checkpoints */
 
 	assert(in.eof());
+	streams.contigs.flush();
 
 	if (params.verbose) {
 		readsProgressMessage(counters);
@@ -0,0 +1,309 @@
+#include "BAM.h"
+#include <cassert>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+using namespace std;
+
+/** The BAM codes of the bases, which are the index of the base in
+ * "=ACMGRSVTWYHKDBN". */
+static const unsigned char BAM_CODE[256] = {
+	15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,
+	15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,
+	15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,
+	15,15,15,15,15,15,15,15,15,15,15,15,15, 0,15,15,
+	15, 1,14, 2,13,15,15, 4,11,15,15,12,15, 3,15,15,
+	15,15, 5, 6, 8,15, 7, 9,15,10,15,15,15,15,15,15,
+	15, 1,14, 2,13,15,15, 4,11,15,15,12,15, 3,15,15,
+	15,15, 5, 6, 8,15, 7, 9,15,10,15,15,15,15,15,15,
+	15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,
+	15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,
+	15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,
+	15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,
+	15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,
+	15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,
+	15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,
+	15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,
+};
+
+/** Append an integer of n bytes to s in little-endian order. */
+static inline void appendLE(string& s, uint32_t x, unsigned n)
+{
+	for (unsigned i = 0; i < n; ++i)
+		s += char(x >> (8 * i));
+}
+
+/** Store an integer of four bytes at p in little-endian order. */
+static inline void storeLE32(char* p, uint32_t x)
+{
+	for (unsigned i = 0; i < 4; ++i)
+		p[i] = char(x >> (8 * i));
+}
+
+/** Append a float to s in little-endian order. */
+static inline void appendFloat(string& s, float x)
+{
+	uint32_t bits;
+	memcpy(&bits, &x, sizeof bits);
+	appendLE(s, bits, 4);
+}
+
+void appendBAMHeader(string& s, const string& text,
+		const vector<string>& names, const vector<uint32_t>& lengths)
+{
+	assert(names.size() == lengths.size());
+	s.append("BAM\1", 4);
+	appendLE(s, text.size(), 4);
+	s += text;
+	appendLE(s, names.size(), 4);
+	for (size_t i = 0; i < names.size(); ++i) {
+		appendLE(s, names[i].size() + 1, 4);
+		s.append(names[i].c_str(), names[i].size() + 1);
+		appendLE(s, lengths[i], 4);
+	}
+}
+
+/** Parse an integer of the range [min, max] from the field of a tag.
+ * @return false if the field is not an integer of that range
+ */
+static bool parseTagInt(const char* first, const char* last,
+		long long min, long long max, long long& x)
+{
+	if (first == last)
+		return false;
+	string field(first, last);
+	char* end;
+	errno = 0;
+	x = strtoll(field.c_str(), &end, 10);
+	return errno == 0 && end == field.c_str() + field.size()
+		&& x >= min && x <= max;
+}
+
+/** Parse a float from the field of a tag.
+ * @return false if the field is not a number
+ */
+static bool parseTagFloat(const char* first, const char* last, float& x)
+{
+	if (first == last)
+		return false;
+	string field(first, last);
+	char* end;
+	x = strtof(field.c_str(), &end);
+	return end == field.c_str() + field.size();
+}
+
+/** Append the value of an integer tag to s, using the smallest type
+ * that holds the value, as samtools does. */
+static void appendTagInt(string& s, long long x)
+{
+	if (x < 0) {
+		if (x >= numeric_limits<int8_t>::min()) {
+			s += 'c';
+			appendLE(s, x, 1);
+		} else if (x >= numeric_limits<int16_t>::min()) {
+			s += 's';
+			appendLE(s, x, 2);
+		} else {
+			s += 'i';
+			appendLE(s, x, 4);
+		}
+	} else {
+		if (x <= numeric_limits<uint8_t>::max()) {
+			s += 'C';
+			appendLE(s, x, 1);
+		} else if (x <= numeric_limits<uint16_t>::max()) {
+			s += 'S';
+			appendLE(s, x, 2);
+		} else {
+			s += 'I';
+			appendLE(s, x, 4);
+		}
+	}
+}
+
+/** Append the value of an array tag to s, whose text is the subtype
+ * followed by the comma-separated values.
+ * @return false if the value is invalid
+ */
+static bool appendTagArray(string& s, const char* first, const char* last)
+{
+	if (first == last)
+		return false;
+	char subtype = *first++;
+	long long min, max;
+	unsigned n = 4;
+	switch (subtype) {
+	  case 'c': min = -0x80; max = 0x7f; n = 1; break;
+	  case 'C': min = 0; max = 0xff; n = 1; break;
+	  case 's': min = -0x8000; max = 0x7fff; n = 2; break;
+	  case 'S': min = 0; max = 0xffff; n = 2; break;
+	  case 'i': min = -0x80000000LL; max = 0x7fffffff; break;
+	  case 'I': min = 0; max = 0xffffffffLL; break;
+	  case 'f': min = max = 0; break;
+	  default: return false;
+	}
+	s += subtype;
+	size_t countPos = s.size();
+	appendLE(s, 0, 4);
+	uint32_t count = 0;
+	while (first != last) {
+		if (*first++ != ',')
+			return false;
+		const char* end = static_cast<const char*>(
+				memchr(first, ',', last - first));
+		if (end == NULL)
+			end = last;
+		if (subtype == 'f') {
+			float x;
+			if (!parseTagFloat(first, end, x))
+				return false;
+			appendFloat(s, x);
+		} else {
+			long long x;
+			if (!parseTagInt(first, end, min, max, x))
+				return false;
+			appendLE(s, x, n);
+		}
+		++count;
+		first = end;
+	}
+	storeLE32(&s[countPos], count);
+	return true;
+}
+
+/** Append one optional field of SAM, TAG:TYPE:VALUE, to s. */
+static bool appendBAMTag(string& s, const char* first, const char* last)
+{
+	if (last - first < 5 || !isalpha(first[0]) || !isalnum(first[1])
+			|| first[2] != ':' || first[4] != ':')
+		return false;
+	char type = first[3];
+	s.append(first, 2);
+	first += 5;
+	switch (type) {
+	  case 'A':
+		if (last - first != 1)
+			return false;
+		s += 'A';
+		s += *first;
+		return true;
+	  case 'i': {
+		long long x;
+		if (!parseTagInt(first, last, -0x80000000LL, 0xffffffffLL, x))
+			return false;
+		appendTagInt(s, x);
+		return true;
+	  }
+	  case 'f': {
+		float x;
+		if (!parseTagFloat(first, last, x))
+			return false;
+		s += 'f';
+		appendFloat(s, x);
+		return true;
+	  }
+	  case 'Z': case 'H':
+		if (memchr(first, '\0', last - first) != NULL)
+			return false;
+		s += type;
+		s.append(first, last);
+		s += '\0';
+		return true;
+	  case 'B':
+		s += 'B';
+		return appendTagArray(s, first, last);
+	  default:
+		return false;
+	}
+}
+
+bool appendBAMTags(string& s, const char* first, const char* last)
+{
+	while (first != last) {
+		const char* end = static_cast<const char*>(
+				memchr(first, '\t', last - first));
+		if (end == NULL)
+			end = last;
+		if (!appendBAMTag(s, first, end))
+			return false;
+		first = end == last ? last : end + 1;
+	}
+	return true;
+}
+
+bool appendBAM(string& s, const SAMRecord& rec, int tid, int mtid,
+		const string& tags)
+{
+	vector<uint32_t> ops;
+	if (rec.qname.empty() || rec.qname.size() > 254
+			|| !SAMAlignment::decodeCigar(rec.cigar.data(),
+				rec.cigar.data() + rec.cigar.size(), ops)
+			|| ops.size() > 0xffff)
+		return false;
+
+	// The span of the alignment on the target
+	int end = rec.pos;
+	for (vector<uint32_t>::const_iterator it = ops.begin();
+			it != ops.end(); ++it) {
+		switch (*it & 0xf) {
+		  case 0: case 2: case 3: case 7: case 8:
+			end += *it >> 4;
+		}
+	}
+	if (end == rec.pos)
+		++end;
+
+#if SAM_SEQ_QUAL
+	const string none;
+	const string& seq = rec.seq == "*" ? none : rec.seq;
+	if (rec.qual != "*" && rec.qual.size() != seq.size())
+		return false;
+#else
+	const string seq;
+#endif
+
+	size_t start = s.size();
+	appendLE(s, 0, 4); // block_size
+	appendLE(s, tid, 4);
+	appendLE(s, rec.pos, 4);
+	appendLE(s, rec.qname.size() + 1, 1);
+	appendLE(s, rec.mapq, 1);
+	appendLE(s, bamReg2bin(rec.pos, end), 2);
+	appendLE(s, ops.size(), 2);
+	appendLE(s, rec.flag, 2);
+	appendLE(s, seq.size(), 4);
+	appendLE(s, mtid, 4);
+	appendLE(s, rec.mpos, 4);
+	appendLE(s, rec.isize, 4);
+	s.append(rec.qname.c_str(), rec.qname.size() + 1);
+	for (vector<uint32_t>::const_iterator it = ops.begin();
+			it != ops.end(); ++it)
+		appendLE(s, *it, 4);
+	for (size_t i = 0; i < seq.size(); i += 2) {
+		unsigned hi = BAM_CODE[(unsigned char)seq[i]];
+		unsigned lo = i + 1 < seq.size()
+			? BAM_CODE[(unsigned char)seq[i + 1]] : 0;
+		s += char(hi << 4 | lo);
+	}
+#if SAM_SEQ_QUAL
+	if (rec.qual == "*")
+		s.append(seq.size(), '\xff');
+	else
+		for (size_t i = 0; i < seq.size(); ++i)
+			s += char(rec.qual[i] - 33);
+	if (!appendBAMTags(s, rec.tags.data(),
+				rec.tags.data() + rec.tags.size())) {
+		s.resize(start);
+		return false;
+	}
+#endif
+	if (!appendBAMTags(s, tags.data(), tags.data() + tags.size())) {
+		s.resize(start);
+		return false;
+	}
+	storeLE32(&s[start], s.size() - start - 4);
+	return true;
+}
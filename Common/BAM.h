@@ -0,0 +1,53 @@
+#ifndef BAM_H
+#define BAM_H 1
+
+#include "Common/SAM.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * Encode SAM records in the binary format of BAM. The encoded data is
+ * appended to a string, which is compressed with BGZF to form a BAM
+ * file. See the SAM/BAM format specification, section 4.2.
+ */
+
+/** Return the bin of the region [beg, end) of a target. */
+static inline unsigned bamReg2bin(int beg, int end)
+{
+	--end;
+	if (beg >> 14 == end >> 14)
+		return ((1 << 15) - 1) / 7 + (beg >> 14);
+	if (beg >> 17 == end >> 17)
+		return ((1 << 12) - 1) / 7 + (beg >> 17);
+	if (beg >> 20 == end >> 20)
+		return ((1 << 9) - 1) / 7 + (beg >> 20);
+	if (beg >> 23 == end >> 23)
+		return ((1 << 6) - 1) / 7 + (beg >> 23);
+	if (beg >> 26 == end >> 26)
+		return ((1 << 3) - 1) / 7 + (beg >> 26);
+	return 0;
+}
+
+/** Append the header of a BAM file, the SAM header text and the
+ * names and lengths of the targets, to s. */
+void appendBAMHeader(std::string& s, const std::string& text,
+		const std::vector<std::string>& names,
+		const std::vector<uint32_t>& lengths);
+
+/** Append the optional fields of SAM, which are separated by tabs,
+ * to s as BAM tags.
+ * @return false if a field is invalid
+ */
+bool appendBAMTags(std::string& s, const char* first, const char* last);
+
+/** Append a BAM record to s.
+ * @param tid the index of the target of rec, or -1 if none
+ * @param mtid the index of the target of the mate, or -1 if none
+ * @param tags the optional fields of SAM, separated by tabs
+ * @return false if the record cannot be encoded
+ */
+bool appendBAM(std::string& s, const SAMRecord& rec, int tid, int mtid,
+		const std::string& tags);
+
+#endif
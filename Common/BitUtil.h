@@ -3,10 +3,15 @@
 
 #include "config.h"
 #include <cstdlib> // for exit
+#include <cstring> // for memcpy
 #include <stdint.h>
 #include <cassert>
 #include <iostream>
 
+#if __GNUC__ && __x86_64__
+# include <immintrin.h>
+#endif
+
 enum BitwiseOp { BITWISE_OVERWRITE, BITWISE_OR, BITWISE_AND };
 
 /** The return value of the CPUID instruction. */
@@ -34,6 +39,19 @@ static inline bool havePopcnt() { return cpuid(1).c & (1 << 23); }
 
 static const bool hasPopcnt = havePopcnt();
 
+/** Return whether this processor supports AVX2. */
+static inline bool haveAvx2()
+{
+#if __GNUC__ && __x86_64__
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
+
+static const bool hasAvx2 = haveAvx2();
+
 /** Return the Hamming weight of x. */
 static inline uint64_t popcount(uint64_t x)
 {
@@ -54,6 +72,187 @@ static inline uint64_t popcount(uint64_t x)
 	return x & 0x7FLLU;
 }
 
+/** Hint that the cache line at p will be read soon. */
+static inline void prefetch(const void* p)
+{
+#if __GNUC__
+	__builtin_prefetch(p);
+#else
+	(void)p;
+#endif
+}
+
+/** Load an unaligned 64-bit word. */
+static inline uint64_t loadWord(const char* p)
+{
+	uint64_t x;
+	memcpy(&x, p, sizeof x);
+	return x;
+}
+
+/** Store an unaligned 64-bit word. */
+static inline void storeWord(char* p, uint64_t x)
+{
+	memcpy(p, &x, sizeof x);
+}
+
+/** Counts of the four combinations of bits of two bit arrays. */
+struct BitCounts {
+	/** bits set in both arrays (1/1) */
+	uint64_t both;
+	/** bits set in the first array only (1/0) */
+	uint64_t first;
+	/** bits set in the second array only (0/1) */
+	uint64_t second;
+	/** bits set in neither array (0/0) */
+	uint64_t neither;
+
+	BitCounts() : both(0), first(0), second(0), neither(0) { }
+
+	BitCounts& operator+=(const BitCounts& o)
+	{
+		both += o.both;
+		first += o.first;
+		second += o.second;
+		neither += o.neither;
+		return *this;
+	}
+};
+
+#if __GNUC__ && __x86_64__
+/** Return the population count of each 64-bit lane of x. */
+__attribute__((target("avx2")))
+static inline __m256i popcount256(__m256i x)
+{
+	const __m256i lookup = _mm256_setr_epi8(
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i lowMask = _mm256_set1_epi8(0x0f);
+	__m256i lo = _mm256_and_si256(x, lowMask);
+	__m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), lowMask);
+	__m256i counts = _mm256_add_epi8(
+			_mm256_shuffle_epi8(lookup, lo),
+			_mm256_shuffle_epi8(lookup, hi));
+	return _mm256_sad_epu8(counts, _mm256_setzero_si256());
+}
+
+/** Return the sum of the four 64-bit lanes of x. */
+__attribute__((target("avx2")))
+static inline uint64_t sum256(__m256i x)
+{
+	uint64_t lanes[4];
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), x);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+/** Combine 32-byte blocks of src into dest. Return bytes done. */
+__attribute__((target("avx2")))
+static inline size_t combineBytesAvx2(char* dest, const char* src,
+	size_t bytes, BitwiseOp op)
+{
+	size_t i = 0;
+	for (; i + 32 <= bytes; i += 32) {
+		__m256i* pd = reinterpret_cast<__m256i*>(dest + i);
+		__m256i x = _mm256_loadu_si256(pd);
+		__m256i y = _mm256_loadu_si256(
+				reinterpret_cast<const __m256i*>(src + i));
+		_mm256_storeu_si256(pd, op == BITWISE_AND
+				? _mm256_and_si256(x, y) : _mm256_or_si256(x, y));
+	}
+	return i;
+}
+
+/** Count the bit combinations of 32-byte blocks. Return bytes done. */
+__attribute__((target("avx2")))
+static inline size_t compareBytesAvx2(const char* a, const char* b,
+	size_t bytes, BitCounts& counts)
+{
+	__m256i both = _mm256_setzero_si256();
+	__m256i first = _mm256_setzero_si256();
+	__m256i second = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 32 <= bytes; i += 32) {
+		__m256i x = _mm256_loadu_si256(
+				reinterpret_cast<const __m256i*>(a + i));
+		__m256i y = _mm256_loadu_si256(
+				reinterpret_cast<const __m256i*>(b + i));
+		both = _mm256_add_epi64(both,
+				popcount256(_mm256_and_si256(x, y)));
+		first = _mm256_add_epi64(first,
+				popcount256(_mm256_andnot_si256(y, x)));
+		second = _mm256_add_epi64(second,
+				popcount256(_mm256_andnot_si256(x, y)));
+	}
+	counts.both += sum256(both);
+	counts.first += sum256(first);
+	counts.second += sum256(second);
+	counts.neither += 8 * i - sum256(both) - sum256(first) - sum256(second);
+	return i;
+}
+#endif
+
+/**
+ * Combine the byte array src into dest with a bitwise OR or AND.
+ * Uses AVX2 when the processor supports it.
+ */
+static inline void combineBytes(char* dest, const char* src,
+	size_t bytes, BitwiseOp op)
+{
+	assert(op == BITWISE_OR || op == BITWISE_AND);
+	size_t i = 0;
+#if __GNUC__ && __x86_64__
+	if (hasAvx2)
+		i = combineBytesAvx2(dest, src, bytes, op);
+#endif
+	for (; i + 8 <= bytes; i += 8) {
+		uint64_t x = loadWord(dest + i), y = loadWord(src + i);
+		storeWord(dest + i, op == BITWISE_AND ? x & y : x | y);
+	}
+	for (; i < bytes; i++) {
+		if (op == BITWISE_AND)
+			dest[i] &= src[i];
+		else
+			dest[i] |= src[i];
+	}
+}
+
+/**
+ * Count the bits that are set in both, either or neither of two bit
+ * arrays of the specified length in bits. Bits are numbered from the
+ * most significant bit of the first byte.
+ * Uses AVX2 when the processor supports it.
+ */
+static inline BitCounts compareBits(const char* a, const char* b,
+	size_t bits)
+{
+	BitCounts counts;
+	size_t bytes = bits / 8;
+	size_t i = 0;
+#if __GNUC__ && __x86_64__
+	if (hasAvx2)
+		i = compareBytesAvx2(a, b, bytes, counts);
+#endif
+	for (; i + 8 <= bytes; i += 8) {
+		uint64_t x = loadWord(a + i), y = loadWord(b + i);
+		counts.both += popcount(x & y);
+		counts.first += popcount(x & ~y);
+		counts.second += popcount(~x & y);
+		counts.neither += popcount(~(x | y));
+	}
+	unsigned char lastByteMask = 0xFF;
+	for (; i * 8 < bits; i++) {
+		if (bits - i * 8 < 8)
+			lastByteMask = 0xFF << (8 - (bits - i * 8));
+		unsigned char x = a[i] & lastByteMask;
+		unsigned char y = b[i] & lastByteMask;
+		counts.both += popcount(x & y);
+		counts.first += popcount(x & ~y & 0xFF);
+		counts.second += popcount(~x & y & 0xFF);
+		counts.neither += popcount(~(x | y) & lastByteMask);
+	}
+	return counts;
+}
+
 /**
  * Memory copy with bit-level resolution.
  *
@@ -0,0 +1,294 @@
+#include "BucketSorter.h"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring> // for strerror
+#include <iostream>
+#include <unistd.h> // for unlink
+
+using namespace std;
+
+/** The size of a chunk of the records without a key */
+static const size_t CHUNK_SIZE = 16 * 1024 * 1024;
+
+/** The header of a record of a bucket */
+struct RecordHeader
+{
+	uint64_t key;
+	uint64_t seq;
+	uint64_t size;
+};
+
+/** The position of a record in a loaded bucket */
+struct RecordEntry
+{
+	uint64_t key;
+	uint64_t seq;
+	size_t pos;
+	size_t size;
+
+	bool operator<(const RecordEntry& o) const
+	{
+		return key != o.key ? key < o.key : seq < o.seq;
+	}
+};
+
+/** Print an error message about a temporary file and exit. */
+static void die(const string& path)
+{
+	cerr << "error: `" << path << "': " << strerror(errno) << endl;
+	exit(EXIT_FAILURE);
+}
+
+/** Create a temporary file in TMPDIR, which is removed when it is
+ * closed. */
+static FILE* createTempFile()
+{
+	const char* dir = getenv("TMPDIR");
+	string path = string(dir != NULL && *dir != '\0' ? dir : "/tmp")
+		+ "/abyss-sort.XXXXXX";
+	int fd = mkstemp(&path[0]);
+	if (fd < 0)
+		die(path);
+	unlink(path.c_str());
+	FILE* file = fdopen(fd, "w+b");
+	if (file == NULL)
+		die(path);
+	return file;
+}
+
+BucketSorter::BucketSorter(uint64_t maxKey, unsigned numBuckets,
+		size_t memory)
+	: m_keysPerBucket(maxKey / numBuckets + 1),
+	m_buckets(numBuckets + 1), m_memory(memory), m_buffered(0),
+	m_spills(0), m_next(0), m_tailPos(0), m_tailInFile(false)
+{
+	assert(numBuckets > 0);
+	for (unsigned i = 0; i < numBuckets; ++i) {
+		m_buckets[i].begin = i * m_keysPerBucket;
+		m_buckets[i].end = i + 1 < numBuckets
+			? (i + 1) * m_keysPerBucket : NO_KEY;
+	}
+}
+
+BucketSorter::~BucketSorter()
+{
+	for (vector<Bucket>::iterator it = m_buckets.begin();
+			it != m_buckets.end(); ++it)
+		if (it->file != NULL)
+			fclose(it->file);
+}
+
+void BucketSorter::add(uint64_t key, uint64_t seq,
+		const char* data, size_t size)
+{
+	assert(m_next == 0);
+	size_t n = m_buckets.size() - 1;
+	size_t i = key == NO_KEY ? n : min(key / m_keysPerBucket, (uint64_t)n - 1);
+	RecordHeader header = { key, seq, size };
+	Bucket& bucket = m_buckets[i];
+	bucket.buffer.append(reinterpret_cast<const char*>(&header),
+			sizeof header);
+	bucket.buffer.append(data, size);
+	bucket.size += sizeof header + size;
+	m_buffered += sizeof header + size;
+	if (m_buffered > m_memory)
+		spill();
+}
+
+/** Append the buffer of a bucket to its temporary file. */
+static void spillBucket(string& buffer, FILE*& file)
+{
+	if (buffer.empty())
+		return;
+	if (file == NULL)
+		file = createTempFile();
+	if (fwrite(buffer.data(), buffer.size(), 1, file) != 1)
+		die("temporary file");
+	string().swap(buffer);
+}
+
+/** Append the buffers to the temporary files of their buckets. */
+void BucketSorter::spill()
+{
+	for (vector<Bucket>::iterator it = m_buckets.begin();
+			it != m_buckets.end(); ++it)
+		spillBucket(it->buffer, it->file);
+	m_buffered = 0;
+	m_spills++;
+}
+
+/** Split the bucket i, which is larger than the memory limit, into
+ * buckets of narrower ranges of keys. The records are copied one at a
+ * time, and the new buckets are spilled to their own temporary files
+ * whenever their buffers exceed the memory limit. */
+void BucketSorter::split(size_t i)
+{
+	Bucket bucket;
+	swap(bucket, m_buckets[i]);
+	uint64_t width = bucket.end - bucket.begin;
+	assert(width > 1);
+	uint64_t n = min(width, bucket.size / max(m_memory, (size_t)1) + 2);
+	uint64_t keysPerPart = width / n + (width % n != 0);
+	n = width / keysPerPart + (width % keysPerPart != 0);
+
+	vector<Bucket> parts(n);
+	for (uint64_t j = 0; j < n; ++j) {
+		parts[j].begin = bucket.begin + j * keysPerPart;
+		parts[j].end = j + 1 < n ? parts[j].begin + keysPerPart
+			: bucket.end;
+	}
+
+	size_t buffered = 0;
+	string record;
+	size_t bufferPos = 0;
+	if (bucket.file != NULL)
+		rewind(bucket.file);
+	for (;;) {
+		// Read the next record, first from the file and then from
+		// the buffer.
+		RecordHeader header;
+		if (bucket.file != NULL) {
+			if (fread(&header, sizeof header, 1, bucket.file) != 1) {
+				if (ferror(bucket.file))
+					die("temporary file");
+				fclose(bucket.file);
+				bucket.file = NULL;
+				continue;
+			}
+			record.resize(header.size);
+			if (header.size > 0
+					&& fread(&record[0], header.size, 1, bucket.file) != 1)
+				die("temporary file");
+		} else if (bufferPos < bucket.buffer.size()) {
+			memcpy(&header, &bucket.buffer[bufferPos], sizeof header);
+			bufferPos += sizeof header;
+			record.assign(bucket.buffer, bufferPos, header.size);
+			bufferPos += header.size;
+		} else
+			break;
+
+		Bucket& part = parts[(header.key - bucket.begin) / keysPerPart];
+		part.buffer.append(reinterpret_cast<const char*>(&header),
+				sizeof header);
+		part.buffer.append(record);
+		part.size += sizeof header + header.size;
+		buffered += sizeof header + header.size;
+		if (buffered > m_memory) {
+			for (vector<Bucket>::iterator it = parts.begin();
+					it != parts.end(); ++it)
+				spillBucket(it->buffer, it->file);
+			buffered = 0;
+			m_spills++;
+		}
+	}
+	string().swap(bucket.buffer);
+
+	// Spill the remaining buffers, so that the memory of the new
+	// buckets is bounded until each of them is read.
+	for (vector<Bucket>::iterator it = parts.begin();
+			it != parts.end(); ++it)
+		spillBucket(it->buffer, it->file);
+
+	m_buckets.erase(m_buckets.begin() + i);
+	m_buckets.insert(m_buckets.begin() + i, parts.begin(), parts.end());
+}
+
+/** Read the records of a bucket, both those of its file and those of
+ * its buffer, and free the bucket. */
+void BucketSorter::load(Bucket& bucket, string& data)
+{
+	data.clear();
+	if (bucket.file != NULL) {
+		if (fseeko(bucket.file, 0, SEEK_END) != 0)
+			die("temporary file");
+		off_t size = ftello(bucket.file);
+		rewind(bucket.file);
+		data.resize(size + bucket.buffer.size());
+		if (size > 0 && fread(&data[0], size, 1, bucket.file) != 1)
+			die("temporary file");
+		fclose(bucket.file);
+		bucket.file = NULL;
+		memcpy(&data[size], bucket.buffer.data(), bucket.buffer.size());
+	} else
+		data.swap(bucket.buffer);
+	string().swap(bucket.buffer);
+}
+
+bool BucketSorter::read(string& out)
+{
+	out.clear();
+	size_t n = m_buckets.size() - 1;
+	while (m_next < n) {
+		Bucket& bucket = m_buckets[m_next];
+		if (bucket.size > m_memory && bucket.end - bucket.begin > 1) {
+			split(m_next);
+			n = m_buckets.size() - 1;
+			continue;
+		}
+		string data;
+		load(m_buckets[m_next++], data);
+		if (data.empty())
+			continue;
+
+		vector<RecordEntry> entries;
+		for (size_t pos = 0; pos < data.size();) {
+			RecordHeader header;
+			assert(pos + sizeof header <= data.size());
+			memcpy(&header, &data[pos], sizeof header);
+			pos += sizeof header;
+			RecordEntry entry = { header.key, header.seq, pos,
+				header.size };
+			entries.push_back(entry);
+			pos += header.size;
+		}
+		sort(entries.begin(), entries.end());
+
+		out.reserve(data.size());
+		for (vector<RecordEntry>::const_iterator it = entries.begin();
+				it != entries.end(); ++it)
+			out.append(data, it->pos, it->size);
+		return true;
+	}
+	if (m_next == n) {
+		m_next++;
+		Bucket& tail = m_buckets.back();
+		m_tailInFile = tail.file != NULL;
+		if (m_tailInFile)
+			rewind(tail.file);
+	}
+
+	// Read the records without a key in the order that they were
+	// added, first those of the file and then those of the buffer.
+	Bucket& tail = m_buckets.back();
+	while (m_tailInFile && out.size() < CHUNK_SIZE) {
+		RecordHeader header;
+		if (fread(&header, sizeof header, 1, tail.file) != 1) {
+			if (ferror(tail.file))
+				die("temporary file");
+			fclose(tail.file);
+			tail.file = NULL;
+			m_tailInFile = false;
+			break;
+		}
+		size_t pos = out.size();
+		out.resize(pos + header.size);
+		if (header.size > 0
+				&& fread(&out[pos], header.size, 1, tail.file) != 1)
+			die("temporary file");
+	}
+	while (m_tailPos < tail.buffer.size() && out.size() < CHUNK_SIZE) {
+		RecordHeader header;
+		memcpy(&header, &tail.buffer[m_tailPos], sizeof header);
+		m_tailPos += sizeof header;
+		out.append(tail.buffer, m_tailPos, header.size);
+		m_tailPos += header.size;
+	}
+	if (out.empty()) {
+		string().swap(tail.buffer);
+		m_tailPos = 0;
+		return false;
+	}
+	return true;
+}
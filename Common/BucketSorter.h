@@ -0,0 +1,95 @@
+#ifndef BUCKETSORTER_H
+#define BUCKETSORTER_H 1
+
+#include <cstdio>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * Sort records of bytes by an integer key using a bounded amount of
+ * memory. The records are distributed by key to a fixed number of
+ * buckets, which cover consecutive ranges of keys. When the buffered
+ * records exceed the memory limit, the buffers are appended to a
+ * temporary file per bucket. After all records are added, the buckets
+ * are read and sorted one at a time. A bucket larger than the memory
+ * limit is first split into buckets of narrower ranges of keys, so
+ * that a bucket that is loaded fits in the memory limit, unless its
+ * records share a single key. Records of equal keys are ordered by a
+ * sequence number given by the caller. Records without a key follow
+ * all others in the order that they were added, and are not held in
+ * memory at once.
+ */
+class BucketSorter
+{
+  public:
+	/** The key of a record that is not sorted */
+	static const uint64_t NO_KEY = ~uint64_t(0);
+
+	/** Sort records of keys at most maxKey, using the specified
+	 * number of buckets and buffering at most the specified number
+	 * of bytes. */
+	BucketSorter(uint64_t maxKey, unsigned numBuckets, size_t memory);
+	~BucketSorter();
+
+	/** Add a record of the specified key and sequence number. */
+	void add(uint64_t key, uint64_t seq, const char* data, size_t size);
+
+	/** Set out to the next chunk of the sorted records, after all
+	 * records have been added. A chunk is a sorted bucket or a part
+	 * of the records without a key.
+	 * @return false if all records have been read
+	 */
+	bool read(std::string& out);
+
+	/** Return the number of times that the buffers were written to
+	 * the temporary files. */
+	unsigned spills() const { return m_spills; }
+
+  private:
+	/** A bucket of records of the keys [begin, end). Each record is
+	 * stored as its key, its sequence number and its size, followed
+	 * by its data. */
+	struct Bucket {
+		uint64_t begin, end;
+		uint64_t size;
+		std::string buffer;
+		FILE* file;
+		Bucket() : begin(0), end(0), size(0), file(NULL) { }
+	};
+
+	void spill();
+	void split(size_t i);
+	void load(Bucket& bucket, std::string& data);
+
+	BucketSorter(const BucketSorter&);
+	BucketSorter& operator=(const BucketSorter&);
+
+	/** The number of keys per bucket */
+	uint64_t m_keysPerBucket;
+
+	/** The buckets, the last of which holds the records without a
+	 * key */
+	std::vector<Bucket> m_buckets;
+
+	/** The memory limit */
+	size_t m_memory;
+
+	/** The number of buffered bytes */
+	size_t m_buffered;
+
+	/** The number of spills */
+	unsigned m_spills;
+
+	/** The next bucket to read */
+	size_t m_next;
+
+	/** The position of the next record of the unsorted bucket to
+	 * read from its buffer */
+	size_t m_tailPos;
+
+	/** Whether records without a key remain in the file */
+	bool m_tailInFile;
+};
+
+#endif
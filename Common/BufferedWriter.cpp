@@ -0,0 +1,274 @@
+#include "BufferedWriter.h"
+#include "Gzip.h"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring> // for strerror
+#include <iostream>
+#include <unistd.h>
+
+using namespace std;
+
+/** Size of the buffer of a thread that is handed to the output
+ * stage */
+static const size_t BUFFER_SIZE = 1 << 20;
+
+/** Maximum number of buffers in the output stage per thread of the
+ * output stage */
+static const size_t MAX_PENDING = 4;
+
+void BufferedWriter::init(const string& path, Compression compression,
+		bool append, unsigned threads)
+{
+	m_path = path;
+	m_compression = compression;
+	m_open = true;
+	m_mate = NULL;
+	m_second = false;
+	m_submitted = m_written = 0;
+	m_closing = false;
+
+	if (m_compression != NONE && !haveGzip()) {
+		cerr << "error: `" << m_path << "': compression requires zlib, "
+			"which was not found when ABySS was compiled\n";
+		exit(EXIT_FAILURE);
+	}
+
+	m_file = path == "-" ? stdout
+		: fopen(path.c_str(), append ? "a" : "w");
+	if (m_file == NULL)
+		die();
+
+	pthread_mutex_init(&m_flushMutex, NULL);
+	m_flushLock = &m_flushMutex;
+	pthread_mutex_init(&m_mutex, NULL);
+	pthread_cond_init(&m_cond, NULL);
+
+	if (m_compression != NONE) {
+		if (threads == 0)
+			threads = max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+		m_workers.resize(threads);
+		for (unsigned i = 0; i < threads; ++i)
+			pthread_create(&m_workers[i], NULL, workerThread, this);
+	}
+	pthread_create(&m_io, NULL, ioThread, this);
+}
+
+/** Print an error message and exit. */
+void BufferedWriter::die()
+{
+	cerr << "error: writing to `" << m_path << "': "
+		<< strerror(errno) << endl;
+	exit(EXIT_FAILURE);
+}
+
+void BufferedWriter::setMate(BufferedWriter& mate)
+{
+	assert(m_mate == NULL && mate.m_mate == NULL);
+	m_mate = &mate;
+	mate.m_mate = this;
+	mate.m_second = true;
+	mate.m_flushLock = m_flushLock;
+}
+
+/** Return the buffer of the calling thread. */
+BufferedWriter::Buffer& BufferedWriter::buffer()
+{
+	assert(m_open);
+	Buffer*& b = m_current.get();
+	if (b == NULL) {
+		b = new Buffer;
+		pthread_mutex_lock(&m_mutex);
+		m_buffers.push_back(b);
+		pthread_mutex_unlock(&m_mutex);
+	}
+	return *b;
+}
+
+/** Hand the buffer of this thread to the output stage when it is
+ * full. */
+void BufferedWriter::endRecord(Buffer& b)
+{
+	if (m_mate == NULL) {
+		if (b.data.size() >= BUFFER_SIZE)
+			submit(b.data);
+	} else if (m_second) {
+		// The record of the first file of this thread is complete.
+		// Hand over the buffers of both files together.
+		Buffer& first = m_mate->buffer();
+		if (b.data.size() >= BUFFER_SIZE
+				|| first.data.size() >= BUFFER_SIZE) {
+			pthread_mutex_lock(m_flushLock);
+			m_mate->submit(first.data);
+			submit(b.data);
+			pthread_mutex_unlock(m_flushLock);
+		}
+	}
+}
+
+/** Hand data to the output stage, and clear it. */
+void BufferedWriter::submit(string& data)
+{
+	if (data.empty())
+		return;
+	pthread_mutex_lock(&m_mutex);
+	// Bound the data held in the output stage.
+	size_t maxPending = MAX_PENDING * (m_workers.size() + 1);
+	while (m_submitted - m_written >= maxPending)
+		pthread_cond_wait(&m_cond, &m_mutex);
+	size_t index = m_submitted++;
+	if (m_compression == NONE) {
+		m_ready[index].swap(data);
+	} else {
+		m_jobs.push_back(make_pair(index, string()));
+		m_jobs.back().second.swap(data);
+	}
+	pthread_cond_broadcast(&m_cond);
+	pthread_mutex_unlock(&m_mutex);
+	data.clear();
+	data.reserve(BUFFER_SIZE + BUFFER_SIZE / 4);
+}
+
+/** Compress a buffer. */
+void BufferedWriter::compress(const string& in, string& out) const
+{
+	out.clear();
+	switch (m_compression) {
+	  case NONE:
+		out = in;
+		break;
+	  case GZIP:
+		gzipCompress(in.data(), in.size(), out);
+		break;
+	  case BGZF:
+		bgzfCompress(in.data(), in.size(), out);
+		break;
+	}
+}
+
+void* BufferedWriter::workerThread(void* arg)
+{
+	static_cast<BufferedWriter*>(arg)->workerLoop();
+	return NULL;
+}
+
+void* BufferedWriter::ioThread(void* arg)
+{
+	static_cast<BufferedWriter*>(arg)->ioLoop();
+	return NULL;
+}
+
+/** Compress buffers in a worker thread. */
+void BufferedWriter::workerLoop()
+{
+	string in, out;
+	for (;;) {
+		pthread_mutex_lock(&m_mutex);
+		while (m_jobs.empty() && !m_closing)
+			pthread_cond_wait(&m_cond, &m_mutex);
+		if (m_jobs.empty()) {
+			pthread_mutex_unlock(&m_mutex);
+			break;
+		}
+		size_t index = m_jobs.front().first;
+		in.swap(m_jobs.front().second);
+		m_jobs.pop_front();
+		pthread_mutex_unlock(&m_mutex);
+
+		compress(in, out);
+
+		pthread_mutex_lock(&m_mutex);
+		m_ready[index].swap(out);
+		pthread_cond_broadcast(&m_cond);
+		pthread_mutex_unlock(&m_mutex);
+	}
+}
+
+/** Write the buffers in order in the I/O thread. */
+void BufferedWriter::ioLoop()
+{
+	string data;
+	for (;;) {
+		pthread_mutex_lock(&m_mutex);
+		map<size_t, string>::iterator it;
+		while ((it = m_ready.find(m_written)) == m_ready.end()
+				&& !(m_closing && m_written == m_submitted))
+			pthread_cond_wait(&m_cond, &m_mutex);
+		if (it == m_ready.end()) {
+			pthread_mutex_unlock(&m_mutex);
+			break;
+		}
+		data.swap(it->second);
+		m_ready.erase(it);
+		pthread_mutex_unlock(&m_mutex);
+
+		if (fwrite(data.data(), 1, data.size(), m_file) != data.size())
+			die();
+
+		pthread_mutex_lock(&m_mutex);
+		m_written++;
+		pthread_cond_broadcast(&m_cond);
+		pthread_mutex_unlock(&m_mutex);
+	}
+}
+
+void BufferedWriter::close(bool sync)
+{
+	if (!m_open)
+		return;
+
+	if (m_mate == NULL) {
+		for (unsigned i = 0; i < m_buffers.size(); ++i)
+			submit(m_buffers[i]->data);
+	} else {
+		// Hand over the buffers of a thread in both files together,
+		// and then separate the files.
+		BufferedWriter& first = m_second ? *m_mate : *this;
+		BufferedWriter& second = m_second ? *this : *m_mate;
+		pthread_mutex_lock(m_flushLock);
+		for (unsigned i = 0; i < first.m_buffers.size(); ++i) {
+			Buffer& b = *first.m_buffers[i];
+			first.submit(b.data);
+			for (unsigned j = 0; j < second.m_buffers.size(); ++j)
+				if (pthread_equal(second.m_buffers[j]->owner, b.owner))
+					second.submit(second.m_buffers[j]->data);
+		}
+		for (unsigned j = 0; j < second.m_buffers.size(); ++j)
+			second.submit(second.m_buffers[j]->data);
+		pthread_mutex_unlock(m_flushLock);
+		first.m_mate = second.m_mate = NULL;
+		second.m_second = false;
+		second.m_flushLock = &second.m_flushMutex;
+	}
+
+	pthread_mutex_lock(&m_mutex);
+	m_closing = true;
+	pthread_cond_broadcast(&m_cond);
+	pthread_mutex_unlock(&m_mutex);
+	for (unsigned i = 0; i < m_workers.size(); ++i)
+		pthread_join(m_workers[i], NULL);
+	pthread_join(m_io, NULL);
+	m_open = false;
+
+	if (m_compression == BGZF) {
+		string eof = bgzfEOF();
+		if (fwrite(eof.data(), 1, eof.size(), m_file) != eof.size())
+			die();
+	}
+	if (fflush(m_file) != 0)
+		die();
+	if (sync && fsync(fileno(m_file)) < 0)
+		die();
+	if (m_file != stdout && fclose(m_file) != 0)
+		die();
+	m_file = NULL;
+
+	for (unsigned i = 0; i < m_buffers.size(); ++i)
+		delete m_buffers[i];
+	m_buffers.clear();
+	m_current.clear();
+	pthread_cond_destroy(&m_cond);
+	pthread_mutex_destroy(&m_mutex);
+	pthread_mutex_destroy(&m_flushMutex);
+}
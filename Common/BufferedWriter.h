@@ -0,0 +1,205 @@
+#ifndef BUFFEREDWRITER_H
+#define BUFFEREDWRITER_H 1
+
+#include "Common/PerThread.h"
+#include "Common/StringUtil.h" // for endsWith
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <ostream>
+#include <pthread.h>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+/** A stream buffer that appends to a string. */
+class StringAppendBuf : public std::streambuf
+{
+  public:
+	explicit StringAppendBuf(std::string& s) : m_s(s) { }
+
+  protected:
+	int_type overflow(int_type c)
+	{
+		if (c != traits_type::eof())
+			m_s.push_back(traits_type::to_char_type(c));
+		return traits_type::not_eof(c);
+	}
+
+	std::streamsize xsputn(const char* s, std::streamsize n)
+	{
+		m_s.append(s, n);
+		return n;
+	}
+
+  private:
+	std::string& m_s;
+};
+
+/** Write a text file from several threads, and optionally compress
+ * it.
+ * Each thread appends its records to its own buffer. A full buffer is
+ * handed to the output stage, in which several threads compress the
+ * buffers in parallel, and a single I/O thread writes them to the
+ * file in the order that they were handed over. The records of one
+ * thread are written in order. The records of different threads are
+ * interleaved, but a record is never split.
+ * A file whose name ends in .gz is compressed with BGZF, which is
+ * compatible with gzip and may be decompressed in parallel.
+ */
+class BufferedWriter
+{
+  public:
+	enum Compression { NONE, GZIP, BGZF };
+
+	/** Return the compression implied by the name of a file. */
+	static Compression compressionOf(const std::string& path)
+	{
+		return endsWith(path, ".gz") ? BGZF : NONE;
+	}
+
+	/** Open a file, or the standard output if path is "-".
+	 * @param threads the number of compression threads, or 0 to use
+	 * all of the processors
+	 */
+	BufferedWriter(const std::string& path, Compression compression,
+			bool append = false, unsigned threads = 0)
+	{
+		init(path, compression, append, threads);
+	}
+
+	explicit BufferedWriter(const std::string& path,
+			bool append = false)
+	{
+		init(path, compressionOf(path), append, 0);
+	}
+
+	~BufferedWriter() { close(); }
+
+	/** Write one record. */
+	void write(const char* s, size_t n)
+	{
+		Buffer& b = buffer();
+		b.data.append(s, n);
+		endRecord(b);
+	}
+
+	void write(const std::string& s) { write(s.data(), s.size()); }
+
+	/** Format and write one record. This operator may not be chained,
+	 * because each call ends a record. Use stream to write a record in
+	 * several parts.
+	 */
+	template <typename T>
+	void operator<<(const T& x)
+	{
+		Buffer& b = buffer();
+		b.os << x;
+		endRecord(b);
+	}
+
+	/** Return the stream of the buffer of the calling thread, which
+	 * may be used to write a record in several parts. The record must
+	 * be ended by calling endRecord.
+	 */
+	std::ostream& stream() { return buffer().os; }
+
+	/** End the record written to stream. */
+	void endRecord() { endRecord(buffer()); }
+
+	/** Hand a chunk of whole records to the output stage, bypassing
+	 * the buffer of the calling thread. Chunks are written in the
+	 * order of the calls, which the caller serializes, such as to
+	 * write the chunks of an OrderedWriter. The chunk is cleared.
+	 */
+	void writeChunk(std::string& chunk) { submit(chunk); }
+
+	/** Keep this file in step with the specified file, such as the
+	 * first and second reads of read pairs. A thread writes a record
+	 * to this file and then a record to the mate. The buffers of a
+	 * thread in both files are output together, so that the records
+	 * of the two files are written in the same order. Call this
+	 * function before writing.
+	 */
+	void setMate(BufferedWriter& mate);
+
+	/** Write the buffers of all threads, and close the file. No other
+	 * thread may write while the file is closed.
+	 * @param sync synchronize the file to storage
+	 */
+	void close(bool sync = false);
+
+	const std::string& path() const { return m_path; }
+
+  private:
+	BufferedWriter(const BufferedWriter&);
+	BufferedWriter& operator=(const BufferedWriter&);
+
+	/** The buffer of one thread. */
+	struct Buffer
+	{
+		std::string data;
+		StringAppendBuf buf;
+		std::ostream os;
+		pthread_t owner;
+
+		Buffer() : buf(data), os(&buf), owner(pthread_self()) { }
+	};
+
+	void init(const std::string& path, Compression compression,
+			bool append, unsigned threads);
+	Buffer& buffer();
+	void endRecord(Buffer& b);
+	void submit(std::string& data);
+	void compress(const std::string& in, std::string& out) const;
+	void ioLoop();
+	void workerLoop();
+	static void* ioThread(void* arg);
+	static void* workerThread(void* arg);
+	void die();
+
+	std::string m_path;
+	FILE* m_file;
+	Compression m_compression;
+	bool m_open;
+
+	/** The buffer of the calling thread */
+	PerThread<Buffer*> m_current;
+
+	/** The buffers of all threads */
+	std::vector<Buffer*> m_buffers;
+
+	/** The file whose buffers are output with the buffers of this
+	 * file, or NULL */
+	BufferedWriter* m_mate;
+
+	/** Whether this file is the second file of a pair */
+	bool m_second;
+
+	/** Serialize handing buffers to the output stage. This lock is
+	 * shared with the mate. */
+	pthread_mutex_t m_flushMutex;
+	pthread_mutex_t* m_flushLock;
+
+	pthread_mutex_t m_mutex;
+	pthread_cond_t m_cond;
+	pthread_t m_io;
+	std::vector<pthread_t> m_workers;
+
+	/** Buffers waiting to be compressed */
+	std::deque<std::pair<size_t, std::string> > m_jobs;
+
+	/** Buffers waiting to be written */
+	std::map<size_t, std::string> m_ready;
+
+	/** Number of buffers handed to the output stage */
+	size_t m_submitted;
+
+	/** Number of buffers written */
+	size_t m_written;
+
+	/** Whether no more buffers will be handed over */
+	bool m_closing;
+};
+
+#endif
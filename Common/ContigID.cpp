@@ -1,5 +1,45 @@
 #include "ContigID.h"
+#include <cerrno>
+#include <cstdio> // for rename
+#include <cstring> // for strerror
+#include <sys/stat.h>
+
+using namespace std;
 
 Dictionary g_contigNames;
 
 unsigned g_nextContigName;
+
+/** Return the path of the dictionary of the contig names of the
+ * specified graph. */
+static string getContigNamesPath(const string& path)
+{
+	return path + ".names";
+}
+
+bool openContigNames(const string& path)
+{
+	if (!g_contigNames.empty() || path == "-")
+		return false;
+	string namesPath = getContigNamesPath(path);
+	struct stat st, namesSt;
+	if (stat(path.c_str(), &st) < 0
+			|| stat(namesPath.c_str(), &namesSt) < 0
+			|| namesSt.st_mtime < st.st_mtime)
+		return false;
+	return g_contigNames.open(namesPath);
+}
+
+void saveContigNames(const string& path)
+{
+	// The dictionary may be mapped from the file that is replaced, so
+	// write a new file rather than overwriting the mapped file.
+	string namesPath = getContigNamesPath(path);
+	string tmpPath = namesPath + ".tmp";
+	g_contigNames.save(tmpPath);
+	if (rename(tmpPath.c_str(), namesPath.c_str()) < 0) {
+		cerr << "error: `" << namesPath << "': "
+			<< strerror(errno) << endl;
+		exit(EXIT_FAILURE);
+	}
+}
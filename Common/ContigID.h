@@ -11,6 +11,17 @@
 /** The dictionary of contig names. */
 extern Dictionary g_contigNames;
 
+/** Map the dictionary of contig names from the file PATH.names, if
+ * it is at least as new as the graph PATH and no names are known.
+ * Reading the graph then checks its names against the dictionary
+ * rather than storing and hashing them.
+ * @return whether the dictionary was mapped
+ */
+bool openContigNames(const std::string& path);
+
+/** Write the dictionary of contig names to the file PATH.names. */
+void saveContigNames(const std::string& path);
+
 /** The next unique contig name. */
 extern unsigned g_nextContigName;
 
@@ -55,6 +66,16 @@ static inline std::string createContigName()
 	return ss.str();
 }
 
+/** Return whether the specified name is not in the dictionary of
+ * contig names. */
+struct IsNotContigName
+{
+	bool operator()(const std::string& name) const
+	{
+		return g_contigNames.count(name) == 0;
+	}
+};
+
 /** A contig index. */
 class ContigID
 {
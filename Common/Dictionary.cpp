@@ -0,0 +1,234 @@
+#include "Dictionary.h"
+#include "IOUtil.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <fstream>
+
+using namespace std;
+
+/** The size of a chunk of the arena of names */
+static const size_t CHUNK_SIZE = 64 * 1024;
+
+/** The header of a dictionary file. The file is followed by the
+ * hash table, padded to a multiple of eight bytes, the offsets of
+ * the names, and the null-terminated names. The integers are stored
+ * in the byte order of the machine that wrote the file.
+ */
+struct DictionaryHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t identity;
+	uint64_t size;
+	uint64_t tableSize;
+	uint64_t namesSize;
+};
+
+static const char DICTIONARY_MAGIC[8] = { 'A', 'B', 'y', 'S', 'S', 'D', 'i', 'c' };
+static const uint32_t DICTIONARY_VERSION = 1;
+
+const Dictionary::index_type Dictionary::NOT_FOUND;
+
+/** Return the size of the hash table padded to eight bytes. */
+static size_t paddedTableBytes(uint64_t tableSize)
+{
+	return (tableSize * sizeof (uint32_t) + 7) / 8 * 8;
+}
+
+Dictionary::Dictionary(const Dictionary& o)
+	: m_size(0), m_identity(true), m_locked(false),
+	m_mapped(false), m_file(NULL), m_mappedTable(NULL),
+	m_mappedOffsets(NULL), m_mappedNames(NULL),
+	m_tableSize(0), m_chunkNext(NULL), m_chunkFree(0)
+{
+	m_names.reserve(o.size());
+	for (index_type i = 0; i < o.size(); ++i) {
+		const char* s = o.getName(i);
+		append(s, strlen(s));
+	}
+	m_locked = o.m_locked;
+}
+
+Dictionary::~Dictionary()
+{
+	for (vector<char*>::const_iterator it = m_chunks.begin();
+			it != m_chunks.end(); ++it)
+		delete[] *it;
+	// The names of an unmapped dictionary may point into the file.
+	delete m_file;
+}
+
+/** Append the name of length n, which must not be present. */
+Dictionary::index_type Dictionary::append(const char* s, size_t n)
+{
+	assert(m_size < NOT_FOUND - 1);
+	if (m_mapped)
+		unmap();
+
+	if (n + 1 > m_chunkFree) {
+		size_t chunkSize = max(CHUNK_SIZE, n + 1);
+		m_chunks.push_back(new char[chunkSize]);
+		m_chunkNext = m_chunks.back();
+		m_chunkFree = chunkSize;
+	}
+	char* p = m_chunkNext;
+	memcpy(p, s, n);
+	p[n] = '\0';
+	m_chunkNext += n + 1;
+	m_chunkFree -= n + 1;
+	m_names.push_back(p);
+	index_type i = m_size++;
+
+	if (m_identity) {
+		index_type x;
+		if (parseIndex(s, n, x) && x == i)
+			return i;
+		m_identity = false;
+		buildTable(2 * m_size);
+	} else if (2 * m_size > m_tableSize)
+		buildTable(2 * m_tableSize);
+	else
+		insertTable(i);
+	return i;
+}
+
+/** Copy the mapped hash table and the names into memory, so that
+ * names may be added. The names themselves remain in the mapping. */
+void Dictionary::unmap()
+{
+	assert(m_mapped);
+	m_names.resize(m_size);
+	for (size_t i = 0; i < m_size; ++i)
+		m_names[i] = m_mappedNames + m_mappedOffsets[i];
+	if (!m_identity)
+		m_table.assign(m_mappedTable, m_mappedTable + m_tableSize);
+	m_mapped = false;
+	m_mappedTable = NULL;
+	m_mappedOffsets = NULL;
+	m_mappedNames = NULL;
+}
+
+/** Build a hash table of at least the specified size. */
+void Dictionary::buildTable(size_t tableSize)
+{
+	assert(!m_mapped);
+	size_t n = 16;
+	while (n < tableSize)
+		n *= 2;
+	m_tableSize = n;
+	m_table.assign(n, 0);
+	for (index_type i = 0; i < m_size; ++i)
+		insertTable(i);
+}
+
+/** Insert the specified index into the hash table. */
+void Dictionary::insertTable(index_type i)
+{
+	assert(!m_mapped);
+	const char* s = m_names[i];
+	size_t mask = m_tableSize - 1;
+	size_t j = hashmem(s, strlen(s)) & mask;
+	while (m_table[j] != 0)
+		j = (j + 1) & mask;
+	m_table[j] = i + 1;
+}
+
+void Dictionary::save(const string& path) const
+{
+	ofstream out(path.c_str(), ios::binary);
+	assert_good(out, path);
+
+	vector<uint64_t> offsets(m_size);
+	uint64_t namesSize = 0;
+	for (index_type i = 0; i < m_size; ++i) {
+		offsets[i] = namesSize;
+		namesSize += strlen(getName(i)) + 1;
+	}
+
+	DictionaryHeader header;
+	memcpy(header.magic, DICTIONARY_MAGIC, sizeof header.magic);
+	header.version = DICTIONARY_VERSION;
+	header.identity = m_identity;
+	header.size = m_size;
+	header.tableSize = m_identity ? 0 : m_tableSize;
+	header.namesSize = namesSize;
+	out.write(reinterpret_cast<const char*>(&header), sizeof header);
+
+	if (!m_identity) {
+		const uint32_t* table = m_mapped ? m_mappedTable : &m_table[0];
+		out.write(reinterpret_cast<const char*>(table),
+				m_tableSize * sizeof *table);
+		static const char pad[8] = { 0 };
+		out.write(pad, paddedTableBytes(m_tableSize)
+				- m_tableSize * sizeof *table);
+	}
+	if (m_size > 0)
+		out.write(reinterpret_cast<const char*>(&offsets[0]),
+				m_size * sizeof offsets[0]);
+	for (index_type i = 0; i < m_size; ++i) {
+		const char* s = getName(i);
+		out.write(s, strlen(s) + 1);
+	}
+	out.close();
+	assert_good(out, path);
+}
+
+bool Dictionary::open(const string& path)
+{
+	assert(empty());
+	assert(m_file == NULL);
+	m_file = new MappedFile(path, MappedFile::RANDOM);
+	const char* data = m_file->data();
+	size_t fileSize = m_file->size();
+
+	DictionaryHeader header;
+	if (fileSize < sizeof header) {
+		delete m_file;
+		m_file = NULL;
+		return false;
+	}
+	memcpy(&header, data, sizeof header);
+	size_t tableBytes = paddedTableBytes(header.tableSize);
+	bool valid = memcmp(header.magic, DICTIONARY_MAGIC,
+				sizeof header.magic) == 0
+		&& header.version == DICTIONARY_VERSION
+		&& header.size < NOT_FOUND
+		&& (header.identity
+				? header.tableSize == 0
+				: header.tableSize > header.size
+					&& (header.tableSize & (header.tableSize - 1)) == 0)
+		&& sizeof header + tableBytes + header.size * sizeof (uint64_t)
+			+ header.namesSize == fileSize
+		&& (header.size == 0 || (header.namesSize > 0
+				&& data[fileSize - 1] == '\0'));
+	if (!valid) {
+		delete m_file;
+		m_file = NULL;
+		return false;
+	}
+
+	// Reject a file whose table or offsets point outside the names.
+	const uint32_t* table = reinterpret_cast<const uint32_t*>(
+			data + sizeof header);
+	const uint64_t* offsets = reinterpret_cast<const uint64_t*>(
+			data + sizeof header + tableBytes);
+	for (size_t i = 0; valid && i < header.tableSize; ++i)
+		valid = table[i] <= header.size;
+	for (size_t i = 0; valid && i < header.size; ++i)
+		valid = offsets[i] < header.namesSize;
+	if (!valid) {
+		delete m_file;
+		m_file = NULL;
+		return false;
+	}
+
+	m_mapped = true;
+	m_size = header.size;
+	m_identity = header.identity;
+	m_tableSize = header.tableSize;
+	m_mappedTable = table;
+	m_mappedOffsets = offsets;
+	m_mappedNames = data + sizeof header + tableBytes
+		+ m_size * sizeof (uint64_t);
+	return true;
+}
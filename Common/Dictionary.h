@@ -2,14 +2,31 @@
 #define DICTIONARY_H 1
 
 #include "ConstString.h"
-#include "UnorderedMap.h"
+#include "HashFunction.h"
 #include <cassert>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <stdint.h>
 #include <string>
 #include <vector>
 
-/** A bidirectional map of indices and names. */
+class MappedFile;
+
+/**
+ * A bidirectional map of indices and names.
+ *
+ * The names are stored in an arena of large chunks, which are never
+ * reallocated, so that a name_reference remains valid for the
+ * lifetime of the dictionary. The names are indexed by an
+ * open-addressing hash table of indices. When each name is the
+ * decimal representation of its index, which is the usual case for
+ * contigs, the hash table is not built, and a name is looked up by
+ * parsing it.
+ *
+ * The dictionary may be saved to a file and later mapped into memory
+ * with open, which avoids parsing and hashing the names again.
+ */
 class Dictionary
 {
 	public:
@@ -18,25 +35,24 @@ class Dictionary
 		typedef std::string name_type;
 		typedef cstring name_reference;
 
-		typedef std::vector<const_string> Vector;
-		typedef unordered_map<name_reference, index_type,
-			hash<name_reference> > Map;
+		Dictionary()
+			: m_size(0), m_identity(true), m_locked(false),
+			m_mapped(false), m_file(NULL), m_mappedTable(NULL),
+			m_mappedOffsets(NULL), m_mappedNames(NULL),
+			m_tableSize(0), m_chunkNext(NULL), m_chunkFree(0) { }
 
-		Dictionary() : m_locked(false) { }
+		Dictionary(const Dictionary& o);
+		~Dictionary();
 
 		/** Insert the specified name. */
 		index_reference insert(const name_type& name)
 		{
-			m_vec.push_back(name);
-			std::pair<Map::const_iterator, bool> inserted
-				= m_map.insert(Map::value_type(
-							m_vec.back(), m_map.size()));
-			if (!inserted.second) {
+			if (find(name.data(), name.size()) != NOT_FOUND) {
 				std::cerr << "error: duplicate ID: `"
 					<< name << "'\n";
 				abort();
 			}
-			return inserted.first->second;
+			return append(name.data(), name.size());
 		}
 
 		/** If the specified index is within this dictionary, ensure
@@ -45,11 +61,17 @@ class Dictionary
 		 */
 		void put(index_type index, const name_type& name)
 		{
-			if (index < m_vec.size()) {
-				assert(getName(index) == name);
+			if (index < m_size) {
+				if (strcmp(getName(index), name.c_str()) != 0) {
+					// The names of a mapped dictionary come from
+					// another file, which may not match.
+					std::cerr << "error: ID mismatch: `" << name
+						<< "' and `" << getName(index) << "'\n";
+					exit(EXIT_FAILURE);
+				}
 			} else {
 				assert(!m_locked);
-				assert(index == m_vec.size());
+				assert(index == m_size);
 				index_type i = insert(name);
 				assert(i == index);
 				(void)i;
@@ -59,20 +81,22 @@ class Dictionary
 		/** Return the index of the specified name. */
 		index_reference getIndex(const name_type& name) const
 		{
-			Map::const_iterator it = m_map.find(name);
-			if (it == m_map.end()) {
+			index_type i = find(name.data(), name.size());
+			if (i == NOT_FOUND) {
 				std::cerr << "error: unexpected ID: `"
 					<< name << "'\n";
 				abort();
 			}
-			return it->second;
+			return i;
 		}
 
 		/** Return the name of the specified index. */
 		name_reference getName(index_type index) const
 		{
-			assert(index < m_vec.size());
-			return m_vec[index];
+			assert(index < m_size);
+			return m_mapped
+				? m_mappedNames + m_mappedOffsets[index]
+				: m_names[index];
 		}
 
 		/** Lock this dictionary. No further elements may be added. */
@@ -82,28 +106,119 @@ class Dictionary
 		void unlock() { m_locked = false; }
 
 		/** Return true if this dictionary is empty. */
-		bool empty() const { return m_vec.empty(); }
+		bool empty() const { return m_size == 0; }
 
 		/** Return the number of elements in this dictionary. */
-		size_t size() const { return m_vec.size(); }
+		size_t size() const { return m_size; }
 
 		/** Return the number of elements with the specified name. */
 		size_t count(const name_type& name) const
 		{
-			return m_map.count(name);
+			return find(name.data(), name.size()) != NOT_FOUND;
 		}
 
 		/** Return the last name in this dictionary. */
 		name_reference back() const
 		{
-			assert(!m_vec.empty());
-			return m_vec.back();
+			assert(m_size > 0);
+			return getName(m_size - 1);
 		}
 
+		/** Write this dictionary to the specified file. */
+		void save(const std::string& path) const;
+
+		/** Map a dictionary written by save into memory. This
+		 * dictionary must be empty.
+		 * @return false if the file is not a valid dictionary
+		 */
+		bool open(const std::string& path);
+
+		/** Return whether this dictionary is mapped from a file. */
+		bool isMapped() const { return m_mapped; }
+
 	private:
-		Map m_map;
-		Vector m_vec;
+		Dictionary& operator=(const Dictionary&);
+
+		static const index_type NOT_FOUND = ~0U;
+
+		/** Return whether the name of length n is the decimal
+		 * representation of an index of this dictionary and store
+		 * that index in i. */
+		bool parseIndex(const char* s, size_t n, index_type& i) const
+		{
+			if (n == 0 || n > 10 || (s[0] == '0' && n > 1))
+				return false;
+			uint64_t x = 0;
+			for (size_t j = 0; j < n; ++j) {
+				unsigned d = (unsigned char)s[j] - '0';
+				if (d > 9)
+					return false;
+				x = 10 * x + d;
+			}
+			i = x;
+			return x == i;
+		}
+
+		/** Return the slot of the hash table with index j. */
+		uint32_t slot(size_t j) const
+		{
+			return m_mapped ? m_mappedTable[j] : m_table[j];
+		}
+
+		/** Return the index of the name of length n, or NOT_FOUND. */
+		index_type find(const char* s, size_t n) const
+		{
+			if (m_identity) {
+				index_type i;
+				return parseIndex(s, n, i) && i < m_size
+					? i : NOT_FOUND;
+			}
+			assert(m_tableSize > 0);
+			size_t mask = m_tableSize - 1;
+			for (size_t j = hashmem(s, n) & mask;; j = (j + 1) & mask) {
+				uint32_t x = slot(j);
+				if (x == 0)
+					return NOT_FOUND;
+				const char* name = getName(x - 1);
+				if (strncmp(name, s, n) == 0 && name[n] == '\0')
+					return x - 1;
+			}
+		}
+
+		index_type append(const char* s, size_t n);
+		void unmap();
+		void buildTable(size_t tableSize);
+		void insertTable(index_type i);
+
+		/** The number of names */
+		size_t m_size;
+
+		/** Whether each name is the decimal representation of its
+		 * index, in which case the hash table is empty */
+		bool m_identity;
+
 		bool m_locked;
+
+		/** Whether the dictionary is mapped from m_file */
+		bool m_mapped;
+		MappedFile* m_file;
+		const uint32_t* m_mappedTable;
+		const uint64_t* m_mappedOffsets;
+		const char* m_mappedNames;
+
+		/** The hash table of indices plus one, where zero is empty */
+		std::vector<uint32_t> m_table;
+		size_t m_tableSize;
+
+		/** The names, which point into m_chunks or m_file */
+		std::vector<const char*> m_names;
+
+		/** The arena of null-terminated names */
+		std::vector<char*> m_chunks;
+
+		/** The free space of the last chunk */
+		char* m_chunkNext;
+		size_t m_chunkFree;
 };
 
 static inline Dictionary::name_reference get(
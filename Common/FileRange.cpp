@@ -0,0 +1,43 @@
+#include "FileRange.h"
+#include "Uncompress.h"
+#include <algorithm>
+#include <sys/stat.h>
+#include <vector>
+
+using namespace std;
+
+bool isSplittable(const string& path)
+{
+	if (path == "-" || isCompressed(path))
+		return false;
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+streamoff fileSize(const string& path)
+{
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+streamoff findLineStart(istream& in, streamoff offset)
+{
+	// Search backwards for the newline that precedes the line.
+	const streamoff BLOCK_SIZE = 4096;
+	vector<char> buf;
+	for (streamoff end = offset; end > 0;) {
+		streamoff begin = max((streamoff)0, end - BLOCK_SIZE);
+		buf.resize(end - begin);
+		in.clear();
+		in.seekg(begin);
+		in.read(&buf[0], buf.size());
+		if ((size_t)in.gcount() != buf.size())
+			break;
+		vector<char>::reverse_iterator it
+			= find(buf.rbegin(), buf.rend(), '\n');
+		if (it != buf.rend())
+			return begin + (buf.rend() - it);
+		end = begin;
+	}
+	return 0;
+}
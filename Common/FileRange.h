@@ -0,0 +1,176 @@
+#ifndef FILERANGE_H
+#define FILERANGE_H 1
+
+#include <algorithm>
+#include <cassert>
+#include <deque>
+#include <istream>
+#include <string>
+#include <vector>
+
+/**
+ * Split a text file into byte ranges, which separate streams read in
+ * parallel. A range starts at a record boundary, which is found by
+ * resynchronising on the lines that follow an arbitrary offset.
+ */
+
+/** Return whether the specified file may be split into byte ranges,
+ * which is a regular file that is not decompressed by a pipe.
+ */
+bool isSplittable(const std::string& path);
+
+/** Return the size of the specified file. */
+std::streamoff fileSize(const std::string& path);
+
+/** Return the offset of the start of the line that contains the
+ * character at the specified offset.
+ */
+std::streamoff findLineStart(std::istream& in, std::streamoff offset);
+
+/** Return the offset of the first record boundary at or after the
+ * specified offset, or the end of the file if there is none.
+ * A boundary is the start of a line. The predicate is given a window
+ * of lines: the line before the candidate line, which is empty at the
+ * start of the file, the candidate line and the lines that follow it,
+ * of which there are fewer than window - 1 near the end of the file.
+ */
+template <typename IsBoundary>
+std::streamoff findBoundary(std::istream& in, std::streamoff offset,
+		unsigned window, IsBoundary isBoundary)
+{
+	assert(window >= 2);
+	in.clear();
+	std::deque<std::string> lines;
+	std::deque<std::streamoff> starts;
+	std::streamoff pos;
+	if (offset <= 0) {
+		lines.push_back(std::string());
+		starts.push_back(0);
+		pos = 0;
+	} else
+		pos = findLineStart(in, offset - 1);
+	in.clear();
+	in.seekg(pos);
+
+	std::string line;
+	for (;;) {
+		while (lines.size() < window && getline(in, line)) {
+			lines.push_back(line);
+			starts.push_back(pos);
+			pos += line.size() + 1;
+		}
+		if (lines.size() < 2)
+			break;
+		if (isBoundary(lines))
+			return starts[1];
+		lines.pop_front();
+		starts.pop_front();
+	}
+	// There is no boundary before the end of the file.
+	in.clear();
+	in.seekg(0, std::ios::end);
+	return in.tellg();
+}
+
+/** Return the boundaries of n ranges of similar size of the byte
+ * range [begin, end) of a file. Range i is [b[i], b[i + 1]).
+ */
+template <typename IsBoundary>
+std::vector<std::streamoff> splitRange(std::istream& in,
+		std::streamoff begin, std::streamoff end, unsigned n,
+		unsigned window, IsBoundary isBoundary)
+{
+	assert(n > 0);
+	std::vector<std::streamoff> b;
+	b.reserve(n + 1);
+	b.push_back(begin);
+	for (unsigned i = 1; i < n; ++i) {
+		std::streamoff x = begin + (end - begin) * i / n;
+		x = std::max(x, b.back());
+		b.push_back(x >= end ? end
+				: std::min(end, findBoundary(in, x, window, isBoundary)));
+	}
+	b.push_back(end);
+	in.clear();
+	return b;
+}
+
+/** A FASTA record starts with `>'. */
+struct IsFastaBoundary
+{
+	static const unsigned WINDOW = 2;
+	bool operator()(const std::deque<std::string>& lines) const
+	{
+		return !lines[1].empty() && lines[1][0] == '>';
+	}
+};
+
+/** A FASTQ record is four lines. Its header starts with `@', and its
+ * third line with `+'. A quality line may also start with `@', but it
+ * is followed by a header and a sequence rather than by a `+' line.
+ */
+struct IsFastqBoundary
+{
+	static const unsigned WINDOW = 5;
+	bool operator()(const std::deque<std::string>& lines) const
+	{
+		if (lines.size() < 4)
+			return false;
+		return !lines[1].empty() && lines[1][0] == '@'
+			&& !lines[3].empty() && lines[3][0] == '+'
+			&& (lines.size() < 5 || lines[2].size() == lines[4].size());
+	}
+};
+
+/** Every line is a record, as in SAM, qseq and export files. */
+struct IsLineBoundary
+{
+	static const unsigned WINDOW = 2;
+	bool operator()(const std::deque<std::string>&) const
+	{
+		return true;
+	}
+};
+
+/**
+ * The alignments of a SAM file sorted by target start at a mapped line
+ * whose target differs from that of the last mapped line before it.
+ * Unmapped lines, whose target is `*', are skipped, because a sort by
+ * target may interleave them with the alignments of a target, such as
+ * `sort -snk3' does with the target `0'. The target that precedes the
+ * first window is unknown, so a boundary is found only after a mapped
+ * line has been seen.
+ */
+class IsSAMTargetBoundary
+{
+  public:
+	static const unsigned WINDOW = 2;
+
+	/** Return the RNAME field of a SAM record. */
+	static std::string rname(const std::string& line)
+	{
+		size_t i = line.find('\t');
+		i = i == std::string::npos ? i : line.find('\t', i + 1);
+		if (i == std::string::npos)
+			return std::string();
+		size_t j = line.find('\t', i + 1);
+		return line.substr(i + 1,
+				j == std::string::npos ? j : j - i - 1);
+	}
+
+	bool operator()(const std::deque<std::string>& lines)
+	{
+		std::string prev = rname(lines[0]);
+		if (!prev.empty() && prev != "*")
+			m_last = prev;
+		std::string cur = rname(lines[1]);
+		return !m_last.empty() && !cur.empty() && cur != "*"
+			&& cur != m_last;
+	}
+
+  private:
+	/** The target of the last mapped line */
+	std::string m_last;
+};
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef GZIP_H
+#define GZIP_H 1
+
+#include "config.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <stdint.h>
+#include <string>
+
+#if HAVE_ZLIB_H && HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+/** Return whether gzip compression is available. */
+static inline bool
+haveGzip()
+{
+#if HAVE_ZLIB_H && HAVE_LIBZ
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Compress a buffer as one gzip member and append it to `out'.
+ * The concatenation of gzip members is a valid gzip file, so that
+ * several threads may compress consecutive chunks of a file
+ * independently.
+ */
+static inline void
+gzipCompress(const char* data, size_t size, std::string& out, int level = 6)
+{
+#if HAVE_ZLIB_H && HAVE_LIBZ
+	z_stream z = z_stream();
+	// 16 + MAX_WBITS selects the gzip wrapper
+	int err = deflateInit2(&z, level, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+	assert(err == Z_OK);
+	size_t offset = out.size();
+	out.resize(offset + deflateBound(&z, size));
+	z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+	z.avail_in = size;
+	z.next_out = reinterpret_cast<Bytef*>(&out[offset]);
+	z.avail_out = out.size() - offset;
+	err = deflate(&z, Z_FINISH);
+	assert(err == Z_STREAM_END);
+	out.resize(offset + z.total_out);
+	deflateEnd(&z);
+	(void)err;
+#else
+	(void)data;
+	(void)size;
+	(void)out;
+	(void)level;
+	std::cerr << "error: gzip compression requires zlib, which was not "
+	             "found when ABySS was compiled\n";
+	exit(EXIT_FAILURE);
+#endif
+}
+
+/** Maximum size of the uncompressed data of a BGZF block */
+static const size_t BGZF_BLOCK_SIZE = 0xff00;
+
+/**
+ * Compress a buffer as BGZF blocks and append them to `out'. A BGZF
+ * block is a gzip member of at most 64 kB, whose size is stored in an
+ * extra field, so that the blocks may be decompressed in parallel.
+ */
+static inline void
+bgzfCompress(const char* data, size_t size, std::string& out, int level = 6)
+{
+#if HAVE_ZLIB_H && HAVE_LIBZ
+	static const unsigned char header[] = { 31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0 };
+	z_stream z = z_stream();
+	// negative window bits select raw deflate data
+	int err = deflateInit2(&z, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+	assert(err == Z_OK);
+	do {
+		size_t n = std::min(size, BGZF_BLOCK_SIZE);
+		size_t offset = out.size();
+		out.append(reinterpret_cast<const char*>(header), sizeof header);
+		out.resize(offset + sizeof header + 2 + deflateBound(&z, n) + 8);
+		deflateReset(&z);
+		z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+		z.avail_in = n;
+		z.next_out = reinterpret_cast<Bytef*>(&out[offset + sizeof header + 2]);
+		z.avail_out = out.size() - offset - sizeof header - 2 - 8;
+		err = deflate(&z, Z_FINISH);
+		assert(err == Z_STREAM_END);
+
+		size_t bsize = sizeof header + 2 + z.total_out + 8;
+		assert(bsize <= 0x10000);
+		uint32_t crc = crc32(crc32(0, NULL, 0), reinterpret_cast<const Bytef*>(data), n);
+		char* p = &out[offset + sizeof header];
+		p[0] = (bsize - 1) & 0xff;
+		p[1] = (bsize - 1) >> 8;
+		p += 2 + z.total_out;
+		for (unsigned i = 0; i < 4; ++i)
+			p[i] = crc >> (8 * i);
+		for (unsigned i = 0; i < 4; ++i)
+			p[4 + i] = n >> (8 * i);
+		out.resize(offset + bsize);
+		data += n;
+		size -= n;
+	} while (size > 0);
+	deflateEnd(&z);
+	(void)err;
+#else
+	(void)data;
+	(void)size;
+	(void)out;
+	(void)level;
+	std::cerr << "error: gzip compression requires zlib, which was not "
+	             "found when ABySS was compiled\n";
+	exit(EXIT_FAILURE);
+#endif
+}
+
+/** Return the empty BGZF block that marks the end of a BGZF file. */
+static inline std::string
+bgzfEOF()
+{
+	static const char eof[] = "\x1f\x8b\x08\x04\0\0\0\0\0\xff\x06\0BC\x02\0\x1b\0\x03\0\0\0\0\0\0\0\0\0";
+	return std::string(eof, sizeof eof - 1);
+}
+
+/** Compress a string as one gzip member. */
+static inline std::string
+gzipCompress(const std::string& s, int level = 6)
+{
+	std::string out;
+	gzipCompress(s.data(), s.size(), out, level);
+	return out;
+}
+
+#endif
@@ -0,0 +1,350 @@
+/** Decompress gzip and BGZF files in this process.
+ * The uncompress module decompresses a file by forking gunzip, which
+ * limits the throughput to that of one external process and a pipe.
+ */
+
+#include "GzipReader.h"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <stdint.h>
+#include <unistd.h>
+
+#if HAVE_ZLIB_H && HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+using namespace std;
+
+/** Size of a block read from the compressed file */
+static const size_t IN_SIZE = 1 << 20;
+
+/** Size of a decompressed chunk of a gzip file */
+static const size_t CHUNK_SIZE = 1 << 20;
+
+/** Maximum number of threads that decompress a BGZF file */
+static const unsigned MAX_WORKERS = 4;
+
+GzipReader::GzipReader(const char* path)
+	: m_path(path), m_fd(-1), m_bgzf(false),
+	m_in(IN_SIZE), m_inPos(0), m_inLen(0), m_chunkPos(0),
+	m_next(0), m_produced(0), m_done(false), m_stop(false)
+{
+#if HAVE_ZLIB_H && HAVE_LIBZ
+	// The mode 0 bypasses the open hook of the uncompress module.
+	m_fd = ::open(path, O_RDONLY, 0);
+	if (m_fd < 0)
+		die(strerror(errno));
+
+	// A BGZF block is a gzip member with a BC extra field.
+	if (fill(18)) {
+		const unsigned char* p
+			= reinterpret_cast<const unsigned char*>(&m_in[0]);
+		m_bgzf = p[0] == 31 && p[1] == 139 && p[2] == 8
+			&& (p[3] & 4) && p[12] == 'B' && p[13] == 'C';
+	}
+
+	pthread_mutex_init(&m_mutex, NULL);
+	pthread_cond_init(&m_cond, NULL);
+	if (m_bgzf) {
+		long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		unsigned n = max(1L, min((long)MAX_WORKERS, ncpu));
+		m_workers.resize(n);
+		for (unsigned i = 0; i < n; ++i)
+			pthread_create(&m_workers[i], NULL, workerThread, this);
+	}
+	pthread_create(&m_reader, NULL, readerThread, this);
+#else
+	die("decompression requires zlib, which was not found "
+			"when ABySS was compiled");
+#endif
+}
+
+GzipReader::~GzipReader()
+{
+	pthread_mutex_lock(&m_mutex);
+	m_stop = true;
+	pthread_cond_broadcast(&m_cond);
+	pthread_mutex_unlock(&m_mutex);
+	pthread_join(m_reader, NULL);
+	for (unsigned i = 0; i < m_workers.size(); ++i)
+		pthread_join(m_workers[i], NULL);
+	pthread_cond_destroy(&m_cond);
+	pthread_mutex_destroy(&m_mutex);
+	close(m_fd);
+}
+
+/** Print an error message and exit. */
+void GzipReader::die(const string& msg)
+{
+	cerr << "error: `" << m_path << "': " << msg << endl;
+	exit(EXIT_FAILURE);
+}
+
+/** Read the compressed file until at least n bytes are buffered.
+ * @return false at end-of-file
+ */
+bool GzipReader::fill(size_t n)
+{
+	if (m_inLen - m_inPos >= n)
+		return true;
+	memmove(&m_in[0], &m_in[m_inPos], m_inLen - m_inPos);
+	m_inLen -= m_inPos;
+	m_inPos = 0;
+	if (m_in.size() < n)
+		m_in.resize(n);
+	while (m_inLen < n) {
+		ssize_t k = ::read(m_fd, &m_in[m_inLen], m_in.size() - m_inLen);
+		if (k < 0 && errno == EINTR)
+			continue;
+		if (k < 0)
+			die(strerror(errno));
+		if (k == 0)
+			return false;
+		m_inLen += k;
+	}
+	return true;
+}
+
+/** Wait until the reader thread may produce another chunk.
+ * The mutex must be held.
+ * @return false if the threads should stop
+ */
+bool GzipReader::waitForRoom()
+{
+	// Bound the decompressed data held in memory.
+	size_t maxPending = m_bgzf ? 16 * MAX_WORKERS : 4;
+	while (!m_stop && m_produced - m_next >= maxPending)
+		pthread_cond_wait(&m_cond, &m_mutex);
+	return !m_stop;
+}
+
+/** Store a decompressed chunk to be read. */
+void GzipReader::push(size_t index, string& chunk)
+{
+	pthread_mutex_lock(&m_mutex);
+	m_ready[index].swap(chunk);
+	pthread_cond_broadcast(&m_cond);
+	pthread_mutex_unlock(&m_mutex);
+}
+
+void* GzipReader::readerThread(void* arg)
+{
+	GzipReader& o = *static_cast<GzipReader*>(arg);
+	if (o.m_bgzf)
+		o.splitBlocks();
+	else
+		o.inflateStream();
+	pthread_mutex_lock(&o.m_mutex);
+	o.m_done = true;
+	pthread_cond_broadcast(&o.m_cond);
+	pthread_mutex_unlock(&o.m_mutex);
+	return NULL;
+}
+
+void* GzipReader::workerThread(void* arg)
+{
+	static_cast<GzipReader*>(arg)->inflateBlocks();
+	return NULL;
+}
+
+#if HAVE_ZLIB_H && HAVE_LIBZ
+
+/** Decompress a gzip file, which may have several members, in the
+ * reader thread.
+ */
+void GzipReader::inflateStream()
+{
+	z_stream z = z_stream();
+	// 16 + MAX_WBITS selects the gzip wrapper
+	if (inflateInit2(&z, 16 + MAX_WBITS) != Z_OK)
+		die("inflateInit2 failed");
+
+	string out(CHUNK_SIZE, '\0');
+	size_t outLen = 0;
+	bool member = true;
+	for (;;) {
+		if (m_inPos == m_inLen && !fill(1)) {
+			if (member)
+				die("unexpected end of file");
+			break;
+		}
+		if (!member) {
+			// Decompress the next member, and ignore trailing garbage.
+			if (!fill(2) || (unsigned char)m_in[m_inPos] != 31
+					|| (unsigned char)m_in[m_inPos + 1] != 139)
+				break;
+			inflateReset(&z);
+			member = true;
+		}
+
+		z.next_in = reinterpret_cast<Bytef*>(&m_in[m_inPos]);
+		z.avail_in = m_inLen - m_inPos;
+		z.next_out = reinterpret_cast<Bytef*>(&out[outLen]);
+		z.avail_out = out.size() - outLen;
+		int err = inflate(&z, Z_NO_FLUSH);
+		m_inPos = m_inLen - z.avail_in;
+		outLen = out.size() - z.avail_out;
+		if (err == Z_STREAM_END)
+			member = false;
+		else if (err != Z_OK && err != Z_BUF_ERROR)
+			die(z.msg != NULL ? z.msg : "invalid compressed data");
+
+		if (outLen == out.size()) {
+			pthread_mutex_lock(&m_mutex);
+			bool room = waitForRoom();
+			size_t index = m_produced++;
+			pthread_mutex_unlock(&m_mutex);
+			if (!room)
+				break;
+			push(index, out);
+			out.assign(CHUNK_SIZE, '\0');
+			outLen = 0;
+		}
+	}
+	inflateEnd(&z);
+
+	if (outLen > 0) {
+		out.resize(outLen);
+		pthread_mutex_lock(&m_mutex);
+		bool room = waitForRoom();
+		size_t index = m_produced++;
+		pthread_mutex_unlock(&m_mutex);
+		if (room)
+			push(index, out);
+	}
+}
+
+/** Split a BGZF file into blocks in the reader thread. */
+void GzipReader::splitBlocks()
+{
+	for (;;) {
+		if (!fill(18)) {
+			if (m_inPos != m_inLen)
+				die("truncated BGZF block");
+			break;
+		}
+		const unsigned char* p
+			= reinterpret_cast<const unsigned char*>(&m_in[m_inPos]);
+		if (p[0] != 31 || p[1] != 139 || p[2] != 8
+				|| !(p[3] & 4) || p[12] != 'B' || p[13] != 'C')
+			die("invalid BGZF block");
+		size_t size = (p[16] | p[17] << 8) + 1;
+		if (!fill(size))
+			die("truncated BGZF block");
+		string block(&m_in[m_inPos], size);
+		m_inPos += size;
+
+		pthread_mutex_lock(&m_mutex);
+		if (!waitForRoom()) {
+			pthread_mutex_unlock(&m_mutex);
+			break;
+		}
+		m_jobs.push_back(make_pair(m_produced++, string()));
+		m_jobs.back().second.swap(block);
+		pthread_cond_broadcast(&m_cond);
+		pthread_mutex_unlock(&m_mutex);
+	}
+}
+
+/** Return the little-endian 32-bit integer at p. */
+static uint32_t getLE32(const unsigned char* p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/** Decompress BGZF blocks in a worker thread. */
+void GzipReader::inflateBlocks()
+{
+	z_stream z = z_stream();
+	// Negative window bits select raw deflate data.
+	if (inflateInit2(&z, -MAX_WBITS) != Z_OK)
+		die("inflateInit2 failed");
+
+	string block, out;
+	for (;;) {
+		pthread_mutex_lock(&m_mutex);
+		while (!m_stop && m_jobs.empty() && !m_done)
+			pthread_cond_wait(&m_cond, &m_mutex);
+		if (m_stop || m_jobs.empty()) {
+			pthread_mutex_unlock(&m_mutex);
+			break;
+		}
+		size_t index = m_jobs.front().first;
+		block.swap(m_jobs.front().second);
+		m_jobs.pop_front();
+		pthread_mutex_unlock(&m_mutex);
+
+		const unsigned char* p
+			= reinterpret_cast<const unsigned char*>(block.data());
+		size_t header = 12 + (p[10] | p[11] << 8);
+		if (block.size() < header + 8)
+			die("invalid BGZF block");
+		uint32_t crc = getLE32(p + block.size() - 8);
+		uint32_t size = getLE32(p + block.size() - 4);
+		out.resize(size);
+
+		inflateReset(&z);
+		z.next_in = const_cast<Bytef*>(p + header);
+		z.avail_in = block.size() - header - 8;
+		z.next_out = reinterpret_cast<Bytef*>(&out[0]);
+		z.avail_out = size;
+		if (inflate(&z, Z_FINISH) != Z_STREAM_END || z.avail_out != 0)
+			die(z.msg != NULL ? z.msg : "invalid BGZF block");
+		if (crc32(crc32(0, NULL, 0),
+					reinterpret_cast<const Bytef*>(out.data()),
+					size) != crc)
+			die("CRC error in BGZF block");
+		push(index, out);
+	}
+	inflateEnd(&z);
+}
+
+#else
+
+void GzipReader::inflateStream() { }
+void GzipReader::splitBlocks() { }
+void GzipReader::inflateBlocks() { }
+
+#endif
+
+/** Wait for the next decompressed chunk.
+ * @return false at end-of-file
+ */
+bool GzipReader::nextChunk()
+{
+	pthread_mutex_lock(&m_mutex);
+	map<size_t, string>::iterator it;
+	while ((it = m_ready.find(m_next)) == m_ready.end()
+			&& !(m_done && m_next == m_produced))
+		pthread_cond_wait(&m_cond, &m_mutex);
+	bool found = it != m_ready.end();
+	if (found) {
+		m_chunk.swap(it->second);
+		m_ready.erase(it);
+		m_next++;
+		pthread_cond_broadcast(&m_cond);
+	} else
+		m_chunk.clear();
+	pthread_mutex_unlock(&m_mutex);
+	m_chunkPos = 0;
+	return found;
+}
+
+size_t GzipReader::read(char* buf, size_t n)
+{
+	size_t total = 0;
+	while (total < n) {
+		if (m_chunkPos == m_chunk.size() && !nextChunk())
+			break;
+		size_t k = min(n - total, m_chunk.size() - m_chunkPos);
+		memcpy(buf + total, m_chunk.data() + m_chunkPos, k);
+		m_chunkPos += k;
+		total += k;
+	}
+	return total;
+}
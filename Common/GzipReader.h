@@ -0,0 +1,101 @@
+#ifndef GZIPREADER_H
+#define GZIPREADER_H 1
+
+#include "config.h"
+#include "Common/StringUtil.h" // for endsWith
+#include <deque>
+#include <map>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+/** Return whether the specified file may be decompressed by
+ * GzipReader rather than by a gunzip pipe.
+ */
+static inline bool canReadGzip(const std::string& path)
+{
+#if HAVE_ZLIB_H && HAVE_LIBZ
+	return endsWith(path, ".gz") && !endsWith(path, ".tar.gz")
+		&& !startsWith(path, "http://")
+		&& !startsWith(path, "https://")
+		&& !startsWith(path, "ftp://");
+#else
+	(void)path;
+	return false;
+#endif
+}
+
+/** Decompress a gzip file in this process.
+ * A BGZF file, which is a series of independent gzip blocks of at
+ * most 64 kB, is decompressed by several threads in parallel. Any
+ * other gzip file is decompressed by a helper thread, which runs
+ * ahead of the reader.
+ * An error in the compressed data is fatal.
+ */
+class GzipReader
+{
+  public:
+	/** Open the specified file, and start decompressing it. */
+	explicit GzipReader(const char* path);
+	~GzipReader();
+
+	/** Read up to n bytes into buf.
+	 * @return the number of bytes read, which is 0 at end-of-file
+	 */
+	size_t read(char* buf, size_t n);
+
+	/** Return whether the file is BGZF. */
+	bool isBGZF() const { return m_bgzf; }
+
+  private:
+	GzipReader(const GzipReader&);
+	GzipReader& operator=(const GzipReader&);
+
+	static void* readerThread(void* arg);
+	static void* workerThread(void* arg);
+	void inflateStream();
+	void splitBlocks();
+	void inflateBlocks();
+	bool fill(size_t n);
+	bool waitForRoom();
+	void push(size_t index, std::string& chunk);
+	bool nextChunk();
+	void die(const std::string& msg);
+
+	std::string m_path;
+	int m_fd;
+	bool m_bgzf;
+
+	/** Compressed input, which is used by the reader thread. */
+	std::vector<char> m_in;
+	size_t m_inPos, m_inLen;
+
+	/** The chunk being read. */
+	std::string m_chunk;
+	size_t m_chunkPos;
+
+	pthread_mutex_t m_mutex;
+	pthread_cond_t m_cond;
+	pthread_t m_reader;
+	std::vector<pthread_t> m_workers;
+
+	/** BGZF blocks waiting to be decompressed. */
+	std::deque<std::pair<size_t, std::string> > m_jobs;
+
+	/** Decompressed chunks waiting to be read. */
+	std::map<size_t, std::string> m_ready;
+
+	/** Index of the next chunk to be read. */
+	size_t m_next;
+
+	/** Number of chunks produced by the reader thread. */
+	size_t m_produced;
+
+	/** Whether the reader thread has reached end-of-file. */
+	bool m_done;
+
+	/** Whether the threads should stop. */
+	bool m_stop;
+};
+
+#endif
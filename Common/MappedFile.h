@@ -0,0 +1,122 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H 1
+
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring> // for strerror
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * A read-only memory mapping of a file.
+ * Pages are loaded lazily by the kernel and shared between processes
+ * that map the same file.
+ */
+class MappedFile
+{
+  public:
+	/** Access pattern hints passed to madvise. */
+	enum Advice
+	{
+		NORMAL = MADV_NORMAL,
+		SEQUENTIAL = MADV_SEQUENTIAL,
+		RANDOM = MADV_RANDOM,
+		WILLNEED = MADV_WILLNEED,
+		DONTNEED = MADV_DONTNEED
+	};
+
+	MappedFile()
+	  : m_data(NULL)
+	  , m_size(0)
+	{}
+
+	/** Map the specified file. Exit with an error message on failure. */
+	explicit MappedFile(const std::string& path, Advice advice = NORMAL)
+	  : m_data(NULL)
+	  , m_size(0)
+	{
+		open(path, advice);
+	}
+
+	~MappedFile() { close(); }
+
+	/** Map the specified file. Exit with an error message on failure. */
+	void open(const std::string& path, Advice advice = NORMAL)
+	{
+		close();
+		m_path = path;
+		// Pass a mode so that the open hook of Uncompress.cpp does
+		// not replace the file with a decompression pipe.
+		int fd = ::open(path.c_str(), O_RDONLY, 0);
+		if (fd < 0)
+			die();
+		struct stat st;
+		if (fstat(fd, &st) < 0)
+			die();
+		m_size = st.st_size;
+		if (m_size > 0) {
+			void* p = mmap(NULL, m_size, PROT_READ, MAP_SHARED, fd, 0);
+			if (p == MAP_FAILED)
+				die();
+			m_data = static_cast<const char*>(p);
+			advise(advice);
+		}
+		::close(fd);
+	}
+
+	/** Unmap the file. */
+	void close()
+	{
+		if (m_data != NULL)
+			munmap(const_cast<char*>(m_data), m_size);
+		m_data = NULL;
+		m_size = 0;
+	}
+
+	/** Give the kernel a hint about the access pattern. */
+	void advise(Advice advice) const
+	{
+		if (m_data != NULL)
+			madvise(const_cast<char*>(m_data), m_size, advice);
+	}
+
+	/** Give the kernel a hint about the access pattern of a range. */
+	void advise(size_t offset, size_t length, Advice advice) const
+	{
+		assert(offset + length <= m_size);
+		if (m_data == NULL || length == 0)
+			return;
+		size_t page = getpagesize();
+		size_t start = offset / page * page;
+		madvise(const_cast<char*>(m_data) + start, offset + length - start, advice);
+	}
+
+	bool isOpen() const { return m_data != NULL; }
+	const char* data() const { return m_data; }
+	size_t size() const { return m_size; }
+	const std::string& path() const { return m_path; }
+
+	const char* begin() const { return m_data; }
+	const char* end() const { return m_data + m_size; }
+
+  private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	__attribute__((noreturn)) void die() const
+	{
+		std::cerr << "error: `" << m_path << "': " << strerror(errno) << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	std::string m_path;
+	const char* m_data;
+	size_t m_size;
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef ORDEREDWRITER_H
+#define ORDEREDWRITER_H 1
+
+#include <cassert>
+#include <map>
+#include <ostream>
+#include <string>
+
+/**
+ * Write numbered chunks of output in order. Parallel workers finish
+ * their chunks out of order; a chunk that arrives early is held until
+ * all of the chunks before it have been written.
+ * This class is not thread safe. Callers serialize calls to write.
+ */
+class OrderedWriter
+{
+  public:
+	explicit OrderedWriter(std::ostream& out)
+	  : m_out(out)
+	  , m_next(0)
+	{}
+
+	/**
+	 * Write the chunk with the specified index, and any held chunks
+	 * that follow it. The chunk is swapped out of `chunk'.
+	 */
+	void write(size_t index, std::string& chunk)
+	{
+		assert(index >= m_next);
+		if (index != m_next) {
+			assert(m_pending.count(index) == 0);
+			m_pending[index].swap(chunk);
+			return;
+		}
+		m_out << chunk;
+		chunk.clear();
+		for (++m_next; !m_pending.empty() && m_pending.begin()->first == m_next; ++m_next) {
+			m_out << m_pending.begin()->second;
+			m_pending.erase(m_pending.begin());
+		}
+	}
+
+	/** Return the index of the next chunk to write. */
+	size_t next() const { return m_next; }
+
+	/** Return the number of chunks held. */
+	size_t pending() const { return m_pending.size(); }
+
+  private:
+	std::ostream& m_out;
+	size_t m_next;
+	std::map<size_t, std::string> m_pending;
+};
+
+#endif
@@ -0,0 +1,45 @@
+#include "PerThread.h"
+
+/** The number of objects whose data each thread caches */
+static const unsigned CACHE_SIZE = 8;
+
+namespace {
+struct Slot
+{
+	uint64_t serial;
+	void* p;
+};
+}
+
+/** The cache of the calling thread. A serial number of 0 is unused. */
+static __thread Slot t_cache[CACHE_SIZE];
+
+/** The next slot of the cache to replace */
+static __thread unsigned t_next;
+
+static pthread_mutex_t g_serialMutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t g_serial;
+
+uint64_t PerThreadCache::newSerial()
+{
+	pthread_mutex_lock(&g_serialMutex);
+	uint64_t serial = ++g_serial;
+	pthread_mutex_unlock(&g_serialMutex);
+	return serial;
+}
+
+void* PerThreadCache::lookup(uint64_t serial)
+{
+	for (unsigned i = 0; i < CACHE_SIZE; ++i)
+		if (t_cache[i].serial == serial)
+			return t_cache[i].p;
+	return NULL;
+}
+
+void PerThreadCache::insert(uint64_t serial, void* p)
+{
+	Slot& slot = t_cache[t_next];
+	t_next = (t_next + 1) % CACHE_SIZE;
+	slot.serial = serial;
+	slot.p = p;
+}
@@ -0,0 +1,100 @@
+#ifndef PERTHREAD_H
+#define PERTHREAD_H 1
+
+#include <pthread.h>
+#include <stdint.h>
+#include <vector>
+
+/** The cache of the per-thread data of the calling thread. */
+namespace PerThreadCache {
+	/** Return a serial number that is never reused. */
+	uint64_t newSerial();
+
+	/** Return the cached data of the calling thread for the specified
+	 * object, or NULL. */
+	void* lookup(uint64_t serial);
+
+	/** Cache the data of the calling thread for the specified object. */
+	void insert(uint64_t serial, void* p);
+}
+
+/**
+ * Data of an object that is private to each thread that uses it, such
+ * as an output buffer. The data of a thread is created when the thread
+ * first uses it, and is destroyed with this object.
+ * Unlike a pthread key, the serial number that identifies this object
+ * is never reused, so that a thread cannot see the stale data of a
+ * destroyed object.
+ */
+template <typename T>
+class PerThread
+{
+  public:
+	PerThread() : m_serial(PerThreadCache::newSerial())
+	{
+		pthread_mutex_init(&m_mutex, NULL);
+	}
+
+	~PerThread()
+	{
+		clear();
+		pthread_mutex_destroy(&m_mutex);
+	}
+
+	/** Return the data of the calling thread. */
+	T& get()
+	{
+		void* p = PerThreadCache::lookup(m_serial);
+		if (p != NULL)
+			return *static_cast<T*>(p);
+		return slowGet();
+	}
+
+	/** Return the data of all the threads. No other thread may use
+	 * this object while the vector is in use. */
+	const std::vector<T*>& all() const { return m_data; }
+
+	/** Destroy the data of all the threads. */
+	void clear()
+	{
+		for (size_t i = 0; i < m_data.size(); ++i)
+			delete m_data[i];
+		m_data.clear();
+		m_owners.clear();
+		// Invalidate the data cached by the threads.
+		m_serial = PerThreadCache::newSerial();
+	}
+
+  private:
+	PerThread(const PerThread&);
+	PerThread& operator=(const PerThread&);
+
+	/** Find or create the data of the calling thread. */
+	T& slowGet()
+	{
+		pthread_t self = pthread_self();
+		T* p = NULL;
+		pthread_mutex_lock(&m_mutex);
+		for (size_t i = 0; i < m_owners.size(); ++i) {
+			if (pthread_equal(m_owners[i], self)) {
+				p = m_data[i];
+				break;
+			}
+		}
+		if (p == NULL) {
+			p = new T();
+			m_data.push_back(p);
+			m_owners.push_back(self);
+		}
+		pthread_mutex_unlock(&m_mutex);
+		PerThreadCache::insert(m_serial, p);
+		return *p;
+	}
+
+	uint64_t m_serial;
+	pthread_mutex_t m_mutex;
+	std::vector<T*> m_data;
+	std::vector<pthread_t> m_owners;
+};
+
+#endif
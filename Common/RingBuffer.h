@@ -0,0 +1,348 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H 1
+
+#include <algorithm> // for swap
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <utility> // for swap
+#include <vector>
+
+/** The size of a cache line. The indices that are written by
+ * different threads are padded to separate cache lines. */
+static const size_t RING_CACHE_LINE = 64;
+
+/** Return the smallest power of two not less than n. */
+static inline size_t ringCapacity(size_t n)
+{
+	size_t capacity = 2;
+	while (capacity < n)
+		capacity <<= 1;
+	return capacity;
+}
+
+/**
+ * A bounded lock-free queue of one producer and one consumer. An
+ * element is swapped into and out of its slot, so that the storage of
+ * a chunk of records, such as a vector or a string, circulates between
+ * the producer and the consumer and is reused.
+ */
+template <typename T>
+class SPSCRing
+{
+  public:
+	explicit SPSCRing(size_t capacity)
+		: m_slots(ringCapacity(capacity)), m_mask(m_slots.size() - 1),
+		m_head(0), m_tail(0) { }
+
+	/** Swap x into the tail of the queue.
+	 * @return false if the queue is full
+	 */
+	bool tryPush(T& x)
+	{
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail - m_head.load(std::memory_order_acquire)
+				== m_slots.size())
+			return false;
+		using std::swap;
+		swap(m_slots[tail & m_mask], x);
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** Swap the head of the queue into x.
+	 * @return false if the queue is empty
+	 */
+	bool tryPop(T& x)
+	{
+		size_t head = m_head.load(std::memory_order_relaxed);
+		if (m_tail.load(std::memory_order_acquire) == head)
+			return false;
+		using std::swap;
+		swap(x, m_slots[head & m_mask]);
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** Return the number of slots. */
+	size_t capacity() const { return m_slots.size(); }
+
+  private:
+	SPSCRing(const SPSCRing&);
+	SPSCRing& operator=(const SPSCRing&);
+
+	std::vector<T> m_slots;
+	size_t m_mask;
+	char m_pad0[RING_CACHE_LINE];
+
+	/** The index of the next element to pop, written by the consumer */
+	std::atomic<size_t> m_head;
+	char m_pad1[RING_CACHE_LINE];
+
+	/** The index of the next element to push, written by the producer */
+	std::atomic<size_t> m_tail;
+	char m_pad2[RING_CACHE_LINE];
+};
+
+/**
+ * A bounded lock-free queue of any number of producers and consumers.
+ * Each slot has a sequence number, which tells whether the slot is
+ * ready to be written or read at a given position. A thread claims a
+ * position by a compare-and-swap of the head or the tail, and then owns
+ * its slot until it publishes the new sequence number.
+ * See Dmitry Vyukov, Bounded MPMC queue, 1024cores.net.
+ */
+template <typename T>
+class MPMCRing
+{
+  public:
+	explicit MPMCRing(size_t capacity)
+		: m_slots(ringCapacity(capacity)), m_mask(m_slots.size() - 1),
+		m_head(0), m_tail(0)
+	{
+		for (size_t i = 0; i < m_slots.size(); ++i)
+			m_slots[i].seq.store(i, std::memory_order_relaxed);
+	}
+
+	/** Swap x into the tail of the queue.
+	 * @return false if the queue is full
+	 */
+	bool tryPush(T& x)
+	{
+		size_t pos = m_tail.load(std::memory_order_relaxed);
+		Slot* slot;
+		for (;;) {
+			slot = &m_slots[pos & m_mask];
+			size_t seq = slot->seq.load(std::memory_order_acquire);
+			ptrdiff_t diff = (ptrdiff_t)(seq - pos);
+			if (diff == 0) {
+				if (m_tail.compare_exchange_weak(pos, pos + 1,
+							std::memory_order_relaxed))
+					break;
+			} else if (diff < 0)
+				return false;
+			else
+				pos = m_tail.load(std::memory_order_relaxed);
+		}
+		using std::swap;
+		swap(slot->data, x);
+		slot->seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** Swap the head of the queue into x.
+	 * @return false if the queue is empty
+	 */
+	bool tryPop(T& x)
+	{
+		size_t pos = m_head.load(std::memory_order_relaxed);
+		Slot* slot;
+		for (;;) {
+			slot = &m_slots[pos & m_mask];
+			size_t seq = slot->seq.load(std::memory_order_acquire);
+			ptrdiff_t diff = (ptrdiff_t)(seq - (pos + 1));
+			if (diff == 0) {
+				if (m_head.compare_exchange_weak(pos, pos + 1,
+							std::memory_order_relaxed))
+					break;
+			} else if (diff < 0)
+				return false;
+			else
+				pos = m_head.load(std::memory_order_relaxed);
+		}
+		using std::swap;
+		swap(x, slot->data);
+		slot->seq.store(pos + m_mask + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** Return the number of slots. */
+	size_t capacity() const { return m_slots.size(); }
+
+  private:
+	MPMCRing(const MPMCRing&);
+	MPMCRing& operator=(const MPMCRing&);
+
+	struct Slot
+	{
+		std::atomic<size_t> seq;
+		T data;
+
+		Slot() : seq(0) { }
+		Slot(const Slot& o) : seq(o.seq.load()), data(o.data) { }
+	};
+
+	std::vector<Slot> m_slots;
+	size_t m_mask;
+	char m_pad0[RING_CACHE_LINE];
+
+	/** The position of the next element to pop */
+	std::atomic<size_t> m_head;
+	char m_pad1[RING_CACHE_LINE];
+
+	/** The position of the next element to push */
+	std::atomic<size_t> m_tail;
+	char m_pad2[RING_CACHE_LINE];
+};
+
+/**
+ * Threads that wait for a lock-free queue to become ready. A waiting
+ * thread yields a few times, and then sleeps on a condition variable.
+ * The mutex is only used when a thread sleeps, so a thread that does
+ * not need to wait never locks it.
+ */
+class RingWaiter
+{
+  public:
+	RingWaiter() : m_sleepers(0)
+	{
+		pthread_mutex_init(&m_mutex, NULL);
+		pthread_cond_init(&m_cond, NULL);
+	}
+
+	~RingWaiter()
+	{
+		pthread_cond_destroy(&m_cond);
+		pthread_mutex_destroy(&m_mutex);
+	}
+
+	/** Wait until ready() returns true. */
+	template <typename Ready>
+	void wait(Ready ready)
+	{
+		for (unsigned i = 0; i < SPINS; ++i) {
+			if (ready())
+				return;
+			sched_yield();
+		}
+		pthread_mutex_lock(&m_mutex);
+		m_sleepers.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		while (!ready())
+			pthread_cond_wait(&m_cond, &m_mutex);
+		m_sleepers.fetch_sub(1);
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+	/** Wake the sleeping threads, if any. The caller has made ready()
+	 * true for them. */
+	void notify()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_sleepers.load(std::memory_order_relaxed) == 0)
+			return;
+		pthread_mutex_lock(&m_mutex);
+		pthread_cond_broadcast(&m_cond);
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+  private:
+	RingWaiter(const RingWaiter&);
+	RingWaiter& operator=(const RingWaiter&);
+
+	/** The number of times to yield before sleeping */
+	static const unsigned SPINS = 16;
+
+	std::atomic<unsigned> m_sleepers;
+	pthread_mutex_t m_mutex;
+	pthread_cond_t m_cond;
+};
+
+/**
+ * A bounded queue of chunks between the stages of a pipeline, such as
+ * a reader, parallel workers and a writer. Each element is a chunk of
+ * records, such as a vector of reads or a string of output, so that
+ * the threads synchronize once per chunk rather than once per record.
+ * Push and pop are lock free while the queue is neither full nor
+ * empty, and otherwise wait for it.
+ * The producers close the queue when they are done. The consumers
+ * then pop the remaining chunks.
+ * @param Ring the lock-free queue, SPSCRing for one producer and one
+ * consumer or MPMCRing for any number of each
+ */
+template <typename T, template <typename> class Ring = MPMCRing>
+class RingBuffer
+{
+  public:
+	explicit RingBuffer(size_t capacity)
+		: m_ring(capacity), m_closed(false) { }
+
+	/** Swap x into the queue, waiting while it is full. */
+	void push(T& x)
+	{
+		assert(!m_closed.load(std::memory_order_relaxed));
+		if (!m_ring.tryPush(x))
+			m_notFull.wait([&]() -> bool {
+				return m_ring.tryPush(x);
+			});
+		m_notEmpty.notify();
+	}
+
+	/** Swap the next element into x, waiting while the queue is empty.
+	 * @return false if the queue is empty and closed
+	 */
+	bool pop(T& x)
+	{
+		bool popped = m_ring.tryPop(x);
+		if (!popped) {
+			m_notEmpty.wait([&]() -> bool {
+				if (m_ring.tryPop(x))
+					return popped = true;
+				if (!m_closed.load(std::memory_order_acquire))
+					return false;
+				// Every push precedes the close.
+				popped = m_ring.tryPop(x);
+				return true;
+			});
+		}
+		if (popped)
+			m_notFull.notify();
+		return popped;
+	}
+
+	/** Swap x into the queue if it is not full. */
+	bool tryPush(T& x)
+	{
+		if (!m_ring.tryPush(x))
+			return false;
+		m_notEmpty.notify();
+		return true;
+	}
+
+	/** Swap the next element into x if the queue is not empty. */
+	bool tryPop(T& x)
+	{
+		if (!m_ring.tryPop(x))
+			return false;
+		m_notFull.notify();
+		return true;
+	}
+
+	/** Signal that no more elements will be pushed. */
+	void close()
+	{
+		m_closed.store(true, std::memory_order_release);
+		m_notEmpty.notify();
+	}
+
+	/** Return the number of slots. */
+	size_t capacity() const { return m_ring.capacity(); }
+
+  private:
+	RingBuffer(const RingBuffer&);
+	RingBuffer& operator=(const RingBuffer&);
+
+	Ring<T> m_ring;
+	std::atomic<bool> m_closed;
+
+	/** The consumers waiting for an element */
+	RingWaiter m_notEmpty;
+
+	/** The producers waiting for a free slot */
+	RingWaiter m_notFull;
+};
+
+#endif
@@ -5,12 +5,15 @@
 #include "IOUtil.h"
 #include "Alignment.h"
 #include "ContigID.h" // for g_contigNames
+#include "StringUtil.h" // for appendInt
 #include <algorithm> // for swap
 #include <cstdlib> // for exit
 #include <iostream>
 #include <limits> // for numeric_limits
 #include <sstream>
+#include <stdint.h>
 #include <string>
+#include <vector>
 
 namespace opt {
 	/** The minimal alignment size. */
@@ -106,40 +109,123 @@ struct SAMAlignment {
 		{
 			if (cigar == "*")
 				return;
-			std::istringstream in(cigar);
-			bool first = true;
-			unsigned len;
-			char type;
-			while (in >> len >> type) {
-				switch (type) {
-				  case 'H': case 'S':
-					if (first)
-						qstart = len;
-					qlen += len;
-					break;
-				  case 'M': case 'X': case '=':
-					qlen += len;
-					qspan += len;
-					tspan += len;
-					break;
-				  case 'I':
-					qlen += len;
-					qspan += len;
-					break;
-				  case 'D': case 'N': case 'P':
-					tspan += len;
-					break;
-				  default:
+			const char* p = cigar.data();
+			const char* last = p + cigar.size();
+			for (bool first = true; p != last; first = false) {
+				unsigned len;
+				char type;
+				if (!nextCigarOp(p, last, len, type)) {
 					std::cerr << "error: invalid CIGAR: `"
 						<< cigar << "'\n";
 					exit(EXIT_FAILURE);
 				}
-				first = false;
+				add(len, type, first);
+			}
+		}
+
+		/** Sum the specified CIGAR operations, which are encoded as
+		 * in BAM. */
+		CigarCoord(const uint32_t* first, const uint32_t* last)
+			: qlen(0), qstart(0), qspan(0), tspan(0)
+		{
+			for (const uint32_t* p = first; p != last; ++p)
+				add(*p >> 4, cigarOpChar(*p & 0xf), p == first);
+		}
+
+	  private:
+		/** Add a CIGAR operation. */
+		void add(unsigned len, char type, bool first)
+		{
+			switch (type) {
+			  case 'H': case 'S':
+				if (first)
+					qstart = len;
+				qlen += len;
+				break;
+			  case 'M': case 'X': case '=':
+				qlen += len;
+				qspan += len;
+				tspan += len;
+				break;
+			  case 'I':
+				qlen += len;
+				qspan += len;
+				break;
+			  case 'D': case 'N': case 'P':
+				tspan += len;
+				break;
+			  default:
+				std::cerr << "error: invalid CIGAR operation: `"
+					<< type << "'\n";
+				exit(EXIT_FAILURE);
 			}
-			assert(in.eof());
 		}
 	};
 
+	/** Return the character of the CIGAR operation with the
+	 * specified BAM code. */
+	static char cigarOpChar(unsigned code)
+	{
+		return code < 9 ? "MIDNSHP=X"[code] : '?';
+	}
+
+	/** Return the BAM code of the specified CIGAR operation, or -1 if
+	 * it is invalid. */
+	static int cigarOpCode(char type)
+	{
+		switch (type) {
+		  case 'M': return 0;
+		  case 'I': return 1;
+		  case 'D': return 2;
+		  case 'N': return 3;
+		  case 'S': return 4;
+		  case 'H': return 5;
+		  case 'P': return 6;
+		  case '=': return 7;
+		  case 'X': return 8;
+		  default: return -1;
+		}
+	}
+
+	/** Parse the CIGAR operation at p, and advance p past it.
+	 * @return false if the operation is malformed
+	 */
+	static bool nextCigarOp(const char*& p, const char* last,
+			unsigned& len, char& type)
+	{
+		if (p == last || *p < '0' || *p > '9')
+			return false;
+		for (len = 0; p != last && *p >= '0' && *p <= '9'; ++p)
+			len = 10 * len + (*p - '0');
+		if (p == last)
+			return false;
+		type = *p++;
+		return true;
+	}
+
+	/** Decode a CIGAR string to operations encoded as in BAM, the
+	 * length shifted left four bits ORed with the operation code.
+	 * @return false if the CIGAR string is invalid
+	 */
+	static bool decodeCigar(const char* first, const char* last,
+			std::vector<uint32_t>& ops)
+	{
+		ops.clear();
+		if (last - first == 1 && *first == '*')
+			return true;
+		for (const char* p = first; p != last;) {
+			unsigned len;
+			char type;
+			if (!nextCigarOp(p, last, len, type))
+				return false;
+			int code = cigarOpCode(type);
+			if (code < 0)
+				return false;
+			ops.push_back(len << 4 | code);
+		}
+		return true;
+	}
+
 	/**
 	 * Return the position of the first base of the query on the
 	 * target extrapolated from the start of the alignment.
@@ -160,14 +246,20 @@ struct SAMAlignment {
 	 */
 	static Alignment parseCigar(const std::string& cigar, bool isRC) {
 		Alignment a;
-		std::istringstream in(cigar);
-		unsigned len;
-		char type;
 		unsigned clip0 = 0;
 		a.align_length = 0;
 		unsigned qlen = 0;
 		unsigned clip1 = 0;
-		while (in >> len >> type) {
+		const char* p = cigar.data();
+		const char* last = p + cigar.size();
+		while (p != last) {
+			unsigned len;
+			char type;
+			if (!nextCigarOp(p, last, len, type)) {
+				std::cerr << "error: invalid CIGAR: `"
+					<< cigar << "'\n";
+				exit(EXIT_FAILURE);
+			}
 			switch (type) {
 			  case 'I': case 'X': case '=':
 				qlen += len;
@@ -202,11 +294,6 @@ struct SAMAlignment {
 		}
 		a.read_start_pos = isRC ? clip1 : clip0;
 		a.read_length = qlen;
-		if (!in.eof()){
-			std::cerr << "error: invalid CIGAR: `"
-				<< cigar << "'\n";
-			exit(EXIT_FAILURE);
-		}
 		return a;
 	}
 
@@ -309,6 +396,43 @@ struct SAMRecord : SAMAlignment {
 		return targetAtQueryStart() + isize;
 	}
 
+	/** Append this record, without a newline, to s. */
+	void appendTo(std::string& s) const
+	{
+		s += qname;
+		s += '\t';
+		appendInt(s, flag);
+		s += '\t';
+		s += rname;
+		s += '\t';
+		appendInt(s, 1 + pos);
+		s += '\t';
+		appendInt(s, mapq);
+		s += '\t';
+		s += cigar;
+		s += '\t';
+		if (mrnm == rname)
+			s += '=';
+		else
+			s += mrnm;
+		s += '\t';
+		appendInt(s, 1 + mpos);
+		s += '\t';
+		appendInt(s, isize);
+#if SAM_SEQ_QUAL
+		s += '\t';
+		s += seq;
+		s += '\t';
+		s += qual;
+		if (!tags.empty()) {
+			s += '\t';
+			s += tags;
+		}
+#else
+		s += "\t*\t*";
+#endif
+	}
+
 	friend std::ostream& operator <<(std::ostream& out,
 			const SAMRecord& o)
 	{
@@ -332,43 +456,137 @@ struct SAMRecord : SAMAlignment {
 		return out;
 	}
 
-	friend std::istream& operator >>(std::istream& in, SAMRecord& o)
+	/** Convert the fields of a record that has been parsed from SAM
+	 * to its internal representation.
+	 * @param a the coordinates of the CIGAR of this record
+	 */
+	void normalize(const CigarCoord& a)
 	{
-		in >> o.qname
-			>> o.flag >> o.rname >> o.pos >> o.mapq
-			>> o.cigar >> o.mrnm >> o.mpos >> o.isize;
-#if SAM_SEQ_QUAL
-		in >> o.seq >> o.qual;
-		if (in.peek() != '\n')
-			in >> o.tags;
-#endif
-		in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-		if (!in)
-			return in;
-		o.pos--;
-		o.mpos--;
-		if (o.mrnm == "=")
-			o.mrnm = o.rname;
+		pos--;
+		mpos--;
+		if (mrnm == "=")
+			mrnm = rname;
 
 		// Set the paired flags if qname ends in /1 or /2.
-		unsigned l = o.qname.length();
-		if (l >= 2 && o.qname[l-2] == '/') {
-			switch (o.qname[l-1]) {
-				case '1': o.flag |= FPAIRED | FREAD1; break;
+		unsigned l = qname.length();
+		if (l >= 2 && qname[l-2] == '/') {
+			switch (qname[l-1]) {
+				case '1': flag |= FPAIRED | FREAD1; break;
 				case '2':
-				case '3': o.flag |= FPAIRED | FREAD2; break;
-				default: return in;
+				case '3': flag |= FPAIRED | FREAD2; break;
+				default: return;
 			}
-			o.qname.resize(l - 2);
-			assert(!o.qname.empty());
+			qname.resize(l - 2);
+			assert(!qname.empty());
 		}
 
 		// Set the unmapped flag if the alignment is not long enough.
-		CigarCoord a(o.cigar);
 		if (a.qspan < opt::minAlign || a.tspan < opt::minAlign)
-			o.flag |= FUNMAP;
+			flag |= FUNMAP;
+	}
+
+	/** Read a SAM record. The fields are parsed directly from the
+	 * stream buffer into the existing strings of the record, so that
+	 * reading a series of records into the same record does not
+	 * allocate memory.
+	 */
+	friend std::istream& operator >>(std::istream& in, SAMRecord& o)
+	{
+		std::istream::sentry sentry(in);
+		if (!sentry)
+			return in;
+		std::streambuf& sb = *in.rdbuf();
+		bool good = readField(sb, o.qname)
+			&& readInt(sb, o.flag) && readField(sb, o.rname)
+			&& readInt(sb, o.pos) && readInt(sb, o.mapq)
+			&& readField(sb, o.cigar) && readField(sb, o.mrnm)
+			&& readInt(sb, o.mpos) && readInt(sb, o.isize);
+#if SAM_SEQ_QUAL
+		good = good && readField(sb, o.seq) && readField(sb, o.qual);
+		if (good)
+			readRest(sb, o.tags);
+#endif
+		if (!skipLine(sb))
+			in.setstate(std::ios::eofbit);
+		if (!good) {
+			in.setstate(std::ios::failbit);
+			return in;
+		}
+		o.normalize(CigarCoord(o.cigar));
 		return in;
 	}
+
+  private:
+	typedef std::char_traits<char> traits;
+
+	/** Skip spaces and tabs.
+	 * @return the next character
+	 */
+	static int skipBlanks(std::streambuf& sb)
+	{
+		int c = sb.sgetc();
+		while (c == ' ' || c == '\t')
+			c = sb.snextc();
+		return c;
+	}
+
+	/** Read a field, which ends at white space, into s.
+	 * @return false if the line has no more fields
+	 */
+	static bool readField(std::streambuf& sb, std::string& s)
+	{
+		s.clear();
+		for (int c = skipBlanks(sb); c != traits::eof()
+				&& c != ' ' && c != '\t' && c != '\n' && c != '\r';
+				c = sb.snextc())
+			s += traits::to_char_type(c);
+		return !s.empty();
+	}
+
+	/** Read the rest of the line, less leading blanks, into s. */
+	static void readRest(std::streambuf& sb, std::string& s)
+	{
+		s.clear();
+		for (int c = skipBlanks(sb); c != traits::eof()
+				&& c != '\n' && c != '\r'; c = sb.snextc())
+			s += traits::to_char_type(c);
+	}
+
+	/** Read a decimal integer field.
+	 * @return false if the field is not an integer
+	 */
+	template <typename T>
+	static bool readInt(std::streambuf& sb, T& x)
+	{
+		int c = skipBlanks(sb);
+		bool negative = c == '-';
+		if (negative || c == '+')
+			c = sb.snextc();
+		if (c < '0' || c > '9')
+			return false;
+		long long n = 0;
+		for (; c >= '0' && c <= '9'; c = sb.snextc())
+			n = 10 * n + (c - '0');
+		if (c != ' ' && c != '\t' && c != '\n' && c != '\r'
+				&& c != traits::eof())
+			return false;
+		x = T(negative ? -n : n);
+		return true;
+	}
+
+	/** Discard the rest of the line, including the newline.
+	 * @return false if the stream ends before a newline
+	 */
+	static bool skipLine(std::streambuf& sb)
+	{
+		for (int c = sb.sgetc(); c != traits::eof(); c = sb.snextc()) {
+			if (c == '\n') {
+				sb.sbumpc();
+				return true;
+			}
+		}
+		return false;
+	}
 };
 
 /** Set the mate mapping fields of a0 and a1. */
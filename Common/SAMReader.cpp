@@ -0,0 +1,490 @@
+#include "Common/SAMReader.h"
+#include "Common/GzipReader.h"
+#include "Common/IOUtil.h"
+#include "Common/StringUtil.h" // for appendInt
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+/** The size of a block of the file */
+static const size_t BLOCK_SIZE = 1 << 20;
+
+/** The magic number of a BAM file */
+static const char BAM_MAGIC[] = "BAM\1";
+
+/** The bases of the 4-bit encoding of BAM */
+static const char BAM_BASES[] = "=ACMGRSVTWYHKDBN";
+
+static const StringView STAR("*", 1);
+static const StringView EQUAL("=", 1);
+
+/** Return the little-endian integer at p. */
+static inline uint32_t le32(const char* p)
+{
+	const unsigned char* q = reinterpret_cast<const unsigned char*>(p);
+	return q[0] | q[1] << 8 | q[2] << 16 | (uint32_t)q[3] << 24;
+}
+
+/** Return the little-endian integer at p. */
+static inline uint16_t le16(const char* p)
+{
+	const unsigned char* q = reinterpret_cast<const unsigned char*>(p);
+	return q[0] | q[1] << 8;
+}
+
+/** Parse the decimal integer of the specified field.
+ * @return false if the field is not an integer
+ */
+template <typename T>
+static inline bool parseInt(StringView field, T& x)
+{
+	const char* p = field.begin();
+	const char* last = field.end();
+	bool negative = p != last && *p == '-';
+	if (p != last && (*p == '-' || *p == '+'))
+		++p;
+	if (p == last)
+		return false;
+	long long n = 0;
+	for (; p != last; ++p) {
+		if (*p < '0' || *p > '9')
+			return false;
+		n = 10 * n + (*p - '0');
+	}
+	x = T(negative ? -n : n);
+	return true;
+}
+
+/** Return the field that begins at p, and advance p past the tab that
+ * ends it. */
+static inline StringView nextField(char*& p, char* last)
+{
+	char* q = static_cast<char*>(memchr(p, '\t', last - p));
+	if (q == NULL)
+		q = last;
+	StringView field(p, q - p);
+	p = q == last ? q : q + 1;
+	return field;
+}
+
+void SAMRecordView::appendTo(string& s) const
+{
+	s.append(qname.begin(), qname.end());
+	s += '\t';
+	appendInt(s, flag);
+	s += '\t';
+	s.append(rname.begin(), rname.end());
+	s += '\t';
+	appendInt(s, pos);
+	s += '\t';
+	appendInt(s, mapq);
+	s += '\t';
+	s.append(cigar.begin(), cigar.end());
+	s += '\t';
+	s.append(mrnm.begin(), mrnm.end());
+	s += '\t';
+	appendInt(s, mpos);
+	s += '\t';
+	appendInt(s, isize);
+	s += '\t';
+	s.append(seq.begin(), seq.end());
+	s += '\t';
+	s.append(qual.begin(), qual.end());
+	if (!tags.empty()) {
+		s += '\t';
+		s.append(tags.begin(), tags.end());
+	}
+	s += '\n';
+}
+
+SAMReader::SAMReader(const char* path)
+	: m_path(path),
+	m_in(strcmp(path, "-") == 0 ? cin : m_fin),
+	m_gzip(NULL),
+	m_buf(BLOCK_SIZE), m_pos(0), m_len(0),
+	m_streamEOF(false), m_eof(false), m_bam(false), m_line(0)
+{
+	if (strcmp(path, "-") == 0) {
+		// Read the standard input.
+	} else if (canReadGzip(path) || canReadBAM(path)) {
+		// Decompress the file in this process.
+		m_gzip = new GzipReader(path);
+	} else {
+		m_fin.open(path);
+		assert_good(m_fin, path);
+	}
+
+	if (fill(4) && memcmp(&m_buf[m_pos], BAM_MAGIC, 4) == 0) {
+		m_bam = true;
+		m_pos += 4;
+		readBAMHeader();
+	} else
+		readSAMHeader();
+}
+
+SAMReader::~SAMReader()
+{
+	delete m_gzip;
+}
+
+/** Print an error message and exit. */
+void SAMReader::die(const string& msg)
+{
+	cerr << "error: `" << m_path << "'";
+	if (!m_bam && m_line > 0)
+		cerr << ':' << m_line;
+	cerr << ": " << msg << endl;
+	exit(EXIT_FAILURE);
+}
+
+/** Discard the data that has been parsed, and read another block of
+ * the file into the buffer.
+ * @return false at end-of-file
+ */
+bool SAMReader::readMore()
+{
+	if (m_streamEOF)
+		return false;
+	if (m_pos > 0) {
+		memmove(&m_buf[0], &m_buf[m_pos], m_len - m_pos);
+		m_len -= m_pos;
+		m_pos = 0;
+	}
+	if (m_len == m_buf.size())
+		m_buf.resize(2 * m_buf.size());
+
+	size_t n;
+	if (m_gzip != NULL) {
+		n = m_gzip->read(&m_buf[m_len], m_buf.size() - m_len);
+		if (n == 0)
+			m_streamEOF = true;
+	} else {
+		m_in.read(&m_buf[m_len], m_buf.size() - m_len);
+		n = m_in.gcount();
+		if (m_in.bad())
+			die(strerror(errno));
+		if (m_in.eof())
+			m_streamEOF = true;
+	}
+	m_len += n;
+	return n > 0;
+}
+
+/** Read until at least n unparsed bytes are in the buffer.
+ * @return false if the file ends first
+ */
+bool SAMReader::fill(size_t n)
+{
+	while (m_len - m_pos < n)
+		if (!readMore())
+			return false;
+	return true;
+}
+
+/** Return the offset in the buffer of the newline that ends the line
+ * at m_pos, reading more of the file as needed, or m_len if the file
+ * ends before a newline.
+ */
+size_t SAMReader::findLineEnd()
+{
+	for (size_t i = m_pos;;) {
+		// memchr is vectorized by the C library.
+		const char* p = static_cast<const char*>(
+				memchr(&m_buf[i], '\n', m_len - i));
+		if (p != NULL)
+			return p - &m_buf[0];
+		size_t scanned = m_len - m_pos;
+		if (!readMore())
+			return m_len;
+		i = m_pos + scanned;
+	}
+}
+
+/** Read the header lines of a SAM file. */
+void SAMReader::readSAMHeader()
+{
+	while (fill(1) && m_buf[m_pos] == '@') {
+		size_t end = findLineEnd();
+		m_header.append(&m_buf[m_pos], end - m_pos);
+		m_header += '\n';
+		m_pos = end < m_len ? end + 1 : end;
+		m_line++;
+	}
+}
+
+/** Read the header and the target names of a BAM file. */
+void SAMReader::readBAMHeader()
+{
+	if (!fill(4))
+		die("truncated BAM header");
+	uint32_t textLen = le32(&m_buf[m_pos]);
+	if (!fill(4 + textLen + 4))
+		die("truncated BAM header");
+	const char* text = &m_buf[m_pos + 4];
+	m_header.assign(text, strnlen(text, textLen));
+	if (!m_header.empty() && m_header[m_header.size() - 1] != '\n')
+		m_header += '\n';
+	m_pos += 4 + textLen;
+
+	uint32_t nref = le32(&m_buf[m_pos]);
+	m_pos += 4;
+	m_refNames.reserve(nref);
+	for (uint32_t i = 0; i < nref; ++i) {
+		if (!fill(4))
+			die("truncated BAM header");
+		uint32_t nameLen = le32(&m_buf[m_pos]);
+		if (nameLen == 0 || !fill(4 + nameLen + 4))
+			die("truncated BAM header");
+		m_refNames.push_back(string(&m_buf[m_pos + 4], nameLen - 1));
+		m_pos += 4 + nameLen + 4;
+	}
+}
+
+bool SAMReader::read(SAMRecordView& rec)
+{
+	return m_bam ? readBAM(rec) : readSAM(rec);
+}
+
+/** Read the next record of a SAM file. */
+bool SAMReader::readSAM(SAMRecordView& rec)
+{
+	for (;;) {
+		if (!fill(1)) {
+			m_eof = true;
+			return false;
+		}
+		size_t end = findLineEnd();
+		char* first = &m_buf[m_pos];
+		char* last = &m_buf[0] + end;
+		m_pos = end < m_len ? end + 1 : end;
+		m_line++;
+		if (last > first && last[-1] == '\r')
+			--last;
+		// Skip blank lines and the header of a concatenated file.
+		if (first == last || *first == '@')
+			continue;
+		if (!parseSAM(first, last, rec))
+			die("invalid SAM record");
+		return true;
+	}
+}
+
+/** Split a line of a SAM file into fields in place. */
+bool SAMReader::parseSAM(char* p, char* last, SAMRecordView& rec)
+{
+	rec.qname = nextField(p, last);
+	if (!parseInt(nextField(p, last), rec.flag))
+		return false;
+	rec.rname = nextField(p, last);
+	if (!parseInt(nextField(p, last), rec.pos)
+			|| !parseInt(nextField(p, last), rec.mapq))
+		return false;
+	rec.cigar = nextField(p, last);
+	rec.mrnm = nextField(p, last);
+	if (!parseInt(nextField(p, last), rec.mpos)
+			|| !parseInt(nextField(p, last), rec.isize))
+		return false;
+	if (rec.qname.empty() || rec.rname.empty() || rec.cigar.empty()
+			|| rec.mrnm.empty())
+		return false;
+
+	// The sequence and quality are optional.
+	rec.seq = p == last ? STAR : nextField(p, last);
+	rec.qual = p == last ? STAR : nextField(p, last);
+	rec.tags = StringView(p, last - p);
+
+	if (!SAMAlignment::decodeCigar(rec.cigar.begin(), rec.cigar.end(),
+				rec.ops))
+		die("invalid CIGAR: `" + rec.cigar.str() + "'");
+	return true;
+}
+
+/** Read the next record of a BAM file. */
+bool SAMReader::readBAM(SAMRecordView& rec)
+{
+	if (!fill(4)) {
+		if (m_len > m_pos)
+			die("truncated BAM record");
+		m_eof = true;
+		return false;
+	}
+	uint32_t size = le32(&m_buf[m_pos]);
+	if (size < 32 || !fill(4 + size))
+		die("truncated BAM record");
+	const char* p = &m_buf[m_pos + 4];
+	const char* end = p + size;
+	m_pos += 4 + size;
+
+	int32_t refID = le32(p);
+	int32_t pos = le32(p + 4);
+	unsigned nameLen = (unsigned char)p[8];
+	rec.mapq = (unsigned char)p[9];
+	unsigned ncigar = le16(p + 12);
+	rec.flag = le16(p + 14);
+	uint32_t seqLen = le32(p + 16);
+	int32_t mateRefID = le32(p + 20);
+	int32_t matePos = le32(p + 24);
+	rec.isize = (int32_t)le32(p + 28);
+	rec.pos = pos + 1;
+	rec.mpos = matePos + 1;
+
+	const char* name = p + 32;
+	const char* cigar = name + nameLen;
+	const char* seq = cigar + 4 * ncigar;
+	const char* qual = seq + (seqLen + 1) / 2;
+	const char* tags = qual + seqLen;
+	if (nameLen == 0 || tags > end)
+		die("invalid BAM record");
+
+	if (refID < -1 || refID >= (int32_t)m_refNames.size()
+			|| mateRefID < -1
+			|| mateRefID >= (int32_t)m_refNames.size())
+		die("invalid BAM target ID");
+	rec.rname = refID < 0 ? STAR : StringView(
+			m_refNames[refID].data(), m_refNames[refID].size());
+	rec.mrnm = mateRefID < 0 ? STAR
+		: mateRefID == refID ? EQUAL : StringView(
+			m_refNames[mateRefID].data(),
+			m_refNames[mateRefID].size());
+
+	// Decode the binary fields to text. The offsets of the fields are
+	// recorded, because the scratch buffer may be reallocated.
+	string& s = m_scratch;
+	s.clear();
+	s.append(name, nameLen - 1);
+	size_t cigarStart = s.size();
+
+	rec.ops.resize(ncigar);
+	for (unsigned i = 0; i < ncigar; ++i) {
+		uint32_t op = le32(cigar + 4 * i);
+		rec.ops[i] = op;
+		appendInt(s, op >> 4);
+		s += SAMAlignment::cigarOpChar(op & 0xf);
+	}
+	if (ncigar == 0)
+		s += '*';
+	size_t seqStart = s.size();
+
+	if (seqLen == 0)
+		s += '*';
+	for (uint32_t i = 0; i < seqLen; ++i) {
+		unsigned char x = seq[i / 2];
+		s += BAM_BASES[i % 2 == 0 ? x >> 4 : x & 0xf];
+	}
+	size_t qualStart = s.size();
+
+	if (seqLen == 0 || (unsigned char)qual[0] == 0xff)
+		s += '*';
+	else
+		for (uint32_t i = 0; i < seqLen; ++i)
+			s += char(qual[i] + 33);
+	size_t tagsStart = s.size();
+
+	for (const char* q = tags; q < end;) {
+		if (end - q < 3)
+			die("invalid BAM tag");
+		if (q != tags)
+			s += '\t';
+		s.append(q, 2);
+		s += ':';
+		char type = q[2];
+		q += 3;
+		switch (type) {
+		  case 'A':
+			if (q >= end)
+				die("invalid BAM tag");
+			s += "A:";
+			s += *q++;
+			break;
+		  case 'c': case 'C': case 's': case 'S': case 'i': case 'I': {
+			size_t n = type == 'c' || type == 'C' ? 1
+				: type == 's' || type == 'S' ? 2 : 4;
+			if (end - q < (ptrdiff_t)n)
+				die("invalid BAM tag");
+			long long x = type == 'c' ? (long long)(int8_t)*q
+				: type == 'C' ? (long long)(uint8_t)*q
+				: type == 's' ? (long long)(int16_t)le16(q)
+				: type == 'S' ? (long long)le16(q)
+				: type == 'i' ? (long long)(int32_t)le32(q)
+				: (long long)le32(q);
+			s += "i:";
+			appendInt(s, x);
+			q += n;
+			break;
+		  }
+		  case 'f': {
+			if (end - q < 4)
+				die("invalid BAM tag");
+			uint32_t bits = le32(q);
+			float x;
+			memcpy(&x, &bits, sizeof x);
+			char buf[32];
+			snprintf(buf, sizeof buf, "f:%g", x);
+			s += buf;
+			q += 4;
+			break;
+		  }
+		  case 'Z': case 'H': {
+			const char* nul = static_cast<const char*>(
+					memchr(q, '\0', end - q));
+			if (nul == NULL)
+				die("invalid BAM tag");
+			s += type;
+			s += ':';
+			s.append(q, nul);
+			q = nul + 1;
+			break;
+		  }
+		  case 'B': {
+			if (end - q < 5)
+				die("invalid BAM tag");
+			char subtype = q[0];
+			uint32_t count = le32(q + 1);
+			q += 5;
+			size_t n = subtype == 'c' || subtype == 'C' ? 1
+				: subtype == 's' || subtype == 'S' ? 2 : 4;
+			if ((size_t)(end - q) < n * count)
+				die("invalid BAM tag");
+			s += "B:";
+			s += subtype;
+			for (uint32_t i = 0; i < count; ++i, q += n) {
+				s += ',';
+				switch (subtype) {
+				  case 'c': appendInt(s, (int8_t)*q); break;
+				  case 'C': appendInt(s, (uint8_t)*q); break;
+				  case 's': appendInt(s, (int16_t)le16(q)); break;
+				  case 'S': appendInt(s, le16(q)); break;
+				  case 'i': appendInt(s, (int32_t)le32(q)); break;
+				  case 'I': appendInt(s, le32(q)); break;
+				  case 'f': {
+					uint32_t bits = le32(q);
+					float x;
+					memcpy(&x, &bits, sizeof x);
+					char buf[32];
+					snprintf(buf, sizeof buf, "%g", x);
+					s += buf;
+					break;
+				  }
+				  default:
+					die("invalid BAM tag array type");
+				}
+			}
+			break;
+		  }
+		  default:
+			die(string("invalid BAM tag type: `") + type + "'");
+		}
+	}
+
+	const char* base = s.data();
+	rec.qname = StringView(base, cigarStart);
+	rec.cigar = StringView(base + cigarStart, seqStart - cigarStart);
+	rec.seq = StringView(base + seqStart, qualStart - seqStart);
+	rec.qual = StringView(base + qualStart, tagsStart - qualStart);
+	rec.tags = StringView(base + tagsStart, s.size() - tagsStart);
+	return true;
+}
@@ -0,0 +1,176 @@
+#ifndef SAMREADER_H
+#define SAMREADER_H 1
+
+#include "config.h"
+#include "Common/SAM.h"
+#include "Common/StringUtil.h" // for endsWith
+#include "Common/StringView.h"
+#include <fstream>
+#include <istream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class GzipReader;
+
+/** Return whether the specified file is a BAM file that may be
+ * decoded by SAMReader rather than by samtools. */
+static inline bool canReadBAM(const std::string& path)
+{
+#if HAVE_ZLIB_H && HAVE_LIBZ
+	return endsWith(path, ".bam")
+		&& !startsWith(path, "http://")
+		&& !startsWith(path, "https://")
+		&& !startsWith(path, "ftp://");
+#else
+	(void)path;
+	return false;
+#endif
+}
+
+/**
+ * A SAM record parsed in place. Its fields refer to the buffer of the
+ * SAMReader that read it, and are valid until the next call to a read
+ * function of that SAMReader.
+ */
+struct SAMRecordView
+{
+	StringView qname;
+	StringView rname;
+	StringView cigar;
+	StringView mrnm;
+	StringView seq;
+	StringView qual;
+	/** The optional fields, separated by tabs */
+	StringView tags;
+	unsigned flag;
+	unsigned mapq;
+	/** The 1-based positions, as in SAM, or 0 if not available */
+	int pos;
+	int mpos;
+	int isize;
+	/** The CIGAR operations, encoded as in BAM, which are decoded
+	 * once per record. */
+	std::vector<uint32_t> ops;
+
+	SAMRecordView() : flag(0), mapq(0), pos(0), mpos(0), isize(0) { }
+
+	/** Return the coordinates of the CIGAR. */
+	SAMAlignment::CigarCoord cigarCoord() const
+	{
+		return SAMAlignment::CigarCoord(
+				ops.empty() ? NULL : &ops[0],
+				ops.empty() ? NULL : &ops[0] + ops.size());
+	}
+
+	/** Copy this record to o, reusing its storage. This function is
+	 * inline, because the layout of SAMRecord depends on
+	 * SAM_SEQ_QUAL. */
+	void copyTo(SAMRecord& o) const
+	{
+		qname.copyTo(o.qname);
+		o.flag = flag;
+		rname.copyTo(o.rname);
+		o.pos = pos;
+		o.mapq = mapq;
+		cigar.copyTo(o.cigar);
+		mrnm.copyTo(o.mrnm);
+		o.mpos = mpos;
+		o.isize = isize;
+#if SAM_SEQ_QUAL
+		seq.copyTo(o.seq);
+		qual.copyTo(o.qual);
+		tags.copyTo(o.tags);
+#endif
+		o.normalize(cigarCoord());
+	}
+
+	/** Write this record in SAM format to s. */
+	void appendTo(std::string& s) const;
+};
+
+/**
+ * Read a SAM file, which may be compressed, or a BAM file.
+ * A SAM file is read in large blocks, and each line is split into
+ * fields in place. A BAM file is decompressed in this process and its
+ * binary records decoded directly, rather than converted to text by a
+ * samtools process.
+ * An error in the file is fatal.
+ */
+class SAMReader
+{
+  public:
+	/** Open the specified file, and read its header. A path of `-'
+	 * reads the standard input. */
+	explicit SAMReader(const char* path);
+	~SAMReader();
+
+	/** Return the header, the lines that begin with `@'. */
+	const std::string& header() const { return m_header; }
+
+	/** Return whether the file is BAM. */
+	bool isBAM() const { return m_bam; }
+
+	/** Read a record without copying its fields.
+	 * @return false at end-of-file
+	 */
+	bool read(SAMRecordView& rec);
+
+	/** Read a record, and copy it to rec.
+	 * @return false at end-of-file
+	 */
+	bool read(SAMRecord& rec)
+	{
+		if (!read(m_view))
+			return false;
+		m_view.copyTo(rec);
+		return true;
+	}
+
+	/** Return whether the end of the file has been reached. */
+	bool eof() const { return m_eof; }
+
+  private:
+	SAMReader(const SAMReader&);
+	SAMReader& operator=(const SAMReader&);
+
+	bool readMore();
+	bool fill(size_t n);
+	size_t findLineEnd();
+	void readSAMHeader();
+	void readBAMHeader();
+	bool readSAM(SAMRecordView& rec);
+	bool readBAM(SAMRecordView& rec);
+	bool parseSAM(char* first, char* last, SAMRecordView& rec);
+	void die(const std::string& msg);
+
+	std::string m_path;
+	std::ifstream m_fin;
+	std::istream& m_in;
+	GzipReader* m_gzip;
+
+	/** The buffer of the file contents */
+	std::vector<char> m_buf;
+	/** The position of the next unread byte of the buffer */
+	size_t m_pos;
+	/** The number of bytes in the buffer */
+	size_t m_len;
+	/** Whether the stream has been read to its end */
+	bool m_streamEOF;
+	/** Whether the last record has been read */
+	bool m_eof;
+
+	bool m_bam;
+	std::string m_header;
+	/** The names of the targets of a BAM file */
+	std::vector<std::string> m_refNames;
+	/** The text fields of a decoded BAM record */
+	std::string m_scratch;
+	/** The current line number of a SAM file */
+	size_t m_line;
+
+	/** The record read by read(SAMRecord&) */
+	SAMRecordView m_view;
+};
+
+#endif
@@ -135,6 +135,21 @@ static inline std::string toEng(T n)
 	return s.str();
 }
 
+/** Append the decimal representation of x to s. */
+static inline void appendInt(std::string& s, long long x)
+{
+	char buf[24];
+	char* p = buf + sizeof buf;
+	unsigned long long n = x < 0 ? -(unsigned long long)x : x;
+	do {
+		*--p = '0' + n % 10;
+		n /= 10;
+	} while (n > 0);
+	if (x < 0)
+		*--p = '-';
+	s.append(p, buf + sizeof buf);
+}
+
 /** Return true if the second string is a prefix of the string s. */
 template <size_t N>
 bool startsWith(const std::string& s, const char (&prefix)[N])
@@ -0,0 +1,40 @@
+#ifndef STRINGVIEW_H
+#define STRINGVIEW_H 1
+
+#include <cstring>
+#include <ostream>
+#include <string>
+
+/** A reference to a string in a buffer, which does not own it. */
+struct StringView
+{
+	const char* data;
+	size_t size;
+
+	StringView() : data(NULL), size(0) { }
+	StringView(const char* data, size_t size) : data(data), size(size) { }
+
+	bool empty() const { return size == 0; }
+	size_t length() const { return size; }
+	const char* begin() const { return data; }
+	const char* end() const { return data + size; }
+	char operator[](size_t i) const { return data[i]; }
+
+	/** Return a copy of this string. */
+	std::string str() const { return std::string(data, size); }
+
+	/** Copy this string to s, reusing its storage. */
+	void copyTo(std::string& s) const { s.assign(data, size); }
+
+	bool operator==(const StringView& o) const
+	{
+		return size == o.size && memcmp(data, o.data, size) == 0;
+	}
+
+	friend std::ostream& operator<<(std::ostream& out, const StringView& o)
+	{
+		return out.write(o.data, o.size);
+	}
+};
+
+#endif
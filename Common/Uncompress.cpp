@@ -3,21 +3,27 @@
  * If the extension of the file being opened indicates the file is
  * compressed (.gz, .bz2, .xz), open a pipe to a program that
  * decompresses that file (gunzip, bunzip2 or xzdec) and return a
- * handle to the open pipe.
+ * handle to the open pipe. A BAM file is instead decoded to SAM by a
+ * thread of this process.
  * @author Shaun Jackman <sjackman@bcgsc.ca>
  */
 
 #include "config.h"
+#include "Uncompress.h"
 #if HAVE_LIBDL
 
 #include "Fcontrol.h"
+#include "SAMReader.h"
 #include "SignalHandler.h"
 #include "StringUtil.h"
 #include <cassert>
+#include <cerrno>
 #include <cstdio> // for perror
 #include <cstdlib>
 #include <dlfcn.h>
+#include <pthread.h>
 #include <string>
+#include <sys/socket.h>
 #include <unistd.h>
 
 using namespace std;
@@ -56,6 +62,98 @@ static const char* zcatExec(const string& path)
 		NULL;
 }
 
+bool isCompressed(const string& path)
+{
+	return wgetExec(path) != NULL || zcatExec(path) != NULL;
+}
+
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
+/** Write a string to a socket.
+ * @return false if the reader has closed the socket
+ */
+static bool sendAll(int fd, const string& s)
+{
+	for (size_t i = 0; i < s.size();) {
+		ssize_t n = send(fd, s.data() + i, s.size() - i, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		i += n;
+	}
+	return true;
+}
+
+/** The file and socket of a BAM decoding thread */
+struct BAMToSAMArg
+{
+	string path;
+	int fd;
+};
+
+/** Decode a BAM file, and write it to a socket as SAM. */
+static void* bamToSAMThread(void* arg)
+{
+	const size_t BUFFER_SIZE = 1 << 20;
+	BAMToSAMArg* p = static_cast<BAMToSAMArg*>(arg);
+	string path = p->path;
+	int fd = p->fd;
+	delete p;
+
+	SAMReader in(path.c_str());
+	string s = in.header();
+	s.reserve(BUFFER_SIZE + s.size());
+	SAMRecordView rec;
+	for (bool good = true; good;) {
+		good = in.read(rec);
+		if (good)
+			rec.appendTo(s);
+		if (s.size() >= BUFFER_SIZE || !good) {
+			if (!sendAll(fd, s))
+				break;
+			s.clear();
+		}
+	}
+	close(fd);
+	return NULL;
+}
+
+/** Decode a BAM file to SAM by a thread of this process, rather than
+ * by a samtools process. The SAM is written to a socket rather than a
+ * pipe, so that the process is not killed by SIGPIPE if the reader
+ * closes its end early.
+ * @return a file descriptor
+ */
+static int bamToSAM(const char* path)
+{
+	int fd[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fd) == -1)
+		return -1;
+	int err = setCloexec(fd[0]) | setCloexec(fd[1]);
+	assert(err == 0);
+	(void)err;
+#ifdef SO_NOSIGPIPE
+	int one = 1;
+	setsockopt(fd[1], SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof one);
+#endif
+
+	BAMToSAMArg* arg = new BAMToSAMArg;
+	arg->path = path;
+	arg->fd = fd[1];
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, bamToSAMThread, arg) != 0) {
+		delete arg;
+		close(fd[0]);
+		close(fd[1]);
+		return -1;
+	}
+	pthread_detach(thread);
+	return fd[0];
+}
+
 extern "C" {
 
 /** Open a pipe to uncompress the specified file.
@@ -64,6 +162,9 @@ extern "C" {
  */
 static int uncompress(const char *path)
 {
+	if (canReadBAM(path))
+		return bamToSAM(path);
+
 	const char *wget = wgetExec(path);
 	const char *zcat = wget != NULL ? wget : zcatExec(path);
 	assert(zcat != NULL);
@@ -210,6 +311,13 @@ int open(const char *path, int flags, mode_t mode)
 
 } // extern "C"
 
+#else // HAVE_LIBDL
+
+bool isCompressed(const std::string&)
+{
+	return false;
+}
+
 #endif // HAVE_LIBDL
 
 /** Initialize the uncompress module. */
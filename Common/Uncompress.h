@@ -1,8 +1,14 @@
 #ifndef UNCOMPRESS_H
 #define UNCOMPRESS_H 1
 
+#include <string>
+
 bool uncompress_init();
 
+/** Return whether the specified file is read through a pipe from a
+ * decompression or download program. */
+bool isCompressed(const std::string& path);
+
 namespace {
 const bool uncompressInitialized = uncompress_init();
 bool getUncompressInitialized() __attribute__((unused));
@@ -0,0 +1,328 @@
+/** Measure the throughput of the queues of RingBuffer.h.
+ */
+#include "config.h"
+#include "RingBuffer.h"
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <getopt.h>
+#include <iomanip>
+#include <iostream>
+#include <pthread.h>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define PROGRAM "abyss-ringbench"
+
+static const char VERSION_MESSAGE[] =
+PROGRAM " (" PACKAGE_NAME ") " VERSION "\n"
+"\n"
+"Copyright 2014 Canada's Michael Smith Genome Sciences Centre\n";
+
+static const char USAGE_MESSAGE[] =
+"Usage: " PROGRAM " [OPTION]...\n"
+"Measure the throughput of passing records between threads: one\n"
+"record at a time through a queue guarded by a mutex, and in chunks\n"
+"through the lock-free ring buffers, one producer and one consumer\n"
+"(SPSC) and several of each (MPMC).\n"
+"\n"
+" Options:\n"
+"\n"
+"  -n, --records=N         pass N records [10000000]\n"
+"  -c, --chunk=N           pass chunks of N records [256]\n"
+"  -q, --queue=N           the capacity of a queue [64]\n"
+"  -p, --producers=N       use N producers for MPMC [2]\n"
+"  -j, --consumers=N       use N consumers for MPMC [2]\n"
+"      --help              display this help and exit\n"
+"      --version           output version information and exit\n"
+"\n"
+"Report bugs to <" PACKAGE_BUGREPORT ">.\n";
+
+namespace opt {
+	/** The number of records. */
+	static size_t records = 10000000;
+
+	/** The number of records of a chunk. */
+	static size_t chunk = 256;
+
+	/** The capacity of a queue. */
+	static size_t queue = 64;
+
+	/** The number of producers of MPMC. */
+	static unsigned producers = 2;
+
+	/** The number of consumers of MPMC. */
+	static unsigned consumers = 2;
+}
+
+static const char shortopts[] = "c:j:n:p:q:";
+
+enum { OPT_HELP = 1, OPT_VERSION };
+
+static const struct option longopts[] = {
+	{ "records",   required_argument, NULL, 'n' },
+	{ "chunk",     required_argument, NULL, 'c' },
+	{ "queue",     required_argument, NULL, 'q' },
+	{ "producers", required_argument, NULL, 'p' },
+	{ "consumers", required_argument, NULL, 'j' },
+	{ "help",      no_argument,       NULL, OPT_HELP },
+	{ "version",   no_argument,       NULL, OPT_VERSION },
+	{ NULL, 0, NULL, 0 }
+};
+
+/** A record, such as the index of a read. */
+typedef uint64_t Record;
+
+/** A chunk of records. */
+typedef vector<Record> Chunk;
+
+/**
+ * A bounded queue guarded by a mutex, which passes one record at a
+ * time, as a baseline.
+ */
+class LockedQueue
+{
+  public:
+	explicit LockedQueue(size_t capacity)
+		: m_capacity(capacity), m_closed(false)
+	{
+		pthread_mutex_init(&m_mutex, NULL);
+		pthread_cond_init(&m_notEmpty, NULL);
+		pthread_cond_init(&m_notFull, NULL);
+	}
+
+	~LockedQueue()
+	{
+		pthread_cond_destroy(&m_notFull);
+		pthread_cond_destroy(&m_notEmpty);
+		pthread_mutex_destroy(&m_mutex);
+	}
+
+	void push(Record x)
+	{
+		pthread_mutex_lock(&m_mutex);
+		while (m_queue.size() >= m_capacity)
+			pthread_cond_wait(&m_notFull, &m_mutex);
+		m_queue.push(x);
+		pthread_cond_signal(&m_notEmpty);
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+	bool pop(Record& x)
+	{
+		pthread_mutex_lock(&m_mutex);
+		while (m_queue.empty() && !m_closed)
+			pthread_cond_wait(&m_notEmpty, &m_mutex);
+		bool popped = !m_queue.empty();
+		if (popped) {
+			x = m_queue.front();
+			m_queue.pop();
+			pthread_cond_signal(&m_notFull);
+		}
+		pthread_mutex_unlock(&m_mutex);
+		return popped;
+	}
+
+	void close()
+	{
+		pthread_mutex_lock(&m_mutex);
+		m_closed = true;
+		pthread_cond_broadcast(&m_notEmpty);
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+  private:
+	size_t m_capacity;
+	bool m_closed;
+	std::queue<Record> m_queue;
+	pthread_mutex_t m_mutex;
+	pthread_cond_t m_notEmpty, m_notFull;
+};
+
+/** A benchmark of a queue. */
+template <typename Queue>
+struct Bench
+{
+	Queue queue;
+	unsigned producers;
+	size_t perProducer;
+
+	/** The sum of the records popped by each consumer. */
+	vector<uint64_t> sums;
+
+	Bench(size_t capacity, unsigned producers, unsigned consumers)
+		: queue(capacity), producers(producers),
+		perProducer(opt::records / producers), sums(consumers) { }
+};
+
+/** Push the records of one producer. */
+static void produce(LockedQueue& queue, size_t first, size_t n)
+{
+	for (size_t i = first; i < first + n; ++i)
+		queue.push(i);
+}
+
+/** Pop and sum the records. */
+static uint64_t consume(LockedQueue& queue)
+{
+	uint64_t sum = 0;
+	for (Record x; queue.pop(x);)
+		sum += x;
+	return sum;
+}
+
+/** Push the records of one producer in chunks. */
+template <template <typename> class Ring>
+static void produce(RingBuffer<Chunk, Ring>& queue,
+		size_t first, size_t n)
+{
+	Chunk chunk;
+	for (size_t i = first; i < first + n;) {
+		chunk.clear();
+		for (; i < first + n && chunk.size() < opt::chunk; ++i)
+			chunk.push_back(i);
+		queue.push(chunk);
+	}
+}
+
+/** Pop and sum the records. */
+template <template <typename> class Ring>
+static uint64_t consume(RingBuffer<Chunk, Ring>& queue)
+{
+	uint64_t sum = 0;
+	for (Chunk chunk; queue.pop(chunk);)
+		for (Chunk::const_iterator it = chunk.begin();
+				it != chunk.end(); ++it)
+			sum += *it;
+	return sum;
+}
+
+template <typename Queue>
+struct ThreadArg
+{
+	Bench<Queue>* bench;
+	unsigned i;
+};
+
+template <typename Queue>
+static void* producer(void* arg)
+{
+	ThreadArg<Queue>& p = *static_cast<ThreadArg<Queue>*>(arg);
+	size_t n = p.bench->perProducer;
+	produce(p.bench->queue, p.i * n, n);
+	return NULL;
+}
+
+template <typename Queue>
+static void* consumer(void* arg)
+{
+	ThreadArg<Queue>& p = *static_cast<ThreadArg<Queue>*>(arg);
+	p.bench->sums[p.i] = consume(p.bench->queue);
+	return NULL;
+}
+
+/** Pass the records through a queue, and report the throughput. */
+template <typename Queue>
+static void run(const string& name, size_t capacity,
+		unsigned producers, unsigned consumers)
+{
+	Bench<Queue> bench(capacity, producers, consumers);
+	vector<ThreadArg<Queue> > args(producers + consumers);
+	vector<pthread_t> threads(producers + consumers);
+
+	chrono::steady_clock::time_point start
+		= chrono::steady_clock::now();
+	for (unsigned i = 0; i < producers + consumers; ++i) {
+		args[i].bench = &bench;
+		args[i].i = i < producers ? i : i - producers;
+		pthread_create(&threads[i], NULL,
+				i < producers ? producer<Queue> : consumer<Queue>,
+				&args[i]);
+	}
+	for (unsigned i = 0; i < producers; ++i)
+		pthread_join(threads[i], NULL);
+	bench.queue.close();
+	for (unsigned i = producers; i < producers + consumers; ++i)
+		pthread_join(threads[i], NULL);
+	double seconds = chrono::duration<double>(
+			chrono::steady_clock::now() - start).count();
+
+	// Check that every record was popped once.
+	uint64_t n = bench.perProducer * producers;
+	uint64_t sum = 0;
+	for (unsigned i = 0; i < consumers; ++i)
+		sum += bench.sums[i];
+	if (sum != n * (n - 1) / 2) {
+		cerr << PROGRAM ": error: " << name << ": lost records\n";
+		exit(EXIT_FAILURE);
+	}
+
+	cout << left << setw(32) << name << right << fixed
+		<< setprecision(3) << setw(8) << seconds << " s "
+		<< setprecision(1) << setw(8) << n / seconds / 1e6
+		<< " M records/s\n";
+}
+
+int main(int argc, char** argv)
+{
+	bool die = false;
+	for (int c; (c = getopt_long(argc, argv,
+					shortopts, longopts, NULL)) != -1;) {
+		istringstream arg(optarg != NULL ? optarg : "");
+		switch (c) {
+		  case '?': die = true; break;
+		  case 'c': arg >> opt::chunk; break;
+		  case 'j': arg >> opt::consumers; break;
+		  case 'n': arg >> opt::records; break;
+		  case 'p': arg >> opt::producers; break;
+		  case 'q': arg >> opt::queue; break;
+		  case OPT_HELP:
+			cout << USAGE_MESSAGE;
+			exit(EXIT_SUCCESS);
+		  case OPT_VERSION:
+			cout << VERSION_MESSAGE;
+			exit(EXIT_SUCCESS);
+		}
+		if (optarg != NULL && !arg.eof()) {
+			cerr << PROGRAM ": invalid option: `-"
+				<< (char)c << optarg << "'\n";
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (opt::chunk == 0 || opt::queue == 0
+			|| opt::producers == 0 || opt::consumers == 0) {
+		cerr << PROGRAM ": the options must be positive\n";
+		die = true;
+	}
+
+	if (argc - optind > 0) {
+		cerr << PROGRAM ": too many arguments\n";
+		die = true;
+	}
+
+	if (die) {
+		cerr << "Try `" << PROGRAM
+			<< " --help' for more information.\n";
+		exit(EXIT_FAILURE);
+	}
+
+	ostringstream mpmc;
+	mpmc << opt::producers << ':' << opt::consumers;
+
+	run<LockedQueue>("mutex, record, 1:1",
+			opt::queue * opt::chunk, 1, 1);
+	run<LockedQueue>("mutex, record, " + mpmc.str(),
+			opt::queue * opt::chunk, opt::producers, opt::consumers);
+	run<RingBuffer<Chunk, SPSCRing> >("SPSC ring, chunk, 1:1",
+			opt::queue, 1, 1);
+	run<RingBuffer<Chunk, MPMCRing> >("MPMC ring, chunk, 1:1",
+			opt::queue, 1, 1);
+	run<RingBuffer<Chunk, MPMCRing> >("MPMC ring, chunk, " + mpmc.str(),
+			opt::queue, opt::producers, opt::consumers);
+	return 0;
+}
@@ -0,0 +1,152 @@
+#include "DataLayer/ContigStore.h"
+#include "Common/FileRange.h" // for isSplittable
+#include "Common/IOUtil.h"
+#include "DataLayer/FastaReader.h"
+#include "DataLayer/Options.h"
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+
+using namespace std;
+
+void ContigStore::open(const string& path)
+{
+	m_file.close();
+	m_buf.clear();
+	m_records.clear();
+	m_data = NULL;
+	m_trimMasked = opt::trimMasked;
+
+	if (isSplittable(path)) {
+		m_file.open(path, MappedFile::RANDOM);
+		m_data = m_file.data();
+		if (readIndex(path))
+			return;
+		if (index()) {
+			// Release the pages read while indexing the file.
+			m_file.advise(MappedFile::DONTNEED);
+			m_file.advise(MappedFile::RANDOM);
+			return;
+		}
+		m_file.close();
+		m_data = NULL;
+	}
+	load(path);
+}
+
+/** Read the index FILE.fai, if it is at least as new as the file and
+ * each of its sequences is on a single line.
+ * @return whether the index was read
+ */
+bool ContigStore::readIndex(const string& path)
+{
+	string faiPath = path + ".fai";
+	struct stat fa, fai;
+	if (stat(path.c_str(), &fa) < 0 || stat(faiPath.c_str(), &fai) < 0
+			|| fai.st_mtime < fa.st_mtime)
+		return false;
+	ifstream in(faiPath.c_str());
+	if (!in)
+		return false;
+
+	vector<FAIRecord> records;
+	size_t fileSize = m_file.size();
+	FAIRecord rec;
+	size_t lineLen, lineBinLen;
+	while (in >> rec.id >> rec.size >> rec.offset >> lineLen >> lineBinLen
+			&& in >> Ignore('\n')) {
+		if (rec.size > lineLen
+				|| rec.offset == 0 || rec.offset + rec.size > fileSize
+				|| m_data[rec.offset - 1] != '\n')
+			return false;
+		records.push_back(rec);
+	}
+	if (!in.eof() || records.empty())
+		return false;
+	m_records.swap(records);
+	return true;
+}
+
+/** Index the mapped file.
+ * @return false if the file is not FASTA with each sequence on a
+ * single line
+ */
+bool ContigStore::index()
+{
+	const char* first = m_data;
+	const char* last = m_data + m_file.size();
+	vector<FAIRecord> records;
+	for (const char* p = first; p < last;) {
+		if (*p != '>')
+			return false;
+		const char* eol = static_cast<const char*>(
+				memchr(p, '\n', last - p));
+		if (eol == NULL)
+			return false;
+		const char* id = p + 1;
+		const char* idEnd = id;
+		while (idEnd < eol && !isspace(*idEnd))
+			++idEnd;
+		if (idEnd == id)
+			return false;
+
+		const char* seq = eol + 1;
+		const char* seqEnd = seq;
+		if (seq < last && *seq != '>') {
+			seqEnd = static_cast<const char*>(
+					memchr(seq, '\n', last - seq));
+			if (seqEnd == NULL)
+				seqEnd = last;
+		}
+		size_t n = seqEnd - seq;
+		if (n > 0 && seq[n - 1] == '\r')
+			--n;
+		records.push_back(FAIRecord(seq - first, n, string(id, idEnd)));
+		p = seqEnd == seq ? seq : seqEnd + 1;
+	}
+	if (records.empty())
+		return false;
+	m_records.swap(records);
+	return true;
+}
+
+/** Read the specified file into memory. */
+void ContigStore::load(const string& path)
+{
+	FastaReader in(path.c_str(), FastaReader::NO_FOLD_CASE);
+	for (FastaRecord rec; in >> rec;) {
+		m_buf += '>';
+		m_buf += rec.id;
+		if (!rec.comment.empty()) {
+			m_buf += ' ';
+			m_buf += rec.comment;
+		}
+		m_buf += '\n';
+		m_records.push_back(FAIRecord(m_buf.size(), rec.seq.size(), rec.id));
+		m_buf += rec.seq;
+		m_buf += '\n';
+	}
+	assert(in.eof());
+	m_data = m_buf.data();
+}
+
+StringView ContigStore::comment(size_t i) const
+{
+	assert(i < m_records.size());
+	const FAIRecord& rec = m_records[i];
+	assert(rec.offset > 0);
+	const char* end = m_data + rec.offset - 1;
+	if (end > m_data && end[-1] == '\r')
+		--end;
+	const char* p = end;
+	while (p > m_data && p[-1] != '\n')
+		--p;
+	assert(*p == '>');
+	for (++p; p < end && isspace(*p); ++p)
+		;
+	p += rec.id.size();
+	while (p < end && isspace(*p))
+		++p;
+	return StringView(p, end - p);
+}
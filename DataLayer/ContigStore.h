@@ -0,0 +1,106 @@
+#ifndef CONTIGSTORE_H
+#define CONTIGSTORE_H 1
+
+#include "Common/MappedFile.h"
+#include "Common/StringView.h"
+#include "DataLayer/FastaIndex.h"
+#include <cassert>
+#include <cctype>
+#include <string>
+#include <vector>
+
+/**
+ * Random access to the sequences of a FASTA file of contigs.
+ *
+ * An uncompressed file whose sequences are each on a single line is
+ * mapped into memory, and its records are located by a FASTA index,
+ * which is read from FILE.fai when that file is up to date. The
+ * kernel reads the pages of a sequence when it is first used, so that
+ * memory use is proportional to the working set rather than to the
+ * size of the assembly. Any other file is read into memory.
+ *
+ * As FastaReader does, masked (lower case) bases are trimmed from the
+ * ends of each sequence if opt::trimMasked is set when the file is
+ * opened, whether the file is mapped or read.
+ */
+class ContigStore
+{
+  public:
+	ContigStore() : m_data(NULL), m_trimMasked(false) { }
+	explicit ContigStore(const std::string& path)
+		: m_data(NULL), m_trimMasked(false)
+	{
+		open(path);
+	}
+
+	/** Open the specified FASTA file. */
+	void open(const std::string& path);
+
+	/** Return the number of contigs. */
+	size_t size() const { return m_records.size(); }
+	bool empty() const { return m_records.empty(); }
+
+	/** Return whether the file is mapped rather than read into
+	 * memory. */
+	bool isMapped() const { return m_file.isOpen(); }
+
+	/** Return the ID of contig i. */
+	const std::string& id(size_t i) const
+	{
+		assert(i < m_records.size());
+		return m_records[i].id;
+	}
+
+	/** Return the sequence of contig i. */
+	StringView sequence(size_t i) const
+	{
+		assert(i < m_records.size());
+		const FAIRecord& rec = m_records[i];
+		const char* first = m_data + rec.offset;
+		const char* last = first + rec.size;
+		if (m_trimMasked) {
+			while (first < last && islower(*first))
+				++first;
+			while (last > first && islower(last[-1]))
+				--last;
+		}
+		return StringView(first, last - first);
+	}
+
+	/** Return the comment of contig i, which is the text of the
+	 * header that follows the ID. */
+	StringView comment(size_t i) const;
+
+	/** Remove the contigs whose ID satisfies the predicate. */
+	template <typename Predicate>
+	void removeIf(Predicate pred)
+	{
+		std::vector<FAIRecord>::iterator out = m_records.begin();
+		for (std::vector<FAIRecord>::iterator it = m_records.begin();
+				it != m_records.end(); ++it)
+			if (!pred(it->id))
+				*out++ = *it;
+		m_records.erase(out, m_records.end());
+	}
+
+  private:
+	ContigStore(const ContigStore&);
+	ContigStore& operator=(const ContigStore&);
+
+	bool readIndex(const std::string& path);
+	bool index();
+	void load(const std::string& path);
+
+	/** The mapped file */
+	MappedFile m_file;
+	/** The contents of a file that is read rather than mapped */
+	std::string m_buf;
+	/** The contents of the file */
+	const char* m_data;
+	/** The offset and size of each sequence */
+	std::vector<FAIRecord> m_records;
+	/** Whether to trim masked bases from the ends of a sequence */
+	bool m_trimMasked;
+};
+
+#endif
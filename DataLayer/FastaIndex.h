@@ -1,7 +1,7 @@
 #ifndef FASTA_INDEX_H
 #define FASTA_INDEX_H 1
 
-#include "IOUtil.h"
+#include "Common/IOUtil.h"
 #include <boost/tuple/tuple.hpp>
 #include <algorithm>
 #include <cassert>
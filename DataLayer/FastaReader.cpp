@@ -1,13 +1,22 @@
+#include "Common/FileRange.h"
+#include "Common/GzipReader.h"
 #include "Common/IOUtil.h"
 #include "Common/StringUtil.h"
 #include "DataLayer/FastaReader.h"
 #include "DataLayer/Options.h"
+#include "DataLayer/PackedReads.h"
 #include <algorithm>
 #include <cassert>
 #include <cctype>
+#include <cerrno>
+#include <cstdio> // for perror
+#include <cstring>
 #include <cstdlib>
+#include <fcntl.h>
 #include <iostream>
 #include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <vector>
 
 using namespace std;
@@ -45,19 +54,163 @@ ostream& FastaReader::die()
 }
 
 FastaReader::FastaReader(const char* path, int flags, int len)
-	: m_path(path), m_fin(path),
-	m_in(strcmp(path, "-") == 0 ? cin : m_fin),
+	: m_path(path),
+	m_in(strcmp(path, "-") == 0 ? cin : m_fin), m_fd(-1), m_gzip(NULL),
+	m_packed(NULL), m_packedNext(0), m_packedEnd(0),
+	m_buf(BLOCK_SIZE), m_pos(0), m_len(0), m_offset(0),
+	m_streamEOF(false), m_eofbit(false), m_failbit(false),
 	m_flags(flags), m_line(0), m_unchaste(0),
 	m_end(numeric_limits<streamsize>::max()),
 	m_maxLength(len)
 {
-	if (strcmp(path, "-") != 0)
+	struct stat st;
+	if (strcmp(path, "-") == 0) {
+		// Read the standard input.
+		if (fstat(STDIN_FILENO, &st) == 0 && !S_ISREG(st.st_mode))
+			m_fd = STDIN_FILENO;
+	} else if (isPackedReads(path)) {
+		// Decode the records of the read cache.
+		m_packed = new PackedReads(path);
+		m_packedEnd = m_packed->size();
+		m_streamEOF = true;
+	} else if (canReadGzip(path)) {
+		// Decompress the file in this process rather than by
+		// forking gunzip.
+		m_gzip = new GzipReader(path);
+	} else if (stat(path, &st) == 0 && !S_ISREG(st.st_mode)) {
+		// Read a named pipe by read(2), which returns the data that
+		// is available rather than waiting for a full block.
+		m_fd = open(path, O_RDONLY);
+		if (m_fd < 0) {
+			perror(path);
+			exit(EXIT_FAILURE);
+		}
+	} else {
+		m_fin.open(path);
 		assert_good(m_fin, path);
-	if (m_in.peek() == EOF)
+	}
+	if (peek() == EOF)
 		cerr << m_path << ':' << m_line << ": warning: "
 			"file is empty\n";
 }
 
+FastaReader::~FastaReader()
+{
+	if (!eof()) {
+		string line;
+		getline(line);
+		die() << "expected end-of-file near\n"
+			<< line << '\n';
+		exit(EXIT_FAILURE);
+	}
+	if (m_fd > STDIN_FILENO)
+		close(m_fd);
+	delete m_gzip;
+	delete m_packed;
+}
+
+/** Read another block from the stream into the buffer. */
+bool FastaReader::readMore()
+{
+	if (m_streamEOF)
+		return false;
+	if (m_len == m_buf.size())
+		m_buf.resize(2 * m_buf.size());
+	if (m_gzip != NULL) {
+		size_t n = m_gzip->read(m_buf.data() + m_len,
+				m_buf.size() - m_len);
+		m_len += n;
+		if (n == 0)
+			m_streamEOF = true;
+		return n > 0;
+	}
+	if (m_fd >= 0) {
+		// A read of a pipe returns as soon as any data is available.
+		// Waiting for a full block could deadlock a reader of two
+		// FIFOs that are written in lockstep, such as PairedReader.
+		ssize_t n;
+		do {
+			n = ::read(m_fd, m_buf.data() + m_len,
+					m_buf.size() - m_len);
+		} while (n < 0 && errno == EINTR);
+		if (n < 0) {
+			cerr << "error: `" << m_path << "': "
+				<< strerror(errno) << endl;
+			exit(EXIT_FAILURE);
+		}
+		m_len += n;
+		if (n == 0)
+			m_streamEOF = true;
+		return n > 0;
+	}
+	m_in.read(m_buf.data() + m_len, m_buf.size() - m_len);
+	size_t n = m_in.gcount();
+	m_len += n;
+	if (m_in.bad()) {
+		cerr << "error: `" << m_path << "': " << strerror(errno) << endl;
+		exit(EXIT_FAILURE);
+	}
+	if (m_in.eof())
+		m_streamEOF = true;
+	return n > 0;
+}
+
+/** Discard the data that has been parsed. */
+void FastaReader::compact()
+{
+	if (m_pos == 0)
+		return;
+	memmove(m_buf.data(), m_buf.data() + m_pos, m_len - m_pos);
+	m_offset += m_pos;
+	m_len -= m_pos;
+	m_pos = 0;
+}
+
+/** Return the offset of the end of the line starting at i. */
+size_t FastaReader::findLineEnd(size_t i)
+{
+	for (;;) {
+		// memchr is vectorized by the C library.
+		const char* p = static_cast<const char*>(
+				memchr(m_buf.data() + i, '\n', m_len - i));
+		if (p != NULL)
+			return p - m_buf.data();
+		i = m_len;
+		if (!readMore())
+			return m_len;
+	}
+}
+
+/** Read a single line. */
+bool FastaReader::getline(string& s)
+{
+	s.clear();
+	if (peek() == EOF) {
+		m_failbit = true;
+		return false;
+	}
+	size_t end = findLineEnd(m_pos);
+	s.assign(m_buf.data() + m_pos, end - m_pos);
+	chomp(s, '\r');
+	m_line++;
+	if (end == m_len) {
+		m_pos = end;
+		m_eofbit = true;
+	} else
+		m_pos = end + 1;
+	return true;
+}
+
+/** Ignore the specified number of lines. */
+void FastaReader::ignoreLines(unsigned n)
+{
+	for (unsigned i = 0; i < n && peek() != EOF; ++i) {
+		size_t end = findLineEnd(m_pos);
+		m_pos = end == m_len ? end : end + 1;
+		m_line++;
+	}
+}
+
 /** Split the fasta file into nsections and seek to the start
  * of section. */
 void FastaReader::split(unsigned section, unsigned nsections)
@@ -65,33 +218,71 @@ void FastaReader::split(unsigned section, unsigned nsections)
 	assert(nsections >= section);
 	assert(section > 0);
 	assert(strcmp(m_path, "-") != 0);
+	if (m_packed != NULL) {
+		pair<size_t, size_t> range
+			= m_packed->partition(section - 1, nsections);
+		m_packedNext = range.first;
+		m_packedEnd = range.second;
+		m_eofbit = m_failbit = false;
+		if (peek() == EOF)
+			cerr << m_path << ':' << section << ": warning: "
+				"there are no reads in this section\n";
+		return;
+	}
 	if (nsections == 1)
 		return;
-	// Move the get pointer to the first entry in this section and
-	// update the m_end if there is more than one section.
+	if (m_gzip != NULL || !isSplittable(m_path)) {
+		cerr << "error: `" << m_path << "': "
+			"a compressed file cannot be split\n";
+		exit(EXIT_FAILURE);
+	}
+
+	// Find the record boundaries at the start and the end of this
+	// section, which depend on the format of the file.
+	m_in.clear();
 	m_in.seekg(0, ios::end);
-	streampos length = m_in.tellg();
+	streamoff length = m_in.tellg();
 	assert(length > 0);
-	streampos start = length * (section - 1) / nsections;
-	streampos end = length * section / nsections;
-	assert(end > 0);
-	if (end < length) {
-		m_in.seekg(end);
-		if (m_in.peek() == '>')
-			end += 1;
+	streamoff start = length * (section - 1) / nsections;
+	streamoff end = length * section / nsections;
+	m_in.seekg(0);
+	string line;
+	std::getline(m_in, line);
+	if (line.empty() || line[0] == '>') {
+		start = findBoundary(m_in, start,
+				IsFastaBoundary::WINDOW, IsFastaBoundary());
+		end = findBoundary(m_in, end,
+				IsFastaBoundary::WINDOW, IsFastaBoundary());
+	} else if (line[0] == '@' && !(line.size() >= 4
+				&& isalpha(line[1]) && isalpha(line[2])
+				&& line[3] == '\t')) {
+		start = findBoundary(m_in, start,
+				IsFastqBoundary::WINDOW, IsFastqBoundary());
+		end = findBoundary(m_in, end,
+				IsFastqBoundary::WINDOW, IsFastqBoundary());
+	} else {
+		// SAM, qseq and export files have one record per line.
+		start = findBoundary(m_in, start,
+				IsLineBoundary::WINDOW, IsLineBoundary());
+		end = findBoundary(m_in, end,
+				IsLineBoundary::WINDOW, IsLineBoundary());
 	}
-	m_end = end;
+	if (section == 1)
+		start = 0;
+	if (section == nsections)
+		end = length;
+
+	// Discard the buffer, and read the section.
+	m_in.clear();
 	m_in.seekg(start);
-	if (start > 0) {
-		m_in.ignore(numeric_limits<streamsize>::max(), '\n');
-		m_in.ignore(numeric_limits<streamsize>::max(), '>');
-		if (m_in.peek() == EOF)
-			cerr << m_path << ':' << section << ": warning: "
-				"there are no contigs in this section\n";
-		m_in.putback('>');
-	}
-	assert(m_end > 0);
 	assert(m_in.good());
+	m_pos = m_len = 0;
+	m_offset = start;
+	m_end = end;
+	m_streamEOF = m_eofbit = m_failbit = false;
+	if (start >= end || peek() == EOF)
+		cerr << m_path << ':' << section << ": warning: "
+			"there are no contigs in this section\n";
 }
 
 /** Return whether this read passed the chastity filter. */
@@ -109,9 +300,9 @@ bool FastaReader::isChaste(const string& s, const string& line)
 }
 
 /** Check that the seqeuence and quality agree in length. */
-void FastaReader::checkSeqQual(const string& s, const string& q)
+void FastaReader::checkSeqQual(const StringView& s, const StringView& q)
 {
-	if (s.length() != q.length()) {
+	if (s.size != q.size) {
 		die() << "sequence and quality must be the same length near\n"
 			<< s << '\n' << q << endl;
 		exit(EXIT_FAILURE);
@@ -119,251 +310,326 @@ void FastaReader::checkSeqQual(const string& s, const string& q)
 }
 
 /** Return whether the read seq is in colour space. */
-static bool isColourSpace(const string& seq)
+static bool isColourSpace(const StringView& seq)
 {
 	assert(!seq.empty());
-	size_t i = seq.find_first_of("ACGTacgt0123", 1);
-	return i != string::npos && isdigit(seq[i]);
+	for (size_t i = 1; i < seq.size; ++i)
+		if (strchr("ACGTacgt0123", seq[i]) != NULL)
+			return isdigit(seq[i]);
+	return false;
 }
 
-/** Read a single record. */
-Sequence FastaReader::read(string& id, string& comment,
-		char& anchor, string& q)
+/** Return the length of the line [i, end) without a carriage return. */
+static inline size_t chompLength(const vector<char>& buf,
+		size_t i, size_t end)
 {
-next_record:
-	id.clear();
-	comment.clear();
-	anchor = 0;
-	q.clear();
-
-	// Discard comments.
-	while (m_in.peek() == '#')
-		ignoreLines(1);
+	return end > i && buf[end - 1] == '\r' ? end - i - 1 : end - i;
+}
 
-	signed char recordType = m_in.peek();
-	Sequence s;
-
-	unsigned qualityOffset = 0;
-	if (recordType == EOF || m_in.tellg() >= m_end) {
-		m_in.seekg(0, ios::end);
-		m_in.clear(std::ios::eofbit | std::ios::failbit);
-		return s;
-	} else if (recordType == '>' || recordType == '@') {
-		// Read the header.
-		string header;
-		getline(header);
-		istringstream headerStream(header);
-
-		// Ignore SAM headers.
-		if (header[0] == '@' && isalpha(header[1])
-				&& isalpha(header[2]) && header[3] == '\t')
-			goto next_record;
-
-		headerStream >> recordType >> id >> ws;
-		std::getline(headerStream, comment);
-
-		// Casava FASTQ format
-		if (comment.size() > 3
-				&& comment[1] == ':' && comment[3] == ':') {
-			// read, chastity, flags, index: 1:Y:0:AAAAAA
-			if (opt::chastityFilter && comment[2] == 'Y') {
-				m_unchaste++;
-				if (recordType == '@') {
-					ignoreLines(3);
-				} else {
-					while (m_in.peek() != '>' && m_in.peek() != '#'
-							&& ignoreLines(1))
-						;
-				}
-				goto next_record;
-			}
-			if (id.size() > 2 && id.rbegin()[1] != '/') {
-				// Add the read number to the ID.
-				id += '/';
-				id += comment[0];
+/** Parse a FASTA or FASTQ record in place in the buffer.
+ * @return false if the record is skipped
+ */
+bool FastaReader::readFastaRecord(RecordView& r)
+{
+	// Read the header. Offsets are used rather than pointers,
+	// because reading more of the file may move the buffer.
+	size_t header = m_pos;
+	size_t end = findLineEnd(header);
+	size_t headerEnd = header + chompLength(m_buf, header, end);
+	m_pos = end == m_len ? end : end + 1;
+	m_line++;
+	char recordType = m_buf[header];
+
+	// Ignore SAM headers.
+	if (recordType == '@' && headerEnd - header >= 4
+			&& isalpha(m_buf[header + 1]) && isalpha(m_buf[header + 2])
+			&& m_buf[header + 3] == '\t')
+		return false;
+
+	size_t i = header + 1;
+	while (i < headerEnd && isspace(m_buf[i]))
+		i++;
+	size_t idStart = i;
+	while (i < headerEnd && !isspace(m_buf[i]))
+		i++;
+	size_t idEnd = i;
+	while (i < headerEnd && isspace(m_buf[i]))
+		i++;
+	size_t commentStart = i;
+	const char* comment = m_buf.data() + commentStart;
+
+	// Casava FASTQ format
+	if (headerEnd - commentStart > 3
+			&& comment[1] == ':' && comment[3] == ':') {
+		// read, chastity, flags, index: 1:Y:0:AAAAAA
+		if (opt::chastityFilter && comment[2] == 'Y') {
+			m_unchaste++;
+			if (recordType == '@') {
+				ignoreLines(3);
+			} else {
+				while (peek() != '>' && peek() != '#'
+						&& peek() != EOF)
+					ignoreLines(1);
 			}
+			return false;
 		}
-
-		getline(s);
-		if (recordType == '>') {
-			// Read a multi-line FASTA record.
-			string line;
-			while (m_in.peek() != '>' && m_in.peek() != '#'
-					&& getline(line))
-				s += line;
-			if (m_in.eof())
-				m_in.clear();
+		if (idEnd - idStart > 2 && m_buf[idEnd - 2] != '/') {
+			// Add the read number to the ID. Move the ID over the
+			// record type to make room for the slash, and overwrite
+			// the white-space that follows the ID.
+			char* p = m_buf.data();
+			memmove(p + idStart - 1, p + idStart, idEnd - idStart);
+			p[idEnd - 1] = '/';
+			p[idEnd] = comment[0];
+			idStart--;
+			idEnd++;
 		}
+	}
 
-		if (recordType == '@') {
-			char c = m_in.get();
-			if (c != '+') {
-				string line;
-				getline(line);
-				die() << "expected `+' and saw ";
-				if (m_in.eof())
-					cerr << "end-of-file\n";
-				else
-					cerr << "`" << c << "' near\n"
-					<< c << line << "\n";
-				exit(EXIT_FAILURE);
-			}
-			ignoreLines(1);
-			getline(q);
-		} else
-			q.clear();
+	// Read the sequence.
+	size_t seqStart = m_pos;
+	end = findLineEnd(seqStart);
+	size_t seqLen = chompLength(m_buf, seqStart, end);
+	m_pos = end == m_len ? end : end + 1;
+	m_line++;
+	if (recordType == '>') {
+		// Read a multi-line FASTA record, and join its lines.
+		while (peek() != '>' && peek() != '#' && peek() != EOF) {
+			end = findLineEnd(m_pos);
+			size_t n = chompLength(m_buf, m_pos, end);
+			memmove(m_buf.data() + seqStart + seqLen,
+					m_buf.data() + m_pos, n);
+			seqLen += n;
+			m_pos = end == m_len ? end : end + 1;
+			m_line++;
+		}
+		m_eofbit = false;
+	}
 
-		if (s.empty()) {
-			die() << "sequence with ID `" << id << "' is empty\n";
+	size_t qualStart = 0, qualLen = 0;
+	if (recordType == '@') {
+		int c = peek();
+		if (c != '+') {
+			string line;
+			if (c != EOF)
+				m_pos++;
+			getline(line);
+			die() << "expected `+' and saw ";
+			if (c == EOF)
+				cerr << "end-of-file\n";
+			else
+				cerr << "`" << (char)c << "' near\n"
+				<< (char)c << line << "\n";
 			exit(EXIT_FAILURE);
 		}
-
-		bool colourSpace = isColourSpace(s);
-		if (colourSpace && !isdigit(s[0])) {
-			// The first character is the primer base. The second
-			// character is the dibase read of the primer and the
-			// first base of the sample, which is not part of the
-			// assembly.
-			assert(s.length() > 2);
-			anchor = colourToNucleotideSpace(s[0], s[1]);
-			s.erase(0, 2);
-			q.erase(0, 1);
+		ignoreLines(1);
+		if (peek() != EOF) {
+			qualStart = m_pos;
+			end = findLineEnd(qualStart);
+			qualLen = chompLength(m_buf, qualStart, end);
+			m_pos = end == m_len ? end : end + 1;
+			m_line++;
 		}
+		m_eofbit = false;
+	}
 
+	const char* p = m_buf.data();
+	r.id = StringView(p + idStart, idEnd - idStart);
+	r.comment = StringView(p + commentStart, headerEnd - commentStart);
+	r.seq = StringView(p + seqStart, seqLen);
+	r.qual = qualLen > 0 ? StringView(p + qualStart, qualLen)
+		: StringView();
+	r.anchor = 0;
+
+	StringView& s = r.seq;
+	StringView& q = r.qual;
+	if (s.empty()) {
+		die() << "sequence with ID `" << r.id << "' is empty\n";
+		exit(EXIT_FAILURE);
+	}
+
+	bool colourSpace = isColourSpace(s);
+	if (colourSpace && !isdigit(s[0])) {
+		// The first character is the primer base. The second
+		// character is the dibase read of the primer and the
+		// first base of the sample, which is not part of the
+		// assembly.
+		assert(s.size > 2);
+		r.anchor = colourToNucleotideSpace(s[0], s[1]);
+		s = StringView(s.data + 2, s.size - 2);
+		if (!q.empty())
+			q = StringView(q.data + 1, q.size - 1);
+	}
+
+	if (!q.empty())
+		checkSeqQual(s, q);
+
+	if (opt::trimMasked && !colourSpace) {
+		// Removed masked (lower case) sequence at the beginning
+		// and end of the read.
+		size_t trimFront = 0;
+		while (trimFront < s.size && islower(s[trimFront]))
+			trimFront++;
+		size_t trimBack = s.size;
+		while (trimBack > trimFront && islower(s[trimBack - 1]))
+			trimBack--;
+		s = StringView(s.data + trimFront, trimBack - trimFront);
 		if (!q.empty())
-			checkSeqQual(s, q);
-
-		if (opt::trimMasked && !colourSpace) {
-			// Removed masked (lower case) sequence at the beginning
-			// and end of the read.
-			size_t trimFront = 0;
-			while (trimFront <= s.length() && islower(s[trimFront]))
-				trimFront++;
-			size_t trimBack = s.length();
-			while (trimBack > 0 && islower(s[trimBack - 1]))
-				trimBack--;
-			s.erase(trimBack);
-			s.erase(0, trimFront);
-			if (!q.empty()) {
-				q.erase(trimBack);
-				q.erase(0, trimFront);
+			q = StringView(q.data + trimFront, trimBack - trimFront);
+	}
+	if (flagFoldCase()) {
+		// The record is in the buffer, which may be modified.
+		char* first = const_cast<char*>(s.data);
+		transform(first, first + s.size, first, ::toupper);
+	}
+	return true;
+}
+
+/** Read a SAM, qseq or export record.
+ * @return false if the record is skipped
+ */
+bool FastaReader::readOtherRecord(RecordView& r, unsigned& qualityOffset)
+{
+	string line;
+	vector<string> fields;
+	fields.reserve(22);
+	getline(line);
+	istringstream in(line);
+	string field;
+	while (std::getline(in, field, '\t'))
+		fields.push_back(field);
+
+	m_owned.push_back(OwnedRecord());
+	OwnedRecord& o = m_owned.back();
+	string& id = o.id;
+	string& comment = o.comment;
+	string& s = o.seq;
+	string& q = o.qual;
+
+	if (fields.size() >= 11
+			&& (fields[9].length() == fields[10].length()
+				|| fields[10] == "*")) {
+		// SAM
+		unsigned flags = strtoul(fields[1].c_str(), NULL, 0);
+		if (flags & 0x100) // FSECONDARY
+			return false;
+		if (opt::chastityFilter && (flags & 0x200)) { // FQCFAIL
+			m_unchaste++;
+			return false;
+		}
+		id = fields[0];
+		char which_read = '0';
+		switch (flags & 0xc1) { // FPAIRED|FREAD1|FREAD2
+		  case 0:
+		  case 1: // FPAIRED
+			which_read = '0';
+			break;
+		  case 0x41: // FPAIRED|FREAD1
+			id += "/1";
+			which_read = '1';
+			break;
+		  case 0x81: // FPAIRED|FREAD2
+			id += "/2";
+			which_read = '2';
+			break;
+		  default:
+			die() << "invalid flags: `" << id << "' near"
+				<< line << endl;
+			exit(EXIT_FAILURE);
+		}
+		if (opt::bxTag) {
+			// Copy the linked-reads barcode BX tag to the FASTA comment.
+			for (unsigned i = 11; i < fields.size(); ++i) {
+				if (startsWith(fields[i], "BX:Z:")) {
+					comment = fields[i];
+					break;
+				}
 			}
+		} else {
+			comment = flags & 0x200 ? "0:Y:0:" : "0:N:0:"; // FQCFAIL
+			comment[0] = which_read;
 		}
-		if (flagFoldCase())
-			transform(s.begin(), s.end(), s.begin(), ::toupper);
 
+		s = fields[9];
+		q = fields[10];
+		if (s == "*")
+			s.clear();
+		if (q == "*")
+			q.clear();
+		if (flags & 0x10) { // FREVERSE
+			s = reverseComplement(s);
+			reverse(q.begin(), q.end());
+		}
 		qualityOffset = 33;
+		if (!q.empty() && s.length() != q.length())
+			checkSeqQual(StringView(s.data(), s.size()),
+					StringView(q.data(), q.size()));
+
+	} else if (fields.size() == 11 || fields.size() == 22) {
+		// qseq or export
+		if (opt::chastityFilter
+				&& !isChaste(fields.back(), line)) {
+			m_unchaste++;
+			return false;
+		}
+
+		ostringstream os;
+		os << fields[0];
+		for (int i = 1; i < 6; i++)
+			if (!fields[i].empty())
+				os << ':' << fields[i];
+		if (!fields[6].empty() && fields[6] != "0")
+			os << '#' << fields[6];
+		// The reverse read is typically the second read, but is
+		// the third read of an indexed run.
+		os << '/' << (fields[7] == "3" ? "2" : fields[7]);
+		id = os.str();
+		comment = fields[7];
+		comment += isChaste(fields.back(), line)
+			? ":N:0:" : ":Y:0:";
+		s = fields[8];
+		q = fields[9];
+		qualityOffset = 64;
+		checkSeqQual(StringView(s.data(), s.size()),
+				StringView(q.data(), q.size()));
 	} else {
-		string line;
-		vector<string> fields;
-		fields.reserve(22);
-		getline(line);
-		istringstream in(line);
-		string field;
-		while (std::getline(in, field, '\t'))
-			fields.push_back(field);
-
-		if (fields.size() >= 11
-				&& (fields[9].length() == fields[10].length()
-					|| fields[10] == "*")) {
-			// SAM
-			unsigned flags = strtoul(fields[1].c_str(), NULL, 0);
-			if (flags & 0x100) // FSECONDARY
-				goto next_record;
-			if (opt::chastityFilter && (flags & 0x200)) { // FQCFAIL
-				m_unchaste++;
-				goto next_record;
-			}
-			id = fields[0];
-			char which_read = '0';
-			switch (flags & 0xc1) { // FPAIRED|FREAD1|FREAD2
-			  case 0:
-			  case 1: // FPAIRED
-				which_read = '0';
-				break;
-			  case 0x41: // FPAIRED|FREAD1
-				id += "/1";
-				which_read = '1';
-				break;
-			  case 0x81: // FPAIRED|FREAD2
-				id += "/2";
-				which_read = '2';
-				break;
-			  default:
-				die() << "invalid flags: `" << id << "' near"
-					<< line << endl;
-				exit(EXIT_FAILURE);
-			}
-			if (opt::bxTag) {
-				// Copy the linked-reads barcode BX tag to the FASTA comment.
-				for (unsigned i = 11; i < fields.size(); ++i) {
-					if (startsWith(fields[i], "BX:Z:")) {
-						comment = fields[i];
-						break;
-					}
-				}
-			} else {
-				comment = flags & 0x200 ? "0:Y:0:" : "0:N:0:"; // FQCFAIL
-				comment[0] = which_read;
-			}
+		die() << "Expected either `>' or `@' or 11 fields\n"
+				"and saw `" << (line.empty() ? '\0' : line[0]) << "' and "
+				<< fields.size() << " fields near\n"
+				<< line << endl;
+		exit(EXIT_FAILURE);
+	}
 
-			s = fields[9];
-			q = fields[10];
-			if (s == "*")
-				s.clear();
-			if (q == "*")
-				q.clear();
-			if (flags & 0x10) { // FREVERSE
-				s = reverseComplement(s);
-				reverse(q.begin(), q.end());
-			}
-			qualityOffset = 33;
-			if (!q.empty())
-				checkSeqQual(s, q);
-
-		} else if (fields.size() == 11 || fields.size() == 22) {
-			// qseq or export
-			if (opt::chastityFilter
-					&& !isChaste(fields.back(), line)) {
-				m_unchaste++;
-				goto next_record;
-			}
+	r.id = StringView(id.data(), id.size());
+	r.comment = StringView(comment.data(), comment.size());
+	r.seq = StringView(s.data(), s.size());
+	r.qual = StringView(q.data(), q.size());
+	r.anchor = 0;
+	return true;
+}
 
-			ostringstream o;
-			o << fields[0];
-			for (int i = 1; i < 6; i++)
-				if (!fields[i].empty())
-					o << ':' << fields[i];
-			if (!fields[6].empty() && fields[6] != "0")
-				o << '#' << fields[6];
-			// The reverse read is typically the second read, but is
-			// the third read of an indexed run.
-			o << '/' << (fields[7] == "3" ? "2" : fields[7]);
-			id = o.str();
-			comment = fields[7];
-			comment += isChaste(fields.back(), line)
-				? ":N:0:" : ":Y:0:";
-			s = fields[8];
-			q = fields[9];
-			qualityOffset = 64;
-			checkSeqQual(s, q);
-		} else {
-			die() << "Expected either `>' or `@' or 11 fields\n"
-					"and saw `" << recordType << "' and "
-					<< fields.size() << " fields near\n"
-					<< line << endl;
-			exit(EXIT_FAILURE);
-		}
-	}
+/** Trim a record to the maximum length and by quality, and convert
+ * its quality to standard quality.
+ */
+void FastaReader::trimRecord(RecordView& r, unsigned qualityOffset)
+{
+	StringView& s = r.seq;
+	StringView& q = r.qual;
 
-	if (opt::qualityOffset > 0)
+	// The record is in the buffer or in m_owned, which may be
+	// modified.
+	char* seq = const_cast<char*>(s.data);
+	char* qual = const_cast<char*>(q.data);
+
+	// The quality of a read cache is always standard quality.
+	if (opt::qualityOffset > 0 && m_packed == NULL)
 		qualityOffset = opt::qualityOffset;
 
 	// Trim from the 3' end to the maximum length. Then, trim based on
 	// quality.
 	if (m_maxLength > 0) {
-		s.erase(m_maxLength);
-		q.erase(m_maxLength);
+		s.size = min(s.size, (size_t)m_maxLength);
+		q.size = min(q.size, (size_t)m_maxLength);
 	}
 
 	static const char ASCII[] =
@@ -371,51 +637,178 @@ next_record:
 		"@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_"
 		"`abcdefghijklmnopqrstuvwxyz{|}~";
 	if (opt::qualityThreshold > 0 && !q.empty()) {
-		assert(s.length() == q.length());
+		assert(s.size == q.size);
 		assert(qualityOffset > (unsigned)ASCII[0]);
-		const char* goodQual = ASCII + (qualityOffset - ASCII[0])
-			+ opt::qualityThreshold;
-		size_t trimFront = q.find_first_of(goodQual);
-		size_t trimBack = q.find_last_of(goodQual) + 1;
+		const int goodQual = qualityOffset + opt::qualityThreshold;
+		size_t trimFront = 0;
+		while (trimFront < q.size
+				&& (q[trimFront] < goodQual || q[trimFront] > '~'))
+			trimFront++;
+		size_t trimBack = q.size;
+		while (trimBack > 0
+				&& (q[trimBack - 1] < goodQual || q[trimBack - 1] > '~'))
+			trimBack--;
 		if (trimFront >= trimBack) {
 			// The entire read is poor quality.
-			s.erase(1);
-			q.erase(1);
-		} else if (trimFront > 0 || trimBack < q.length()) {
-			s.erase(trimBack);
-			s.erase(0, trimFront);
-			q.erase(trimBack);
-			q.erase(0, trimFront);
+			s.size = min(s.size, (size_t)1);
+			q.size = min(q.size, (size_t)1);
+		} else if (trimFront > 0 || trimBack < q.size) {
+			s = StringView(s.data + trimFront, trimBack - trimFront);
+			q = StringView(q.data + trimFront, trimBack - trimFront);
+			seq += trimFront;
+			qual += trimFront;
 		}
 	}
 
 	if (opt::internalQThreshold > 0 && !q.empty()) {
-		assert(s.length() == q.length());
+		assert(s.size == q.size);
 		assert(qualityOffset > (unsigned)ASCII[0]);
-		const char* internalGoodQual = ASCII
-			+ (qualityOffset - ASCII[0])
+		const int internalGoodQual = qualityOffset
 			+ opt::internalQThreshold;
-		size_t i = 0;
-		while ((i = q.find_first_not_of(internalGoodQual, i))
-				!= string::npos)
-			s[i++] = 'N';
+		for (size_t i = 0; i < q.size; ++i)
+			if (q[i] < internalGoodQual || q[i] > '~')
+				seq[i] = 'N';
 	}
 
 	assert(qualityOffset >= 33);
 	if (flagConvertQual() && qualityOffset != 33) {
 		// Convert to standard quality (ASCII 33).
-		for (string::iterator it = q.begin(); it != q.end(); ++it) {
-			int x = *it - qualityOffset;
+		for (size_t i = 0; i < q.size; ++i) {
+			int x = q[i] - qualityOffset;
 			if (x < -5 || x > 41) {
 				die() << "quality " << x
 					<< " is out of range -5 <= q <= 41 near\n"
 					<< q << '\n'
-					<< string(it - q.begin(), ' ') << "^\n";
+					<< string(i, ' ') << "^\n";
 				exit(EXIT_FAILURE);
 			}
-			*it = 33 + max(0, x);
+			qual[i] = 33 + max(0, x);
 		}
 	}
+}
+
+/** Return the type of the next record of the read cache, or EOF. */
+int FastaReader::peekPacked()
+{
+	if (m_packedNext == m_packedEnd) {
+		m_eofbit = true;
+		return EOF;
+	}
+	return m_packed->hasQuality() ? '@' : '>';
+}
 
-	return s;
+/** Decode the next record of the read cache. The filters of the
+ * parser were applied when the cache was written.
+ */
+bool FastaReader::readPackedRecord(RecordView& r)
+{
+	r = RecordView();
+	if (m_packedNext == m_packedEnd) {
+		m_eofbit = m_failbit = true;
+		return false;
+	}
+	m_owned.push_back(OwnedRecord());
+	OwnedRecord& o = m_owned.back();
+	m_packed->get(m_packedNext++, o.id, o.comment, o.seq, o.qual);
+	m_line++;
+	r.id = StringView(o.id.data(), o.id.size());
+	r.comment = StringView(o.comment.data(), o.comment.size());
+	r.seq = StringView(o.seq.data(), o.seq.size());
+	r.qual = StringView(o.qual.data(), o.qual.size());
+	trimRecord(r, 33);
+	return true;
+}
+
+/** Read the next record, skipping filtered records. */
+bool FastaReader::readRecord(RecordView& r)
+{
+	if (m_packed != NULL)
+		return readPackedRecord(r);
+	for (;;) {
+		r = RecordView();
+
+		// Discard comments.
+		while (peek() == '#')
+			ignoreLines(1);
+
+		int recordType = peek();
+		if (recordType == EOF || tell() >= m_end) {
+			// Ignore the rest of this section.
+			m_pos = m_len;
+			m_streamEOF = true;
+			m_eofbit = m_failbit = true;
+			return false;
+		}
+
+		unsigned qualityOffset = 33;
+		if (recordType == '>' || recordType == '@'
+				? readFastaRecord(r)
+				: readOtherRecord(r, qualityOffset)) {
+			trimRecord(r, qualityOffset);
+			return true;
+		}
+	}
+}
+
+/** Read the next record without copying it. */
+bool FastaReader::read(RecordView& r)
+{
+	m_owned.clear();
+	if (m_pos > m_buf.size() / 2)
+		compact();
+	return readRecord(r);
+}
+
+/** Move the views of a record from one buffer to another. */
+static void rebase(StringView& s, const char* from, size_t size,
+		const char* to)
+{
+	if (s.data >= from && s.data <= from + size)
+		s.data = to + (s.data - from);
+}
+
+/** Read records until their sequences total at least maxBases. */
+size_t FastaReader::readBatch(vector<RecordView>& batch,
+		size_t maxBases)
+{
+	batch.clear();
+	m_owned.clear();
+	compact();
+
+	const char* base = m_buf.data();
+	size_t baseSize = m_buf.size();
+	size_t bases = 0;
+	for (RecordView r; bases < maxBases && readRecord(r);) {
+		if (m_buf.data() != base) {
+			// The buffer grew. Move the earlier records.
+			const char* to = m_buf.data();
+			for (vector<RecordView>::iterator it = batch.begin();
+					it != batch.end(); ++it) {
+				rebase(it->id, base, baseSize, to);
+				rebase(it->comment, base, baseSize, to);
+				rebase(it->seq, base, baseSize, to);
+				rebase(it->qual, base, baseSize, to);
+			}
+			base = to;
+			baseSize = m_buf.size();
+		}
+		bases += r.seq.size;
+		batch.push_back(r);
+	}
+	if (!batch.empty())
+		m_failbit = false;
+	return batch.size();
+}
+
+/** Read a single record. */
+Sequence FastaReader::read(string& id, string& comment,
+		char& anchor, string& q)
+{
+	RecordView r;
+	read(r);
+	r.id.copyTo(id);
+	r.comment.copyTo(comment);
+	anchor = r.anchor;
+	r.qual.copyTo(q);
+	return r.seq.str();
 }
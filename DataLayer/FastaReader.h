@@ -2,15 +2,52 @@
 #define FASTAREADER_H 1
 
 #include "Common/Sequence.h"
+#include "Common/StringView.h"
 #include "Common/StringUtil.h" // for chomp
 #include <cassert>
+#include <cctype>
 #include <cstdlib> // for exit
+#include <cstring>
+#include <deque>
 #include <fstream>
 #include <istream>
 #include <limits> // for numeric_limits
 #include <ostream>
+#include <vector>
 
-/** Read a FASTA, FASTQ, export, qseq or SAM file. */
+class GzipReader;
+class PackedReads;
+
+/**
+ * A record read by FastaReader without copying. Its fields refer to the
+ * buffer of the FastaReader, and are valid until the next call to a
+ * read function of that FastaReader.
+ */
+struct RecordView
+{
+	/** Identifier */
+	StringView id;
+	/** Comment following the first white-space of the header */
+	StringView comment;
+	/** The sequence */
+	StringView seq;
+	/** Quality, which is empty for a FASTA record */
+	StringView qual;
+	/** Anchor base for a colour-space sequence */
+	char anchor;
+
+	RecordView() : anchor(0) { }
+
+	size_t size() const { return seq.size; }
+};
+
+/** Read a FASTA, FASTQ, export, qseq or SAM file, or a read cache
+ * written by abyss-pack.
+ * The file is read in large blocks, which FASTA and FASTQ records are
+ * parsed from in place. readBatch returns the records without
+ * copying them; read and the FastaRecord and FastqRecord extraction
+ * operators copy each record to strings.
+ */
 class FastaReader {
 	public:
 		enum {
@@ -22,42 +59,63 @@ class FastaReader {
 		bool flagFoldCase() { return ~m_flags & NO_FOLD_CASE; }
 		bool flagConvertQual() { return m_flags & CONVERT_QUALITY; }
 
+		/** Size of a block read from the input stream. */
+		static const size_t BLOCK_SIZE = 1 << 20;
+
 		FastaReader(const char* path, int flags, int len = 0);
 
-		~FastaReader()
-		{
-			if (!m_in.eof()) {
-				std::string line;
-				getline(line);
-				die() << "expected end-of-file near\n"
-					<< line << '\n';
-				exit(EXIT_FAILURE);
-			}
-		}
+		~FastaReader();
 
 		Sequence read(std::string& id, std::string& comment,
 				char& anchor, std::string& qual);
 
+		/** Read the next record without copying it.
+		 * @return false at end-of-file
+		 */
+		bool read(RecordView& record);
+
+		/** Read records until their sequences total at least
+		 * maxBases, or end-of-file.
+		 * @param batch the records, which are valid until the next
+		 * read from this FastaReader
+		 * @return the number of records read
+		 */
+		size_t readBatch(std::vector<RecordView>& batch,
+				size_t maxBases);
+
 		/** Split the fasta file into nsections and seek to the start
-		 * of section. */
+		 * of section. A read cache is split into sections of similar
+		 * numbers of bases. */
 		void split(unsigned section, unsigned nsections);
 
 		/** Return whether this stream is at end-of-file. */
-		bool eof() const { return m_in.eof(); };
+		bool eof() const { return m_eofbit; };
 
 		/** Return true if failbit or badbit of stream is set. */
-		bool fail() const { return m_in.fail(); };
+		bool fail() const { return m_failbit; };
 
 		/** Return whether this stream is good. */
-		operator const void*() const { return m_in ? this : NULL; }
+		operator const void*() const { return m_failbit ? NULL : this; }
 
 		/** Return the next character of this stream. */
-		int peek() { return m_in.peek(); }
+		int peek()
+		{
+			if (m_packed != NULL)
+				return peekPacked();
+			if (m_pos == m_len && !readMore()) {
+				m_eofbit = true;
+				return EOF;
+			}
+			return (unsigned char)m_buf[m_pos];
+		}
 
-		/** Interface for manipulators. */
+		/** Interface for manipulators. Only std::ws is supported. */
 		FastaReader& operator>>(std::istream& (*f)(std::istream&))
 		{
-			f(m_in);
+			assert(f == static_cast<std::istream& (*)(std::istream&)>(std::ws));
+			(void)f;
+			while (isspace(peek()))
+				m_pos++;
 			return *this;
 		}
 
@@ -73,36 +131,87 @@ class FastaReader {
 		}
 
 	private:
-		/** Read a single line. */
-		std::istream& getline(std::string& s)
+		/** A record of a format other than FASTA and FASTQ. */
+		struct OwnedRecord
 		{
-			if (std::getline(m_in, s)) {
-				chomp(s, '\r');
-				m_line++;
-			}
-			return m_in;
-		}
+			std::string id, comment, seq, qual;
+		};
+
+		/** Read a single line. */
+		bool getline(std::string& s);
 
 		/** Ignore the specified number of lines. */
-		std::istream& ignoreLines(unsigned n)
-		{
-			for (unsigned i = 0; i < n; ++i) {
-				if (m_in.ignore(
-						std::numeric_limits<std::streamsize>::max(),
-						'\n'))
-					m_line++;
-			}
-			return m_in;
-		}
+		void ignoreLines(unsigned n);
+
+		/** Return the offset of the end of the line starting at the
+		 * specified offset, which is the offset of its newline or the
+		 * end of the data at end-of-file.
+		 */
+		size_t findLineEnd(size_t i);
+
+		/** Read another block from the stream into the buffer,
+		 * growing the buffer if it is full.
+		 * @return false at the end of the stream
+		 */
+		bool readMore();
+
+		/** Discard the data that has been parsed. */
+		void compact();
+
+		/** Return the offset in the stream of the next character. */
+		std::streamoff tell() const { return m_offset + m_pos; }
+
+		bool readRecord(RecordView& record);
+		bool readPackedRecord(RecordView& record);
+		int peekPacked();
+		bool readFastaRecord(RecordView& record);
+		bool readOtherRecord(RecordView& record,
+				unsigned& qualityOffset);
+		void trimRecord(RecordView& record, unsigned qualityOffset);
 
 		std::ostream& die();
 		bool isChaste(const std::string& s, const std::string& line);
-		void checkSeqQual(const std::string& s, const std::string& q);
+		void checkSeqQual(const StringView& s, const StringView& q);
 
 		const char* m_path;
 		std::ifstream m_fin;
 		std::istream& m_in;
 
+		/** The descriptor of an input that is not a regular file,
+		 * such as a pipe, which is read by read(2), or -1.
+		 */
+		int m_fd;
+
+		/** Decompressor of a gzip file, or NULL. */
+		GzipReader* m_gzip;
+
+		/** A read cache, or NULL. */
+		PackedReads* m_packed;
+
+		/** The range of records of the read cache to read. */
+		size_t m_packedNext, m_packedEnd;
+
+		/** The block buffer. */
+		std::vector<char> m_buf;
+
+		/** Offset in the buffer of the next character to parse. */
+		size_t m_pos;
+
+		/** Size of the data in the buffer. */
+		size_t m_len;
+
+		/** Offset in the stream of the start of the buffer. */
+		std::streamoff m_offset;
+
+		/** Whether the end of the stream has been read. */
+		bool m_streamEOF;
+
+		/** Stream state of the parser. */
+		bool m_eofbit, m_failbit;
+
+		/** Records of other formats than FASTA and FASTQ. */
+		std::deque<OwnedRecord> m_owned;
+
 		/** Flags indicating parsing options. */
 		int m_flags;
 
@@ -146,10 +255,20 @@ struct FastaRecord
 
 	size_t size() const { return seq.size(); }
 
+	/** Copy a record, reusing the storage of this record. */
+	void assign(const RecordView& r)
+	{
+		r.id.copyTo(id);
+		r.comment.copyTo(comment);
+		anchor = r.anchor;
+		r.seq.copyTo(seq);
+	}
+
 	friend FastaReader& operator >>(FastaReader& in, FastaRecord& o)
 	{
-		std::string q;
-		o.seq = in.read(o.id, o.comment, o.anchor, q);
+		RecordView r;
+		in.read(r);
+		o.assign(r);
 		return in;
 	}
 
@@ -177,9 +296,18 @@ struct FastqRecord : FastaRecord
 		assert(seq.length() == qual.length());
 	}
 
+	/** Copy a record, reusing the storage of this record. */
+	void assign(const RecordView& r)
+	{
+		FastaRecord::assign(r);
+		r.qual.copyTo(qual);
+	}
+
 	friend FastaReader& operator >>(FastaReader& in, FastqRecord& o)
 	{
-		o.seq = in.read(o.id, o.comment, o.anchor, o.qual);
+		RecordView r;
+		in.read(r);
+		o.assign(r);
 		return in;
 	}
 
@@ -1,10 +1,10 @@
 #ifndef FASTAWRITER_H
 #define FASTAWRITER_H 1
 
+#include "Common/BufferedWriter.h"
 #include "Common/Sequence.h"
-#include <cstdio>
 
-/** Output a FASTA file. */
+/** Output a FASTA file, which is compressed if its name ends in .gz. */
 class FastaWriter {
 	public:
 		// Constructor opens file
@@ -31,8 +31,7 @@ class FastaWriter {
 				const std::string& comment);
 
 	private:
-		const char *m_path;
-		FILE* m_fileHandle;
+		BufferedWriter m_out;
 };
 
 #endif
@@ -0,0 +1,344 @@
+#include "DataLayer/PackedReads.h"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <unistd.h>
+
+using namespace std;
+using namespace PackedFormat;
+
+/** The alignment of the sections of the file. */
+static const size_t ALIGNMENT = 8;
+
+/** The two-bit code of each base, or 4 if it is not ACGT. */
+static const uint8_t* baseCodes()
+{
+	static uint8_t codes[256];
+	static bool init = false;
+	if (!init) {
+		memset(codes, 4, sizeof codes);
+		codes['A'] = codes['a'] = 0;
+		codes['C'] = codes['c'] = 1;
+		codes['G'] = codes['g'] = 2;
+		codes['T'] = codes['t'] = 3;
+		init = true;
+	}
+	return codes;
+}
+
+static const uint8_t* const BASE_CODES = baseCodes();
+
+static const char CODE_BASES[4] = { 'A', 'C', 'G', 'T' };
+
+/** The four bases of each byte of packed bases. */
+static const char* byteBases()
+{
+	static char bases[256][4];
+	for (unsigned x = 0; x < 256; ++x)
+		for (unsigned i = 0; i < 4; ++i)
+			bases[x][i] = CODE_BASES[x >> (2 * i) & 3];
+	return bases[0];
+}
+
+static const char* const BYTE_BASES = byteBases();
+
+PackedReads::PackedReads(const string& path)
+	: m_file(path)
+{
+	const char* p = m_file.data();
+	m_header = reinterpret_cast<const Header*>(p);
+	if (m_file.size() < sizeof *m_header
+			|| memcmp(m_header->magic, MAGIC, sizeof MAGIC) != 0
+			|| m_header->version != 1) {
+		cerr << "error: `" << path << "': "
+			"not a read cache written by abyss-pack\n";
+		exit(EXIT_FAILURE);
+	}
+	if (m_header->indexOffset
+			+ (m_header->records + 1) * sizeof *m_index
+			> m_file.size()) {
+		cerr << "error: `" << path << "': the file is truncated\n";
+		exit(EXIT_FAILURE);
+	}
+	m_index = reinterpret_cast<const IndexEntry*>(
+			p + m_header->indexOffset);
+	m_nRuns = reinterpret_cast<const NRun*>(p + m_header->nRunOffset);
+	m_seq = reinterpret_cast<const uint8_t*>(p + m_header->seqOffset);
+	m_qual = reinterpret_cast<const uint8_t*>(
+			p + m_header->qualOffset);
+	m_names = p + m_header->nameOffset;
+
+	const uint8_t* bins = m_header->qualityBins;
+	m_byteQuals.resize(2 * 256);
+	for (unsigned x = 0; x < 256; ++x) {
+		m_byteQuals[2 * x] = 33 + bins[x & 0xf];
+		m_byteQuals[2 * x + 1] = 33 + bins[x >> 4];
+	}
+}
+
+void PackedReads::get(size_t i, string& id, string& comment,
+		string& seq, string& qual) const
+{
+	assert(i < size());
+	const IndexEntry& e = m_index[i];
+	const IndexEntry& next = m_index[i + 1];
+
+	// The header is the ID and the comment, separated by a space.
+	const char* name = m_names + e.name;
+	const char* nameEnd = m_names + next.name;
+	const char* sep = static_cast<const char*>(
+			memchr(name, ' ', nameEnd - name));
+	if (sep == NULL) {
+		id.assign(name, nameEnd);
+		comment.clear();
+	} else {
+		id.assign(name, sep);
+		comment.assign(sep + 1, nameEnd);
+	}
+
+	size_t n = next.base - e.base;
+	seq.resize(n);
+	uint64_t b = e.base;
+	size_t j = 0;
+	for (; j < n && (b & 3) != 0; ++j, ++b)
+		seq[j] = CODE_BASES[m_seq[b >> 2] >> (2 * (b & 3)) & 3];
+	// Decode four bases at a time.
+	for (; j + 4 <= n; j += 4, b += 4)
+		memcpy(&seq[j], BYTE_BASES + 4 * m_seq[b >> 2], 4);
+	for (; j < n; ++j, ++b)
+		seq[j] = CODE_BASES[m_seq[b >> 2] >> (2 * (b & 3)) & 3];
+	for (uint32_t r = e.nRun; r < next.nRun; ++r) {
+		const NRun& run = m_nRuns[r];
+		assert(run.pos + run.length <= n);
+		fill_n(seq.begin() + run.pos, run.length, 'N');
+	}
+
+	qual.clear();
+	if (hasQuality() && e.hasQuality) {
+		qual.resize(n);
+		b = e.base;
+		j = 0;
+		if (n > 0 && (b & 1) != 0)
+			qual[j++] = m_byteQuals[2 * m_qual[b++ >> 1] + 1];
+		// Decode two qualities at a time.
+		for (; j + 2 <= n; j += 2, b += 2)
+			memcpy(&qual[j], &m_byteQuals[2 * m_qual[b >> 1]], 2);
+		if (j < n)
+			qual[j] = m_byteQuals[2 * m_qual[b >> 1]];
+	}
+}
+
+/** Return the index of the record that contains the specified base,
+ * or the number of records if it is past the last base.
+ */
+size_t PackedReads::findBase(uint64_t base) const
+{
+	size_t lo = 0, hi = size();
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (m_index[mid + 1].base <= base)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+pair<size_t, size_t> PackedReads::partition(unsigned part,
+		unsigned nparts) const
+{
+	assert(part < nparts);
+	// A partition starts with the record that contains its first
+	// base.
+	size_t first = part == 0 ? 0
+		: findBase(bases() * part / nparts);
+	size_t last = part + 1 == nparts ? size()
+		: findBase(bases() * (part + 1) / nparts);
+	return make_pair(first, last);
+}
+
+PackedReadsWriter::PackedReadsWriter(const string& path, bool quality)
+	: m_path(path), m_header(), m_seqByte(0), m_qualByte(0)
+{
+	memcpy(m_header.magic, MAGIC, sizeof MAGIC);
+	m_header.version = 1;
+	m_header.flags = quality ? HAS_QUALITY : 0;
+	m_header.seqOffset = sizeof m_header;
+	copy(QUALITY_BINS, QUALITY_BINS + NUM_BINS, m_header.qualityBins);
+	for (unsigned q = 0, bin = 0; q < 256; ++q) {
+		unsigned phred = q < 33 ? 0 : q - 33;
+		while (bin + 1 < NUM_BINS && QUALITY_BINS[bin + 1] <= phred)
+			bin++;
+		m_binOf[q] = bin;
+	}
+
+	m_file = fopen(path.c_str(), "w");
+	if (m_file == NULL)
+		die(path);
+	// The header is written when the file is closed.
+	put(m_file, &m_header, sizeof m_header);
+
+	m_nRunFile = openTemp(".nrun");
+	m_nameFile = openTemp(".name");
+	m_qualFile = quality ? openTemp(".qual") : NULL;
+	m_indexFile = openTemp(".index");
+}
+
+/** Print an error message and exit. */
+void PackedReadsWriter::die(const string& path)
+{
+	cerr << "error: `" << path << "': " << strerror(errno) << endl;
+	exit(EXIT_FAILURE);
+}
+
+/** Write to a file. */
+void PackedReadsWriter::put(FILE* f, const void* p, size_t n)
+{
+	if (fwrite(p, 1, n, f) != n)
+		die(m_path);
+}
+
+/** Open a temporary file next to the output file. The file is
+ * removed when it is closed. */
+FILE* PackedReadsWriter::openTemp(const char* suffix)
+{
+	string path = m_path + suffix + ".tmp";
+	FILE* f = fopen(path.c_str(), "w+");
+	if (f == NULL)
+		die(path);
+	unlink(path.c_str());
+	return f;
+}
+
+/** Return the index of the next run of N, which an index entry
+ * stores in 32 bits. */
+uint32_t PackedReadsWriter::nextNRun()
+{
+	if (m_header.nRuns > numeric_limits<uint32_t>::max()) {
+		cerr << "error: `" << m_path << "': too many runs of N\n";
+		exit(EXIT_FAILURE);
+	}
+	return m_header.nRuns;
+}
+
+void PackedReadsWriter::write(const StringView& id,
+		const StringView& comment,
+		const StringView& seq, const StringView& qual)
+{
+	assert(m_file != NULL);
+	assert(qual.empty() || qual.size == seq.size);
+
+	IndexEntry e;
+	e.name = m_header.nameSize;
+	e.base = m_header.bases;
+	e.nRun = nextNRun();
+	e.hasQuality = m_qualFile != NULL && !qual.empty();
+	put(m_indexFile, &e, sizeof e);
+
+	put(m_nameFile, id.data, id.size);
+	m_header.nameSize += id.size;
+	if (!comment.empty()) {
+		put(m_nameFile, " ", 1);
+		put(m_nameFile, comment.data, comment.size);
+		m_header.nameSize += 1 + comment.size;
+	}
+
+	uint64_t b = m_header.bases;
+	NRun run = NRun();
+	for (size_t i = 0; i < seq.size; ++i, ++b) {
+		uint8_t code = BASE_CODES[(unsigned char)seq[i]];
+		if (code > 3) {
+			if (run.length > 0 && run.pos + run.length == i) {
+				run.length++;
+			} else {
+				if (run.length > 0) {
+					put(m_nRunFile, &run, sizeof run);
+					m_header.nRuns++;
+				}
+				run.pos = i;
+				run.length = 1;
+			}
+			code = 0;
+		}
+		m_seqByte |= code << (2 * (b & 3));
+		if ((b & 3) == 3) {
+			put(m_file, &m_seqByte, 1);
+			m_seqByte = 0;
+		}
+	}
+	if (run.length > 0) {
+		put(m_nRunFile, &run, sizeof run);
+		m_header.nRuns++;
+	}
+
+	if (m_qualFile != NULL) {
+		b = m_header.bases;
+		for (size_t i = 0; i < seq.size; ++i, ++b) {
+			uint8_t bin = qual.empty() ? 0
+				: m_binOf[(unsigned char)qual[i]];
+			m_qualByte |= bin << (4 * (b & 1));
+			if ((b & 1) == 1) {
+				put(m_qualFile, &m_qualByte, 1);
+				m_qualByte = 0;
+			}
+		}
+	}
+
+	m_header.bases += seq.size;
+	m_header.records++;
+}
+
+/** Append a section to the output file at the next aligned offset,
+ * and close the section. */
+void PackedReadsWriter::append(FILE* section, uint64_t& offset)
+{
+	long pos = ftell(m_file);
+	static const char zeros[ALIGNMENT] = {};
+	put(m_file, zeros, (ALIGNMENT - pos % ALIGNMENT) % ALIGNMENT);
+	offset = ftell(m_file);
+	if (section == NULL)
+		return;
+
+	rewind(section);
+	vector<char> buf(1 << 20);
+	for (size_t n; (n = fread(&buf[0], 1, buf.size(), section)) > 0;)
+		put(m_file, &buf[0], n);
+	if (ferror(section))
+		die(m_path);
+	fclose(section);
+}
+
+void PackedReadsWriter::close()
+{
+	if (m_file == NULL)
+		return;
+
+	// Flush the partial bytes of the last bases.
+	if ((m_header.bases & 3) != 0)
+		put(m_file, &m_seqByte, 1);
+	if (m_qualFile != NULL && (m_header.bases & 1) != 0)
+		put(m_qualFile, &m_qualByte, 1);
+
+	// The final index entry marks the end of the last record.
+	IndexEntry e = IndexEntry();
+	e.name = m_header.nameSize;
+	e.base = m_header.bases;
+	e.nRun = nextNRun();
+	put(m_indexFile, &e, sizeof e);
+
+	append(m_nRunFile, m_header.nRunOffset);
+	append(m_nameFile, m_header.nameOffset);
+	append(m_qualFile, m_header.qualOffset);
+	append(m_indexFile, m_header.indexOffset);
+	m_nRunFile = m_nameFile = m_qualFile = m_indexFile = NULL;
+
+	rewind(m_file);
+	put(m_file, &m_header, sizeof m_header);
+	if (fclose(m_file) != 0)
+		die(m_path);
+	m_file = NULL;
+}
@@ -0,0 +1,211 @@
+#ifndef PACKEDREADS_H
+#define PACKEDREADS_H 1
+
+#include "Common/MappedFile.h"
+#include "Common/StringUtil.h" // for endsWith
+#include "DataLayer/FastaReader.h"
+#include <cstdio>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * A read cache, which is written once by abyss-pack and then read
+ * many times without parsing or decompression.
+ *
+ * The sequences are packed two bits per base. Runs of characters other
+ * than ACGT are stored separately and are read back as N. The quality
+ * is optional, and is stored four bits per base as one of sixteen
+ * bins. The index of the records permits random access, and splitting
+ * the reads into partitions of similar size.
+ */
+namespace PackedFormat {
+
+/** The file name extension of a read cache. */
+static const char EXTENSION[] = ".pack";
+
+static const char MAGIC[8] = { 'A', 'B', 'y', 'S', 'S', 'P', 'K', '1' };
+
+enum {
+	/** The file has a quality stream. */
+	HAS_QUALITY = 1,
+};
+
+/** The number of quality bins. */
+static const unsigned NUM_BINS = 16;
+
+/** The least quality of each bin, which is the quality to which the
+ * bin is decoded. Decoding never increases the quality, so that a
+ * quality threshold at a bin boundary trims exactly as the original
+ * quality. */
+static const uint8_t QUALITY_BINS[NUM_BINS] = {
+	0, 1, 2, 3, 4, 5, 7, 10, 13, 15, 20, 25, 30, 35, 38, 40 };
+
+/** The header at the start of the file. */
+struct Header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	uint64_t records;
+	uint64_t bases;
+	uint64_t nRuns;
+	uint64_t seqOffset;
+	uint64_t nRunOffset;
+	uint64_t nameOffset;
+	uint64_t nameSize;
+	uint64_t qualOffset;
+	uint64_t indexOffset;
+	uint8_t qualityBins[NUM_BINS];
+};
+
+/** An entry of the index. The index has one entry per record and a
+ * final entry that marks the end of the last record. */
+struct IndexEntry
+{
+	/** The offset of the header in the name section */
+	uint64_t name;
+	/** The index of the first base */
+	uint64_t base;
+	/** The index of the first run of N */
+	uint32_t nRun;
+	/** Whether the record has a quality */
+	uint32_t hasQuality;
+};
+
+/** A run of characters other than ACGT in a record. */
+struct NRun
+{
+	uint32_t pos;
+	uint32_t length;
+};
+
+} // namespace PackedFormat
+
+/** Return whether the specified file is a read cache. */
+static inline bool isPackedReads(const std::string& path)
+{
+	return endsWith(path, PackedFormat::EXTENSION);
+}
+
+/** A read cache that is mapped into memory. */
+class PackedReads
+{
+  public:
+	explicit PackedReads(const std::string& path);
+
+	/** Return the number of records. */
+	size_t size() const { return m_header->records; }
+
+	/** Return the number of bases. */
+	uint64_t bases() const { return m_header->bases; }
+
+	/** Return whether the file has a quality stream. */
+	bool hasQuality() const
+	{
+		return m_header->flags & PackedFormat::HAS_QUALITY;
+	}
+
+	/** Return the length of the specified record. */
+	size_t length(size_t i) const
+	{
+		return m_index[i + 1].base - m_index[i].base;
+	}
+
+	/** Decode the specified record. The quality is empty if the
+	 * record has no quality, and otherwise is offset by 33.
+	 */
+	void get(size_t i, std::string& id, std::string& comment,
+			std::string& seq, std::string& qual) const;
+
+	/** Decode the specified record. */
+	void get(size_t i, FastqRecord& rec) const
+	{
+		get(i, rec.id, rec.comment, rec.seq, rec.qual);
+		rec.anchor = 0;
+	}
+
+	/** Return the range [first, last) of records of the specified
+	 * partition of nparts partitions of similar numbers of bases.
+	 * @param part the partition, numbered from 0
+	 */
+	std::pair<size_t, size_t> partition(unsigned part,
+			unsigned nparts) const;
+
+	const std::string& path() const { return m_file.path(); }
+
+  private:
+	PackedReads(const PackedReads&);
+	PackedReads& operator=(const PackedReads&);
+
+	size_t findBase(uint64_t base) const;
+
+	MappedFile m_file;
+	const PackedFormat::Header* m_header;
+	const PackedFormat::IndexEntry* m_index;
+	const PackedFormat::NRun* m_nRuns;
+	const uint8_t* m_seq;
+	const uint8_t* m_qual;
+	const char* m_names;
+
+	/** The two qualities of each byte of quality bins. */
+	std::vector<char> m_byteQuals;
+};
+
+/** Write a read cache. */
+class PackedReadsWriter
+{
+  public:
+	/** Create the specified file.
+	 * @param quality store the quality of the reads
+	 */
+	PackedReadsWriter(const std::string& path, bool quality);
+
+	~PackedReadsWriter() { close(); }
+
+	/** Add a record. The quality, if any, must be offset by 33. */
+	void write(const StringView& id, const StringView& comment,
+			const StringView& seq, const StringView& qual);
+
+	/** Write the index and the header, and close the file. */
+	void close();
+
+	/** Return the number of records written. */
+	uint64_t records() const { return m_header.records; }
+
+	/** Return the number of bases written. */
+	uint64_t bases() const { return m_header.bases; }
+
+  private:
+	PackedReadsWriter(const PackedReadsWriter&);
+	PackedReadsWriter& operator=(const PackedReadsWriter&);
+
+	FILE* openTemp(const char* suffix);
+	uint32_t nextNRun();
+	void append(FILE* section, uint64_t& offset);
+	void put(FILE* f, const void* p, size_t n);
+	void die(const std::string& path);
+
+	std::string m_path;
+	FILE* m_file;
+	PackedFormat::Header m_header;
+
+	/** The sections other than the sequence, which are written to
+	 * temporary files and appended when the file is closed. */
+	FILE* m_nRunFile;
+	FILE* m_nameFile;
+	FILE* m_qualFile;
+	FILE* m_indexFile;
+
+	/** The byte of packed bases being filled. */
+	uint8_t m_seqByte;
+
+	/** The byte of quality bins being filled. */
+	uint8_t m_qualByte;
+
+	/** The bin of each quality. */
+	uint8_t m_binOf[256];
+};
+
+#endif
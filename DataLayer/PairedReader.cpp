@@ -0,0 +1,100 @@
+#include "DataLayer/PairedReader.h"
+#include "Common/StringUtil.h"
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+
+PairedReader::PairedReader(char** first, char** last, int flags,
+		bool interleaved, bool checkNames)
+	: m_paths(first, last)
+	, m_flags(flags)
+	, m_interleaved(interleaved || m_paths.size() == 1)
+	, m_checkNames(checkNames)
+	, m_next(0)
+	, m_in1(NULL)
+	, m_in2(NULL)
+	, m_eof(false)
+{
+	assert(first != last);
+	if (!m_interleaved && m_paths.size() % 2 != 0) {
+		cerr << "error: the mate files must be given in pairs, "
+			"but there are " << m_paths.size() << " files\n";
+		exit(EXIT_FAILURE);
+	}
+	pthread_mutex_init(&m_mutex, NULL);
+}
+
+PairedReader::~PairedReader()
+{
+	close();
+	pthread_mutex_destroy(&m_mutex);
+}
+
+/** Close the open files. */
+void PairedReader::close()
+{
+	if (m_in2 != m_in1)
+		delete m_in2;
+	delete m_in1;
+	m_in1 = m_in2 = NULL;
+}
+
+/** Read the first mate of the next pair into m_view, and open the next
+ * files when the open files are exhausted.
+ * @return false when all the pairs have been read
+ */
+bool PairedReader::readFirst()
+{
+	for (;;) {
+		if (m_in1 != NULL) {
+			if (m_in1->read(m_view))
+				return true;
+			if (m_in2 != m_in1 && m_in2->read(m_view)) {
+				cerr << "error: `" << m_path2 << "' has more reads than `"
+					<< m_path1 << "'\n";
+				exit(EXIT_FAILURE);
+			}
+			close();
+		}
+		if (m_next == m_paths.size()) {
+			m_eof = true;
+			return false;
+		}
+		m_path1 = m_paths[m_next++];
+		m_in1 = new FastaReader(m_path1.c_str(), m_flags);
+		if (m_interleaved) {
+			m_path2 = m_path1;
+			m_in2 = m_in1;
+		} else {
+			m_path2 = m_paths[m_next++];
+			m_in2 = new FastaReader(m_path2.c_str(), m_flags);
+		}
+	}
+}
+
+/** Read the mate of the read named id into m_view. */
+void PairedReader::readSecond(const string& id)
+{
+	if (m_in2->read(m_view))
+		return;
+	if (m_interleaved)
+		cerr << "error: `" << m_path1 << "': the read `" << id
+			<< "' has no mate\n";
+	else
+		cerr << "error: `" << m_path1 << "' has more reads than `"
+			<< m_path2 << "'\n";
+	exit(EXIT_FAILURE);
+}
+
+/** Check that the names of two mates match. */
+void PairedReader::checkNames(const string& a, const string& b)
+{
+	if (isReadNamePair(a, b))
+		return;
+	cerr << "error: name mismatch between paired end reads.\n"
+		<< "Read 1: " << a << "\n"
+		<< "Read 2: " << b << "\n";
+	exit(EXIT_FAILURE);
+}
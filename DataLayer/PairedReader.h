@@ -0,0 +1,93 @@
+#ifndef PAIREDREADER_H
+#define PAIREDREADER_H 1
+
+#include "DataLayer/FastaReader.h"
+#include <pthread.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Read pairs of reads in batches. The mates of a pair are read either
+ * from two files in lockstep, or from consecutive records of one
+ * interleaved file. Each record is parsed in place and copied to the
+ * storage of the batch, which is reused by the next batch.
+ *
+ * Several threads may call readBatch, which is serialized, and then
+ * process their batches concurrently.
+ */
+class PairedReader
+{
+  public:
+	/** Open the specified files. When interleaved is false and there
+	 * is more than one file, the files are pairs of mate files, such
+	 * as lib1_1.fq lib1_2.fq lib2_1.fq lib2_2.fq. Otherwise each file
+	 * contains interleaved pairs.
+	 * @param checkNames check that the names of mates match
+	 */
+	PairedReader(char** first, char** last, int flags,
+			bool interleaved, bool checkNames = true);
+	~PairedReader();
+
+	/** Read at most maxPairs pairs. The storage of the records of
+	 * the batch is reused.
+	 * @return the number of pairs read, which is 0 when all the pairs
+	 * have been read
+	 */
+	template <typename Record>
+	size_t readBatch(std::vector<std::pair<Record, Record> >& batch,
+			size_t maxPairs)
+	{
+		pthread_mutex_lock(&m_mutex);
+		size_t n = 0;
+		for (; n < maxPairs && readFirst(); ++n) {
+			if (n == batch.size())
+				batch.resize(n + 1);
+			std::pair<Record, Record>& p = batch[n];
+			p.first.assign(m_view);
+			readSecond(p.first.id);
+			p.second.assign(m_view);
+			if (m_checkNames)
+				checkNames(p.first.id, p.second.id);
+		}
+		pthread_mutex_unlock(&m_mutex);
+		batch.resize(n);
+		return n;
+	}
+
+	/** Return whether all the pairs have been read. */
+	bool eof() const { return m_eof; }
+
+  private:
+	PairedReader(const PairedReader&);
+	PairedReader& operator=(const PairedReader&);
+
+	bool readFirst();
+	void readSecond(const std::string& id);
+	void checkNames(const std::string& a, const std::string& b);
+	void close();
+
+	std::vector<std::string> m_paths;
+	int m_flags;
+	bool m_interleaved;
+	bool m_checkNames;
+
+	/** The index of the next file to open */
+	size_t m_next;
+	/** The reader of the first mates */
+	FastaReader* m_in1;
+	/** The reader of the second mates, which is m_in1 when the file
+	 * is interleaved */
+	FastaReader* m_in2;
+	/** The paths of the open files */
+	std::string m_path1, m_path2;
+
+	/** The record most recently read */
+	RecordView m_view;
+	bool m_eof;
+
+	/** Serialize reading batches */
+	pthread_mutex_t m_mutex;
+};
+
+#endif
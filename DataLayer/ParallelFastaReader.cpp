@@ -0,0 +1,121 @@
+#include "DataLayer/ParallelFastaReader.h"
+#include "Common/FileRange.h"
+#include "DataLayer/PackedReads.h"
+#include <algorithm>
+#include <cassert>
+
+using namespace std;
+
+/** The number of partitions of a file per thread */
+static const unsigned PARTITIONS_PER_THREAD = 4;
+
+/** The minimum size of a partition in bytes */
+static const streamoff MIN_PARTITION_SIZE = 1 << 20;
+
+ParallelFastaReader::ParallelFastaReader(char** first, char** last,
+		int flags, unsigned threads)
+	: m_flags(flags)
+{
+	init(first, last, threads);
+}
+
+ParallelFastaReader::ParallelFastaReader(const char* path, int flags,
+		unsigned threads)
+	: m_flags(flags)
+{
+	char* p = const_cast<char*>(path);
+	init(&p, &p + 1, threads);
+}
+
+void ParallelFastaReader::init(char** first, char** last,
+		unsigned threads)
+{
+	assert(first != last);
+	threads = max(threads, 1U);
+	for (char** it = first; it != last; ++it) {
+		string path(*it);
+		bool splittable = isPackedReads(path) || isSplittable(path);
+		unsigned n = 1;
+		if (splittable) {
+			streamoff parts = fileSize(path) / MIN_PARTITION_SIZE;
+			n = max(1U, (unsigned)min((streamoff)PARTITIONS_PER_THREAD
+						* threads, parts));
+		}
+		for (unsigned i = 1; i <= n; ++i) {
+			Partition p;
+			p.path = path;
+			p.section = i;
+			p.nsections = n;
+			p.shared = !splittable;
+			p.in = NULL;
+			p.claimed = p.done = false;
+			m_parts.push_back(p);
+		}
+	}
+	// The mutexes are initialized in place, after the vector is
+	// complete.
+	for (vector<Partition>::iterator it = m_parts.begin();
+			it != m_parts.end(); ++it)
+		pthread_mutex_init(&it->mutex, NULL);
+	pthread_mutex_init(&m_mutex, NULL);
+}
+
+ParallelFastaReader::~ParallelFastaReader()
+{
+	for (vector<Partition>::iterator it = m_parts.begin();
+			it != m_parts.end(); ++it) {
+		delete it->in;
+		pthread_mutex_destroy(&it->mutex);
+	}
+	pthread_mutex_destroy(&m_mutex);
+}
+
+/** Return the partition of the calling thread, and claim the next
+ * unread partition if it has none.
+ * @return NULL if all the partitions have been claimed
+ */
+ParallelFastaReader::Partition* ParallelFastaReader::partition()
+{
+	Partition*& current = m_current.get();
+	if (current != NULL)
+		return current;
+
+	Partition* p = NULL;
+	pthread_mutex_lock(&m_mutex);
+	for (vector<Partition>::iterator it = m_parts.begin();
+			it != m_parts.end(); ++it) {
+		if (!it->done && (!it->claimed || it->shared)) {
+			p = &*it;
+			break;
+		}
+	}
+	if (p != NULL) {
+		p->claimed = true;
+		if (p->in == NULL) {
+			p->in = new FastaReader(p->path.c_str(), m_flags);
+			if (p->nsections > 1)
+				p->in->split(p->section, p->nsections);
+		}
+	}
+	pthread_mutex_unlock(&m_mutex);
+	current = p;
+	return p;
+}
+
+/** Mark the partition of the calling thread as read. */
+void ParallelFastaReader::finish(Partition* p)
+{
+	pthread_mutex_lock(&m_mutex);
+	p->done = true;
+	pthread_mutex_unlock(&m_mutex);
+	m_current.get() = NULL;
+}
+
+bool ParallelFastaReader::eof() const
+{
+	for (vector<Partition>::const_iterator it = m_parts.begin();
+			it != m_parts.end(); ++it)
+		if (!it->done)
+			return false;
+	return true;
+}
@@ -0,0 +1,116 @@
+#ifndef PARALLELFASTAREADER_H
+#define PARALLELFASTAREADER_H 1
+
+#include "Common/PerThread.h"
+#include "DataLayer/FastaReader.h"
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+/**
+ * Read files of sequences with several threads, each of which reads
+ * its own part of the files without a shared lock.
+ *
+ * A file that may be split is divided into partitions of similar size
+ * at record boundaries: byte ranges of an uncompressed file, or ranges
+ * of records of a read cache. There are several partitions per thread,
+ * and a thread claims the next unread partition when it finishes one,
+ * which balances the load. Each partition has its own FastaReader.
+ * A file that cannot be split, such as a compressed file or the
+ * standard input, is read by all the threads through one FastaReader
+ * under a lock.
+ *
+ * The records of a partition are read in order, but the order of the
+ * records of different partitions is not determined.
+ */
+class ParallelFastaReader
+{
+  public:
+	/** Open the specified files.
+	 * @param threads the number of threads that will read the files
+	 */
+	ParallelFastaReader(char** first, char** last, int flags,
+			unsigned threads);
+	ParallelFastaReader(const char* path, int flags, unsigned threads);
+	~ParallelFastaReader();
+
+	/** Read records of the partition of the calling thread, until
+	 * their sequences total at least maxBases.
+	 * @return the number of records read, which is 0 when all the
+	 * records have been read
+	 */
+	template <typename Record>
+	size_t readBatch(std::vector<Record>& batch, size_t maxBases)
+	{
+		batch.clear();
+		size_t bases = 0;
+		while (bases < maxBases) {
+			Partition* p = partition();
+			if (p == NULL)
+				break;
+			if (p->shared)
+				pthread_mutex_lock(&p->mutex);
+			bool good = true;
+			for (Record rec; bases < maxBases && (good = *p->in >> rec);) {
+				bases += size(rec);
+				batch.push_back(rec);
+			}
+			if (p->shared)
+				pthread_mutex_unlock(&p->mutex);
+			if (!good)
+				finish(p);
+		}
+		return batch.size();
+	}
+
+	/** Return whether all the records have been read. */
+	bool eof() const;
+
+	/** Return the number of partitions. */
+	size_t partitions() const { return m_parts.size(); }
+
+  private:
+	ParallelFastaReader(const ParallelFastaReader&);
+	ParallelFastaReader& operator=(const ParallelFastaReader&);
+
+	/** A part of a file. */
+	struct Partition
+	{
+		std::string path;
+		unsigned section, nsections;
+
+		/** Whether the threads share this partition. */
+		bool shared;
+
+		/** The reader, which is opened when the partition is
+		 * claimed. */
+		FastaReader* in;
+
+		/** Whether the partition has been claimed. */
+		bool claimed;
+
+		/** Whether the partition has been read. */
+		bool done;
+
+		/** Serialize reading a shared partition. */
+		pthread_mutex_t mutex;
+	};
+
+	void init(char** first, char** last, unsigned threads);
+	Partition* partition();
+	void finish(Partition* p);
+
+	static size_t size(const std::string& s) { return s.size(); }
+	static size_t size(const FastaRecord& rec) { return rec.seq.size(); }
+
+	int m_flags;
+	std::vector<Partition> m_parts;
+
+	/** The partition of each thread. */
+	PerThread<Partition*> m_current;
+
+	/** Protect the claiming of partitions. */
+	pthread_mutex_t m_mutex;
+};
+
+#endif
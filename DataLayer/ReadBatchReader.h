@@ -0,0 +1,109 @@
+#ifndef READBATCHREADER_H
+#define READBATCHREADER_H 1
+
+#include "Common/Options.h"
+#include "DataLayer/FastaReader.h"
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * Read batches of reads from a list of files, in order. Paired files
+ * are taken two at a time and read in lockstep, so that the mates of
+ * a pair are in the same batch. Not thread safe.
+ */
+class ReadBatchReader
+{
+  public:
+	ReadBatchReader(char** first, char** last, bool paired)
+	  : m_paths(first, last)
+	  , m_next(0)
+	  , m_paired(paired)
+	{
+		m_in[0] = m_in[1] = NULL;
+		if (paired && m_paths.size() % 2 != 0) {
+			std::cerr << "error: --paired requires an even number "
+				"of read files, but there are " << m_paths.size()
+				<< " files\n";
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	~ReadBatchReader() { close(); }
+
+	/**
+	 * Read the next batch of about `maxBases' bases.
+	 * @param reads the reads, and with paired input, their mates
+	 * @return false at the end of the input
+	 */
+	bool read(std::vector<FastqRecord> (&reads)[2], size_t maxBases)
+	{
+		reads[0].clear();
+		reads[1].clear();
+		for (size_t bases = 0; bases < maxBases;) {
+			if (m_in[0] == NULL && !openNext())
+				break;
+			FastqRecord rec;
+			if (!(*m_in[0] >> rec)) {
+				assert(m_in[0]->eof());
+				if (m_paired && *m_in[1] >> rec)
+					dieUnpaired(m_paths[m_next - 2]);
+				close();
+				continue;
+			}
+			bases += rec.seq.size();
+			reads[0].push_back(rec);
+			if (m_paired) {
+				if (!(*m_in[1] >> rec))
+					dieUnpaired(m_paths[m_next - 1]);
+				bases += rec.seq.size();
+				reads[1].push_back(rec);
+			}
+		}
+		return !reads[0].empty();
+	}
+
+  private:
+	ReadBatchReader(const ReadBatchReader&);
+	ReadBatchReader& operator=(const ReadBatchReader&);
+
+	/** Open the next file, or pair of files. */
+	bool openNext()
+	{
+		if (m_next == m_paths.size())
+			return false;
+		for (unsigned i = 0; i < (m_paired ? 2 : 1); ++i) {
+			if (opt::verbose)
+#pragma omp critical(cerr)
+				std::cerr << "Reading `" << m_paths[m_next] << "'..."
+					<< std::endl;
+			m_in[i] = new FastaReader(m_paths[m_next++].c_str(),
+					FastaReader::FOLD_CASE);
+		}
+		return true;
+	}
+
+	void close()
+	{
+		for (unsigned i = 0; i < 2; ++i) {
+			delete m_in[i];
+			m_in[i] = NULL;
+		}
+	}
+
+	void dieUnpaired(const std::string& path)
+	{
+		std::cerr << "error: `" << path
+			<< "' has fewer reads than its mate file\n";
+		exit(EXIT_FAILURE);
+	}
+
+	std::vector<std::string> m_paths;
+	size_t m_next;
+	bool m_paired;
+	FastaReader* m_in[2];
+};
+
+#endif
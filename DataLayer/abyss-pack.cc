@@ -0,0 +1,172 @@
+/** Convert reads to a read cache, which may be read many times
+ * without parsing or decompression.
+ */
+#include "config.h"
+#include "Common/IOUtil.h"
+#include "Common/Uncompress.h"
+#include "DataLayer/FastaReader.h"
+#include "DataLayer/Options.h"
+#include "DataLayer/PackedReads.h"
+#include <cassert>
+#include <cstdlib>
+#include <getopt.h>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+using namespace std;
+
+#define PROGRAM "abyss-pack"
+
+static const char VERSION_MESSAGE[] =
+PROGRAM " (" PACKAGE_NAME ") " VERSION "\n"
+"\n"
+"Copyright 2014 Canada's Michael Smith Genome Sciences Centre\n";
+
+static const char USAGE_MESSAGE[] =
+"Usage: " PROGRAM " -o OUTPUT.pack [OPTION]... [FILE]...\n"
+"Convert reads to a read cache, which ABySS reads in place of FASTA\n"
+"and FASTQ files without parsing or decompressing them. The input\n"
+"format may be FASTA, FASTQ, qseq, export, SAM or BAM format and\n"
+"compressed with gz, bz2 or xz. The records of the input files are\n"
+"concatenated. Pack the first and second reads of read pairs to\n"
+"separate files.\n"
+"\n"
+"The sequence is stored as ACGT, in which any other character is N.\n"
+"The quality is rounded down to one of sixteen values.\n"
+"\n"
+" Options:\n"
+"\n"
+"  -o, --out=FILE          write the read cache to FILE, whose name\n"
+"                          must end in .pack\n"
+"      --no-quality        do not store the quality\n"
+"      --chastity          discard unchaste reads [default]\n"
+"      --no-chastity       do not discard unchaste reads\n"
+"      --trim-masked       trim masked bases from the ends of reads\n"
+"                          [default]\n"
+"      --no-trim-masked    do not trim masked bases from the ends\n"
+"                          of reads\n"
+"      --standard-quality  zero quality is `!' (33)\n"
+"                          default for FASTQ and SAM files\n"
+"      --illumina-quality  zero quality is `@' (64)\n"
+"                          default for qseq and export files\n"
+"  -v, --verbose           display verbose output\n"
+"      --help              display this help and exit\n"
+"      --version           output version information and exit\n"
+"\n"
+"Report bugs to <" PACKAGE_BUGREPORT ">.\n";
+
+namespace opt {
+	static string out;
+	static int quality = 1;
+	static int verbose;
+}
+
+static const char shortopts[] = "o:v";
+
+enum { OPT_HELP = 1, OPT_VERSION };
+
+static const struct option longopts[] = {
+	{ "out",              required_argument, NULL, 'o' },
+	{ "quality",          no_argument, &opt::quality, 1 },
+	{ "no-quality",       no_argument, &opt::quality, 0 },
+	{ "chastity",         no_argument, &opt::chastityFilter, 1 },
+	{ "no-chastity",      no_argument, &opt::chastityFilter, 0 },
+	{ "trim-masked",      no_argument, &opt::trimMasked, 1 },
+	{ "no-trim-masked",   no_argument, &opt::trimMasked, 0 },
+	{ "standard-quality", no_argument, &opt::qualityOffset, 33 },
+	{ "illumina-quality", no_argument, &opt::qualityOffset, 64 },
+	{ "verbose",          no_argument, NULL, 'v' },
+	{ "help",             no_argument, NULL, OPT_HELP },
+	{ "version",          no_argument, NULL, OPT_VERSION },
+	{ NULL, 0, NULL, 0 }
+};
+
+/** FastaReader flags. */
+static const int FASTAREADER_FLAGS
+	= FastaReader::FOLD_CASE | FastaReader::CONVERT_QUALITY;
+
+/** Append the records of a file to the read cache. */
+static void pack(PackedReadsWriter& out, const char* path)
+{
+	FastaReader in(path, FASTAREADER_FLAGS);
+	uint64_t records = 0, bases = 0;
+	vector<RecordView> batch;
+	while (in.readBatch(batch, FastaReader::BLOCK_SIZE) > 0) {
+		for (vector<RecordView>::const_iterator it = batch.begin();
+				it != batch.end(); ++it) {
+			if (it->anchor != 0) {
+				cerr << PROGRAM ": error: `" << path << "': "
+					"colour-space reads are not supported\n";
+				exit(EXIT_FAILURE);
+			}
+			out.write(it->id, it->comment, it->seq, it->qual);
+			bases += it->seq.size;
+		}
+		records += batch.size();
+	}
+	assert(in.eof());
+
+	if (opt::verbose)
+		cerr << records << '\t' << bases << '\t' << path << '\n';
+}
+
+int main(int argc, char** argv)
+{
+	bool die = false;
+	for (int c; (c = getopt_long(argc, argv,
+					shortopts, longopts, NULL)) != -1;) {
+		istringstream arg(optarg != NULL ? optarg : "");
+		switch (c) {
+			case '?':
+				die = true;
+				break;
+			case 'o':
+				arg >> opt::out;
+				break;
+			case 'v':
+				opt::verbose++;
+				break;
+			case OPT_HELP:
+				cout << USAGE_MESSAGE;
+				exit(EXIT_SUCCESS);
+			case OPT_VERSION:
+				cout << VERSION_MESSAGE;
+				exit(EXIT_SUCCESS);
+		}
+		if (optarg != NULL && !arg.eof()) {
+			cerr << PROGRAM ": invalid option: `-"
+				<< (char)c << optarg << "'\n";
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (opt::out.empty()) {
+		cerr << PROGRAM ": missing -o,--out option\n";
+		die = true;
+	} else if (!isPackedReads(opt::out)) {
+		cerr << PROGRAM ": the output file name must end in "
+			<< PackedFormat::EXTENSION << '\n';
+		die = true;
+	}
+
+	if (die) {
+		cerr << "Try `" << PROGRAM
+			<< " --help' for more information.\n";
+		exit(EXIT_FAILURE);
+	}
+
+	PackedReadsWriter out(opt::out, opt::quality);
+	if (optind == argc) {
+		pack(out, "-");
+	} else {
+		for (int i = optind; i < argc; ++i)
+			pack(out, argv[i]);
+	}
+	out.close();
+
+	if (opt::verbose)
+		cerr << out.records() << '\t' << out.bases() << '\t'
+			<< opt::out << '\n';
+	return 0;
+}
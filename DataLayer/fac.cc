@@ -2,16 +2,29 @@
  * Written by Shaun Jackman <sjackman@bcgsc.ca>.
  */
 #include "config.h"
+#include "Common/BitUtil.h" // for popcount
+#include "Common/FileRange.h" // for isSplittable
 #include "Common/Histogram.h"
 #include "Common/IOUtil.h"
+#include "Common/MappedFile.h"
 #include "Common/Sequence.h" // for isACGT
 #include "Common/Uncompress.h"
 #include "DataLayer/FastaReader.h"
 #include "DataLayer/Options.h"
 #include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <getopt.h>
 #include <iostream>
 #include <sstream>
+#include <string>
+#include <vector>
+#if __SSE2__
+# include <emmintrin.h>
+#endif
+#if _OPENMP
+# include <omp.h>
+#endif
 
 using namespace std;
 
@@ -35,6 +48,8 @@ static const char USAGE_MESSAGE[] =
 "  -d, --delimiter=S       use S for the field delimiter [\\t]\n"
 "  -j, --jira              output JIRA format\n"
 "  -m, --mmd               output MultiMarkdown format\n"
+"      --json              output one JSON object per file\n"
+"  -T, --threads=N         read N files in parallel [1]\n"
 "      --chastity          discard unchaste sequences [default]\n"
 "      --no-chastity       do not discard unchaste sequences\n"
 "      --trim-masked       trim masked bases from the end\n"
@@ -55,12 +70,13 @@ namespace opt {
 	static int format;
 	static int verbose;
 	static int countAmbig;
+	static unsigned threads = 1;
 }
-enum { TAB, JIRA, MMD };
+enum { TAB, JIRA, MMD, JSON };
 
-static const char shortopts[] = "d:e:G:jms:t:v";
+static const char shortopts[] = "d:e:G:jms:t:T:v";
 
-enum { OPT_HELP = 1, OPT_VERSION };
+enum { OPT_HELP = 1, OPT_VERSION, OPT_JSON };
 
 static const struct option longopts[] = {
 	{ "genome-size", required_argument, NULL, 'G' },
@@ -68,6 +84,8 @@ static const struct option longopts[] = {
 	{ "delimiter", required_argument, NULL, 'd' },
 	{ "jira", no_argument, NULL, 'j' },
 	{ "mmd", no_argument, NULL, 'm' },
+	{ "json", no_argument, NULL, OPT_JSON },
+	{ "threads", required_argument, NULL, 'T' },
 	{ "chastity", no_argument, &opt::chastityFilter, 1 },
 	{ "no-chastity", no_argument, &opt::chastityFilter, 0 },
 	{ "trim-masked", no_argument, &opt::trimMasked, 1 },
@@ -82,24 +100,216 @@ static const struct option longopts[] = {
 /** FastaReader flags. */
 static const int FASTAREADER_FLAGS = FastaReader::NO_FOLD_CASE;
 
+/** The numbers of bytes of a sequence that are ACGT, and that are
+ * line endings. */
+struct ByteCounts
+{
+	size_t acgt;
+	size_t eol;
+	ByteCounts() : acgt(0), eol(0) { }
+};
+
+/** Count the bytes of [first, last) that are ACGT, ignoring case, and
+ * that are line endings. */
+static ByteCounts countBytes(const char* first, const char* last)
+{
+	ByteCounts n;
+	const char* p = first;
+#if __SSE2__
+	// Classify 64 bytes at a time. Setting the 0x20 bit maps only
+	// the upper and lower case of a letter to the same byte.
+	const __m128i caseBit = _mm_set1_epi8(0x20);
+	const __m128i a = _mm_set1_epi8('a'), c = _mm_set1_epi8('c'),
+		g = _mm_set1_epi8('g'), t = _mm_set1_epi8('t'),
+		lf = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+	for (; last - p >= 64; p += 64) {
+		uint64_t acgt = 0, eol = 0;
+		for (unsigned i = 0; i < 4; ++i) {
+			__m128i x = _mm_loadu_si128(
+					reinterpret_cast<const __m128i*>(p + 16 * i));
+			__m128i y = _mm_or_si128(x, caseBit);
+			__m128i isACGT = _mm_or_si128(
+					_mm_or_si128(_mm_cmpeq_epi8(y, a), _mm_cmpeq_epi8(y, c)),
+					_mm_or_si128(_mm_cmpeq_epi8(y, g), _mm_cmpeq_epi8(y, t)));
+			__m128i isEOL = _mm_or_si128(
+					_mm_cmpeq_epi8(x, lf), _mm_cmpeq_epi8(x, cr));
+			acgt |= (uint64_t)(uint16_t)_mm_movemask_epi8(isACGT) << 16 * i;
+			eol |= (uint64_t)(uint16_t)_mm_movemask_epi8(isEOL) << 16 * i;
+		}
+		n.acgt += popcount(acgt);
+		n.eol += popcount(eol);
+	}
+#endif
+	for (; p < last; ++p) {
+		n.acgt += isACGT(*p);
+		n.eol += *p == '\n' || *p == '\r';
+	}
+	return n;
+}
+
+/** Return whether the header [first, last) has a Casava comment that
+ * marks the read as unchaste, such as 1:Y:0:AAAAAA. */
+static bool isUnchaste(const char* first, const char* last)
+{
+	const char* p = first + 1;
+	while (p < last && isspace(*p))
+		++p;
+	while (p < last && !isspace(*p))
+		++p;
+	while (p < last && isspace(*p))
+		++p;
+	if (last > first && last[-1] == '\r')
+		--last;
+	return last - p > 3 && p[1] == ':' && p[3] == ':' && p[2] == 'Y';
+}
+
+/** Return whether the sequence [first, last), which may span several
+ * lines, is in colour space. */
+static bool isColourSpace(const char* first, const char* last)
+{
+	bool second = false;
+	for (const char* p = first; p < last; ++p) {
+		if (*p == '\n' || *p == '\r')
+			continue;
+		if (second && strchr("ACGTacgt0123", *p) != NULL)
+			return isdigit(*p);
+		second = true;
+	}
+	return false;
+}
+
+/** Count the lengths of the sequences of a FASTA file in place in a
+ * memory mapping of the file, without copying the sequences.
+ * @return false if the file cannot be read this way, in which case
+ * it must be read by FastaReader
+ */
+static bool readLengthsMapped(const char* path, Histogram& h)
+{
+	if (opt::trimMasked || !isSplittable(path))
+		return false;
+	MappedFile file(path, MappedFile::SEQUENTIAL);
+	const char* p = file.begin();
+	const char* last = file.end();
+	if (p < last && *p != '>')
+		return false;
+	while (p < last) {
+		const char* eol = static_cast<const char*>(
+				memchr(p, '\n', last - p));
+		if (eol == NULL)
+			return false;
+		bool unchaste = opt::chastityFilter && isUnchaste(p, eol);
+
+		// The record ends at the next line that starts with '>'.
+		const char* seq = eol + 1;
+		const char* end = seq;
+		for (;;) {
+			const char* q = static_cast<const char*>(
+					memchr(end, '>', last - end));
+			if (q == NULL) {
+				end = last;
+				break;
+			}
+			end = q + 1;
+			if (q[-1] == '\n') {
+				end = q;
+				break;
+			}
+		}
+
+		// Leave comment lines, empty sequences and colour-space
+		// sequences to FastaReader.
+		if (memchr(seq, '#', end - seq) != NULL)
+			return false;
+		ByteCounts n = countBytes(seq, end);
+		size_t length = (end - seq) - n.eol;
+		if (length == 0 || isColourSpace(seq, end))
+			return false;
+		if (!unchaste)
+			h.insert(opt::countAmbig ? length : n.acgt);
+		p = end;
+	}
+	return true;
+}
+
+/** Return a histogram of the lengths of the sequences of a file. */
+static Histogram readLengths(const char* path)
+{
+	Histogram h;
+	if (readLengthsMapped(path, h))
+		return h;
+
+	h = Histogram();
+	FastaReader in(path, FASTAREADER_FLAGS);
+	for (RecordView r; in.read(r);)
+		h.insert(opt::countAmbig ? r.seq.size :
+				count_if(r.seq.begin(), r.seq.end(), isACGT));
+	assert(in.eof());
+	return h;
+}
+
+/** Print a string as a JSON string. */
+static void printJSONString(ostream& out, const string& s)
+{
+	out << '"';
+	for (string::const_iterator it = s.begin(); it != s.end(); ++it) {
+		unsigned char c = *it;
+		if (c == '"' || c == '\\')
+			out << '\\' << c;
+		else if (c < 0x20) {
+			static const char hex[] = "0123456789abcdef";
+			out << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+		} else
+			out << c;
+	}
+	out << '"';
+}
+
+/** Print contiguity statistics as a JSON object on one line. */
+static void printContiguityStatisticsJSON(const char* path,
+		const Histogram& h0)
+{
+	Histogram h = h0.trimLow(opt::minLength);
+	unsigned n50 = h.n50();
+	long long unsigned sum = h.sum();
+	cout << "{\"n\":" << h0.size()
+		<< ",\"n:" << opt::minLength << "\":" << h.size()
+		<< ",\"L50\":" << h.count(n50, INT_MAX);
+	if (opt::genomeSize > 0) {
+		unsigned ng50 = sum < opt::genomeSize/2 ? h.minimum()
+			: h.argMin(sum - opt::genomeSize/2);
+		cout << ",\"LG50\":" << h.count(ng50, INT_MAX)
+			<< ",\"NG50\":" << ng50;
+	}
+	cout << ",\"min\":" << h.minimum()
+		<< ",\"N75\":" << h.weightedPercentile(1 - 0.75)
+		<< ",\"N50\":" << n50
+		<< ",\"N25\":" << h.weightedPercentile(1 - 0.25)
+		<< ",\"E-size\":" << (unsigned)h.expectedValue()
+		<< ",\"max\":" << h.maximum()
+		<< ",\"sum\":" << sum
+		<< ",\"name\":";
+	printJSONString(cout, path);
+	cout << "}\n";
+}
+
 /** Print contiguity statistics. */
-static void printContiguityStatistics(const char* path)
+static void printContiguityStatistics(const char* path,
+		const Histogram& h)
 {
 	static bool printHeader = true;
 	if (string(path) == "---") {
+		if (opt::format == JSON)
+			return;
 		if (printHeader == false)
 			cout << '\n';
 		printHeader = true;
 		return;
 	}
 
-	// Read the sequences and count the lengths.
-	Histogram h;
-	FastaReader in(path, FASTAREADER_FLAGS);
-	for (string s; in >> s;)
-		h.insert(opt::countAmbig ? s.length() :
-				count_if(s.begin(), s.end(), isACGT));
-	assert(in.eof());
+	if (opt::format == JSON) {
+		printContiguityStatisticsJSON(path, h);
+		return;
+	}
 
 	// Print the table header.
 	if (opt::format == JIRA && printHeader) {
@@ -189,6 +399,12 @@ int main(int argc, char** argv)
 			opt::delimiter = "\t|";
 			opt::format = MMD;
 			break;
+		  case OPT_JSON:
+			opt::format = JSON;
+			break;
+		  case 'T':
+			arg >> opt::threads;
+			break;
 		  case 'G':
 		  case 'e':
 			{
@@ -222,11 +438,26 @@ int main(int argc, char** argv)
 		exit(EXIT_FAILURE);
 	}
 
-	if (optind == argc)
-		printContiguityStatistics("-");
-	else
-		for_each(argv + optind, argv + argc,
-				printContiguityStatistics);
+#if _OPENMP
+	if (opt::threads > 0)
+		omp_set_num_threads(opt::threads);
+#endif
+
+	if (optind == argc) {
+		printContiguityStatistics("-", readLengths("-"));
+	} else {
+		// Read the files in parallel, and print their statistics in
+		// the order of the command line.
+		int n = argc - optind;
+#pragma omp parallel for ordered schedule(dynamic, 1)
+		for (int i = 0; i < n; ++i) {
+			const char* path = argv[optind + i];
+			Histogram h = string(path) == "---" ? Histogram()
+				: readLengths(path);
+#pragma omp ordered
+			printContiguityStatistics(path, h);
+		}
+	}
 
 	cout.flush();
 	assert_good(cout, "stdout");
@@ -1,4 +1,5 @@
 #include "Estimate.h"
+#include "FileRange.h"
 #include "Histogram.h"
 #include "IOUtil.h"
 #include "MLE.h"
@@ -430,6 +431,93 @@ static void readPairs(It& it, const It& last, vector<SAMRecord>& out)
 	}
 }
 
+/** An input iterator of the SAM records of the byte range of a file
+ * that ends at the specified offset.
+ */
+class SAMRangeIterator
+{
+  public:
+	SAMRangeIterator() : m_in(NULL), m_end(0) { }
+	SAMRangeIterator(istream& in, streamoff end)
+		: m_in(&in), m_end(end)
+	{
+		++*this;
+	}
+
+	const SAMRecord& operator*() const { return m_rec; }
+	const SAMRecord* operator->() const { return &m_rec; }
+
+	SAMRangeIterator& operator++()
+	{
+		assert(m_in != NULL);
+		if (m_in->tellg() >= m_end || !(*m_in >> m_rec))
+			m_in = NULL;
+		return *this;
+	}
+
+	bool operator!=(const SAMRangeIterator& it) const
+	{
+		return m_in != it.m_in;
+	}
+
+  private:
+	istream* m_in;
+	streamoff m_end;
+	SAMRecord m_rec;
+};
+
+/** The first and last targets of the alignments of a byte range,
+ * which are empty when the range has no alignments. */
+typedef pair<string, string> TargetRange;
+
+/** Generate distance estimates for the alignments of the byte range
+ * [begin, end) of the specified file.
+ * @return the first and last targets of the range
+ */
+static TargetRange estimateRange(ostream& out, const string& path,
+		streamoff begin, streamoff end,
+		const vector<unsigned>& lengthVec, const PMF& pmf)
+{
+	ifstream in(path.c_str());
+	assert_good(in, path);
+	in.seekg(begin);
+	SAMRangeIterator it(in, end), last;
+	TargetRange targets;
+	for (vector<SAMRecord> records;;) {
+		records.clear();
+		readPairs(it, last, records);
+		if (records.empty())
+			break;
+		if (targets.first.empty())
+			targets.first = records.front().rname;
+		targets.second = records.front().rname;
+		writeEstimates(out, records, lengthVec, pmf);
+	}
+	return targets;
+}
+
+/** Check that the input is sorted across the boundaries of the byte
+ * ranges, each of which readPairs checks on its own. The first target
+ * of each range must follow the last target of the previous range.
+ */
+static void checkSorted(const vector<TargetRange>& targets)
+{
+	const string* prev = NULL;
+	for (vector<TargetRange>::const_iterator it = targets.begin();
+			it != targets.end(); ++it) {
+		if (it->first.empty())
+			continue;
+		if (prev != NULL && get(g_contigNames, it->first)
+				<= get(g_contigNames, *prev)) {
+			cerr << "error: input must be sorted: saw `"
+				<< *prev << "' before `"
+				<< it->first << "'\n";
+			exit(EXIT_FAILURE);
+		}
+		prev = &it->second;
+	}
+}
+
 int main(int argc, char** argv)
 {
 	if (!opt::db.empty())
@@ -658,6 +746,9 @@ int main(int argc, char** argv)
 
 	g_contigNames.lock();
 
+	// The offset of the first alignment
+	streamoff body = isSplittable(alignFile) ? (streamoff)in.tellg() : -1;
+
 	// Estimate the distances between contigs.
 	istream_iterator<SAMRecord> it(in), last;
 	if (contigLens.size() == 1) {
@@ -669,14 +760,37 @@ int main(int argc, char** argv)
 	assert(in);
 
 	g_recMA = opt::minAlign;
+	if (body >= 0) {
+		// Split the file into byte ranges, each of which starts with
+		// the alignments to a new target, and read the ranges in
+		// parallel.
+#if _OPENMP
+		unsigned threads = omp_get_max_threads();
+#else
+		unsigned threads = 1;
+#endif
+		vector<streamoff> ranges = splitRange(inFile, body,
+				fileSize(alignFile), 4 * threads,
+				IsSAMTargetBoundary::WINDOW, IsSAMTargetBoundary());
+		vector<TargetRange> targets(ranges.size() - 1);
+#pragma omp parallel for schedule(dynamic)
+		for (int i = 0; i < (int)ranges.size() - 1; ++i)
+			if (ranges[i] < ranges[i + 1])
+				targets[i] = estimateRange(out, alignFile,
+						ranges[i], ranges[i + 1], contigLens, pmf);
+		checkSorted(targets);
+		inFile.seekg(0, ios::end);
+		inFile.peek();
+	} else {
 #pragma omp parallel
-	for (vector<SAMRecord> records;;) {
-		records.clear();
+		for (vector<SAMRecord> records;;) {
+			records.clear();
 #pragma omp critical(in)
-		readPairs(it, last, records);
-		if (records.empty())
-			break;
-		writeEstimates(out, records, contigLens, pmf);
+			readPairs(it, last, records);
+			if (records.empty())
+				break;
+			writeEstimates(out, records, contigLens, pmf);
+		}
 	}
 
 	if (opt::verbose > 0) {
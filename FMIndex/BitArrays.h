@@ -2,9 +2,10 @@
 #define BITARRAYS_H 1
 
 #include "bit_array.h"
+#include "PageAligned.h"
 #include <algorithm>
 #include <cassert>
-#include <functional>
+#include <cstddef> // for ptrdiff_t
 #include <istream>
 #include <limits> // for numeric_limits
 #include <ostream>
@@ -23,9 +24,12 @@ class BitArrays
 	static T SENTINEL() { return std::numeric_limits<T>::max(); }
 
   public:
-	/** Count the occurrences of the symbols of [first, last). */
+	/** Count the occurrences of the symbols of [first, last).
+	 * @param alphabetSize the minimum size of the alphabet, which is
+	 * otherwise determined by the largest symbol
+	 */
 	template<typename It>
-	void assign(It first, It last)
+	void assign(It first, It last, unsigned alphabetSize = 0)
 	{
 		assert(first < last);
 		m_data.clear();
@@ -36,21 +40,32 @@ class BitArrays
 			if (*it != SENTINEL())
 				n = std::max(n, *it);
 		n++;
+		assert(alphabetSize < std::numeric_limits<T>::max());
+		n = std::max(n, T(alphabetSize));
 
 		assert(n < std::numeric_limits<T>::max());
 		m_data.resize(n, wat_array::BitArray(last - first));
 
-		size_t i = 0;
-		for (It it = first; it != last; ++it, ++i) {
-			T c = *it;
-			if (c == SENTINEL())
-				continue;
-			assert(c < m_data.size());
-			m_data[c].SetBit(1, i);
+		// Each chunk is a multiple of 64 symbols, so that no two
+		// threads write to the same word of a bit array.
+		const ptrdiff_t chunkSize = 1 << 16;
+		ptrdiff_t size = last - first;
+		ptrdiff_t chunks = (size + chunkSize - 1) / chunkSize;
+#pragma omp parallel for
+		for (ptrdiff_t j = 0; j < chunks; ++j) {
+			ptrdiff_t end = std::min(size, (j + 1) * chunkSize);
+			for (ptrdiff_t i = j * chunkSize; i < end; ++i) {
+				T c = first[i];
+				if (c == SENTINEL())
+					continue;
+				assert(c < m_data.size());
+				m_data[c].SetBit(1, i);
+			}
 		}
 
-		std::for_each(
-		    m_data.begin(), m_data.end(), [](wat_array::BitArray& b) { return b.Build(); });
+#pragma omp parallel for
+		for (ptrdiff_t c = 0; c < (ptrdiff_t)m_data.size(); ++c)
+			m_data[c].Build();
 	}
 
 	/** Return the size of the string. */
@@ -66,6 +81,9 @@ class BitArrays
 	/** Return the count of symbol c in s[0, i). */
 	size_t rank(T c, size_t i) const { return m_data[c].Rank(1, i); }
 
+	/** Prefetch the data read by rank(c, i). */
+	void prefetch(T c, size_t i) const { m_data[c].Prefetch(i); }
+
 	/** Return the symbol at the specified position. */
 	T at(size_t i) const
 	{
@@ -102,6 +120,58 @@ class BitArrays
 		return in;
 	}
 
+	/** Store this data structure in a page-aligned layout, which may
+	 * be mapped into memory. */
+	void write(PageAlignedWriter& out) const
+	{
+		out.write<uint64_t>(m_data.size());
+		for (Data::const_iterator it = m_data.begin(); it != m_data.end(); ++it) {
+			out.write<uint64_t>(it->length());
+			out.write<uint64_t>(it->one_num());
+		}
+		for (Data::const_iterator it = m_data.begin(); it != m_data.end(); ++it) {
+			out.align();
+			out.write(it->bit_data(), it->block_num());
+			out.align();
+			out.write(it->rank_data(), it->table_num());
+		}
+	}
+
+	/** Use the data structure stored by write in place. The mapped
+	 * memory must outlive this data structure. */
+	void map(PageAlignedReader& in)
+	{
+		m_data.clear();
+		uint64_t n = in.read<uint64_t>();
+		if (n == 0 || n >= std::numeric_limits<T>::max()) {
+			in.fail();
+			return;
+		}
+		m_data.resize(n);
+		std::vector<uint64_t> ones(n);
+		uint64_t length = 0;
+		for (size_t i = 0; i < n; ++i) {
+			uint64_t len = in.read<uint64_t>();
+			ones[i] = in.read<uint64_t>();
+			if (i == 0)
+				length = len;
+			if (len != length || ones[i] > length) {
+				in.fail();
+				return;
+			}
+			m_data[i].Map(length, 0, NULL, NULL);
+		}
+		for (Data::iterator it = m_data.begin(); it != m_data.end(); ++it) {
+			in.align();
+			const uint64_t* bits = in.read<uint64_t>(it->block_num());
+			in.align();
+			const uint64_t* ranks = in.read<uint64_t>(it->table_num());
+			if (!in.good())
+				return;
+			it->Map(it->length(), ones[it - m_data.begin()], bits, ranks);
+		}
+	}
+
   private:
 	typedef std::vector<wat_array::BitArray> Data;
 	Data m_data;
@@ -3,15 +3,22 @@
 
 #include "config.h"
 #include "BitArrays.h"
+#include "InterleavedOcc.h"
 #include "IOUtil.h"
+#include "LocateCache.h"
+#include "MappedFile.h"
+#include "PageAligned.h"
 #include "sais.hxx"
 #include <boost/integer.hpp>
 #include <algorithm>
 #include <cassert>
+#include <cstddef> // for ptrdiff_t
 #include <cstdlib> // for exit
+#include <fstream>
 #include <iostream>
 #include <iterator>
 #include <limits> // for numeric_limits
+#include <memory> // for shared_ptr
 #include <stdint.h>
 #include <string>
 #include <vector>
@@ -40,7 +47,7 @@ struct SAInterval
 {
 	size_type l, u;
 	SAInterval(size_type l, size_type u) : l(l), u(u) { }
-	SAInterval(const FMIndex& fm) : l(1), u(fm.m_occ.size()) { }
+	SAInterval(const FMIndex& fm) : l(1), u(fm.occSize()) { }
 	bool empty() const { return l >= u; }
 	bool operator==(const SAInterval& x) const
 	{
@@ -72,10 +79,26 @@ struct Match : public SAInterval
 	}
 };
 
-FMIndex() : m_sampleSA(1) { }
+/** The layout of the character occurrence table. */
+enum OccLayout {
+	/** One bit array per symbol */
+	BIT_ARRAYS,
+	/** Counts and packed symbols interleaved in cache lines */
+	INTERLEAVED
+};
+
+FMIndex() : m_sampleSA(1), m_layout(BIT_ARRAYS),
+	m_mappedSA(NULL), m_mappedSASize(0) { }
 
 /** Return the size of the string not counting the sentinel. */
-size_t size() const { return m_occ.size() - 1; }
+size_t size() const { return occSize() - 1; }
+
+/** Set the layout of the occurrence table built by assign and
+ * assignBWT. */
+void setOccLayout(OccLayout layout) { m_layout = layout; }
+
+/** Return the layout of the occurrence table. */
+OccLayout occLayout() const { return m_layout; }
 
 /** The size of the alphabet. */
 unsigned alphabetSize() const { return m_alphabet.size(); }
@@ -143,16 +166,18 @@ void setSA(size_t sai, size_t pos)
 void constructSuffixArray()
 {
 	// The length of the original string.
-	size_t n = m_occ.size() - 1;
+	size_t n = occSize() - 1;
 	assert(n > 0);
 	assert(m_sampleSA > 0);
+	m_mappedSA = NULL;
+	m_locateCache.reset();
 	m_sa.resize(n / m_sampleSA + 1);
 	size_t sai = 0;
 	for (size_t i = n; i > 0; i--) {
 		setSA(sai, i);
-		T c = m_occ.at(sai);
+		T c = occAt(sai);
 		assert(c != SENTINEL());
-		sai = m_cf[c] + m_occ.rank(c, sai);
+		sai = m_cf[c] + occRank(c, sai);
 		assert(sai > 0);
 	}
 	setSA(sai, 0);
@@ -167,7 +192,7 @@ void assignBWT(It first, It last)
 			< std::numeric_limits<size_type>::max());
 
 	std::cerr << "Building the character occurrence table...\n";
-	m_occ.assign(first, last);
+	occAssign(first, last);
 	countOccurrences();
 
 	// Construct the suffix array from the FM index.
@@ -190,6 +215,8 @@ void assign(It first, It last)
 	std::cerr << "Building the suffix array...\n";
 	size_t n = last - first;
 	m_sampleSA = 1;
+	m_mappedSA = NULL;
+	m_locateCache.reset();
 	m_sa.resize(n + 1);
 	m_sa[0] = n;
 
@@ -210,8 +237,40 @@ void assign(It first, It last)
 		bwt[i] = m_sa[i] == 0 ? SENTINEL() : first[m_sa[i] - 1];
 
 	std::cerr << "Building the character occurrence table...\n";
-	m_occ.assign(bwt.begin(), bwt.end());
+	occAssign(bwt.begin(), bwt.end());
+	countOccurrences();
+}
+
+/** Build an FM-index of the specified data in blocks of at most
+ * blockSize symbols, which uses less memory than assign, but is
+ * slower. The suffix array is sampled with the period set by
+ * sampleSA beforehand. The index is identical to that built by
+ * assign followed by sampleSA.
+ */
+template<typename It>
+void assignBlockwise(It first, It last, size_t blockSize)
+{
+	assert(first < last);
+	assert(size_t(last - first)
+			< std::numeric_limits<size_type>::max());
+	assert(blockSize > 0);
+	assert(m_sampleSA > 0);
+
+	encode(first, last);
+	std::replace(first, last, SENTINEL(), T(0));
+
+	std::cerr << "Building the Burrows-Wheeler transform in blocks...\n";
+	std::vector<T> bwt;
+	std::vector<size_type> anchors;
+	buildBWTBlockwise(first, last, blockSize, bwt, anchors);
+
+	std::cerr << "Building the character occurrence table...\n";
+	occAssign(bwt.begin(), bwt.end());
+	std::vector<T>().swap(bwt);
 	countOccurrences();
+
+	std::cerr << "Building the suffix array...\n";
+	constructSuffixArray(anchors);
 }
 
 /** Sample the suffix array. */
@@ -222,6 +281,10 @@ void sampleSA(unsigned period)
 		return;
 	assert(m_sampleSA == 1);
 	m_sampleSA = period;
+	if (m_mappedSA != NULL) {
+		m_sa.assign(m_mappedSA, m_mappedSA + m_mappedSASize);
+		m_mappedSA = NULL;
+	}
 	if (m_sampleSA == 1 || m_sa.empty())
 		return;
 	std::vector<size_type>::iterator out = m_sa.begin();
@@ -231,19 +294,85 @@ void sampleSA(unsigned period)
 	assert(!m_sa.empty());
 }
 
+/** Cache the elements of the suffix array located by at, using at
+ * most the specified number of bytes. A size of zero, or an
+ * unsampled suffix array, disables the cache. The cache is shared by
+ * the copies of this index. */
+void setLocateCache(size_t bytes)
+{
+	m_locateCache.reset();
+	if (bytes > 0 && m_sampleSA > 1) {
+		m_locateCache = std::make_shared<LocateCache>(occSize(), bytes);
+		if (m_locateCache->empty())
+			m_locateCache.reset();
+	}
+}
+
+/** Return the locate cache, or null if it is disabled. */
+const LocateCache* locateCache() const { return m_locateCache.get(); }
+
+/** Return the size in bytes of the sampled suffix array. */
+size_t saBytes() const { return saSize() * sizeof (size_type); }
+
+/** Return the sampling period of the suffix array. */
+unsigned sampleSAPeriod() const { return m_sampleSA; }
+
 /** Return the specified element of the suffix array. */
 size_t at(size_t i) const
 {
-	assert(i < m_occ.size());
+	assert(i < occSize());
+	if (m_locateCache != NULL)
+		return locateCached(i);
 	size_t n = 0;
 	while (i % m_sampleSA != 0) {
-		T c = m_occ.at(i);
-		i = c == SENTINEL() ? 0 : m_cf[c] + m_occ.rank(c, i);
+		T c = occAt(i);
+		i = c == SENTINEL() ? 0 : m_cf[c] + occRank(c, i);
 		n++;
 	}
-	assert(i / m_sampleSA < m_sa.size());
-	size_t pos = m_sa[i / m_sampleSA] + n;
-	return pos < m_occ.size() ? pos : pos - m_occ.size();
+	assert(i / m_sampleSA < saSize());
+	size_t pos = saData()[i / m_sampleSA] + n;
+	return pos < occSize() ? pos : pos - occSize();
+}
+
+/** Return the specified element of the suffix array, which is found
+ * either in the sampled suffix array or in the locate cache. Cache
+ * the elements visited by the walk. */
+size_t locateCached(size_t i) const
+{
+	/** The number of elements of a walk that are cached */
+	static const unsigned MAX_WALK = 256;
+	LocateCache& cache = *m_locateCache;
+	size_type walk[MAX_WALK];
+	size_t n = 0;
+	size_t pos;
+	bool hit = false;
+	for (;;) {
+		if (i % m_sampleSA == 0) {
+			assert(i / m_sampleSA < saSize());
+			pos = saData()[i / m_sampleSA];
+			break;
+		}
+		if (cache.lookup(i, pos)) {
+			hit = true;
+			break;
+		}
+		if (n < MAX_WALK)
+			walk[n] = i;
+		T c = occAt(i);
+		i = c == SENTINEL() ? 0 : m_cf[c] + occRank(c, i);
+		n++;
+	}
+	cache.count(n, hit);
+
+	// The element walk[j], which is n - j steps before the end of the
+	// walk, is pos + n - j.
+	size_t m = occSize();
+	for (size_t j = 0; j < n && j < MAX_WALK; ++j) {
+		size_t x = pos + (n - j);
+		cache.insert(walk[j], x < m ? x : x - m);
+	}
+	pos += n;
+	return pos < m ? pos : pos - m;
 }
 
 /** Return the specified element of the suffix array. */
@@ -255,8 +384,8 @@ size_t operator[](size_t i) const
 /** Return the symbol at the specifed position of the BWT. */
 T bwtAt(size_t i) const
 {
-	assert(i < m_occ.size());
-	T c = m_occ.at(i);
+	assert(i < occSize());
+	T c = occAt(i);
 	assert(c != SENTINEL());
 	assert(c < m_alphabet.size());
 	return m_alphabet[c];
@@ -265,7 +394,7 @@ T bwtAt(size_t i) const
 /** Return the first symbol of the specified suffix. */
 T symbolAt(size_t i) const
 {
-	assert(i < m_occ.size());
+	assert(i < occSize());
 	std::vector<size_type>::const_iterator it
 		= std::upper_bound(m_cf.begin(), m_cf.end(), i);
 	assert(it != m_cf.begin());
@@ -281,12 +410,12 @@ void decompress(It out)
 	// Construct the original string.
 	std::vector<T> s;
 	for (size_t i = 0;;) {
-		assert(i < m_occ.size());
-		T c = m_occ.at(i);
+		assert(i < occSize());
+		T c = occAt(i);
 		if (c == SENTINEL())
 			break;
 		s.push_back(c);
-		i = m_cf[c] + m_occ.rank(c, i);
+		i = m_cf[c] + occRank(c, i);
 		assert(i > 0);
 	}
 
@@ -303,7 +432,7 @@ void decompress(It out)
 size_type update(size_type i, T c) const
 {
 	assert(c < m_cf.size());
-	return m_cf[c] + m_occ.rank(c, i);
+	return m_cf[c] + occRank(c, i);
 }
 
 /** Extend a suffix array interval by one character to the left. */
@@ -468,6 +597,89 @@ Match find(const std::string& q, unsigned k) const
 	return findSubstring(s.begin(), s.end(), k);
 }
 
+/** The number of queries of findBatch searched in lockstep. */
+static const unsigned BATCH_WIDTH = 32;
+
+/** Search for a matching substring of each query at least minLen[i]
+ * long, as find does. The searches of BATCH_WIDTH queries advance in
+ * lockstep. Each round resolves the step of every search whose
+ * blocks of the occurrence table were prefetched by the previous
+ * round and prefetches the blocks of its next step, so that the cache
+ * misses of the searches overlap.
+ * @param matches [out] the longest match of each query
+ */
+void findBatch(const std::vector<std::string>& queries,
+		const std::vector<unsigned>& minLen,
+		std::vector<Match>& matches) const
+{
+	assert(queries.size() == minLen.size());
+	matches.resize(queries.size());
+	std::vector<BatchSearch> slots(BATCH_WIDTH);
+	for (size_t next = 0, active = 1; active > 0;) {
+		active = 0;
+		for (std::vector<BatchSearch>::iterator it
+				= slots.begin(); it != slots.end(); ++it) {
+			BatchSearch& q = *it;
+			if (q.pending) {
+				if (batchStep(q)) {
+					++active;
+					continue;
+				}
+				matches[q.index] = q.best;
+				q.pending = false;
+			}
+			while (next < queries.size()) {
+				size_t i = next++;
+				if (batchStart(q, i, queries[i], minLen[i])) {
+					q.pending = true;
+					++active;
+					break;
+				}
+				matches[i] = q.best;
+			}
+		}
+	}
+}
+
+/** Search for the overlaps of each query, as findOverlapSuffix does
+ * if prefix[i] is false and as findOverlapPrefix does otherwise. The
+ * searches of BATCH_WIDTH queries advance in lockstep, as those of
+ * findBatch do.
+ * @param matches [out] the matches of each query, in the order that
+ * findOverlapSuffix or findOverlapPrefix outputs them
+ */
+void findOverlapBatch(const std::vector<std::string>& queries,
+		const std::vector<bool>& prefix, unsigned minOverlap,
+		std::vector<std::vector<Match> >& matches) const
+{
+	assert(queries.size() == prefix.size());
+	matches.assign(queries.size(), std::vector<Match>());
+	std::vector<OverlapSearch> slots(BATCH_WIDTH);
+	for (size_t next = 0, active = 1; active > 0;) {
+		active = 0;
+		for (std::vector<OverlapSearch>::iterator it
+				= slots.begin(); it != slots.end(); ++it) {
+			OverlapSearch& q = *it;
+			if (q.pending) {
+				if (overlapStep(q, minOverlap, matches[q.index])) {
+					++active;
+					continue;
+				}
+				q.pending = false;
+			}
+			while (next < queries.size()) {
+				size_t i = next++;
+				if (overlapStart(q, i, queries[i], prefix[i],
+							minOverlap, matches[i])) {
+					q.pending = true;
+					++active;
+					break;
+				}
+			}
+		}
+	}
+}
+
 /** Set the alphabet to [first, last).
  * The character '\0' is treated specially and not included in the
  * alphabet.
@@ -507,21 +719,28 @@ void setAlphabet(const std::string& s)
 #define STRINGIFY(X) #X
 #define FM_VERSION_BITS(BITS) "FM " STRINGIFY(BITS) " 1"
 #define FM_VERSION FM_VERSION_BITS(FMBITS)
+#define FM_INTERLEAVED_VERSION_BITS(BITS) "FM " STRINGIFY(BITS) " 2"
+#define FM_INTERLEAVED_VERSION FM_INTERLEAVED_VERSION_BITS(FMBITS)
+#define FM_MAPPED_VERSION_BITS(BITS) "FM " STRINGIFY(BITS) " 3"
+#define FM_MAPPED_VERSION FM_MAPPED_VERSION_BITS(FMBITS)
 
 /** Store an index. */
 friend std::ostream& operator<<(std::ostream& out, const FMIndex& o)
 {
-	out << FM_VERSION << '\n'
+	out << (o.m_layout == INTERLEAVED
+			? FM_INTERLEAVED_VERSION : FM_VERSION) << '\n'
 		<< o.m_sampleSA << '\n';
 
 	out << o.m_alphabet.size() << '\n';
 	out.write(reinterpret_cast<const char*>(&o.m_alphabet[0]),
 			o.m_alphabet.size() * sizeof o.m_alphabet[0]);
 
-	out << o.m_sa.size() << '\n';
-	out.write(reinterpret_cast<const char*>(&o.m_sa[0]),
-		o.m_sa.size() * sizeof o.m_sa[0]);
+	out << o.saSize() << '\n';
+	out.write(reinterpret_cast<const char*>(o.saData()),
+		o.saSize() * sizeof (size_type));
 
+	if (o.m_layout == INTERLEAVED)
+		return out << o.m_interleavedOcc;
 	return out << o.m_occ;
 }
 
@@ -531,10 +750,15 @@ friend std::istream& operator>>(std::istream& in, FMIndex& o)
 	std::string version;
 	std::getline(in, version);
 	assert(in);
-	if (version != FM_VERSION) {
+	if (version == FM_VERSION)
+		o.m_layout = BIT_ARRAYS;
+	else if (version == FM_INTERLEAVED_VERSION)
+		o.m_layout = INTERLEAVED;
+	else {
 		std::cerr << "error: the version of this FM-index, `"
 			<< version << "', does not match the version required "
-			"by this program, `" FM_VERSION "'.\n";
+			"by this program, `" FM_VERSION "' or `"
+			FM_INTERLEAVED_VERSION "'.\n";
 		exit(EXIT_FAILURE);
 	}
 
@@ -553,20 +777,588 @@ friend std::istream& operator>>(std::istream& in, FMIndex& o)
 	in >> n >> expect("\n");
 	assert(in);
 	assert(n < std::numeric_limits<size_type>::max());
+	o.m_mappedSA = NULL;
+	o.m_locateCache.reset();
 	o.m_sa.resize(n);
 	in.read(reinterpret_cast<char*>(&o.m_sa[0]),
 			n * sizeof o.m_sa[0]);
 
-	in >> o.m_occ;
+	if (o.m_layout == INTERLEAVED) {
+		o.m_occ = BitArrays();
+		in >> o.m_interleavedOcc;
+	} else {
+		o.m_interleavedOcc = InterleavedOcc();
+		in >> o.m_occ;
+	}
 	assert(in);
+	o.m_file.reset();
 	o.countOccurrences();
 
 	return in;
 }
 
+/** Store an index in a page-aligned layout, which load maps into
+ * memory rather than reads. */
+void writeMapped(std::ostream& out) const
+{
+	static const char version[] = FM_MAPPED_VERSION "\n";
+	out << version;
+	PageAlignedWriter w(out, sizeof version - 1);
+	w.write<uint64_t>(m_layout);
+	w.write<uint64_t>(m_sampleSA);
+	w.write<uint64_t>(m_alphabet.size());
+	w.write(m_alphabet.data(), m_alphabet.size());
+	w.write<uint64_t>(saSize());
+	w.align();
+	w.write(saData(), saSize());
+	w.align();
+	if (m_layout == INTERLEAVED)
+		m_interleavedOcc.write(w);
+	else
+		m_occ.write(w);
+}
+
+/** Load an index from the specified file. An index stored by
+ * writeMapped is mapped into memory and used in place, so that the
+ * processes that load the same index share one copy of it.
+ */
+void load(const std::string& path)
+{
+	std::ifstream in(path.c_str());
+	assert_good(in, path);
+	std::string version;
+	std::getline(in, version);
+	in.close();
+	if (version != FM_MAPPED_VERSION) {
+		in.clear();
+		in.open(path.c_str());
+		assert_good(in, path);
+		in >> *this;
+		assert_good(in, path);
+		return;
+	}
+
+	std::shared_ptr<MappedFile> file(
+			new MappedFile(path, MappedFile::RANDOM));
+	PageAlignedReader r(file->data(), file->size(), version.size() + 1);
+	uint64_t layout = r.read<uint64_t>();
+	uint64_t sampleSA = r.read<uint64_t>();
+	uint64_t alphabetSize = r.read<uint64_t>();
+	const T* alphabet = alphabetSize < SENTINEL()
+		? r.read<T>(alphabetSize) : NULL;
+	uint64_t saSize = r.read<uint64_t>();
+	r.align();
+	const size_type* sa = r.read<size_type>(saSize);
+	r.align();
+	if (layout == INTERLEAVED) {
+		m_occ = BitArrays();
+		m_interleavedOcc.map(r);
+	} else {
+		m_interleavedOcc = InterleavedOcc();
+		m_occ.map(r);
+	}
+	m_layout = OccLayout(layout);
+	m_sampleSA = sampleSA;
+	if (!r.eof() || layout > INTERLEAVED || alphabet == NULL
+			|| alphabetSize == 0 || sampleSA == 0
+			|| sampleSA > std::numeric_limits<unsigned>::max()
+			|| occSize() == 0
+			|| saSize != (occSize() - 1) / sampleSA + 1) {
+		std::cerr << "error: `" << path
+			<< "': the FM-index is corrupt\n";
+		exit(EXIT_FAILURE);
+	}
+
+	setAlphabet(alphabet, alphabet + alphabetSize);
+	std::vector<size_type>().swap(m_sa);
+	m_mappedSA = sa;
+	m_mappedSASize = saSize;
+	m_locateCache.reset();
+	m_file = file;
+	countOccurrences();
+}
+
+/** Return whether this index is mapped from a file. */
+bool isMapped() const { return m_file != NULL; }
+
 private:
 
-/** Build the cumulative frequency table m_cf from m_occ. */
+/** The state of one search of findBatch, which follows
+ * findSubstring and findSuffix. The suffix of the query ending at
+ * end is extended to the left by the symbol s[pos - 1]. */
+struct BatchSearch
+{
+	std::string s;
+	std::vector<SAInterval> memo;
+	size_t index;
+	unsigned end, pos, memoPos;
+	SAInterval sai;
+	Match best;
+	bool pending;
+
+	BatchSearch() : index(0), end(0), pos(0), memoPos(0),
+		sai(0, 0), pending(false) { }
+};
+
+/** Start the search of query number i.
+ * @return false if the search is complete
+ */
+bool batchStart(BatchSearch& q, size_t i, const std::string& query,
+		unsigned k) const
+{
+	q.s = query;
+	std::transform(q.s.begin(), q.s.end(), q.s.begin(),
+			Translate(*this));
+	q.memo.assign(q.s.size(), SAInterval(0, 0));
+	q.index = i;
+	q.best = Match(0, 0, 0, k > 0 ? k - 1 : 0);
+	q.end = q.s.size();
+	if (q.end == 0 || q.end < q.best.qspan())
+		return false;
+	q.sai = SAInterval(*this);
+	q.pos = q.end;
+	q.memoPos = 0;
+	return batchNext(q, false);
+}
+
+/** Prefetch the blocks of the occurrence table read by the next step
+ * of the search. If the search of this suffix is complete, record its
+ * match and continue with the next suffix.
+ * @return false if the search of the query is complete
+ */
+bool batchNext(BatchSearch& q, bool suffixDone) const
+{
+	for (;;) {
+		T c = q.pos > 0 ? q.s[q.pos - 1] : SENTINEL();
+		if (!suffixDone && c != SENTINEL() && !q.sai.empty()) {
+			occPrefetch(c, q.sai.l);
+			occPrefetch(c, q.sai.u);
+			return true;
+		}
+
+		Match interval(q.sai.l, q.sai.u, q.pos, q.end);
+		if (interval.qspan() > q.best.qspan())
+			q.best = interval;
+		else if (interval.qspan() == q.best.qspan())
+			q.best.num++;
+
+		if (--q.end == 0 || q.end < q.best.qspan())
+			return false;
+		q.sai = SAInterval(*this);
+		q.pos = q.end;
+		q.memoPos = q.s.size() - q.end;
+		suffixDone = false;
+	}
+}
+
+/** Extend the interval of the search by the symbol s[pos - 1], whose
+ * blocks were prefetched, and prefetch the next step.
+ * @return false if the search of the query is complete
+ */
+bool batchStep(BatchSearch& q) const
+{
+	SAInterval sai = update(q.sai, q.s[q.pos - 1]);
+	if (sai.empty())
+		return batchNext(q, true);
+	q.sai = sai;
+	if (q.memo[q.memoPos] == sai) {
+		// This vertex of the prefix DAWG has been visited.
+		return batchNext(q, true);
+	}
+	q.memo[q.memoPos++] = sai;
+	q.pos--;
+	return batchNext(q, false);
+}
+
+/** The state of one search of findOverlapBatch. A suffix search
+ * follows findOverlapSuffix. A prefix search follows
+ * findOverlapPrefix, and searches for the prefix of each length in
+ * turn. The search of the string s[pos, end) is extended to the left
+ * by the symbol s[pos - 1]. */
+struct OverlapSearch
+{
+	std::string s;
+	size_t index;
+	unsigned pos, end;
+	SAInterval sai;
+	bool prefix, pending;
+
+	/** Whether the suffix search checks whether s[pos, end) is a
+	 * prefix of the target, by extending it by the symbol 0 */
+	bool check;
+
+	OverlapSearch() : index(0), pos(0), end(0), sai(0, 0),
+		prefix(false), pending(false), check(false) { }
+};
+
+/** Start the search of query number i.
+ * @return false if the search is complete
+ */
+bool overlapStart(OverlapSearch& q, size_t i, const std::string& query,
+		bool prefix, unsigned minOverlap,
+		std::vector<Match>& matches) const
+{
+	q.s = query;
+	std::transform(q.s.begin(), q.s.end(), q.s.begin(),
+			Translate(*this));
+	q.index = i;
+	q.prefix = prefix;
+	q.check = false;
+	if (prefix) {
+		q.end = std::max(minOverlap, 1U);
+		if (q.end > q.s.size())
+			return false;
+		q.sai = update(SAInterval(*this), 0);
+	} else {
+		q.end = q.s.size();
+		if (q.end == 0)
+			return false;
+		q.sai = SAInterval(*this);
+	}
+	q.pos = q.end;
+	return overlapNext(q, minOverlap, matches);
+}
+
+/** Prefetch the blocks of the occurrence table read by the next step
+ * of the search. If the search of a prefix is complete, record its
+ * match and continue with the next longer prefix.
+ * @return false if the search of the query is complete
+ */
+bool overlapNext(OverlapSearch& q, unsigned minOverlap,
+		std::vector<Match>& matches) const
+{
+	if (!q.prefix) {
+		q.check = q.pos < q.end && q.end - q.pos >= minOverlap;
+		T c = q.pos > 0 ? q.s[q.pos - 1] : SENTINEL();
+		if (q.check) {
+			occPrefetch(0, q.sai.l);
+			occPrefetch(0, q.sai.u);
+		}
+		if (c != SENTINEL()) {
+			occPrefetch(c, q.sai.l);
+			occPrefetch(c, q.sai.u);
+		}
+		return q.check || c != SENTINEL();
+	}
+
+	for (;;) {
+		if (!q.sai.empty()) {
+			if (q.pos > 0) {
+				T c = q.s[q.pos - 1];
+				if (c == SENTINEL()) {
+					// Every longer prefix includes this symbol.
+					return false;
+				}
+				occPrefetch(c, q.sai.l);
+				occPrefetch(c, q.sai.u);
+				return true;
+			}
+			matches.push_back(Match(q.sai.l, q.sai.u, 0, q.end));
+		}
+		if (++q.end > q.s.size())
+			return false;
+		q.sai = update(SAInterval(*this), 0);
+		q.pos = q.end;
+	}
+}
+
+/** Advance the search by one step, whose blocks were prefetched, and
+ * prefetch the next step.
+ * @return false if the search of the query is complete
+ */
+bool overlapStep(OverlapSearch& q, unsigned minOverlap,
+		std::vector<Match>& matches) const
+{
+	if (q.check) {
+		SAInterval sai = update(q.sai, 0);
+		if (!sai.empty())
+			matches.push_back(Match(sai.l, sai.u, q.pos, q.end));
+	}
+	T c = q.pos > 0 ? q.s[q.pos - 1] : SENTINEL();
+	if (c == SENTINEL())
+		return false;
+	q.sai = update(q.sai, c);
+	q.pos--;
+	if (!q.prefix && q.sai.empty())
+		return false;
+	return overlapNext(q, minOverlap, matches);
+}
+
+/** Return the sampled suffix array. */
+const size_type* saData() const
+{
+	return m_mappedSA != NULL ? m_mappedSA : m_sa.data();
+}
+
+/** Return the size of the sampled suffix array. */
+size_t saSize() const
+{
+	return m_mappedSA != NULL ? m_mappedSASize : m_sa.size();
+}
+
+/** The suffixes of the text at multiples of this period are the
+ * starting points of constructing the suffix array in parallel. */
+static const size_t ANCHOR_PERIOD = 1 << 16;
+
+/** Compare the suffixes of a block by their rank among the old
+ * suffixes and their first symbol. The position following the last
+ * suffix of the block is the terminator, the first old suffix. */
+template<typename It>
+struct BlockKey
+{
+	const std::vector<size_type>& ranks;
+	It text;
+	uint64_t row;
+	uint64_t sigma;
+
+	BlockKey(const std::vector<size_type>& ranks, It text,
+			uint64_t row, uint64_t sigma)
+		: ranks(ranks), text(text), row(row), sigma(sigma) { }
+
+	/** Return the key of the suffix k of the block. */
+	uint64_t key(size_t k) const
+	{
+		return k < ranks.size()
+			? 2 * uint64_t(ranks[k]) * sigma + text[k]
+			: (2 * row + 1) * sigma;
+	}
+
+	bool operator()(size_t a, size_t b) const
+	{
+		return key(a) < key(b);
+	}
+};
+
+/** Sort the suffixes of a block by their keys, which are at most
+ * maxKey, using a least-significant-digit radix sort. */
+template<typename It>
+static void radixSort(const BlockKey<It>& key, uint64_t maxKey,
+		std::vector<sais_size_type>& sa)
+{
+	const unsigned DIGIT_BITS = 16;
+	const uint64_t DIGIT_MASK = (1 << DIGIT_BITS) - 1;
+	std::vector<sais_size_type> tmp(sa.size());
+	std::vector<size_t> counts(DIGIT_MASK + 1);
+	for (unsigned shift = 0; shift < 64 && maxKey >> shift > 0;
+			shift += DIGIT_BITS) {
+		std::fill(counts.begin(), counts.end(), 0);
+		for (size_t t = 0; t < sa.size(); ++t)
+			counts[key.key(sa[t]) >> shift & DIGIT_MASK]++;
+		size_t sum = 0;
+		for (size_t d = 0; d <= DIGIT_MASK; ++d) {
+			size_t count = counts[d];
+			counts[d] = sum;
+			sum += count;
+		}
+		for (size_t t = 0; t < sa.size(); ++t)
+			tmp[counts[key.key(sa[t]) >> shift & DIGIT_MASK]++] = sa[t];
+		sa.swap(tmp);
+	}
+}
+
+/** Build the BWT of the encoded text [first, last) in blocks,
+ * starting from the end of the text. The BWT of the suffixes that
+ * start before the block is known. The rank of each suffix of the
+ * block among those old suffixes is found by backward search. The
+ * suffixes of the block are sorted by suffix sorting the string of
+ * their ranks and first symbols, which is terminated by the first old
+ * suffix, and the BWT of the block is then merged into the BWT.
+ * @param[out] bwt the BWT including the sentinel
+ * @param[out] anchors the row of the suffix starting at each
+ * multiple of ANCHOR_PERIOD
+ */
+template<typename It>
+void buildBWTBlockwise(It first, It last, size_t blockSize,
+		std::vector<T>& bwt, std::vector<size_type>& anchors) const
+{
+	const uint64_t sigma = m_alphabet.size();
+	size_t n = last - first;
+
+	// The BWT of the empty suffix, and the row of the first suffix.
+	bwt.reserve(n + 1);
+	bwt.assign(1, SENTINEL());
+	size_t row = 0;
+	anchors.assign(n / ANCHOR_PERIOD + 1, 0);
+
+	for (size_t i = n; i > 0;) {
+		size_t j = i > blockSize ? i - blockSize : 0;
+		size_t b = i - j;
+
+		// Index the BWT of the suffixes of [i, n).
+		FMIndex old;
+		old.m_alphabet = m_alphabet;
+		if (InterleavedOcc::supports(sigma)) {
+			old.m_layout = INTERLEAVED;
+			old.m_interleavedOcc.assign(bwt.begin(), bwt.end(), sigma);
+		} else
+			old.m_occ.assign(bwt.begin(), bwt.end(), sigma);
+		old.countOccurrences();
+
+		// Count the old suffixes less than each suffix of the block.
+		std::vector<size_type> ranks(b);
+		size_t rank = row;
+		for (size_t k = b; k > 0; --k) {
+			rank = old.update(rank, first[j + k - 1]);
+			ranks[k - 1] = rank;
+		}
+		old = FMIndex();
+
+		// The key of a suffix of the block is its rank and its
+		// first symbol. The terminator sorts after the suffixes whose
+		// rank is at most the row of the first old suffix. Replace
+		// each key by its order among the distinct keys.
+		BlockKey<It> less(ranks, first + j, row, sigma);
+		std::vector<sais_size_type> sa(b + 1);
+		for (size_t k = 0; k <= b; ++k)
+			sa[k] = k;
+		radixSort(less, (2 * bwt.size() + 1) * sigma, sa);
+		std::vector<sais_size_type> s(b + 1);
+		sais_size_type alphabetSize = 0;
+		for (size_t t = 0; t <= b; ++t) {
+			if (t > 0 && less(sa[t - 1], sa[t]))
+				alphabetSize++;
+			s[sa[t]] = alphabetSize;
+		}
+		alphabetSize++;
+
+		// Sort the suffixes of the block.
+		int status = saisxx(&s[0], &sa[0],
+				(sais_size_type)(b + 1), alphabetSize);
+		assert(status == 0);
+		if (status != 0)
+			abort();
+		std::vector<sais_size_type>().swap(s);
+		sa.erase(std::find(sa.begin(), sa.end(),
+					(sais_size_type)b));
+
+		// Update the rows of the old anchors.
+		for (size_t m = (i + ANCHOR_PERIOD - 1) / ANCHOR_PERIOD;
+				m < anchors.size(); ++m) {
+			size_t lo = 0, hi = b;
+			while (lo < hi) {
+				size_t mid = lo + (hi - lo) / 2;
+				if (ranks[sa[mid]] <= anchors[m])
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			anchors[m] += lo;
+		}
+
+		// Merge the BWT of the block into the BWT.
+		bwt[row] = first[i - 1];
+		size_t q = bwt.size();
+		bwt.resize(q + b);
+		for (size_t t = b; t > 0; --t) {
+			size_t k = sa[t - 1];
+			size_t r = ranks[k];
+			std::copy_backward(bwt.begin() + r, bwt.begin() + q,
+					bwt.begin() + q + t);
+			q = r;
+			bwt[r + t - 1] = k == 0 ? SENTINEL() : first[j + k - 1];
+			if ((j + k) % ANCHOR_PERIOD == 0)
+				anchors[(j + k) / ANCHOR_PERIOD] = r + t - 1;
+			if (k == 0)
+				row = r + t - 1;
+		}
+		i = j;
+	}
+	assert(bwt.size() == n + 1);
+	assert(bwt[row] == SENTINEL());
+}
+
+/** Construct the sampled suffix array from the FM index in parallel.
+ * @param anchors the row of the suffix starting at each multiple of
+ * ANCHOR_PERIOD
+ */
+void constructSuffixArray(const std::vector<size_type>& anchors)
+{
+	// The length of the original string.
+	size_t n = occSize() - 1;
+	assert(n > 0);
+	assert(m_sampleSA > 0);
+	assert(anchors.size() == n / ANCHOR_PERIOD + 1);
+	m_mappedSA = NULL;
+	m_locateCache.reset();
+	m_sa.resize(n / m_sampleSA + 1);
+	setSA(anchors[0], 0);
+
+	// Walk backward from each anchor to the previous anchor.
+	ptrdiff_t nanchors = anchors.size();
+#pragma omp parallel for schedule(dynamic)
+	for (ptrdiff_t m = 0; m < nanchors; ++m) {
+		size_t j = m * ANCHOR_PERIOD;
+		size_t i = std::min(j + ANCHOR_PERIOD, n);
+		size_t sai = i == n ? 0 : anchors[m + 1];
+		for (; i > j; i--) {
+			setSA(sai, i);
+			T c = occAt(sai);
+			assert(c != SENTINEL());
+			sai = m_cf[c] + occRank(c, sai);
+		}
+	}
+}
+
+/** Build the occurrence table of the BWT [first, last). */
+template<typename It>
+void occAssign(It first, It last)
+{
+	if (m_layout == INTERLEAVED
+			&& !InterleavedOcc::supports(m_alphabet.size())) {
+		std::cerr << "warning: the alphabet has " << m_alphabet.size()
+			<< " symbols, which is too many for the interleaved "
+			"occurrence table\n";
+		m_layout = BIT_ARRAYS;
+	}
+	if (m_layout == INTERLEAVED) {
+		m_occ = BitArrays();
+		m_interleavedOcc.assign(first, last, m_alphabet.size());
+	} else {
+		m_interleavedOcc = InterleavedOcc();
+		m_occ.assign(first, last);
+	}
+}
+
+/** Return the size of the BWT. */
+size_t occSize() const
+{
+	return m_layout == INTERLEAVED
+		? m_interleavedOcc.size() : m_occ.size();
+}
+
+/** Return the symbol of the BWT at the specified position. */
+T occAt(size_t i) const
+{
+	return m_layout == INTERLEAVED
+		? m_interleavedOcc.at(i) : m_occ.at(i);
+}
+
+/** Return the count of symbol c in BWT[0, i). */
+size_t occRank(T c, size_t i) const
+{
+	return m_layout == INTERLEAVED
+		? m_interleavedOcc.rank(c, i) : m_occ.rank(c, i);
+}
+
+/** Prefetch the blocks of the occurrence table read by
+ * occRank(c, i). */
+void occPrefetch(T c, size_t i) const
+{
+	if (m_layout == INTERLEAVED)
+		m_interleavedOcc.prefetch(i);
+	else
+		m_occ.prefetch(c, i);
+}
+
+/** Return the number of occurrences of the specified symbol. */
+size_t occCount(T c) const
+{
+	return m_layout == INTERLEAVED
+		? m_interleavedOcc.count(c) : m_occ.count(c);
+}
+
+/** Build the cumulative frequency table m_cf from the occurrence
+ * table. */
 void countOccurrences()
 {
 	assert(!m_alphabet.empty());
@@ -574,7 +1366,7 @@ void countOccurrences()
 	// The sentinel character occurs once.
 	m_cf[0] = 1;
 	for (unsigned i = 0; i < m_cf.size() - 1; ++i)
-		m_cf[i + 1] = m_cf[i] + m_occ.count(i);
+		m_cf[i + 1] = m_cf[i] + occCount(i);
 }
 
 	unsigned m_sampleSA;
@@ -582,7 +1374,21 @@ void countOccurrences()
 	std::vector<T> m_mapping;
 	std::vector<size_type> m_cf;
 	std::vector<size_type> m_sa;
+	OccLayout m_layout;
 	BitArrays m_occ;
+	InterleavedOcc m_interleavedOcc;
+
+	/** The mapped file of an index loaded by load, which is shared by
+	 * the copies of this index */
+	std::shared_ptr<MappedFile> m_file;
+
+	/** The sampled suffix array of a mapped file, or null */
+	const size_type* m_mappedSA;
+	size_t m_mappedSASize;
+
+	/** The cache of located elements of the suffix array, which is
+	 * shared by the copies of this index, or null */
+	std::shared_ptr<LocateCache> m_locateCache;
 };
 
 #endif
@@ -0,0 +1,415 @@
+#ifndef INTERLEAVEDOCC_H
+#define INTERLEAVEDOCC_H 1
+
+#include "BitUtil.h" // for popcount
+#include "PageAligned.h"
+#include <algorithm>
+#include <cassert>
+#include <cstddef> // for ptrdiff_t
+#include <cstdlib> // for posix_memalign
+#include <istream>
+#include <limits> // for numeric_limits
+#include <new> // for bad_alloc
+#include <ostream>
+#include <stdint.h>
+#include <vector>
+
+/** Allocate memory aligned to a cache line. */
+template <typename T>
+struct CacheLineAllocator
+{
+	typedef T value_type;
+
+	CacheLineAllocator() { }
+	template <typename U>
+	CacheLineAllocator(const CacheLineAllocator<U>&) { }
+
+	T* allocate(size_t n)
+	{
+		void* p;
+		if (posix_memalign(&p, 64, n * sizeof (T)) != 0)
+			throw std::bad_alloc();
+		return static_cast<T*>(p);
+	}
+
+	void deallocate(T* p, size_t) { free(p); }
+
+	template <typename U>
+	bool operator==(const CacheLineAllocator<U>&) const { return true; }
+	template <typename U>
+	bool operator!=(const CacheLineAllocator<U>&) const { return false; }
+};
+
+/**
+ * Store a string of symbols from a small alphabet, such as the BWT of
+ * DNA, for rank queries. The string is divided into blocks of one
+ * cache line. Each block stores the number of occurrences of each
+ * symbol before the block followed by the symbols of the block
+ * packed in two or three bits, so that rank reads one cache line.
+ * The counts of a block are relative to its superblock of 2^16
+ * blocks, whose counts are stored separately.
+ *
+ * The sentinel symbol is stored as the symbol 0, and its position
+ * is stored separately.
+ */
+class InterleavedOcc
+{
+	/** A symbol. */
+	typedef uint8_t T;
+
+	/** The sentinel symbol. */
+	static T SENTINEL() { return std::numeric_limits<T>::max(); }
+
+	/** The number of 64-bit words of a block. */
+	static const unsigned BLOCK_WORDS = 8;
+
+	/** The number of blocks of a superblock is 2^SUPERBLOCK_SHIFT. */
+	static const unsigned SUPERBLOCK_SHIFT = 16;
+
+	/** The layout of a block whose symbols are packed in BITS bits.
+	 * The counts of the symbols are 32-bit integers. */
+	template <unsigned BITS>
+	struct Layout
+	{
+		static const unsigned MAX_ALPHABET = BITS == 2 ? 4 : 6;
+		static const unsigned COUNT_WORDS = MAX_ALPHABET / 2;
+		static const unsigned SYMBOLS_PER_WORD = 64 / BITS;
+		static const unsigned SYMBOLS_PER_BLOCK
+			= (BLOCK_WORDS - COUNT_WORDS) * SYMBOLS_PER_WORD;
+		/** The least significant bit of each symbol. */
+		static const uint64_t LSB = BITS == 2
+			? 0x5555555555555555ULL : 0x1249249249249249ULL;
+	};
+
+	typedef std::vector<uint64_t, CacheLineAllocator<uint64_t> > Blocks;
+
+  public:
+	/** The maximum size of the alphabet not counting the sentinel. */
+	static const unsigned MAX_ALPHABET = Layout<3>::MAX_ALPHABET;
+
+	InterleavedOcc() : m_size(0), m_bits(0), m_sentinel(0),
+		m_mappedSuperblocks(NULL), m_mappedBlocks(NULL)
+	{
+		std::fill(m_counts, m_counts + MAX_ALPHABET, 0);
+	}
+
+	/** Return whether an alphabet of the specified size, not
+	 * counting the sentinel, may be stored. */
+	static bool supports(unsigned alphabetSize)
+	{
+		return alphabetSize <= MAX_ALPHABET;
+	}
+
+	/** Count the occurrences of the symbols of [first, last).
+	 * @param alphabetSize the minimum size of the alphabet, which is
+	 * otherwise determined by the largest symbol
+	 */
+	template<typename It>
+	void assign(It first, It last, unsigned alphabetSize = 0)
+	{
+		assert(first < last);
+		T n = 0;
+		for (It it = first; it != last; ++it)
+			if (*it != SENTINEL())
+				n = std::max(n, *it);
+		n++;
+		assert(supports(alphabetSize));
+		n = std::max(n, T(alphabetSize));
+		assert(supports(n));
+		m_bits = n <= Layout<2>::MAX_ALPHABET ? 2 : 3;
+		m_mappedSuperblocks = NULL;
+		m_mappedBlocks = NULL;
+		if (m_bits == 2)
+			fill<2>(first, last);
+		else
+			fill<3>(first, last);
+	}
+
+	/** Return the size of the string. */
+	size_t size() const { return m_size; }
+
+	/** Return the number of occurrences of the specified symbol. */
+	size_t count(T c) const
+	{
+		assert(c < MAX_ALPHABET);
+		return m_counts[c] - (c == 0 && m_sentinel < m_size);
+	}
+
+	/** Return the count of symbol c in s[0, i). */
+	size_t rank(T c, size_t i) const
+	{
+		assert(i <= m_size);
+		assert(c < MAX_ALPHABET);
+		size_t n = m_bits == 2 ? rank<2>(c, i) : rank<3>(c, i);
+		return c == 0 && i > m_sentinel ? n - 1 : n;
+	}
+
+	/** Prefetch the block read by rank(c, i). */
+	void prefetch(size_t i) const
+	{
+		size_t b = m_bits == 2 ? i / Layout<2>::SYMBOLS_PER_BLOCK
+			: i / Layout<3>::SYMBOLS_PER_BLOCK;
+		::prefetch(blocks() + b * BLOCK_WORDS);
+	}
+
+	/** Return the symbol at the specified position. */
+	T at(size_t i) const
+	{
+		assert(i < m_size);
+		if (i == m_sentinel)
+			return SENTINEL();
+		return m_bits == 2 ? at<2>(i) : at<3>(i);
+	}
+
+	/** Store this data structure. */
+	friend std::ostream& operator<<(std::ostream& out,
+			const InterleavedOcc& o)
+	{
+		uint64_t header[4] = { o.m_size, o.m_bits, o.m_sentinel,
+			o.numSuperblocks() * MAX_ALPHABET };
+		out.write(reinterpret_cast<const char*>(header), sizeof header);
+		out.write(reinterpret_cast<const char*>(o.m_counts),
+				sizeof o.m_counts);
+		out.write(reinterpret_cast<const char*>(o.superblocks()),
+				header[3] * sizeof (uint64_t));
+		return out.write(reinterpret_cast<const char*>(o.blocks()),
+				o.numBlocks() * BLOCK_WORDS * sizeof (uint64_t));
+	}
+
+	/** Load this data structure. */
+	friend std::istream& operator>>(std::istream& in, InterleavedOcc& o)
+	{
+		uint64_t header[4];
+		if (!in.read(reinterpret_cast<char*>(header), sizeof header))
+			return in;
+		o.m_size = header[0];
+		o.m_bits = header[1];
+		o.m_sentinel = header[2];
+		o.m_mappedSuperblocks = NULL;
+		o.m_mappedBlocks = NULL;
+		assert(o.m_bits == 2 || o.m_bits == 3);
+		in.read(reinterpret_cast<char*>(o.m_counts), sizeof o.m_counts);
+		o.m_superblocks.resize(header[3]);
+		in.read(reinterpret_cast<char*>(&o.m_superblocks[0]),
+				o.m_superblocks.size() * sizeof o.m_superblocks[0]);
+		o.m_blocks.resize(o.numBlocks() * BLOCK_WORDS);
+		in.read(reinterpret_cast<char*>(&o.m_blocks[0]),
+				o.m_blocks.size() * sizeof o.m_blocks[0]);
+		return in;
+	}
+
+	/** Store this data structure in a page-aligned layout, which may
+	 * be mapped into memory. */
+	void write(PageAlignedWriter& out) const
+	{
+		out.write<uint64_t>(m_size);
+		out.write<uint64_t>(m_bits);
+		out.write<uint64_t>(m_sentinel);
+		out.write(m_counts, MAX_ALPHABET);
+		out.align();
+		out.write(superblocks(), numSuperblocks() * MAX_ALPHABET);
+		out.align();
+		out.write(blocks(), numBlocks() * BLOCK_WORDS);
+	}
+
+	/** Use the data structure stored by write in place. The mapped
+	 * memory must outlive this data structure. */
+	void map(PageAlignedReader& in)
+	{
+		Blocks().swap(m_blocks);
+		std::vector<uint64_t>().swap(m_superblocks);
+		m_size = in.read<uint64_t>();
+		m_bits = in.read<uint64_t>();
+		m_sentinel = in.read<uint64_t>();
+		for (unsigned c = 0; c < MAX_ALPHABET; ++c)
+			m_counts[c] = in.read<uint64_t>();
+		if (m_bits != 2 && m_bits != 3) {
+			in.fail();
+			return;
+		}
+		in.align();
+		m_mappedSuperblocks = in.read<uint64_t>(
+				numSuperblocks() * MAX_ALPHABET);
+		in.align();
+		m_mappedBlocks = in.read<uint64_t>(numBlocks() * BLOCK_WORDS);
+	}
+
+  private:
+	/** Return the number of blocks, which includes the position
+	 * m_size. */
+	size_t numBlocks() const
+	{
+		return m_size / (m_bits == 2
+				? Layout<2>::SYMBOLS_PER_BLOCK
+				: Layout<3>::SYMBOLS_PER_BLOCK) + 1;
+	}
+
+	/** Return the number of superblocks. */
+	size_t numSuperblocks() const
+	{
+		return ((numBlocks() - 1) >> SUPERBLOCK_SHIFT) + 1;
+	}
+
+	/** Return the counts before each superblock. */
+	const uint64_t* superblocks() const
+	{
+		return m_mappedSuperblocks != NULL
+			? m_mappedSuperblocks : m_superblocks.data();
+	}
+
+	/** Return the blocks. */
+	const uint64_t* blocks() const
+	{
+		return m_mappedBlocks != NULL ? m_mappedBlocks : m_blocks.data();
+	}
+
+	/** Pack the symbols of [first, last) into blocks. The
+	 * superblocks are counted and then packed in parallel. */
+	template <unsigned BITS, typename It>
+	void fill(It first, It last)
+	{
+		typedef Layout<BITS> L;
+		const size_t NONE = std::numeric_limits<size_t>::max();
+		m_size = last - first;
+		size_t nblocks = numBlocks();
+		ptrdiff_t nsuper = ((nblocks - 1) >> SUPERBLOCK_SHIFT) + 1;
+		size_t superSize = L::SYMBOLS_PER_BLOCK << SUPERBLOCK_SHIFT;
+		m_blocks.assign(nblocks * BLOCK_WORDS, 0);
+		m_superblocks.assign(nsuper * MAX_ALPHABET, 0);
+
+		// Count the symbols of each superblock.
+		std::vector<size_t> sentinels(nsuper, NONE);
+#pragma omp parallel for
+		for (ptrdiff_t k = 0; k < nsuper; ++k) {
+			uint64_t* counts = &m_superblocks[k * MAX_ALPHABET];
+			size_t end = std::min(m_size, (k + 1) * superSize);
+			for (size_t i = k * superSize; i < end; ++i) {
+				T c = first[i];
+				if (c == SENTINEL()) {
+					assert(sentinels[k] == NONE);
+					sentinels[k] = i;
+					c = 0;
+				}
+				assert(c < L::MAX_ALPHABET);
+				counts[c]++;
+			}
+		}
+
+		// Replace the counts of each superblock by the counts before
+		// the superblock.
+		m_sentinel = NONE;
+		std::fill(m_counts, m_counts + MAX_ALPHABET, 0);
+		for (ptrdiff_t k = 0; k < nsuper; ++k) {
+			if (sentinels[k] != NONE) {
+				assert(m_sentinel == NONE);
+				m_sentinel = sentinels[k];
+			}
+			uint64_t* counts = &m_superblocks[k * MAX_ALPHABET];
+			for (unsigned c = 0; c < MAX_ALPHABET; ++c)
+				std::swap(counts[c], m_counts[c]);
+			for (unsigned c = 0; c < MAX_ALPHABET; ++c)
+				m_counts[c] += counts[c];
+		}
+
+		// Pack the symbols of each superblock.
+#pragma omp parallel for
+		for (ptrdiff_t k = 0; k < nsuper; ++k) {
+			uint64_t counts[MAX_ALPHABET] = { 0 };
+			size_t i = k * superSize;
+			size_t endBlock = std::min(nblocks,
+					size_t(k + 1) << SUPERBLOCK_SHIFT);
+			for (size_t b = size_t(k) << SUPERBLOCK_SHIFT;
+					b < endBlock; ++b) {
+				uint64_t* p = &m_blocks[b * BLOCK_WORDS];
+				for (unsigned c = 0; c < L::MAX_ALPHABET; ++c)
+					p[c / 2] |= counts[c] << (c % 2 * 32);
+				p += L::COUNT_WORDS;
+				for (unsigned j = 0; j < L::SYMBOLS_PER_BLOCK
+						&& i < m_size; ++j, ++i) {
+					T c = first[i];
+					if (c == SENTINEL())
+						c = 0;
+					counts[c]++;
+					p[j / L::SYMBOLS_PER_WORD] |= uint64_t(c)
+						<< (j % L::SYMBOLS_PER_WORD * BITS);
+				}
+			}
+		}
+	}
+
+	/** Return the count of symbol c in s[0, i), counting the
+	 * sentinel as the symbol 0. */
+	template <unsigned BITS>
+	size_t rank(T c, size_t i) const
+	{
+		typedef Layout<BITS> L;
+		static const unsigned DATA_WORDS = BLOCK_WORDS - L::COUNT_WORDS;
+		size_t b = i / L::SYMBOLS_PER_BLOCK;
+		unsigned r = i % L::SYMBOLS_PER_BLOCK;
+		const uint64_t* p = blocks() + b * BLOCK_WORDS;
+		size_t n = superblocks()[
+			(b >> SUPERBLOCK_SHIFT) * MAX_ALPHABET + c]
+			+ uint32_t(p[c / 2] >> (c % 2 * 32));
+		p += L::COUNT_WORDS;
+
+		// Count the symbols of the words before word q and the first
+		// symbols of word q. Every word of the block is examined to
+		// avoid branches. The least significant bit of each symbol
+		// marks a match, and the marks of BITS words are shifted to
+		// distinct bits, so that one popcount counts BITS words.
+		unsigned q = r / L::SYMBOLS_PER_WORD;
+		uint64_t partial = (uint64_t(1)
+				<< r % L::SYMBOLS_PER_WORD * BITS) - 1;
+		uint64_t pattern = L::LSB * c;
+		for (unsigned j = 0; j < DATA_WORDS; j += BITS) {
+			uint64_t x = 0;
+			for (unsigned m = 0; m < BITS && j + m < DATA_WORDS; ++m) {
+				uint64_t y = p[j + m] ^ pattern;
+				y = BITS == 2 ? y | y >> 1 : y | y >> 1 | y >> 2;
+				uint64_t mask = -uint64_t(j + m < q)
+					| (-uint64_t(j + m == q) & partial);
+				x |= (~y & L::LSB & mask) << m;
+			}
+			n += popcount(x);
+		}
+		return n;
+	}
+
+	/** Return the symbol at the specified position. */
+	template <unsigned BITS>
+	T at(size_t i) const
+	{
+		typedef Layout<BITS> L;
+		size_t b = i / L::SYMBOLS_PER_BLOCK;
+		unsigned r = i % L::SYMBOLS_PER_BLOCK;
+		uint64_t x = blocks()[b * BLOCK_WORDS + L::COUNT_WORDS
+			+ r / L::SYMBOLS_PER_WORD];
+		return x >> (r % L::SYMBOLS_PER_WORD * BITS)
+			& ((1 << BITS) - 1);
+	}
+
+	/** The size of the string */
+	size_t m_size;
+
+	/** The number of bits per symbol, either 2 or 3 */
+	unsigned m_bits;
+
+	/** The position of the sentinel, or the maximum size_t */
+	size_t m_sentinel;
+
+	/** The number of occurrences of each symbol, counting the
+	 * sentinel as the symbol 0 */
+	uint64_t m_counts[MAX_ALPHABET];
+
+	/** The counts of each symbol before each superblock */
+	std::vector<uint64_t> m_superblocks;
+
+	/** The blocks */
+	Blocks m_blocks;
+
+	/** The superblocks and blocks of a mapped file, or null */
+	const uint64_t* m_mappedSuperblocks;
+	const uint64_t* m_mappedBlocks;
+};
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef LOCATECACHE_H
+#define LOCATECACHE_H 1
+
+#include "PerThread.h"
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * A cache of the elements of a sampled suffix array that were located
+ * by walking the LF mapping. Every element visited by a walk is
+ * cached, so that the cache fills with the dense suffix array of the
+ * regions of the text that are located often, and a later walk stops
+ * as soon as it reaches a cached element. The cache needs no inverse
+ * suffix array.
+ *
+ * The cache is direct mapped: an element is stored in the slot
+ * selected by the low bits of its index, replacing the element in
+ * that slot. The high bits of the index and the value of the element
+ * are packed in one word, which is read and written atomically, so
+ * that the threads that search an index share its cache without a
+ * lock.
+ */
+class LocateCache
+{
+  public:
+	/** Statistics of the use of the cache */
+	struct Stats
+	{
+		/** The number of elements located */
+		uint64_t locates;
+		/** The number of those elements found in the cache, either
+		 * directly or by a walk that reached a cached element */
+		uint64_t hits;
+		/** The number of steps of the LF mapping */
+		uint64_t steps;
+
+		Stats() : locates(0), hits(0), steps(0) { }
+
+		Stats& operator+=(const Stats& o)
+		{
+			locates += o.locates;
+			hits += o.hits;
+			steps += o.steps;
+			return *this;
+		}
+	};
+
+	/** Construct a cache of at most the specified number of bytes
+	 * for a suffix array of n elements. The cache is empty if it
+	 * cannot hold an element in that size. */
+	LocateCache(size_t n, size_t bytes)
+		: m_valueBits(bitsFor(n)), m_slotBits(0), m_size(0)
+	{
+		size_t slots = bytes / sizeof (uint64_t);
+		while (m_slotBits < 63 && (uint64_t(2) << m_slotBits) <= slots)
+			m_slotBits++;
+		// A slot stores the tag of its index plus one, so that zero
+		// is an empty slot.
+		unsigned tagBits = m_valueBits > m_slotBits
+			? m_valueBits - m_slotBits : 0;
+		if (slots == 0 || tagBits + 1 + m_valueBits > 64)
+			return;
+		m_size = size_t(1) << m_slotBits;
+		m_slots.reset(new std::atomic<uint64_t>[m_size]);
+		for (size_t i = 0; i < m_size; ++i)
+			m_slots[i].store(0, std::memory_order_relaxed);
+	}
+
+	/** Return the size of this cache in bytes. */
+	size_t bytes() const { return m_size * sizeof (uint64_t); }
+
+	/** Return whether this cache holds no slots. */
+	bool empty() const { return m_size == 0; }
+
+	/** Return whether the element of index i is cached, and if so
+	 * set value to the element. */
+	bool lookup(size_t i, size_t& value) const
+	{
+		assert(m_size > 0);
+		uint64_t x = m_slots[i & (m_size - 1)].load(
+				std::memory_order_relaxed);
+		if (x >> m_valueBits != tag(i))
+			return false;
+		value = x & ((uint64_t(1) << m_valueBits) - 1);
+		return true;
+	}
+
+	/** Cache the element of index i. */
+	void insert(size_t i, size_t value)
+	{
+		assert(m_size > 0);
+		assert(value >> m_valueBits == 0);
+		m_slots[i & (m_size - 1)].store(
+				tag(i) << m_valueBits | value,
+				std::memory_order_relaxed);
+	}
+
+	/** Add to the statistics of the calling thread. */
+	void count(unsigned steps, bool hit) const
+	{
+		Stats& stats = m_stats.get();
+		stats.locates++;
+		stats.hits += hit;
+		stats.steps += steps;
+	}
+
+	/** Return the statistics of all the threads. No other thread may
+	 * use this cache meanwhile. */
+	Stats stats() const
+	{
+		Stats sum;
+		const std::vector<Stats*>& all = m_stats.all();
+		for (size_t i = 0; i < all.size(); ++i)
+			sum += *all[i];
+		return sum;
+	}
+
+  private:
+	LocateCache(const LocateCache&);
+	LocateCache& operator=(const LocateCache&);
+
+	/** Return the number of bits of a value less than n. */
+	static unsigned bitsFor(size_t n)
+	{
+		unsigned bits = 1;
+		while (bits < 64 && (uint64_t(1) << bits) < n)
+			bits++;
+		return bits;
+	}
+
+	/** Return the tag of index i plus one. */
+	uint64_t tag(size_t i) const
+	{
+		return (uint64_t(i) >> m_slotBits) + 1;
+	}
+
+	/** The number of bits of a value */
+	unsigned m_valueBits;
+
+	/** The number of bits of the index of a slot */
+	unsigned m_slotBits;
+
+	/** The number of slots */
+	size_t m_size;
+
+	/** The slots */
+	std::unique_ptr<std::atomic<uint64_t>[]> m_slots;
+
+	/** The statistics of each thread */
+	mutable PerThread<Stats> m_stats;
+};
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef PAGEALIGNED_H
+#define PAGEALIGNED_H 1
+
+#include <cassert>
+#include <cstring> // for memcpy
+#include <ostream>
+#include <stdint.h>
+
+/** The alignment of the arrays of a page-aligned file. It is
+ * independent of the page size of the machine, so that a file may be
+ * mapped by any machine with pages of at most this size. */
+static const size_t PAGE_ALIGNMENT = 4096;
+
+/** Write a file of small values and arrays, whose arrays may be
+ * aligned to a page, so that the file may be mapped into memory and
+ * the arrays used in place. */
+class PageAlignedWriter
+{
+  public:
+	/** Write to the specified stream, whose first pos bytes are
+	 * already written. */
+	PageAlignedWriter(std::ostream& out, size_t pos = 0)
+		: m_out(out), m_pos(pos) { }
+
+	/** Write an array of n elements. */
+	template <typename T>
+	void write(const T* p, size_t n)
+	{
+		m_out.write(reinterpret_cast<const char*>(p), n * sizeof *p);
+		m_pos += n * sizeof *p;
+	}
+
+	/** Write a value. */
+	template <typename T>
+	void write(const T& x)
+	{
+		write(&x, 1);
+	}
+
+	/** Pad the file to the next page. */
+	void align()
+	{
+		static const char zeros[PAGE_ALIGNMENT] = { 0 };
+		size_t n = (PAGE_ALIGNMENT - m_pos % PAGE_ALIGNMENT)
+			% PAGE_ALIGNMENT;
+		m_out.write(zeros, n);
+		m_pos += n;
+	}
+
+  private:
+	std::ostream& m_out;
+	size_t m_pos;
+};
+
+/** Read a file written by PageAlignedWriter, which is mapped into
+ * memory. A read past the end of the file sets the fail flag and
+ * returns zero or a null pointer. */
+class PageAlignedReader
+{
+  public:
+	/** Read the specified data starting at pos. */
+	PageAlignedReader(const char* data, size_t size, size_t pos = 0)
+		: m_data(data), m_size(size), m_pos(pos), m_fail(pos > size) { }
+
+	/** Return a pointer to an array of n elements. */
+	template <typename T>
+	const T* read(size_t n)
+	{
+		if (m_fail || n > (m_size - m_pos) / sizeof (T)) {
+			m_fail = true;
+			return NULL;
+		}
+		const T* p = reinterpret_cast<const T*>(m_data + m_pos);
+		m_pos += n * sizeof (T);
+		return p;
+	}
+
+	/** Read a value, which need not be aligned. */
+	template <typename T>
+	T read()
+	{
+		T x = T();
+		const char* p = read<char>(sizeof x);
+		if (p != NULL)
+			memcpy(&x, p, sizeof x);
+		return x;
+	}
+
+	/** Skip to the next page. */
+	void align()
+	{
+		size_t n = (PAGE_ALIGNMENT - m_pos % PAGE_ALIGNMENT)
+			% PAGE_ALIGNMENT;
+		read<char>(n);
+	}
+
+	/** Set the fail flag, because the data is not valid. */
+	void fail() { m_fail = true; }
+
+	/** Return whether every read was within the file. */
+	bool good() const { return !m_fail; }
+
+	/** Return whether the whole file was read. */
+	bool eof() const { return !m_fail && m_pos == m_size; }
+
+  private:
+	const char* m_data;
+	size_t m_size;
+	size_t m_pos;
+	bool m_fail;
+};
+
+#endif
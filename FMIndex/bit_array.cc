@@ -20,13 +20,15 @@
 #include "bit_array.h"
 #include "BitUtil.h" // for popcount
 #include <cassert>
+#include <cstddef> // for NULL
 
 namespace wat_array {
 
-BitArray::BitArray() : length_(0), one_num_(0){
+BitArray::BitArray() : length_(0), one_num_(0),
+  mapped_bits_(NULL), mapped_ranks_(NULL){
 }
 
-BitArray::BitArray(uint64_t length){
+BitArray::BitArray(uint64_t length) : mapped_bits_(NULL), mapped_ranks_(NULL){
   Init(length);
 }
 
@@ -44,8 +46,9 @@ uint64_t BitArray::one_num() const{
 void BitArray::Init(uint64_t length){
   length_    = length;
   one_num_ = 0;
-  uint64_t block_num = (length + BLOCK_BITNUM - 1) / BLOCK_BITNUM;
-  bit_blocks_.resize(block_num);
+  mapped_bits_ = NULL;
+  mapped_ranks_ = NULL;
+  bit_blocks_.resize(block_num());
 }
 
 void BitArray::Clear(){
@@ -53,12 +56,43 @@ void BitArray::Clear(){
   std::vector<uint64_t>().swap(rank_tables_);
   length_ = 0;
   one_num_ = 0;
+  mapped_bits_ = NULL;
+  mapped_ranks_ = NULL;
+}
+
+void BitArray::Map(uint64_t length, uint64_t one_num,
+		   const uint64_t* bits, const uint64_t* ranks){
+  Clear();
+  length_ = length;
+  one_num_ = one_num;
+  mapped_bits_ = bits;
+  mapped_ranks_ = ranks;
+}
+
+bool BitArray::IsMapped() const {
+  return mapped_bits_ != NULL;
+}
+
+uint64_t BitArray::block_num() const {
+  return (length_ + BLOCK_BITNUM - 1) / BLOCK_BITNUM;
+}
+
+uint64_t BitArray::table_num() const {
+  return (block_num() + TABLE_INTERVAL - 1) / TABLE_INTERVAL + 1;
+}
+
+const uint64_t* BitArray::bit_data() const {
+  return mapped_bits_ != NULL ? mapped_bits_ : bit_blocks_.data();
+}
+
+const uint64_t* BitArray::rank_data() const {
+  return mapped_ranks_ != NULL ? mapped_ranks_ : rank_tables_.data();
 }
 
 void BitArray::Build() {
+  assert(!IsMapped());
   one_num_ = 0;
-  uint64_t table_num = ((bit_blocks_.size() + TABLE_INTERVAL - 1) / TABLE_INTERVAL) + 1;
-  rank_tables_.resize(table_num);
+  rank_tables_.resize(table_num());
   for (size_t i = 0; i < bit_blocks_.size(); ++i){
     if ((i % TABLE_INTERVAL) == 0){
       rank_tables_[i/TABLE_INTERVAL] = one_num_;
@@ -69,6 +103,7 @@ void BitArray::Build() {
 }
 
 void BitArray::SetBit(uint64_t bit, uint64_t pos) {
+  assert(!IsMapped());
   if (!bit) return;
   bit_blocks_[pos / BLOCK_BITNUM] |= (1LLU << (pos % BLOCK_BITNUM));
 }
@@ -79,6 +114,16 @@ uint64_t BitArray::Rank(uint64_t bit, uint64_t pos) const {
   else return pos - RankOne(pos);
 }
 
+// Hint that Rank(bit, pos) will be called soon.
+void BitArray::Prefetch(uint64_t pos) const {
+#if __GNUC__
+  __builtin_prefetch(rank_data() + pos / BLOCK_BITNUM / TABLE_INTERVAL);
+  __builtin_prefetch(bit_data() + pos / BLOCK_BITNUM);
+#else
+  (void)pos;
+#endif
+}
+
 uint64_t BitArray::Select(uint64_t bit, uint64_t rank) const {
   if (bit){
     if (rank > one_num_) return NOTFOUND;
@@ -87,18 +132,22 @@ uint64_t BitArray::Select(uint64_t bit, uint64_t rank) const {
   }
 
   uint64_t block_pos = SelectOutBlock(bit, rank);
-  uint64_t block = (bit) ? bit_blocks_[block_pos] : ~bit_blocks_[block_pos];
+  const uint64_t* bits = bit_data();
+  uint64_t block = (bit) ? bits[block_pos] : ~bits[block_pos];
   return block_pos * BLOCK_BITNUM + SelectInBlock(block, rank);
 }
 
 uint64_t BitArray::SelectOutBlock(uint64_t bit, uint64_t& rank) const {
+  const uint64_t* bits = bit_data();
+  const uint64_t* ranks = rank_data();
+
   // binary search over tables
   uint64_t left = 0;
-  uint64_t right = rank_tables_.size();
+  uint64_t right = table_num();
   while (left < right){
     uint64_t mid = (left + right) / 2;
     uint64_t length = BLOCK_BITNUM * TABLE_INTERVAL * mid;
-    if (GetBitNum(rank_tables_[mid], length, bit) < rank) {
+    if (GetBitNum(ranks[mid], length, bit) < rank) {
       left = mid+1;
     } else {
       right = mid;
@@ -107,13 +156,13 @@ uint64_t BitArray::SelectOutBlock(uint64_t bit, uint64_t& rank) const {
 
   uint64_t table_ind   = (left != 0) ? left - 1: 0;
   uint64_t block_pos   = table_ind * TABLE_INTERVAL;
-  rank -= GetBitNum(rank_tables_[table_ind],
+  rank -= GetBitNum(ranks[table_ind],
 		    block_pos * BLOCK_BITNUM,
 		    bit);
 
   // sequential search over blocks
-  for ( ; block_pos < bit_blocks_.size(); ++block_pos){
-    uint64_t rank_next= GetBitNum(PopCount(bit_blocks_[block_pos]), BLOCK_BITNUM, bit);
+  for ( ; block_pos < block_num(); ++block_pos){
+    uint64_t rank_next= GetBitNum(PopCount(bits[block_pos]), BLOCK_BITNUM, bit);
     if (rank <= rank_next){
       break;
     }
@@ -156,20 +205,21 @@ uint64_t BitArray::SelectInBlock(uint64_t x, uint64_t rank) {
 }
 
 uint64_t BitArray::Lookup(uint64_t pos) const {
-  return (bit_blocks_[pos / BLOCK_BITNUM] >> (pos % BLOCK_BITNUM)) & 1LLU;
+  return (bit_data()[pos / BLOCK_BITNUM] >> (pos % BLOCK_BITNUM)) & 1LLU;
 }
 
 
 uint64_t BitArray::RankOne(uint64_t pos) const {
+  const uint64_t* bits = bit_data();
   uint64_t block_ind = pos / BLOCK_BITNUM;
   uint64_t table_ind = block_ind / TABLE_INTERVAL;
-  assert(table_ind < rank_tables_.size());
+  assert(table_ind < table_num());
 
-  uint64_t rank = rank_tables_[table_ind];
+  uint64_t rank = rank_data()[table_ind];
   for (uint64_t i = table_ind * TABLE_INTERVAL; i < block_ind; ++i){
-    rank += PopCount(bit_blocks_[i]);
+    rank += PopCount(bits[i]);
   }
-  rank += PopCountMask(bit_blocks_[block_ind], pos % BLOCK_BITNUM);
+  rank += PopCountMask(bits[block_ind], pos % BLOCK_BITNUM);
   return rank;
 }
 
@@ -201,7 +251,7 @@ void BitArray::PrintForDebug(std::ostream& os) const {
 
 void BitArray::Save(std::ostream& os) const{
   os.write((const char*)(&length_), sizeof(length_));
-  os.write((const char*)(&bit_blocks_[0]), sizeof(bit_blocks_[0]) * bit_blocks_.size());
+  os.write((const char*)(bit_data()), sizeof(uint64_t) * block_num());
 }
 
 void BitArray::Load(std::istream& is){
@@ -52,6 +52,7 @@ public:
   uint64_t Rank(uint64_t bit, uint64_t pos) const;
   uint64_t Select(uint64_t bit, uint64_t rank) const;
   uint64_t Lookup(uint64_t pos) const;
+  void Prefetch(uint64_t pos) const;
 
   static uint64_t PopCount(uint64_t x);
   static uint64_t PopCountMask(uint64_t x, uint64_t offset);
@@ -62,6 +63,16 @@ public:
   void Save(std::ostream& os) const;
   void Load(std::istream& is);
 
+  // Use the bits and rank tables stored in memory that outlives
+  // this array, such as a memory-mapped file.
+  void Map(uint64_t length, uint64_t one_num,
+	   const uint64_t* bits, const uint64_t* ranks);
+  bool IsMapped() const;
+  uint64_t block_num() const;
+  uint64_t table_num() const;
+  const uint64_t* bit_data() const;
+  const uint64_t* rank_data() const;
+
 private:
   uint64_t RankOne(uint64_t pos) const;
   uint64_t SelectOutBlock(uint64_t bit, uint64_t& rank) const;
@@ -71,6 +82,8 @@ private:
   std::vector<uint64_t> rank_tables_;
   uint64_t length_;
   uint64_t one_num_;
+  const uint64_t* mapped_bits_;
+  const uint64_t* mapped_ranks_;
 };
 
 }
@@ -132,12 +132,10 @@ static void readFMIndex(FMIndex& g, const string& faPath)
 	string fmPath = faPath + ".fm";
 	ifstream in(fmPath.c_str());
 	if (in) {
+		in.close();
 		if (opt::verbose > 0)
 			cerr << "Reading `" << fmPath << "'...\n";
-		assert_good(in, fmPath);
-		in >> g;
-		assert_good(in, fmPath);
-		in.close();
+		g.load(fmPath);
 		return;
 	}
 
@@ -0,0 +1,340 @@
+/** Measure the throughput of searching an FM index.
+ */
+#include "config.h"
+#include "FMIndex.h"
+#include "IOUtil.h"
+#include "Sequence.h" // for reverseComplement
+#include "StringUtil.h" // for SIToBytes
+#include "Uncompress.h"
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <getopt.h>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define PROGRAM "abyss-fmbench"
+
+static const char VERSION_MESSAGE[] =
+PROGRAM " (" PACKAGE_NAME ") " VERSION "\n"
+"\n"
+"Copyright 2014 Canada's Michael Smith Genome Sciences Centre\n";
+
+static const char USAGE_MESSAGE[] =
+"Usage: " PROGRAM " [OPTION]... FASTA\n"
+"Measure the throughput of searching an FM index of FASTA for\n"
+"simulated reads, as abyss-map does, using each layout of the\n"
+"character occurrence table, one read at a time and in batches.\n"
+"Then measure the throughput of locating the matches in the sampled\n"
+"suffix array, without and with a locate cache.\n"
+"\n"
+" Options:\n"
+"\n"
+"  -n, --reads=N           search for N reads [100000]\n"
+"  -r, --read-length=N     the length of a read [150]\n"
+"  -e, --error-rate=R      the substitution error rate [0.01]\n"
+"  -l, --min-align=N       find matches at least N bp [1]\n"
+"  -s, --seed=N            the seed of the random numbers [1]\n"
+"  -S, --sample=N          sample the suffix array [16]\n"
+"  -c, --locate-cache=N    use a locate cache of N bytes [64M]\n"
+"  -v, --verbose           display verbose output\n"
+"      --help              display this help and exit\n"
+"      --version           output version information and exit\n"
+"\n"
+"Report bugs to <" PACKAGE_BUGREPORT ">.\n";
+
+namespace opt {
+	/** The number of reads. */
+	static unsigned numReads = 100000;
+
+	/** The length of a read. */
+	static unsigned readLength = 150;
+
+	/** The substitution error rate. */
+	static double errorRate = 0.01;
+
+	/** The minimum alignment length. */
+	static unsigned k = 1;
+
+	/** The seed of the random number generator. */
+	static unsigned seed = 1;
+
+	/** The sampling period of the suffix array. */
+	static unsigned sampleSA = 16;
+
+	/** The size of the locate cache. */
+	static size_t locateCache = 64 << 20;
+
+	/** Verbose output. */
+	static int verbose;
+}
+
+static const char shortopts[] = "c:e:l:n:r:s:S:v";
+
+enum { OPT_HELP = 1, OPT_VERSION };
+
+static const struct option longopts[] = {
+	{ "reads", required_argument, NULL, 'n' },
+	{ "read-length", required_argument, NULL, 'r' },
+	{ "error-rate", required_argument, NULL, 'e' },
+	{ "min-align", required_argument, NULL, 'l' },
+	{ "seed", required_argument, NULL, 's' },
+	{ "sample", required_argument, NULL, 'S' },
+	{ "locate-cache", required_argument, NULL, 'c' },
+	{ "verbose", no_argument, NULL, 'v' },
+	{ "help", no_argument, NULL, OPT_HELP },
+	{ "version", no_argument, NULL, OPT_VERSION },
+	{ NULL, 0, NULL, 0 }
+};
+
+typedef FMIndex::Match Match;
+
+/** Simulate reads from the sequences of the text. */
+static vector<string> simulateReads(const vector<FMIndex::value_type>& s)
+{
+	static const char ACGT[] = "ACGT";
+	mt19937 rng(opt::seed);
+	uniform_int_distribution<size_t> randomPos(
+			0, s.size() - opt::readLength);
+	bernoulli_distribution randomError(opt::errorRate);
+	uniform_int_distribution<unsigned> randomBase(0, 3);
+
+	vector<string> reads;
+	reads.reserve(opt::numReads);
+	for (unsigned tries = 0; reads.size() < opt::numReads; ++tries) {
+		if (tries > 100 * opt::numReads) {
+			cerr << PROGRAM ": too few sequences of "
+				<< opt::readLength << " bp\n";
+			exit(EXIT_FAILURE);
+		}
+		// Skip the line breaks of the sequence.
+		string read;
+		read.reserve(opt::readLength);
+		for (size_t i = randomPos(rng); i < s.size()
+				&& read.size() < opt::readLength; ++i) {
+			if (s[i] == '\n')
+				continue;
+			if (strchr(ACGT, s[i]) == NULL)
+				break;
+			read += s[i];
+		}
+		if (read.size() < opt::readLength)
+			continue;
+		for (string::iterator it = read.begin(); it != read.end(); ++it)
+			if (randomError(rng))
+				*it = ACGT[randomBase(rng)];
+		if (reads.size() % 2 == 1)
+			read = reverseComplement(read);
+		reads.push_back(read);
+	}
+	return reads;
+}
+
+/** Search for the reads in both orientations as abyss-map does.
+ * @return the time in seconds
+ */
+static double search(const FMIndex& fm, const vector<string>& reads,
+		vector<Match>& matches)
+{
+	matches.clear();
+	matches.reserve(2 * reads.size());
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (vector<string>::const_iterator it = reads.begin();
+			it != reads.end(); ++it) {
+		Match m = fm.find(*it, opt::k);
+		Match rcm = fm.find(reverseComplement(*it), m.qspan());
+		matches.push_back(m);
+		matches.push_back(rcm);
+	}
+	return chrono::duration<double>(
+			chrono::steady_clock::now() - start).count();
+}
+
+/** Search for the reads in both orientations as abyss-map --batch
+ * does.
+ * @return the time in seconds
+ */
+static double searchBatch(const FMIndex& fm, const vector<string>& reads,
+		vector<Match>& matches)
+{
+	matches.clear();
+	matches.reserve(2 * reads.size());
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	vector<string> rcReads;
+	rcReads.reserve(reads.size());
+	for (vector<string>::const_iterator it = reads.begin();
+			it != reads.end(); ++it)
+		rcReads.push_back(reverseComplement(*it));
+	vector<unsigned> minLen(reads.size(), opt::k);
+	vector<Match> m, rcm;
+	fm.findBatch(reads, minLen, m);
+	for (size_t i = 0; i < m.size(); ++i)
+		minLen[i] = m[i].qspan();
+	fm.findBatch(rcReads, minLen, rcm);
+	for (size_t i = 0; i < m.size(); ++i) {
+		matches.push_back(m[i]);
+		matches.push_back(rcm[i]);
+	}
+	return chrono::duration<double>(
+			chrono::steady_clock::now() - start).count();
+}
+
+/** Locate the better match of each read and its reverse complement,
+ * as abyss-map does.
+ * @return the time in seconds
+ */
+static double locate(const FMIndex& fm, const vector<Match>& matches,
+		vector<size_t>& positions)
+{
+	positions.clear();
+	positions.reserve(matches.size());
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (size_t i = 0; i + 1 < matches.size(); i += 2) {
+		const Match& m = matches[i + 1].qspan() > matches[i].qspan()
+			? matches[i + 1] : matches[i];
+		if (m.size() > 0)
+			positions.push_back(fm[m.l]);
+	}
+	return chrono::duration<double>(
+			chrono::steady_clock::now() - start).count();
+}
+
+/** Return whether two matches are identical. */
+static bool isSameMatch(const Match& a, const Match& b)
+{
+	return a.l == b.l && a.u == b.u && a.qstart == b.qstart
+		&& a.qend == b.qend && a.num == b.num;
+}
+
+int main(int argc, char** argv)
+{
+	bool die = false;
+	for (int c; (c = getopt_long(argc, argv,
+					shortopts, longopts, NULL)) != -1;) {
+		istringstream arg(optarg != NULL ? optarg : "");
+		switch (c) {
+			case '?': die = true; break;
+			case 'e': arg >> opt::errorRate; break;
+			case 'l': arg >> opt::k; break;
+			case 'n': arg >> opt::numReads; break;
+			case 'r': arg >> opt::readLength; break;
+			case 's': arg >> opt::seed; break;
+			case 'S': arg >> opt::sampleSA; break;
+			case 'c': opt::locateCache = SIToBytes(arg); break;
+			case 'v': opt::verbose++; break;
+			case OPT_HELP:
+				cout << USAGE_MESSAGE;
+				exit(EXIT_SUCCESS);
+			case OPT_VERSION:
+				cout << VERSION_MESSAGE;
+				exit(EXIT_SUCCESS);
+		}
+		if (optarg != NULL && !arg.eof()) {
+			cerr << PROGRAM ": invalid option: `-"
+				<< (char)c << optarg << "'\n";
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (opt::readLength == 0) {
+		cerr << PROGRAM ": the read length must be positive\n";
+		die = true;
+	}
+
+	if (argc - optind != 1) {
+		cerr << PROGRAM ": "
+			<< (argc - optind < 1 ? "missing" : "too many")
+			<< " arguments\n";
+		die = true;
+	}
+
+	if (die) {
+		cerr << "Try `" << PROGRAM
+			<< " --help' for more information.\n";
+		exit(EXIT_FAILURE);
+	}
+
+	const char* path = argv[optind];
+	vector<FMIndex::value_type> s;
+	readFile(path, s);
+	transform(s.begin(), s.end(), s.begin(), ::toupper);
+	if (s.size() <= opt::readLength) {
+		cerr << PROGRAM ": `" << path << "' is smaller than a read\n";
+		exit(EXIT_FAILURE);
+	}
+	vector<string> reads = simulateReads(s);
+
+	static const FMIndex::OccLayout layouts[] = {
+		FMIndex::BIT_ARRAYS, FMIndex::INTERLEAVED };
+	static const char* const names[] = { "bit-arrays", "interleaved" };
+	vector<Match> expected;
+	vector<size_t> expectedPositions;
+	ostringstream locateTable;
+	locateTable << "layout\tsample\tSA bytes\tcache bytes\tlocates\t"
+		"seconds\tlocates/s\tsteps/locate\thits\n";
+	cout << "layout\tsearch\treads\tseconds\treads/s\n";
+	for (unsigned i = 0; i < 2; ++i) {
+		FMIndex fm;
+		fm.setAlphabet("-ACGT");
+		fm.setOccLayout(layouts[i]);
+		vector<FMIndex::value_type> text(s);
+		fm.assign(text.begin(), text.end());
+
+		for (unsigned batch = 0; batch < 2; ++batch) {
+			vector<Match> matches;
+			double seconds = batch ? searchBatch(fm, reads, matches)
+				: search(fm, reads, matches);
+			cout << names[i] << '\t' << (batch ? "batch" : "read")
+				<< '\t' << reads.size() << '\t'
+				<< seconds << '\t' << unsigned(reads.size() / seconds)
+				<< endl;
+
+			if (i == 0 && batch == 0)
+				expected.swap(matches);
+			else if (!equal(matches.begin(), matches.end(),
+						expected.begin(), isSameMatch)) {
+				cerr << PROGRAM ": error: the matches of the layout `"
+					<< names[i] << "' and search `"
+					<< (batch ? "batch" : "read") << "' differ\n";
+				exit(EXIT_FAILURE);
+			}
+		}
+
+		fm.sampleSA(opt::sampleSA);
+		for (unsigned cache = 0; cache < 2; ++cache) {
+			fm.setLocateCache(cache ? opt::locateCache : 0);
+			const LocateCache* lc = fm.locateCache();
+			vector<size_t> positions;
+			double seconds = locate(fm, expected, positions);
+			locateTable << names[i] << '\t' << opt::sampleSA
+				<< '\t' << fm.saBytes()
+				<< '\t' << (lc != NULL ? lc->bytes() : 0)
+				<< '\t' << positions.size()
+				<< '\t' << seconds
+				<< '\t' << unsigned(positions.size() / seconds);
+			if (lc != NULL) {
+				LocateCache::Stats stats = lc->stats();
+				locateTable << '\t' << (double)stats.steps / stats.locates
+					<< '\t' << stats.hits << '\n';
+			} else
+				locateTable << "\t-\t-\n";
+
+			if (i == 0 && cache == 0)
+				expectedPositions.swap(positions);
+			else if (positions != expectedPositions) {
+				cerr << PROGRAM ": error: the located positions "
+					"of the layout `" << names[i] << "' differ\n";
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+	cout << '\n' << locateTable.str();
+	return 0;
+}
@@ -8,13 +8,14 @@
 #include "ContigID.h"
 #include "ContigPath.h"
 #include "ContigProperties.h"
-#include "FastaReader.h"
+#include "DataLayer/ContigStore.h"
 #include "Graph/ContigGraph.h"
 #include "Graph/ContigGraphAlgorithms.h"
 #include "Graph/DirectedGraph.h"
 #include "Graph/GraphIO.h"
 #include "Graph/GraphUtil.h"
 #include "IOUtil.h"
+#include "Sequence.h"
 #include "Uncompress.h"
 #include <algorithm>
 #include <boost/lambda/bind.hpp>
@@ -535,7 +536,7 @@ removeContigs_if(Graph& g, pred p)
 }
 
 /** Contig sequences. */
-typedef vector<const_string> Contigs;
+typedef ContigStore Contigs;
 static Contigs g_contigs;
 
 /** Return the sequence of vertex u. */
@@ -544,7 +545,7 @@ getSequence(const Graph& g, vertex_descriptor u)
 {
 	size_t i = get(vertex_contig_index, g, u);
 	assert(i < g_contigs.size());
-	string seq(g_contigs[i]);
+	string seq(g_contigs.sequence(i).str());
 	return get(vertex_sense, g, u) ? reverseComplement(seq) : seq;
 }
 
@@ -786,14 +787,10 @@ main(int argc, char** argv)
 		Contigs& contigs = g_contigs;
 		if (opt::verbose > 0)
 			cerr << "Reading `" << contigsPath << "'...\n";
-		FastaReader in(contigsPath, FastaReader::NO_FOLD_CASE);
-		for (FastaRecord rec; in >> rec;) {
-			if (g_contigNames.count(rec.id) == 0)
-				continue;
-			assert(contigs.size() == get(g_contigNames, rec.id));
-			contigs.push_back(rec.seq);
-		}
-		assert(in.eof());
+		contigs.open(contigsPath);
+		contigs.removeIf(IsNotContigName());
+		for (size_t i = 0; i < contigs.size(); ++i)
+			assert(i == get(g_contigNames, contigs.id(i)));
 
 		removeEdges_if(g, is_edge_inconsistent(g));
 	}
@@ -47,6 +47,8 @@ static const char USAGE_MESSAGE[] =
 "      --sam             output the graph in SAM format\n"
 "  -e, --estimate output distance estimates\n"
 "      --add-complements add missing complementary edges\n"
+"      --names    write the contig names of FILE to FILE.names,\n"
+"                 which later stages map rather than parse\n"
 "  -v, --verbose  display verbose output\n"
 "      --help     display this help and exit\n"
 "      --version  output version information and exit\n"
@@ -65,6 +67,9 @@ namespace opt {
 	 */
 	int addComplementaryEdges;
 
+	/** Write the dictionary of contig names. */
+	static int names;
+
 	/** Output format */
 	int format = DOT; // used by ContigProperties
 }
@@ -86,6 +91,7 @@ static const struct option longopts[] = {
 	{ "sam",     no_argument,       &opt::format, SAM },
 	{ "estimate", no_argument,      NULL, 'e' },
 	{ "add-complements", no_argument, &opt::addComplementaryEdges, true },
+	{ "names",   no_argument,       &opt::names, true },
 	{ "kmer",    required_argument, NULL, 'k' },
 	{ "verbose", no_argument,       NULL, 'v' },
 	{ "help",    no_argument,       NULL, OPT_HELP },
@@ -99,6 +105,8 @@ static void readGraph(const string& path, Graph& g, BetterEP betterEP)
 {
 	if (opt::verbose > 0)
 		cerr << "Reading `" << path << "'...\n";
+	if (openContigNames(path) && opt::verbose > 0)
+		cerr << "Mapped the contig names of `" << path << "'\n";
 	ifstream fin(path.c_str());
 	istream& in = path == "-" ? cin : fin;
 	assert_good(in, path);
@@ -168,6 +176,12 @@ int main(int argc, char** argv)
 		die = true;
 	}
 
+	if (opt::names && (argc - optind != 1
+				|| string(argv[optind]) == "-")) {
+		cerr << PROGRAM ": --names requires exactly one graph file\n";
+		die = true;
+	}
+
 	if (die) {
 		cerr << "Try `" << PROGRAM
 			<< " --help' for more information.\n";
@@ -183,11 +197,15 @@ int main(int argc, char** argv)
 		ContigGraph<DirectedGraph<ContigProperties, DistanceEst> > g;
 		readGraphs(g, argv + optind, argv + argc,
 				BetterDistanceEst());
+		if (opt::names)
+			saveContigNames(argv[optind]);
 		write_graph(cout, g, PROGRAM, commandLine);
 	} else {
 		ContigGraph<DirectedGraph<ContigProperties, Distance> > g;
 		readGraphs(g, argv + optind, argv + argc,
 				DisallowParallelEdges());
+		if (opt::names)
+			saveContigNames(argv[optind]);
 		write_graph(cout, g, PROGRAM, commandLine);
 	}
 	assert(cout.good());
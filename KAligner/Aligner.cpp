@@ -69,21 +69,41 @@ void Aligner<SeqPosHashMap>::addReferenceSequence(
 	}
 }
 
+template <>
+void Aligner<SeedIndex>::addReferenceSequence(
+		const StringID& idString, const Sequence& seq)
+{
+	m_target.add(seq, contigIDToIndex(idString));
+}
+
+template <>
+void Aligner<SeedIndex>::buildIndex()
+{
+	m_target.build(opt::multimap != opt::MULTIMAP);
+	Position first, second;
+	string kmer;
+	if (opt::multimap == opt::ERROR
+			&& m_target.firstDuplicate(first, second, kmer))
+		first.setDuplicate(contigIndexToID(first.contig),
+				contigIndexToID(second.contig), kmer);
+}
+
 template <class SeqPosHashMap>
 template <class oiterator>
 void Aligner<SeqPosHashMap>::alignRead(
 		const string& qid, const Sequence& seq,
 		oiterator dest)
 {
-	coalesceAlignments(qid, seq,
-			getAlignmentsInternal(seq, false), dest);
+	AlignmentSet& aligns = m_aligns.get();
+	getAlignmentsInternal(seq, false, aligns);
+	coalesceAlignments(qid, seq, aligns, dest);
 	Sequence seqrc = reverseComplement(seq);
-	coalesceAlignments(qid, seqrc,
-			getAlignmentsInternal(seqrc, true), dest);
+	getAlignmentsInternal(seqrc, true, aligns);
+	coalesceAlignments(qid, seqrc, aligns, dest);
 }
 
 /** Store all alignments for a given Kmer in the parameter aligns.
- *  @param[out] aligns Map of contig IDs to alignment vectors.
+ *  @param[out] aligns the alignments of the k-mer to each target
  */
 template <class SeqPosHashMap>
 void Aligner<SeqPosHashMap>::alignKmer(
@@ -91,13 +111,10 @@ void Aligner<SeqPosHashMap>::alignKmer(
 		bool isRC, bool good, int read_ind, int seqLen)
 {
 	assert(read_ind >= 0);
-	Sequence kmer(seq, read_ind, m_hashSize);
-	if (!good && kmer.find_first_not_of("ACGT0123") != string::npos)
+	SeedRange range;
+	if (!findSeeds(seq, read_ind, good, range))
 		return;
 
-	pair<map_const_iterator, map_const_iterator> range
-		= m_target.equal_range(Kmer(kmer));
-
 	if (range.first != range.second
 				&& opt::multimap == opt::IGNORE
 				&& range.first->second.isDuplicate())
@@ -115,64 +132,63 @@ void Aligner<SeqPosHashMap>::alignKmer(
 		Alignment align(string(),
 				resultIter->second.pos, read_pos, m_hashSize,
 				seqLen, isRC);
-		aligns[ctgIndex].push_back(align);
+		aligns.push_back(KmerAlignment(ctgIndex, aligns.size(), align));
 	}
 }
 
+/** Find the k-mer alignments of the query.
+ *  @param[out] aligns the alignments of the k-mer to each target
+ */
 template <class SeqPosHashMap>
-typename Aligner<SeqPosHashMap>::AlignmentSet
-Aligner<SeqPosHashMap>::getAlignmentsInternal(
-		const Sequence& seq, bool isRC)
+void Aligner<SeqPosHashMap>::getAlignmentsInternal(
+		const Sequence& seq, bool isRC, AlignmentSet& aligns)
 {
-	// The results
-	AlignmentSet aligns;
+	aligns.clear();
 
 	bool good = seq.find_first_not_of("ACGT0123") == string::npos;
 	int seqLen = seq.length();
 	int last_kmer = seqLen - m_hashSize;
 
 	if (last_kmer < 0)
-		return aligns;
+		return;
 
 	// Align the first kmer
 	alignKmer(aligns, seq, isRC, good, 0, seqLen);
 
 	if (last_kmer == 0)
-		return aligns;
+		return;
 
 	// Align the last kmer
 	alignKmer(aligns, seq, isRC, good, last_kmer, seqLen);
 
 	// Short-cut logic ignoring the middle alignments if the first
 	// and last kmers overlap, and align to the same contig
-	if (good && seqLen <= 2 * m_hashSize && aligns.size() == 1) {
-		AlignmentSet::const_iterator ctgIter = aligns.begin();
-		const AlignmentVector& a = ctgIter->second;
-		if (ctgIter->second.size() == 2) {
-			int qstep = isRC
-					? a[0].read_start_pos - a[1].read_start_pos
-					: a[1].read_start_pos - a[0].read_start_pos;
-			assert(qstep >= 0);
-
-			// Verify this isn't a kmer aligning to two parts of a
-			// contig, and that the alignments are coalescable.
-			if (qstep == last_kmer &&
-					a[1].contig_start_pos
-						== a[0].contig_start_pos + qstep)
-				return aligns;
-		}
+	if (good && seqLen <= 2 * m_hashSize && aligns.size() == 2
+			&& aligns[0].contig == aligns[1].contig) {
+		const Alignment& a0 = aligns[0].align;
+		const Alignment& a1 = aligns[1].align;
+		int qstep = isRC
+				? a0.read_start_pos - a1.read_start_pos
+				: a1.read_start_pos - a0.read_start_pos;
+		assert(qstep >= 0);
+
+		// Verify this isn't a kmer aligning to two parts of a
+		// contig, and that the alignments are coalescable.
+		if (qstep == last_kmer &&
+				a1.contig_start_pos == a0.contig_start_pos + qstep)
+			return;
 	}
 
 	// Align middle kmers
 	for(int i = 1; i < last_kmer; ++i)
 		alignKmer(aligns, seq, isRC, good, i, seqLen);
-
-	return aligns;
 }
 
-static int compareQueryPos(const Alignment& a1, const Alignment& a2)
+template <class KmerAlignment>
+static int compareQueryPos(const KmerAlignment& a1,
+		const KmerAlignment& a2)
 {
-	return a1.read_start_pos < a2.read_start_pos;
+	return a1.align.read_start_pos < a2.align.read_start_pos;
 }
 
 /** Coalesce the k-mer alignments into a read alignment. */
@@ -180,44 +196,51 @@ template <class SeqPosHashMap>
 template <class oiterator>
 void Aligner<SeqPosHashMap>::coalesceAlignments(
 		const string& qid, const string& seq,
-		const AlignmentSet& alignSet,
+		AlignmentSet& alignSet,
 		oiterator& dest)
 {
 	typedef typename output_iterator_traits<oiterator>::value_type
 		value_type;
-	for (AlignmentSet::const_iterator ctgIter = alignSet.begin();
-			ctgIter != alignSet.end(); ++ctgIter) {
-		AlignmentVector alignVec = ctgIter->second;
-		assert(!alignVec.empty());
-
-		sort(alignVec.begin(), alignVec.end(), compareQueryPos);
-
-		AlignmentVector::iterator prevIter = alignVec.begin();
-		AlignmentVector::iterator currIter = alignVec.begin() + 1;
-		Alignment currAlign = *prevIter;
-		while (currIter != alignVec.end()) {
-			int qstep = currIter->read_start_pos -
-						prevIter->read_start_pos;
+
+	// Group the alignments by target, in the order that they were
+	// found.
+	sort(alignSet.begin(), alignSet.end());
+
+	for (typename AlignmentSet::iterator first = alignSet.begin();
+			first != alignSet.end();) {
+		typename AlignmentSet::iterator last = first + 1;
+		while (last != alignSet.end() && last->contig == first->contig)
+			++last;
+
+		sort(first, last, compareQueryPos<KmerAlignment>);
+
+		typename AlignmentSet::iterator prevIter = first;
+		typename AlignmentSet::iterator currIter = first + 1;
+		Alignment currAlign = prevIter->align;
+		while (currIter != last) {
+			const Alignment& curr = currIter->align;
+			const Alignment& prev = prevIter->align;
+			int qstep = curr.read_start_pos - prev.read_start_pos;
 			assert(qstep >= 0);
-			int tstep = currIter->isRC ? -qstep : qstep;
-			if (currIter->contig_start_pos
-						== prevIter->contig_start_pos + tstep
+			int tstep = curr.isRC ? -qstep : qstep;
+			if (curr.contig_start_pos == prev.contig_start_pos + tstep
 					&& qstep <= m_hashSize) {
 				currAlign.align_length += qstep;
 				if (currAlign.isRC)
 					currAlign.contig_start_pos -= qstep;
 			} else {
-				currAlign.contig = contigIndexToID(ctgIter->first);
+				currAlign.contig = contigIndexToID(first->contig);
 				*dest++ = value_type(currAlign, qid, seq);
-				currAlign = *currIter;
+				currAlign = curr;
 			}
 
 			prevIter = currIter;
 			currIter++;
 		}
 
-		currAlign.contig = contigIndexToID(ctgIter->first);
+		currAlign.contig = contigIndexToID(first->contig);
 		*dest++ = value_type(currAlign, qid, seq);
+		first = last;
 	}
 }
 
@@ -247,3 +270,13 @@ template void Aligner<SeqPosHashUniqueMap>::
 alignRead<ostream_iterator<SAMRecord> >(
 		const string& qid, const Sequence& seq,
 		ostream_iterator<SAMRecord> dest);
+
+template void Aligner<SeedIndex>::
+alignRead<affix_ostream_iterator<Alignment> >(
+		const string& qid, const Sequence& seq,
+		affix_ostream_iterator<Alignment> dest);
+
+template void Aligner<SeedIndex>::
+alignRead<ostream_iterator<SAMRecord> >(
+		const string& qid, const Sequence& seq,
+		ostream_iterator<SAMRecord> dest);
@@ -5,9 +5,13 @@
 #include "ConstString.h"
 #include "Functional.h"
 #include "KAligner/Options.h"
+#include "KAligner/Position.h"
+#include "KAligner/SeedIndex.h"
 #include "Kmer.h"
+#include "PerThread.h"
 #include "UnorderedMap.h"
 #include "config.h"
+#include <algorithm>
 #include <cassert>
 #include <cstdlib>
 #include <cstring> // for strcpy
@@ -15,41 +19,12 @@
 #include <iostream>
 #include <istream>
 #include <limits>
-#include <map>
 #include <ostream>
 #include <string>
 #include <vector>
 
 typedef std::string StringID;
 
-/** A tuple of a target ID and position. */
-struct Position
-{
-	uint32_t contig;
-	uint32_t pos; // 0 indexed
-	Position(
-	    uint32_t contig = std::numeric_limits<uint32_t>::max(),
-	    uint32_t pos = std::numeric_limits<uint32_t>::max())
-	  : contig(contig)
-	  , pos(pos)
-	{}
-
-	/** Mark this seed as a duplicate. */
-	void setDuplicate(const char* thisContig, const char* otherContig, const Sequence& kmer)
-	{
-		if (opt::multimap == opt::IGNORE)
-			contig = std::numeric_limits<uint32_t>::max();
-		else {
-			std::cerr << "error: duplicate k-mer in " << thisContig << " also in " << otherContig
-			          << ": " << kmer << '\n';
-			exit(EXIT_FAILURE);
-		}
-	}
-
-	/** Return whether this seed is a duplciate. */
-	bool isDuplicate() const { return contig == std::numeric_limits<uint32_t>::max(); }
-};
-
 typedef unordered_multimap<Kmer, Position, hash<Kmer>> SeqPosHashMultiMap;
 
 #if HAVE_GOOGLE_SPARSE_HASH_MAP
@@ -87,6 +62,9 @@ class Aligner
 	void addReferenceSequence(const StringID& id, const Sequence& seq);
 	void addReferenceSequence(const Kmer& kmer, Position pos);
 
+	/** Finish the index of the target after adding its sequences. */
+	void buildIndex() { }
+
 	template<class oiterator>
 	void alignRead(const std::string& qid, const Sequence& seq, oiterator dest);
 
@@ -97,8 +75,9 @@ class Aligner
 	size_t countDuplicates() const
 	{
 		assert(opt::multimap == opt::IGNORE);
-		return count_if(
-		    m_target.begin(), m_target.end(), [](const std::pair<const Kmer, Position>& s) {
+		return std::count_if(
+		    m_target.begin(), m_target.end(),
+		    [](const typename SeqPosHashMap::value_type& s) {
 			    return s.second.isDuplicate();
 		    });
 	}
@@ -106,7 +85,47 @@ class Aligner
   private:
 	explicit Aligner(const Aligner&);
 
-	typedef std::map<unsigned, AlignmentVector> AlignmentSet;
+	/** An alignment of a k-mer of the query to a target. */
+	struct KmerAlignment
+	{
+		/** The index of the target */
+		unsigned contig;
+		/** The order in which the k-mer was aligned */
+		unsigned order;
+		Alignment align;
+
+		KmerAlignment(unsigned contig, unsigned order,
+				const Alignment& align)
+			: contig(contig), order(order), align(align) { }
+
+		bool operator<(const KmerAlignment& o) const
+		{
+			return contig != o.contig ? contig < o.contig
+				: order < o.order;
+		}
+	};
+
+	/** The k-mer alignments of a query. Each thread reuses its own
+	 * set for each query. */
+	typedef std::vector<KmerAlignment> AlignmentSet;
+
+	typedef std::pair<map_const_iterator, map_const_iterator>
+		SeedRange;
+
+	/** Find the seeds of the k-mer of seq at pos.
+	 * @param good whether seq consists of ACGT or 0123 only
+	 * @return false if the k-mer contains another base
+	 */
+	bool findSeeds(const Sequence& seq, int pos, bool good,
+			SeedRange& range) const
+	{
+		Sequence kmer(seq, pos, m_hashSize);
+		if (!good && kmer.find_first_not_of("ACGT0123")
+				!= std::string::npos)
+			return false;
+		range = m_target.equal_range(Kmer(kmer));
+		return true;
+	}
 
 	void alignKmer(
 	    AlignmentSet& aligns,
@@ -116,13 +135,14 @@ class Aligner
 	    int read_ind,
 	    int seqLen);
 
-	AlignmentSet getAlignmentsInternal(const Sequence& seq, bool isRC);
+	void getAlignmentsInternal(
+	    const Sequence& seq, bool isRC, AlignmentSet& aligns);
 
 	template<class oiterator>
 	void coalesceAlignments(
 	    const std::string& qid,
 	    const std::string& seq,
-	    const AlignmentSet& alignSet,
+	    AlignmentSet& alignSet,
 	    oiterator& dest);
 
 	// The number of bases to hash on
@@ -134,6 +154,9 @@ class Aligner
 	/** A dictionary of contig IDs. */
 	std::vector<const_string> m_dict;
 
+	/** The k-mer alignments of the query of each thread */
+	PerThread<AlignmentSet> m_aligns;
+
 	unsigned contigIDToIndex(const std::string& id)
 	{
 		m_dict.push_back(id);
@@ -147,4 +170,21 @@ class Aligner
 	}
 };
 
+template<>
+inline bool Aligner<SeedIndex>::findSeeds(
+    const Sequence& seq, int pos, bool, SeedRange& range) const
+{
+	uint64_t key;
+	if (!m_target.pack(seq.data() + pos, key))
+		return false;
+	range = m_target.equal_range(key);
+	return true;
+}
+
+template<>
+void Aligner<SeedIndex>::addReferenceSequence(const StringID& id, const Sequence& seq);
+
+template<>
+void Aligner<SeedIndex>::buildIndex();
+
 #endif
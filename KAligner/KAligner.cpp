@@ -6,11 +6,11 @@
 #include "Iterator.h"
 #include "IOUtil.h"
 #include "MemoryUtil.h"
+#include "OrderedWriter.h"
+#include "RingBuffer.h"
 #include "SAM.h"
 #include "StringUtil.h" // for toSI
 #include "Uncompress.h"
-#include "Pipe.h"
-#include "PipeMux.h"
 #include <algorithm>
 #include <cassert>
 #include <cctype>
@@ -25,6 +25,9 @@
 #include <string>
 #include <sys/stat.h>
 #include <sys/time.h>
+#if _OPENMP
+# include <omp.h>
+#endif
 
 using namespace std;
 
@@ -50,6 +53,9 @@ static const char USAGE_MESSAGE[] =
 "                        [default]\n"
 "  -m, --multimap        allow duplicate k-mer in the target\n"
 "      --no-multimap     disallow duplicate k-mer in the target\n"
+"      --seed-table      index the target in a sorted table of\n"
+"                        seeds, if k is at most 32 [default]\n"
+"      --hash-table      index the target in a hash table\n"
 "  -j, --threads=N       use N threads [2] up to one per query file\n"
 "                        or if N is 0 use one thread per query file\n"
 "  -v, --verbose         display verbose output\n"
@@ -64,6 +70,9 @@ static const char USAGE_MESSAGE[] =
 /** Enumeration of output formats */
 enum format { KALIGNER, SAM };
 
+/** Enumeration of indexes of the target */
+enum table { HASH_TABLE, SEED_TABLE };
+
 namespace opt {
 	static unsigned k;
 	static int threads = 2;
@@ -73,6 +82,9 @@ namespace opt {
 
 	/** Output formats */
 	static int format;
+
+	/** The index of the target */
+	static int table = SEED_TABLE;
 }
 
 static const char shortopts[] = "ij:k:l:mo:s:v";
@@ -86,6 +98,8 @@ static const struct option longopts[] = {
 	{ "no-multi",    no_argument,     &opt::multimap, opt::ERROR },
 	{ "multimap",    no_argument,     &opt::multimap, opt::MULTIMAP },
 	{ "ignore-multimap", no_argument, &opt::multimap, opt::IGNORE },
+	{ "seed-table",  no_argument,       &opt::table, SEED_TABLE },
+	{ "hash-table",  no_argument,       &opt::table, HASH_TABLE },
 	{ "threads",     required_argument,	NULL, 'j' },
 	{ "verbose",     no_argument,       NULL, 'v' },
 	{ "no-sam",      no_argument,       &opt::format, KALIGNER },
@@ -177,6 +191,7 @@ static void readContigsIntoDB(string refFastaFile,
 		Aligner<SeqPosHashMap>& aligner);
 static void *alignReadsToDB(void *arg);
 static void *readFile(void *arg);
+static void *muxReads(void *arg);
 
 /** Unique aligner using map */
 static Aligner<SeqPosHashUniqueMap> *g_aligner_u;
@@ -184,6 +199,9 @@ static Aligner<SeqPosHashUniqueMap> *g_aligner_u;
 /** Multimap aligner using multimap */
 static Aligner<SeqPosHashMultiMap> *g_aligner_m;
 
+/** Aligner using a sorted table of seeds */
+static Aligner<SeedIndex> *g_aligner_s;
+
 /** Number of reads. */
 static unsigned g_readCount;
 
@@ -193,84 +211,76 @@ static unsigned g_alignedCount;
 /** Guard cerr. */
 static pthread_mutex_t g_mutexCerr = PTHREAD_MUTEX_INITIALIZER;
 
-/** Stores the output string and the read index number for an
- * alignment. */
-struct OutData
+/** The number of reads in a chunk. */
+static const size_t CHUNK_SIZE = 256;
+
+/** The number of chunks of each queue. */
+static const size_t QUEUE_SIZE = 64;
+
+/** A chunk of reads and its index in the order of input. */
+struct ReadChunk
 {
-	string s;
 	size_t index;
+	vector<FastaRecord> reads;
 
-	OutData(string s = string(), size_t index = 0)
-		: s(s), index(index) { }
+	ReadChunk() : index(0) { }
+};
 
-	/** Operator needed for sorting priority queue. */
-	bool operator<(const OutData& a) const
-	{
-		// Smaller index number has higher priority.
-		return index > a.index;
-	}
+/** The output of a chunk of reads and the index of the chunk. */
+struct OutChunk
+{
+	size_t index;
+	string s;
+
+	OutChunk() : index(0) { }
 };
 
-/** Shares data between workers and the output thread. */
-static Pipe<OutData> g_pipeOut(1<<7);
+/** A query file and the chunks of reads read from it. */
+struct QueryFile
+{
+	FastaReader in;
+	RingBuffer<vector<FastaRecord>, SPSCRing> chunks;
+
+	QueryFile(const char* path)
+		: in(path, FastaReader::FOLD_CASE), chunks(4) { }
+};
 
-/** Shares data between producer and worker threads. */
-static PipeMux<FastaRecord> g_pipeMux(1);
+/** The query files. */
+static vector<QueryFile*> g_queryFiles;
 
-/** Notification of the current size of the g_pqueue. */
-static size_t g_pqSize;
-static const size_t MAX_PQ_SIZE = 1000;
+/** Shares chunks of reads between the mux and worker threads. */
+static RingBuffer<ReadChunk> g_readQueue(QUEUE_SIZE);
 
-/** Conditional variable used to block workers until the g_pqueue has
- * become small enough. */
-static pthread_cond_t g_pqSize_cv = PTHREAD_COND_INITIALIZER;
-static pthread_mutex_t g_mutexPqSize = PTHREAD_MUTEX_INITIALIZER;
+/** Shares chunks of output between workers and the output thread. */
+static RingBuffer<OutChunk> g_outQueue(QUEUE_SIZE);
+
+/** The number of chunks held by the output thread. */
+static size_t g_pending;
+static const size_t MAX_PENDING = 16;
+
+/** Conditional variable used to block workers until the output
+ * thread holds few enough chunks. */
+static pthread_cond_t g_pending_cv = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t g_mutexPending = PTHREAD_MUTEX_INITIALIZER;
 
 static void* printAlignments(void*)
 {
-	priority_queue<OutData> pqueue;
-	size_t index = 1;
-	for (pair<OutData, size_t> p = g_pipeOut.pop();
-			p.second > 0; p = g_pipeOut.pop()) {
-		pqueue.push(p.first);
-		while (!pqueue.empty()) {
-			const OutData& rec = pqueue.top();
-			if (index == rec.index) {
-				// Print the record at the current index.
-				index++;
-				assert(rec.index > 0);
-				cout << rec.s;
-				assert_good(cout, "stdout");
-				pqueue.pop();
-			} else if (g_pipeMux.invalidEntry(index)) {
-				// Skip this index since it is invalid.
-				index++;
-			} else {
-				// The record for this index has not been added, get
-				// another record from the pipe.
-				break;
-			}
-		}
-
-		// Let waiting workers continue if the pqueue is small enough.
-		pthread_mutex_lock(&g_mutexPqSize);
-		g_pqSize = pqueue.size();
-		if (g_pqSize < MAX_PQ_SIZE)
-			pthread_cond_broadcast(&g_pqSize_cv);
-		pthread_mutex_unlock(&g_mutexPqSize);
+	OrderedWriter writer(cout);
+	for (OutChunk chunk; g_outQueue.pop(chunk);) {
+		writer.write(chunk.index, chunk.s);
+		assert_good(cout, "stdout");
+
+		// Let waiting workers continue if few enough chunks are held.
+		pthread_mutex_lock(&g_mutexPending);
+		g_pending = writer.pending();
+		if (g_pending < MAX_PENDING)
+			pthread_cond_broadcast(&g_pending_cv);
+		pthread_mutex_unlock(&g_mutexPending);
 	}
+	assert(writer.pending() == 0);
 	return NULL;
 }
 
-/** Store a FastaReader and Pipe. */
-struct WorkerArg {
-	FastaReader& in;
-	Pipe<FastaRecord>& out;
-	WorkerArg(FastaReader& in, Pipe<FastaRecord>& out)
-		: in(in), out(out) { }
-	~WorkerArg() { delete &in; }
-};
-
 static pthread_t getReadFiles(const char *readsFile)
 {
 	if (opt::verbose > 0) {
@@ -279,12 +289,11 @@ static pthread_t getReadFiles(const char *readsFile)
 		pthread_mutex_unlock(&g_mutexCerr);
 	}
 
-	FastaReader* in = new FastaReader(
-			readsFile, FastaReader::FOLD_CASE);
-	WorkerArg* arg = new WorkerArg(*in, *g_pipeMux.addPipe());
+	QueryFile* file = new QueryFile(readsFile);
+	g_queryFiles.push_back(file);
 
 	pthread_t thread;
-	pthread_create(&thread, NULL, readFile, static_cast<void*>(arg));
+	pthread_create(&thread, NULL, readFile, static_cast<void*>(file));
 
 	return thread;
 }
@@ -358,6 +367,9 @@ int main(int argc, char** argv)
 	int numQuery = argc - optind;
 	if (opt::threads <= 0)
 		opt::threads = numQuery;
+#if _OPENMP
+	omp_set_num_threads(opt::threads);
+#endif
 
 	// SAM headers.
 	cout << "@HD\tVN:1.0\n"
@@ -365,7 +377,10 @@ int main(int argc, char** argv)
 		"CL:" << commandLine << '\n';
 
 	size_t numKmer = countKmer(refFastaFile);
-	if (opt::multimap == opt::MULTIMAP) {
+	if (opt::table == SEED_TABLE && opt::k <= SeedIndex::MAX_K) {
+		g_aligner_s = new Aligner<SeedIndex>(opt::k, numKmer);
+		readContigsIntoDB(refFastaFile, *g_aligner_s);
+	} else if (opt::multimap == opt::MULTIMAP) {
 		g_aligner_m = new Aligner<SeqPosHashMultiMap>(opt::k,
 				numKmer);
 		readContigsIntoDB(refFastaFile, *g_aligner_m);
@@ -385,6 +400,8 @@ int main(int argc, char** argv)
 	vector<pthread_t> producer_threads;
 	transform(argv + optind, argv + argc,
 			back_inserter(producer_threads), getReadFiles);
+	pthread_t mux_thread;
+	pthread_create(&mux_thread, NULL, muxReads, NULL);
 
 	vector<pthread_t> threads;
 	for (int i = 0; i < opt::threads; i++) {
@@ -400,20 +417,23 @@ int main(int argc, char** argv)
 	// Wait for all threads to finish.
 	for (size_t i = 0; i < producer_threads.size(); i++)
 		pthread_join(producer_threads[i], &status);
+	pthread_join(mux_thread, &status);
 	for (size_t i = 0; i < threads.size(); i++)
 		pthread_join(threads[i], &status);
-	g_pipeOut.close();
+	g_outQueue.close();
 	pthread_join(out_thread, &status);
 
+	for (size_t i = 0; i < g_queryFiles.size(); i++)
+		delete g_queryFiles[i];
+
 	if (opt::verbose > 0)
 		cerr << "Aligned " << g_alignedCount
 			<< " of " << g_readCount << " reads ("
 			<< (float)100 * g_alignedCount / g_readCount << "%)\n";
 
-	if (opt::multimap == opt::MULTIMAP)
-		delete g_aligner_m;
-	else
-		delete g_aligner_u;
+	delete g_aligner_s;
+	delete g_aligner_m;
+	delete g_aligner_u;
 
 	return 0;
 }
@@ -430,6 +450,14 @@ static void printProgress(const Aligner<SeqPosHashMap>& align,
 		<< " using " << toSI(getMemoryUsage()) << "B." << endl;
 }
 
+static void printProgress(const Aligner<SeedIndex>& align,
+		unsigned count)
+{
+	cerr << "Read " << count << " contigs. "
+		"Seeds: " << align.size()
+		<< " using " << toSI(getMemoryUsage()) << "B." << endl;
+}
+
 template <class SeqPosHashMap>
 static void readContigsIntoDB(string refFastaFile,
 		Aligner<SeqPosHashMap>& aligner)
@@ -464,6 +492,8 @@ static void readContigsIntoDB(string refFastaFile,
 	if (opt::verbose > 0)
 		printProgress(aligner, count);
 
+	aligner.buildIndex();
+
 	if (opt::multimap == opt::IGNORE) {
 		// Count the number of duplicate k-mer in the target.
 		size_t duplicates = aligner.countDuplicates();
@@ -474,24 +504,103 @@ static void readContigsIntoDB(string refFastaFile,
 	}
 }
 
-/** Read each fasta record from 'in', and add it to 'pipe'. */
-static void readFile(FastaReader& in, Pipe<FastaRecord>& pipe)
+/** Read the records of 'in' in chunks, and add them to 'chunks'. */
+static void readFile(FastaReader& in,
+		RingBuffer<vector<FastaRecord>, SPSCRing>& chunks)
 {
-	for (FastaRecord rec; in >> rec;)
-		pipe.push(rec);
+	// The records of a chunk reuse the storage of a chunk returned
+	// by the mux thread.
+	vector<FastaRecord> chunk;
+	for (size_t n = CHUNK_SIZE; n == CHUNK_SIZE;) {
+		chunk.resize(CHUNK_SIZE);
+		for (n = 0; n < CHUNK_SIZE && in >> chunk[n]; n++)
+			;
+		chunk.resize(n);
+		if (n > 0)
+			chunks.push(chunk);
+	}
 	assert(in.eof());
-	pipe.close();
+	chunks.close();
 }
 
 /** Producer thread. */
 static void* readFile(void* arg)
 {
-	WorkerArg* p = static_cast<WorkerArg*>(arg);
-	readFile(p->in, p->out);
-	delete p;
+	QueryFile* p = static_cast<QueryFile*>(arg);
+	readFile(p->in, p->chunks);
 	return NULL;
 }
 
+/** Interleave the reads of the query files, taking one read of each
+ * file in turn, and number the chunks of reads for the workers. */
+static void* muxReads(void*)
+{
+	size_t index = 0;
+	ReadChunk chunk;
+	if (g_queryFiles.size() == 1) {
+		// Pass the chunks of the one file through.
+		for (RingBuffer<vector<FastaRecord>, SPSCRing>& in
+					= g_queryFiles.front()->chunks;
+				in.pop(chunk.reads);) {
+			chunk.index = index++;
+			g_readQueue.push(chunk);
+		}
+		g_readQueue.close();
+		return NULL;
+	}
+
+	size_t numFiles = g_queryFiles.size();
+	vector<vector<FastaRecord> > buffers(numFiles);
+	vector<size_t> next(numFiles);
+	vector<size_t> open;
+	for (size_t i = 0; i < numFiles; i++)
+		open.push_back(i);
+
+	chunk.reads.clear();
+	for (size_t i = 0; !open.empty();) {
+		size_t f = open[i];
+		if (next[f] == buffers[f].size()) {
+			next[f] = 0;
+			if (!g_queryFiles[f]->chunks.pop(buffers[f])) {
+				// This file is done. Continue with the next file.
+				open.erase(open.begin() + i);
+				if (i == open.size())
+					i = 0;
+				continue;
+			}
+		}
+		chunk.reads.push_back(FastaRecord());
+		swap(chunk.reads.back(), buffers[f][next[f]++]);
+		if (++i == open.size())
+			i = 0;
+
+		if (chunk.reads.size() == CHUNK_SIZE) {
+			chunk.index = index++;
+			g_readQueue.push(chunk);
+			chunk.reads.clear();
+		}
+	}
+	if (!chunk.reads.empty()) {
+		chunk.index = index++;
+		g_readQueue.push(chunk);
+	}
+	g_readQueue.close();
+	return NULL;
+}
+
+/** Align a read to the target using the aligner of the index. */
+template <class oiterator>
+static void alignRead(const string& id, const Sequence& seq,
+		oiterator dest)
+{
+	if (g_aligner_s != NULL)
+		g_aligner_s->alignRead(id, seq, dest);
+	else if (opt::multimap == opt::MULTIMAP)
+		g_aligner_m->alignRead(id, seq, dest);
+	else
+		g_aligner_u->alignRead(id, seq, dest);
+}
+
 /** @Returns the time in seconds between [start, end]. */
 static double timeDiff(const timeval& start, const timeval& end)
 {
@@ -502,88 +611,95 @@ static double timeDiff(const timeval& start, const timeval& end)
 	return result;
 }
 
-static void* alignReadsToDB(void*)
+/** Count the reads of a chunk, and report the progress. */
+static void countReads(size_t reads, size_t aligned)
 {
-	opt::chastityFilter = false;
-	opt::trimMasked = false;
 	static timeval start, end;
+	static unsigned lastCount;
 
 	pthread_mutex_lock(&g_mutexCerr);
-	gettimeofday(&start, NULL);
+	if (g_readCount == 0)
+		gettimeofday(&start, NULL);
+	g_alignedCount += aligned;
+	g_readCount += reads;
+	if (g_readCount / 1000000 > lastCount / 1000000) {
+		gettimeofday(&end, NULL);
+		double result = timeDiff(start, end);
+		cerr << "Aligned " << g_readCount << " reads at "
+			<< (int)((g_readCount - lastCount) / result)
+			<< " reads/sec.\n";
+		start = end;
+		lastCount = g_readCount;
+	}
 	pthread_mutex_unlock(&g_mutexCerr);
+}
 
-	for (pair<FastaRecord, size_t> recPair = g_pipeMux.nextValue();
-			recPair.second > 0; recPair = g_pipeMux.nextValue()) {
-		const FastaRecord& rec = recPair.first;
-		const Sequence& seq = rec.seq;
-		ostringstream output;
-		if (seq.find_first_not_of("ACGT0123") == string::npos) {
-			if (opt::colourSpace)
-				assert(isdigit(seq[0]));
-			else
-				assert(isalpha(seq[0]));
-		}
+static void* alignReadsToDB(void*)
+{
+	opt::chastityFilter = false;
+	opt::trimMasked = false;
 
-		switch (opt::format) {
-		  case KALIGNER:
-			if (opt::multimap == opt::MULTIMAP)
-				g_aligner_m->alignRead(rec.id, seq,
-						affix_ostream_iterator<Alignment>(
-							output, "\t"));
-			else
-				g_aligner_u->alignRead(rec.id, seq,
-						affix_ostream_iterator<Alignment>(
-							output, "\t"));
-			break;
-		  case SAM:
-			if (opt::multimap == opt::MULTIMAP)
-				g_aligner_m->alignRead(rec.id, seq,
-						ostream_iterator<SAMRecord>(output, "\n"));
-			else
-				g_aligner_u->alignRead(rec.id, seq,
+	ReadChunk chunk;
+	OutChunk outChunk;
+	while (g_readQueue.pop(chunk)) {
+		outChunk.index = chunk.index;
+		outChunk.s.clear();
+		size_t aligned = 0;
+		for (vector<FastaRecord>::const_iterator it
+				= chunk.reads.begin(); it != chunk.reads.end(); ++it) {
+			const FastaRecord& rec = *it;
+			const Sequence& seq = rec.seq;
+			ostringstream output;
+			if (seq.find_first_not_of("ACGT0123") == string::npos) {
+				if (opt::colourSpace)
+					assert(isdigit(seq[0]));
+				else
+					assert(isalpha(seq[0]));
+			}
+
+			switch (opt::format) {
+			  case KALIGNER:
+				alignRead(rec.id, seq,
+						affix_ostream_iterator<Alignment>(output, "\t"));
+				break;
+			  case SAM:
+				alignRead(rec.id, seq,
 						ostream_iterator<SAMRecord>(output, "\n"));
-			break;
-		}
+				break;
+			}
 
-		ostringstream out;
-		string s = output.str();
-		switch (opt::format) {
-		  case KALIGNER:
-			out << rec.id;
-			if (opt::printSeq) {
-				out << ' ';
-				if (opt::colourSpace)
-					out << rec.anchor;
-				out << seq;
+			ostringstream out;
+			string s = output.str();
+			switch (opt::format) {
+			  case KALIGNER:
+				out << rec.id;
+				if (opt::printSeq) {
+					out << ' ';
+					if (opt::colourSpace)
+						out << rec.anchor;
+					out << seq;
+				}
+				out << s << '\n';
+				break;
+			  case SAM:
+				out << s;
+				break;
 			}
-			out << s << '\n';
-			break;
-		  case SAM:
-			out << s;
-			break;
+			outChunk.s += out.str();
+			if (!s.empty())
+				aligned++;
 		}
-		g_pipeOut.push(OutData(out.str(), recPair.second));
+		g_outQueue.push(outChunk);
 
-		// Prevent the priority_queue from growing too large by
+		// Prevent the output thread from holding too many chunks by
 		// waiting for threads going far too slow.
-		pthread_mutex_lock(&g_mutexPqSize);
-		if (g_pqSize >= MAX_PQ_SIZE)
-			pthread_cond_wait(&g_pqSize_cv, &g_mutexPqSize);
-		pthread_mutex_unlock(&g_mutexPqSize);
+		pthread_mutex_lock(&g_mutexPending);
+		while (g_pending >= MAX_PENDING)
+			pthread_cond_wait(&g_pending_cv, &g_mutexPending);
+		pthread_mutex_unlock(&g_mutexPending);
 
-		if (opt::verbose > 0) {
-			pthread_mutex_lock(&g_mutexCerr);
-			if (!s.empty())
-				g_alignedCount++;
-			if (++g_readCount % 1000000 == 0) {
-				gettimeofday(&end, NULL);
-				double result = timeDiff(start, end);
-				cerr << "Aligned " << g_readCount << " reads at "
-					<< (int)(1000000 / result) << " reads/sec.\n";
-				start = end;
-			}
-			pthread_mutex_unlock(&g_mutexCerr);
-		}
+		if (opt::verbose > 0)
+			countReads(chunk.reads.size(), aligned);
 	}
 	return NULL;
 }
@@ -0,0 +1,39 @@
+#ifndef POSITION_H
+#define POSITION_H 1
+
+#include "KAligner/Options.h"
+#include "Sequence.h"
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <stdint.h>
+
+/** A tuple of a target ID and position. */
+struct Position
+{
+	uint32_t contig;
+	uint32_t pos; // 0 indexed
+	Position(
+	    uint32_t contig = std::numeric_limits<uint32_t>::max(),
+	    uint32_t pos = std::numeric_limits<uint32_t>::max())
+	  : contig(contig)
+	  , pos(pos)
+	{}
+
+	/** Mark this seed as a duplicate. */
+	void setDuplicate(const char* thisContig, const char* otherContig, const Sequence& kmer)
+	{
+		if (opt::multimap == opt::IGNORE)
+			contig = std::numeric_limits<uint32_t>::max();
+		else {
+			std::cerr << "error: duplicate k-mer in " << thisContig << " also in " << otherContig
+			          << ": " << kmer << '\n';
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	/** Return whether this seed is a duplciate. */
+	bool isDuplicate() const { return contig == std::numeric_limits<uint32_t>::max(); }
+};
+
+#endif
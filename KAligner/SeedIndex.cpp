@@ -0,0 +1,215 @@
+#include "SeedIndex.h"
+#include "Common/Options.h"
+#include "Kmer.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#if _OPENMP
+# include <omp.h>
+#endif
+
+using namespace std;
+
+/** The codes of the bases ACGT and of the colours 0123 */
+const uint8_t SeedIndex::s_codes[256] = {
+	4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+	4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+	4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+	0,1,2,3,4,4,4,4,4,4,4,4,4,4,4,4,
+	4,0,4,1,4,4,4,2,4,4,4,4,4,4,4,4,
+	4,4,4,4,3,4,4,4,4,4,4,4,4,4,4,4,
+	4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+	4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+	4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+	4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+	4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+	4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+	4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+	4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+	4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+	4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+};
+
+const uint32_t SeedIndex::EMPTY;
+
+/** The number of bits of a digit of the radix sort */
+static const unsigned RADIX_BITS = 11;
+
+SeedIndex::SeedIndex(size_t expected)
+	: m_k(Kmer::length()), m_tableBits(0), m_dupKey(0)
+{
+	assert(m_k > 0 && m_k <= MAX_K);
+	m_seeds.reserve(expected);
+}
+
+void SeedIndex::add(const Sequence& seq, uint32_t contig)
+{
+	uint64_t mask = m_k == 32 ? ~uint64_t(0)
+		: (uint64_t(1) << 2 * m_k) - 1;
+	uint64_t key = 0;
+	unsigned n = 0;
+	for (size_t i = 0; i < seq.size(); ++i) {
+		uint8_t c = s_codes[(unsigned char)seq[i]];
+		if (c > 3) {
+			n = 0;
+			continue;
+		}
+		key = (key << 2 | c) & mask;
+		if (++n >= m_k)
+			m_seeds.push_back(value_type(key,
+						Position(contig, i + 1 - m_k)));
+	}
+}
+
+string SeedIndex::unpack(uint64_t key) const
+{
+	string s(m_k, 'N');
+	for (unsigned i = 0; i < m_k; ++i)
+		s[i] = codeToBase(key >> 2 * (m_k - 1 - i) & 3);
+	return s;
+}
+
+uint64_t SeedIndex::reverseComplement(uint64_t key) const
+{
+	uint64_t x = opt::colourSpace ? key : ~key;
+	// Reverse the pairs of bits.
+	x = (x >> 2 & 0x3333333333333333ULL)
+		| (x & 0x3333333333333333ULL) << 2;
+	x = (x >> 4 & 0x0f0f0f0f0f0f0f0fULL)
+		| (x & 0x0f0f0f0f0f0f0f0fULL) << 4;
+	x = (x >> 8 & 0x00ff00ff00ff00ffULL)
+		| (x & 0x00ff00ff00ff00ffULL) << 8;
+	x = (x >> 16 & 0x0000ffff0000ffffULL)
+		| (x & 0x0000ffff0000ffffULL) << 16;
+	x = x >> 32 | x << 32;
+	return x >> (64 - 2 * m_k);
+}
+
+/** The key of a seed by which the seeds are sorted */
+struct SeedKey
+{
+	const SeedIndex& index;
+	bool canonical;
+
+	SeedKey(const SeedIndex& index, bool canonical)
+		: index(index), canonical(canonical) { }
+
+	uint64_t operator()(const SeedIndex::value_type& seed) const
+	{
+		return canonical
+			? min(seed.first, index.reverseComplement(seed.first))
+			: seed.first;
+	}
+};
+
+/** Sort the seeds stably by a key of the specified number of bits
+ * using a least-significant-digit radix sort. The seeds are divided
+ * in one chunk per thread, each of which is counted and then
+ * scattered in parallel. */
+static void radixSort(vector<SeedIndex::value_type>& seeds,
+		unsigned bits, const SeedKey& key)
+{
+	const size_t numDigits = size_t(1) << RADIX_BITS;
+	size_t n = seeds.size();
+#if _OPENMP
+	ptrdiff_t chunks = omp_get_max_threads();
+#else
+	ptrdiff_t chunks = 1;
+#endif
+	vector<SeedIndex::value_type> tmp(n);
+	vector<size_t> counts(chunks * numDigits);
+	for (unsigned shift = 0; shift < bits; shift += RADIX_BITS) {
+		fill(counts.begin(), counts.end(), 0);
+#pragma omp parallel for
+		for (ptrdiff_t t = 0; t < chunks; ++t) {
+			size_t* count = &counts[t * numDigits];
+			for (size_t i = n * t / chunks; i < n * (t + 1) / chunks; ++i)
+				count[key(seeds[i]) >> shift & (numDigits - 1)]++;
+		}
+
+		// The position of the first seed of each digit and chunk
+		size_t sum = 0;
+		for (size_t d = 0; d < numDigits; ++d) {
+			for (ptrdiff_t t = 0; t < chunks; ++t) {
+				size_t x = counts[t * numDigits + d];
+				counts[t * numDigits + d] = sum;
+				sum += x;
+			}
+		}
+
+#pragma omp parallel for
+		for (ptrdiff_t t = 0; t < chunks; ++t) {
+			size_t* count = &counts[t * numDigits];
+			for (size_t i = n * t / chunks; i < n * (t + 1) / chunks; ++i)
+				tmp[count[key(seeds[i]) >> shift & (numDigits - 1)]++]
+					= seeds[i];
+		}
+		seeds.swap(tmp);
+	}
+}
+
+/** Return whether position a was added before position b. */
+static bool addedBefore(const Position& a, const Position& b)
+{
+	return a.contig != b.contig ? a.contig < b.contig : a.pos < b.pos;
+}
+
+void SeedIndex::build(bool unique)
+{
+	SeedKey key(*this, unique);
+	radixSort(m_seeds, 2 * m_k, key);
+
+	// Collapse the seeds of a k-mer and its reverse complement to the
+	// first seed added.
+	size_t numKeys = 0;
+	if (unique) {
+		for (size_t i = 0; i < m_seeds.size();) {
+			uint64_t x = key(m_seeds[i]);
+			size_t j = i + 1;
+			while (j < m_seeds.size() && key(m_seeds[j]) == x)
+				++j;
+			value_type seed = m_seeds[i];
+			if (j - i > 1) {
+				const value_type& second = m_seeds[i + 1];
+				if (m_dupFirst.isDuplicate()
+						|| addedBefore(second.second, m_dupSecond)) {
+					m_dupFirst = seed.second;
+					m_dupSecond = second.second;
+					m_dupKey = second.first;
+				}
+				seed.second.contig = Position().contig;
+			}
+			m_seeds[numKeys++] = seed;
+			i = j;
+		}
+		m_seeds.resize(numKeys);
+		vector<value_type>(m_seeds).swap(m_seeds);
+	} else {
+		for (size_t i = 0; i < m_seeds.size(); ++i)
+			if (i == 0 || m_seeds[i].first != m_seeds[i - 1].first)
+				numKeys++;
+	}
+
+	if (m_seeds.size() >= EMPTY) {
+		cerr << "error: the target has too many k-mer for the "
+			"seed table: " << m_seeds.size() << '\n';
+		exit(EXIT_FAILURE);
+	}
+
+	// Map each key to its first seed, leaving at least half of the
+	// slots empty.
+	m_tableBits = 1;
+	while ((size_t(1) << m_tableBits) < 2 * numKeys)
+		m_tableBits++;
+	m_table.assign(size_t(1) << m_tableBits, EMPTY);
+	size_t mask = m_table.size() - 1;
+	for (size_t i = 0; i < m_seeds.size(); ++i) {
+		if (!unique && i > 0 && m_seeds[i].first == m_seeds[i - 1].first)
+			continue;
+		size_t s = slot(m_seeds[i].first);
+		while (m_table[s] != EMPTY)
+			s = (s + 1) & mask;
+		m_table[s] = i;
+	}
+}
@@ -0,0 +1,169 @@
+#ifndef SEEDINDEX_H
+#define SEEDINDEX_H 1
+
+#include "KAligner/Position.h"
+#include "Sequence.h"
+#include <cassert>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * An index of the k-mer of a target, for k at most 32. Each k-mer is
+ * packed in a 64-bit key. The seeds, a key and a position each, are
+ * collected from the target and then sorted by a parallel radix sort,
+ * which places the positions of a k-mer next to each other. An
+ * open-addressing table maps a key to its first seed.
+ *
+ * The seeds are collapsed as the hash tables of Aligner collapse them.
+ * If unique, one seed is kept of the occurrences of a k-mer and its
+ * reverse complement, the first added, and is marked a duplicate if
+ * there is more than one occurrence. Otherwise all seeds are kept.
+ */
+class SeedIndex
+{
+  public:
+	/** The largest k-mer that fits in a key */
+	static const unsigned MAX_K = 32;
+
+	/** A seed, the key of a k-mer and its position in the target */
+	struct value_type
+	{
+		uint64_t first;
+		Position second;
+
+		value_type(uint64_t key, Position pos)
+			: first(key), second(pos) { }
+		value_type() : first(0) { }
+	};
+
+	typedef const value_type* const_iterator;
+	typedef const_iterator iterator;
+
+	/** Construct an index of k-mer of the current length, Kmer::length(),
+	 * reserving space for the specified number of k-mer. */
+	explicit SeedIndex(size_t expected = 0);
+
+	/** Add the k-mer of the sequence of the specified target. The
+	 * k-mer that contain a base other than ACGT or 0123 are skipped.
+	 */
+	void add(const Sequence& seq, uint32_t contig);
+
+	/** Sort the seeds and build the table. */
+	void build(bool unique);
+
+	/** Return the seeds of the k-mer of key. */
+	std::pair<const_iterator, const_iterator> equal_range(uint64_t key)
+		const
+	{
+		if (m_table.empty())
+			return std::make_pair(end(), end());
+		size_t mask = m_table.size() - 1;
+		for (size_t s = slot(key);; s = (s + 1) & mask) {
+			uint32_t i = m_table[s];
+			if (i == EMPTY)
+				return std::make_pair(end(), end());
+			if (m_seeds[i].first == key) {
+				size_t j = i + 1;
+				while (j < m_seeds.size() && m_seeds[j].first == key)
+					++j;
+				return std::make_pair(begin() + i, begin() + j);
+			}
+		}
+	}
+
+	/** Return the key of the k-mer at p.
+	 * @return false if the k-mer contains a base other than ACGT or
+	 * 0123
+	 */
+	bool pack(const char* p, uint64_t& key) const
+	{
+		key = 0;
+		for (unsigned i = 0; i < m_k; ++i) {
+			uint8_t c = s_codes[(unsigned char)p[i]];
+			if (c > 3)
+				return false;
+			key = key << 2 | c;
+		}
+		return true;
+	}
+
+	/** Return the k-mer of key. */
+	std::string unpack(uint64_t key) const;
+
+	/** Return the key of the reverse complement of key. */
+	uint64_t reverseComplement(uint64_t key) const;
+
+	/** Return the number of seeds. Once built unique, it is the
+	 * number of distinct k-mer. */
+	size_t size() const { return m_seeds.size(); }
+
+	/** Return the number of slots of the table. */
+	size_t bucket_count() const { return m_table.size(); }
+
+	/** Return the number of bytes used by the seeds and the table. */
+	size_t bytes() const
+	{
+		return m_seeds.capacity() * sizeof (value_type)
+			+ m_table.capacity() * sizeof (uint32_t);
+	}
+
+	const_iterator begin() const { return m_seeds.data(); }
+	const_iterator end() const
+	{
+		return m_seeds.data() + m_seeds.size();
+	}
+
+	/** Return the first duplicate k-mer in the order that the seeds
+	 * were added, after build(true).
+	 * @param first [out] the position of its first occurrence
+	 * @param second [out] the position of its second occurrence
+	 * @param kmer [out] the k-mer at its second occurrence
+	 * @return false if there is no duplicate k-mer
+	 */
+	bool firstDuplicate(Position& first, Position& second,
+			std::string& kmer) const
+	{
+		if (m_dupFirst.isDuplicate())
+			return false;
+		first = m_dupFirst;
+		second = m_dupSecond;
+		kmer = unpack(m_dupKey);
+		return true;
+	}
+
+  private:
+	SeedIndex(const SeedIndex&);
+	SeedIndex& operator=(const SeedIndex&);
+
+	/** Return the slot of the table of key. */
+	size_t slot(uint64_t key) const
+	{
+		return (key * 0x9e3779b97f4a7c15ULL) >> (64 - m_tableBits);
+	}
+
+	/** An empty slot of the table */
+	static const uint32_t EMPTY = ~uint32_t(0);
+
+	/** The codes of the bases, or 4 for an invalid base */
+	static const uint8_t s_codes[256];
+
+	/** The length of a k-mer */
+	unsigned m_k;
+
+	/** The seeds */
+	std::vector<value_type> m_seeds;
+
+	/** The index of the first seed of each key */
+	std::vector<uint32_t> m_table;
+
+	/** The number of bits of the index of a slot */
+	unsigned m_tableBits;
+
+	/** The first duplicate k-mer */
+	Position m_dupFirst, m_dupSecond;
+	uint64_t m_dupKey;
+};
+
+#endif
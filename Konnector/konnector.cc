@@ -11,12 +11,12 @@
 #include "DBGBloomAlgorithms.h"
 
 #include "Align/alignGlobal.h"
+#include "Common/BufferedWriter.h"
 #include "Common/IOUtil.h"
 #include "Common/Options.h"
 #include "Common/StringUtil.h"
-#include "DataLayer/FastaConcat.h"
-#include "DataLayer/FastaInterleave.h"
 #include "DataLayer/Options.h"
+#include "DataLayer/PairedReader.h"
 #include "Graph/DotIO.h"
 #include "Graph/Options.h"
 #include "Graph/GraphUtil.h"
@@ -76,6 +76,7 @@ static const char USAGE_MESSAGE[] =
 "                             connected, extend them inwards as well.\n"
 "  --fastq                    output merged reads in FASTQ format\n"
 "                             (default is FASTA)\n"
+"  --gzip                     compress the output files with gzip\n"
 "  -f, --min-frag=N           min fragment size in base pairs [0]\n"
 "  -F, --max-frag=N           max fragment size in base pairs [1000]\n"
 "  -i, --input-bloom=FILE     load bloom filter from FILE\n"
@@ -199,6 +200,11 @@ namespace opt {
 	 */
 	bool fastq = false;
 
+	/**
+	 * Compress the output files.
+	 */
+	bool gzip = false;
+
 	/** The size of a k-mer. */
 	unsigned k;
 
@@ -289,7 +295,7 @@ static struct {
 
 static const char shortopts[] = "b:B:c:C:d:D:eEf:F:i:Ij:k:lm:M:no:p:P:q:Q:r:s:t:vx:X:";
 
-enum { OPT_FASTQ = 1, OPT_HELP, OPT_PRESERVE_READS, OPT_VERSION };
+enum { OPT_FASTQ = 1, OPT_GZIP, OPT_HELP, OPT_PRESERVE_READS, OPT_VERSION };
 
 static const struct option longopts[] = {
 	{ "bloom-size",       required_argument, NULL, 'b' },
@@ -329,6 +335,7 @@ static const struct option longopts[] = {
 	{ "read-identity",    required_argument, NULL, 'x' },
 	{ "path-identity",    required_argument, NULL, 'X' },
 	{ "fastq",            no_argument, NULL, OPT_FASTQ },
+	{ "gzip",             no_argument, NULL, OPT_GZIP },
 	{ "help",             no_argument, NULL, OPT_HELP },
 	{ "preserve-reads",   no_argument, NULL, OPT_PRESERVE_READS },
 	{ "version",          no_argument, NULL, OPT_VERSION },
@@ -694,7 +701,7 @@ static inline void updateCounters(const ConnectPairsParams& params,
 	}
 }
 
-static inline void outputRead(const FastqRecord& read, ostream& out,
+static inline void outputRead(const FastqRecord& read, BufferedWriter& out,
 	bool fastq = true)
 {
 	if (fastq)
@@ -741,9 +748,9 @@ static void connectPair(const Graph& g,
 	FastqRecord& read1,
 	FastqRecord& read2,
 	const ConnectPairsParams& params,
-	ofstream& mergedStream,
-	ofstream& read1Stream,
-	ofstream& read2Stream,
+	BufferedWriter& mergedStream,
+	BufferedWriter& read1Stream,
+	BufferedWriter& read2Stream,
 	ofstream& traceStream)
 {
 	/*
@@ -870,61 +877,50 @@ static void connectPair(const Graph& g,
 		!exceedsMismatchThresholds(params, result)) {
 		assert(!paths.empty());
 		if (opt::altPathsMode) {
-#pragma omp critical(mergedStream)
 			for (unsigned i = 0; i < paths.size(); ++i) {
 				if (opt::dupBloomSize == 0 || !pathRedundant.at(i))
 					outputRead(paths.at(i), mergedStream, opt::fastq);
 			}
 		} else if (opt::dupBloomSize == 0 || !pathRedundant.front()) {
-#pragma omp critical(mergedStream)
 			outputRead(consensus, mergedStream, opt::fastq);
 		}
 	} else {
 		if (opt::extend) {
-			if (outputRead1 || outputRead2)
-#pragma omp critical(mergedStream)
-			{
-				if (outputRead1)
-					outputRead(read1, mergedStream, opt::fastq);
-				if (outputRead2)
-					outputRead(read2, mergedStream, opt::fastq);
-			}
-			if (!outputRead1 || !outputRead2)
-#pragma omp critical(readStream)
-			{
-				if (!outputRead1)
-					read1Stream << read1;
-				if (!outputRead2)
-					read2Stream << read2;
-			}
-		} else
-#pragma omp critical(readStream)
-		{
+			if (outputRead1)
+				outputRead(read1, mergedStream, opt::fastq);
+			if (outputRead2)
+				outputRead(read2, mergedStream, opt::fastq);
+			if (!outputRead1)
+				read1Stream << read1;
+			if (!outputRead2)
+				read2Stream << read2;
+		} else {
 			read1Stream << read1;
 			read2Stream << read2;
 		}
 	}
 }
 
+/** The number of read pairs that a thread reads at once */
+static const size_t PAIR_BATCH_SIZE = 256;
+
 /** Connect read pairs. */
-template <typename Graph, typename FastaStream, typename Bloom>
+template <typename Graph, typename Bloom>
 static void connectPairs(const Graph& g,
 	const Bloom& bloom,
-	FastaStream& in,
+	PairedReader& in,
 	const ConnectPairsParams& params,
-	ofstream& mergedStream,
-	ofstream& read1Stream,
-	ofstream& read2Stream,
+	BufferedWriter& mergedStream,
+	BufferedWriter& read1Stream,
+	BufferedWriter& read2Stream,
 	ofstream& traceStream)
 {
+	typedef vector<pair<FastqRecord, FastqRecord> > Batch;
 #pragma omp parallel
-	for (FastqRecord a, b;;) {
-		bool good;
-#pragma omp critical(in)
-		good = in >> a >> b;
-		if (good) {
-			connectPair(g, bloom, a, b, params, mergedStream, read1Stream,
-				read2Stream, traceStream);
+	for (Batch batch; in.readBatch(batch, PAIR_BATCH_SIZE) > 0;) {
+		for (Batch::iterator it = batch.begin(); it != batch.end(); ++it) {
+			connectPair(g, bloom, it->first, it->second, params,
+				mergedStream, read1Stream, read2Stream, traceStream);
 #pragma omp atomic
 			g_count.readPairsProcessed++;
 			if (opt::verbose >= 2)
@@ -933,8 +929,6 @@ static void connectPairs(const Graph& g,
 				if(g_count.readPairsProcessed % g_progressStep == 0)
 					printProgressMessage();
 			}
-		} else {
-			break;
 		}
 	}
 }
@@ -1037,6 +1031,8 @@ int main(int argc, char** argv)
 			opt::verbose++; break;
 		  case OPT_FASTQ:
 			opt::fastq = true; break;
+		  case OPT_GZIP:
+			opt::gzip = true; break;
 		  case OPT_HELP:
 			cout << USAGE_MESSAGE;
 			exit(EXIT_SUCCESS);
@@ -1068,6 +1064,12 @@ int main(int argc, char** argv)
 		die = true;
 	}
 
+	if (!opt::interleaved && argc - optind > 1
+			&& (argc - optind) % 2 != 0) {
+		cerr << PROGRAM ": the mate files must be given in pairs\n";
+		die = true;
+	}
+
 	if (die) {
 		cerr << "Try `" << PROGRAM
 			<< " --help' for more information.\n";
@@ -1182,8 +1184,9 @@ int main(int argc, char** argv)
 		mergedOutputPath.append(".fq");
 	else
 		mergedOutputPath.append(".fa");
-	ofstream mergedStream(mergedOutputPath.c_str());
-	assert_good(mergedStream, mergedOutputPath);
+	if (opt::gzip)
+		mergedOutputPath.append(".gz");
+	BufferedWriter mergedStream(mergedOutputPath);
 
 	/*
 	 * read pairs that were not successfully connected,
@@ -1193,13 +1196,18 @@ int main(int argc, char** argv)
 
 	string read1OutputPath(opt::outputPrefix);
 	read1OutputPath.append("_reads_1.fq");
-	ofstream read1Stream(read1OutputPath.c_str());
-	assert_good(read1Stream, read1OutputPath);
+	if (opt::gzip)
+		read1OutputPath.append(".gz");
+	BufferedWriter read1Stream(read1OutputPath);
 
 	string read2OutputPath(opt::outputPrefix);
 	read2OutputPath.append("_reads_2.fq");
-	ofstream read2Stream(read2OutputPath.c_str());
-	assert_good(read2Stream, read2OutputPath);
+	if (opt::gzip)
+		read2OutputPath.append(".gz");
+	BufferedWriter read2Stream(read2OutputPath);
+
+	/* keep the unmerged reads of a pair in step */
+	read1Stream.setMate(read2Stream);
 
 	if (opt::verbose > 0)
 		cerr << "Connecting read pairs\n";
@@ -1223,19 +1231,12 @@ int main(int argc, char** argv)
 	params.dotPath = opt::dotPath;
 	params.dotStream = opt::dotPath.empty() ? NULL : &dotStream;
 
-	if (opt::interleaved) {
-		FastaConcat in(argv + optind, argv + argc,
-				FastaReader::FOLD_CASE);
-		connectPairs(g, *bloom, in, params, mergedStream, read1Stream,
-				read2Stream, traceStream);
-		assert(in.eof());
-	} else {
-		FastaInterleave in(argv + optind, argv + argc,
-				FastaReader::FOLD_CASE);
-		connectPairs(g, *bloom, in, params, mergedStream, read1Stream,
-				read2Stream, traceStream);
-		assert(in.eof());
-	}
+	// connectPairs checks the names of the mates.
+	PairedReader in(argv + optind, argv + argc,
+			FastaReader::FOLD_CASE, opt::interleaved, false);
+	connectPairs(g, *bloom, in, params, mergedStream, read1Stream,
+			read2Stream, traceStream);
+	assert(in.eof());
 
 	if (opt::verbose > 0) {
 		cerr <<
@@ -1307,11 +1308,8 @@ int main(int argc, char** argv)
 	else
 		delete cascadingBloom;
 
-	assert_good(mergedStream, mergedOutputPath.c_str());
 	mergedStream.close();
-	assert_good(read1Stream, read1OutputPath.c_str());
 	read1Stream.close();
-	assert_good(read2Stream, read2OutputPath.c_str());
 	read2Stream.close();
 
 	if (!opt::dotPath.empty()) {
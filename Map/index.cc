@@ -14,6 +14,9 @@
 #include <iostream>
 #include <iterator>
 #include <string>
+#if _OPENMP
+# include <omp.h>
+#endif
 
 using namespace std;
 
@@ -41,8 +44,20 @@ static const char USAGE_MESSAGE[] =
 "      --dna               equivalent to -a'-ACGT'\n"
 "      --protein           equivalent to -a'#*ACDEFGHIKLMNPQRSTVWY'\n"
 "  -s, --sample=N          sample the suffix array [16]\n"
+"  -b, --block-size=N      build the BWT in blocks of N symbols, which\n"
+"                          uses less memory, but is slower. N may use\n"
+"                          an SI suffix, such as 500M. [0, disabled]\n"
+"      --interleaved       interleave the occurrence counts with the\n"
+"                          BWT, which is faster to search, but is\n"
+"                          limited to six symbols\n"
+"      --bit-arrays        store the occurrences of each symbol in\n"
+"                          a bit array [default]\n"
+"      --mmap              store the index in a page-aligned layout,\n"
+"                          which abyss-map and abyss-overlap map into\n"
+"                          memory and share rather than read\n"
 "  -d, --decompress        decompress the index FILE\n"
 "  -c, --stdout            write output to standard output\n"
+"  -j, --threads=N         use N parallel threads [1]\n"
 "  -v, --verbose           display verbose output\n"
 "      --help              display this help and exit\n"
 "      --version           output version information and exit\n"
@@ -66,6 +81,19 @@ namespace opt {
 	/** The alphabet. */
 	static string alphabet = "-ACGT";
 
+	/** Build the BWT in blocks of this size, or zero to build the
+	 * suffix array of the whole text. */
+	static size_t blockSize;
+
+	/** The number of parallel threads. */
+	static unsigned threads = 1;
+
+	/** The layout of the occurrence table. */
+	static int occLayout = FMIndex::BIT_ARRAYS;
+
+	/** Store the index in a layout that may be mapped into memory. */
+	static int mmap;
+
 	/** Decompress the index. */
 	static bool decompress;
 
@@ -76,7 +104,7 @@ namespace opt {
 	static int verbose;
 }
 
-static const char shortopts[] = "a:cds:v";
+static const char shortopts[] = "a:b:cdj:s:v";
 
 enum { OPT_HELP = 1, OPT_VERSION,
 	OPT_ALPHA, OPT_DNA, OPT_PROTEIN };
@@ -87,12 +115,17 @@ static const struct option longopts[] = {
 	{ "fm", no_argument, &opt::indexes, opt::FM },
 	{ "fa2bwt", no_argument, &opt::fa2bwt, true },
 	{ "bwt2fm", no_argument, &opt::bwt2fm, true },
+	{ "interleaved", no_argument, &opt::occLayout, FMIndex::INTERLEAVED },
+	{ "bit-arrays", no_argument, &opt::occLayout, FMIndex::BIT_ARRAYS },
+	{ "mmap", no_argument, &opt::mmap, true },
 	{ "alphabet", optional_argument, NULL, 'a' },
 	{ "alpha", optional_argument, NULL, OPT_ALPHA },
 	{ "dna", optional_argument, NULL, OPT_DNA },
 	{ "protein", optional_argument, NULL, OPT_PROTEIN },
 	{ "decompress", no_argument, NULL, 'd' },
 	{ "sample", required_argument, NULL, 's' },
+	{ "block-size", required_argument, NULL, 'b' },
+	{ "threads", required_argument, NULL, 'j' },
 	{ "stdout", no_argument, NULL, 'c' },
 	{ "help", no_argument, NULL, OPT_HELP },
 	{ "version", no_argument, NULL, OPT_VERSION },
@@ -134,6 +167,7 @@ static void buildFMIndexFromBWT(FMIndex& fm, const string& path)
 		fm.setAlphabet(opt::alphabet);
 
 	fm.encode(bwt.begin(), bwt.end());
+	fm.setOccLayout(FMIndex::OccLayout(opt::occLayout));
 	fm.sampleSA(opt::sampleSA);
 	fm.assignBWT(bwt.begin(), bwt.end());
 }
@@ -163,6 +197,7 @@ static void buildFMIndex(FMIndex& fm, const string& path)
 			<< fm.alphabetSize() << " symbols.\n";
 	} else
 		fm.setAlphabet(opt::alphabet);
+	fm.setOccLayout(FMIndex::OccLayout(opt::occLayout));
 
 	if (opt::fa2bwt) {
 		// Build the BWT first.
@@ -170,6 +205,10 @@ static void buildFMIndex(FMIndex& fm, const string& path)
 		fm.buildBWT(s.begin(), s.end() - 1);
 		fm.sampleSA(opt::sampleSA);
 		fm.assignBWT(s.begin(), s.end());
+	} else if (opt::blockSize > 0) {
+		// Build the BWT in blocks.
+		fm.sampleSA(opt::sampleSA);
+		fm.assignBlockwise(s.begin(), s.end(), opt::blockSize);
 	} else {
 		// Construct the suffix array first.
 		fm.assign(s.begin(), s.end());
@@ -198,8 +237,10 @@ int main(int argc, char **argv)
 			case OPT_PROTEIN:
 				opt::alphabet = "#*ACDEFGHIKLMNPQRSTVWY";
 				break;
+			case 'b': opt::blockSize = SIToBytes(arg); break;
 			case 'c': opt::toStdout = true; break;
 			case 'd': opt::decompress = true; break;
+			case 'j': arg >> opt::threads; break;
 			case 's': arg >> opt::sampleSA; break;
 			case 'v': opt::verbose++; break;
 			case OPT_HELP:
@@ -226,12 +267,23 @@ int main(int argc, char **argv)
 		die = true;
 	}
 
+	if (opt::fa2bwt && opt::blockSize > 0) {
+		cerr << PROGRAM ": --fa2bwt and --block-size "
+			"may not be used together\n";
+		die = true;
+	}
+
 	if (die) {
 		cerr << "Try `" << PROGRAM
 			<< " --help' for more information.\n";
 		exit(EXIT_FAILURE);
 	}
 
+#if _OPENMP
+	if (opt::threads > 0)
+		omp_set_num_threads(opt::threads);
+#endif
+
 	if (opt::decompress) {
 		// Decompress the index.
 		string fmPath(argv[optind]);
@@ -240,12 +292,8 @@ int main(int argc, char **argv)
 			fmPath.append(".fm");
 		string faPath(fmPath, 0, fmPath.size() - 3);
 
-		ifstream in(fmPath.c_str());
-		assert_good(in, fmPath);
 		FMIndex fmIndex;
-		in >> fmIndex;
-		assert_good(in, fmPath);
-		in.close();
+		fmIndex.load(fmPath);
 
 		ofstream fout;
 		if (!opt::toStdout)
@@ -257,7 +305,7 @@ int main(int argc, char **argv)
 		out.flush();
 		assert_good(out, faPath);
 
-		in.open((faPath + ".fai").c_str());
+		ifstream in((faPath + ".fai").c_str());
 		FastaIndex faIndex;
 		if (in) {
 			in >> faIndex;
@@ -287,6 +335,10 @@ int main(int argc, char **argv)
 		cerr << "Read " << toSI(n) << "B. "
 			"Used " << toSI(bytes) << "B of memory and "
 				<< setprecision(3) << (float)bytes / n << " B/bp.\n";
+		cerr << "The suffix array sampled every " << fm.sampleSAPeriod()
+			<< " uses " << toSI(fm.saBytes()) << "B, and locating a "
+			"position takes " << fm.sampleSAPeriod() - 1 << " steps of the "
+			"LF mapping on average.\n";
 	}
 
 	string fmPath = opt::toStdout ? "-" : path + ".fm";
@@ -296,7 +348,10 @@ int main(int argc, char **argv)
 		fout.open(fmPath.c_str());
 	ostream& out = opt::toStdout ? cout : fout;
 	assert_good(out, fmPath);
-	out << fm;
+	if (opt::mmap)
+		fm.writeMapped(out);
+	else
+		out << fm;
 	out.flush();
 	assert_good(out, fmPath);
 
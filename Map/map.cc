@@ -1,11 +1,16 @@
+#include "BAM.h"
 #include "BitUtil.h"
+#include "BucketSorter.h"
 #include "DataLayer/Options.h"
 #include "FMIndex.h"
 #include "FastaIndex.h"
 #include "FastaInterleave.h"
 #include "FastaReader.h"
+#include "Gzip.h"
 #include "IOUtil.h"
 #include "MemoryUtil.h"
+#include "OrderedWriter.h"
+#include "ParallelFastaReader.h"
 #include "SAM.h"
 #include "StringUtil.h"
 #include "Uncompress.h"
@@ -19,7 +24,6 @@
 #include <iostream>
 #include <stdint.h>
 #include <utility>
-#include <queue>
 #if _OPENMP
 # include <omp.h>
 #endif
@@ -49,10 +53,24 @@ static const char USAGE_MESSAGE[] =
 "\n"
 "  -l, --min-align=N       find matches at least N bp [1]\n"
 "  -j, --threads=N         use N parallel threads [1]\n"
+"  -o, --out=FILE          write the alignments to FILE, in BAM format if\n"
+"                          FILE ends in .bam, and compressed with BGZF\n"
+"                          if FILE ends in .gz [stdout]\n"
+"      --sort              sort the alignments by position, as\n"
+"                          `samtools sort' does\n"
+"      --sort-memory=N     buffer N bytes of alignments in memory while\n"
+"                          sorting before using temporary files, and\n"
+"                          sort at most N bytes at a time, unless the\n"
+"                          alignments share one position [1G]\n"
 "  -C, --append-comment    append the FASTA/FASTQ comment to the SAM tags\n"
 "  -s, --sample=N          sample the suffix array [1]\n"
+"      --locate-cache=N    cache the positions located in a sampled\n"
+"                          suffix array using N bytes of memory [0]\n"
 "  -d, --dup               identify and print duplicate sequence\n"
 "                          IDs between QUERY and TARGET\n"
+"      --batch             search for a batch of queries in lockstep,\n"
+"                          which hides the latency of memory\n"
+"      --no-batch          search for one query at a time [default]\n"
 "      --order             print alignments in the same order as\n"
 "                          read from QUERY\n"
 "      --no-order          print alignments ASAP [default]\n"
@@ -91,6 +109,9 @@ namespace opt {
 	/** Sample the suffix array. */
 	static unsigned sampleSA;
 
+	/** The size of the cache of located positions. */
+	static size_t locateCache;
+
 	/** The number of parallel threads. */
 	static unsigned threads = 1;
 
@@ -112,6 +133,18 @@ namespace opt {
 	/** Ensure output order matches input order. */
 	static int order;
 
+	/** Search for a batch of queries in lockstep. */
+	static int batch;
+
+	/** Write the alignments to this file. */
+	static string outPath;
+
+	/** Sort the alignments by position. */
+	static int sort;
+
+	/** The memory used to buffer alignments while sorting. */
+	static size_t sortMemory = 1 << 30;
+
 	/** Verbose output. */
 	static int verbose;
 }
@@ -119,21 +152,28 @@ namespace opt {
 // for sqlite params
 static bool haveDbParam(false);
 
-static const char shortopts[] = "Cj:k:l:s:dv";
+static const char shortopts[] = "Cj:k:l:o:s:dv";
 
 enum { OPT_HELP = 1, OPT_VERSION,
 	OPT_ALPHA, OPT_DNA, OPT_PROTEIN,
 	OPT_DB, OPT_LIBRARY, OPT_STRAIN, OPT_SPECIES,
+	OPT_SORT_MEMORY, OPT_LOCATE_CACHE,
 };
 
 static const struct option longopts[] = {
 	{ "append-comment", no_argument, NULL, 'C' },
 	{ "sample", required_argument, NULL, 's' },
+	{ "locate-cache", required_argument, NULL, OPT_LOCATE_CACHE },
 	{ "min-align", required_argument, NULL, 'l' },
 	{ "dup", no_argument, NULL, 'd' },
 	{ "threads", required_argument, NULL, 'j' },
+	{ "batch", no_argument, &opt::batch, 1 },
+	{ "no-batch", no_argument, &opt::batch, 0 },
 	{ "order", no_argument, &opt::order, 1 },
 	{ "no-order", no_argument, &opt::order, 0 },
+	{ "out", required_argument, NULL, 'o' },
+	{ "sort", no_argument, &opt::sort, 1 },
+	{ "sort-memory", required_argument, NULL, OPT_SORT_MEMORY },
 	{ "multi", no_argument, &opt::multi, 1 },
 	{ "no-multi", no_argument, &opt::multi, 0 },
 	{ "SS", no_argument, &opt::ss, 1 },
@@ -166,8 +206,60 @@ static struct {
 	unsigned subunmapped;
 } g_count;
 
+/** The output stream and its name. */
+static ostream* g_out = &cout;
+static string g_outPath = "stdout";
+
+/** Whether the output is BAM. */
+static bool g_bam;
+
+/** Whether the output is compressed with BGZF. */
+static bool g_bgzf;
+
+/** The alignments that are sorted before being written, with --sort */
+static BucketSorter* g_sorter;
+
+/** The number of buckets by position of the sort */
+static const unsigned SORT_BUCKETS = 256;
+
+/** The alignments of a batch of queries. */
+struct Mappings
+{
+	/** The formatted alignments */
+	string data;
+
+	/** The sort key and the end in data of each alignment, with
+	 * --sort */
+	vector<pair<uint64_t, size_t> > records;
+
+	void clear()
+	{
+		data.clear();
+		records.clear();
+	}
+};
+
 typedef FMIndex::Match Match;
 
+/** Return the CIGAR string of a match of [qstart, qend) of a query
+ * of length qlength. */
+static string toCigar(unsigned qstart, unsigned qend, unsigned qlength)
+{
+	assert(qstart < qend);
+	string cigar;
+	if (qstart > 0) {
+		appendInt(cigar, qstart);
+		cigar += 'S';
+	}
+	appendInt(cigar, qend - qstart);
+	cigar += 'M';
+	if (qend < qlength) {
+		appendInt(cigar, qlength - qend);
+		cigar += 'S';
+	}
+	return cigar;
+}
+
 #if SAM_SEQ_QUAL
 static string toXA(const FastaIndex& faIndex,
 		const FMIndex& fmIndex, const Match& m, bool rc,
@@ -176,40 +268,31 @@ static string toXA(const FastaIndex& faIndex,
 	if (m.size() == 0)
 		return "";
 	FastaIndex::SeqPos seqPos = faIndex[fmIndex[m.l]];
-	string rname = seqPos.get<0>().id;
-	int pos = seqPos.get<1>() + 1;
-
-	// Set the mapq to the alignment score.
-	assert(m.qstart < m.qend);
-	unsigned matches = m.qend - m.qstart;
-
 	unsigned qstart = seq_start + m.qstart;
 	unsigned qend = m.qend + seq_start;
 	unsigned short flag = rc ? SAMAlignment::FREVERSE : 0;
 
-	ostringstream ss;
-	if (qstart > 0)
-		ss << qstart << 'S';
-	ss << matches << 'M';
-	if (qend < qlength)
-		ss << qlength - qend << 'S';
-	string cigar = ss.str();
-
-	stringstream xa_tag;
-	xa_tag << rname << ',' << pos << ',' << cigar << ",0," << flag;
-
-	return xa_tag.str();
+	string xa_tag = seqPos.get<0>().id;
+	xa_tag += ',';
+	appendInt(xa_tag, seqPos.get<1>() + 1);
+	xa_tag += ',';
+	xa_tag += toCigar(qstart, qend, qlength);
+	xa_tag += ",0,";
+	appendInt(xa_tag, flag);
+	return xa_tag;
 }
 #endif
 
-/** Return a SAM record of the specified match. */
+/** Return a SAM record of the specified match, and set tid to the
+ * index of its target, or -1 if none. */
 static SAMRecord toSAM(const FastaIndex& faIndex,
 		const FMIndex& fmIndex, const Match& m, bool rc,
-		unsigned qlength)
+		unsigned qlength, int& tid)
 {
 	SAMRecord a;
 	if (m.size() == 0) {
 		// No hit.
+		tid = -1;
 		a.rname = "*";
 		a.pos = -1;
 		a.flag = SAMAlignment::FUNMAP;
@@ -217,6 +300,7 @@ static SAMRecord toSAM(const FastaIndex& faIndex,
 		a.cigar = "*";
 	} else {
 		FastaIndex::SeqPos seqPos = faIndex[fmIndex[m.l]];
+		tid = &seqPos.get<0>() - &*faIndex.begin();
 		a.rname = seqPos.get<0>().id;
 		a.pos = seqPos.get<1>();
 		a.flag = rc ? SAMAlignment::FREVERSE : 0;
@@ -226,14 +310,7 @@ static SAMRecord toSAM(const FastaIndex& faIndex,
 		unsigned matches = m.qend - m.qstart;
 		assert (m.num != 0);
 		a.mapq = m.size() > 1 || m.num > 1 ? 0 : min(matches, 254U);
-
-		ostringstream ss;
-		if (m.qstart > 0)
-			ss << m.qstart << 'S';
-		ss << matches << 'M';
-		if (m.qend < qlength)
-			ss << qlength - m.qend << 'S';
-		a.cigar = ss.str();
+		a.cigar = toCigar(m.qstart, m.qend, qlength);
 	}
 	a.mrnm = "*";
 	a.mpos = -1;
@@ -278,11 +355,11 @@ static size_t getMaxLen(const Match& m, const FastaIndex& faIndex,
 	return maxLen;
 }
 
-/** Print the current contig id if it is not the lartest and earliest
- * contig in m. */
+/** Print the current contig id to out if it is not the lartest and
+ * earliest contig in m. */
 static void printDuplicates(const Match& m, const Match& rcm,
 		const FastaIndex& faIndex, const FMIndex& fmIndex,
-		const FastqRecord& rec)
+		const FastqRecord& rec, Mappings& out)
 {
 	size_t myLen = m.qspan();
 	size_t maxLen;
@@ -294,11 +371,8 @@ static void printDuplicates(const Match& m, const Match& rcm,
 	if (myLen < maxLen) {
 #pragma omp atomic
 		g_count.multimapped++;
-#pragma omp critical(cout)
-		{
-			cout << rec.id << '\n';
-			assert_good(cout, "stdout");
-		}
+		out.data += rec.id;
+		out.data += '\n';
 		return;
 	}
 	size_t myPos = getMyPos(m, faIndex, fmIndex, rec.id);
@@ -311,11 +385,8 @@ static void printDuplicates(const Match& m, const Match& rcm,
 	if (myPos > minPos) {
 #pragma omp atomic
 		g_count.multimapped++;
-#pragma omp critical(cout)
-		{
-			cout << rec.id << '\n';
-			assert_good(cout, "stdout");
-		}
+		out.data += rec.id;
+		out.data += '\n';
 	}
 #pragma omp atomic
 	g_count.unique++;
@@ -340,23 +411,83 @@ pair<Match, Match> findMatch(const FMIndex& fmIndex, const string& seq)
 	return make_pair(m, rcm);
 }
 
-static queue<string> g_pq;
+/** Find the matches of a batch of sequences and their reverse
+ * complements, as findMatch does. */
+static void findMatches(const FMIndex& fmIndex,
+		const vector<FastqRecord>& batch,
+		vector<Match>& m, vector<Match>& rcm)
+{
+	vector<string> seqs;
+	vector<unsigned> minLen;
+	seqs.reserve(batch.size());
+	minLen.reserve(batch.size());
+	for (vector<FastqRecord>::const_iterator it = batch.begin();
+			it != batch.end(); ++it) {
+		seqs.push_back(it->seq);
+		minLen.push_back(opt::dup ? it->seq.length() : opt::k);
+	}
+	fmIndex.findBatch(seqs, minLen, m);
+	if (opt::norc) {
+		rcm.assign(batch.size(), Match());
+		return;
+	}
 
-/** Return the mapping of the specified sequence. */
-static void find(const FastaIndex& faIndex, const FMIndex& fmIndex,
-		const FastqRecord& rec)
+	for (size_t i = 0; i < seqs.size(); ++i) {
+		seqs[i] = reverseComplement(seqs[i]);
+		if (!opt::dup && !opt::ss)
+			minLen[i] = m[i].qspan();
+	}
+	fmIndex.findBatch(seqs, minLen, rcm);
+}
+
+/** Check that the specified sequence is not empty. */
+static void checkSequence(const FastqRecord& rec)
 {
 	if (rec.seq.empty()) {
 		cerr << PROGRAM ": error: "
 			"the sequence `" << rec.id << "' is empty\n";
 		exit(EXIT_FAILURE);
 	}
+}
+
+/** Append an alignment and its optional fields, which are separated
+ * by tabs, to out in the output format. */
+static void append(const FastaIndex& faIndex, const SAMRecord& sam,
+		int tid, const string& tags, Mappings& out)
+{
+	if (g_bam) {
+		// The mate fields of the alignments of abyss-map are empty.
+		if (!appendBAM(out.data, sam, tid, -1, tags)) {
+			cerr << PROGRAM ": error: the alignment of `" << sam.qname
+				<< "' cannot be encoded as BAM, since its name or "
+				"its tags `" << tags << "' are invalid\n";
+			exit(EXIT_FAILURE);
+		}
+	} else {
+		sam.appendTo(out.data);
+		if (!tags.empty()) {
+			out.data += '\t';
+			out.data += tags;
+		}
+		out.data += '\n';
+	}
 
-	Match m, rcm;
-	tie(m, rcm) = findMatch(fmIndex, rec.seq);
+	if (opt::sort) {
+		// The key is the offset of the alignment in the FASTA file,
+		// which orders the alignments by target and position.
+		uint64_t key = tid < 0 ? BucketSorter::NO_KEY
+			: faIndex.begin()[tid].offset + sam.pos;
+		out.records.push_back(make_pair(key, out.data.size()));
+	}
+}
 
+/** Print the mapping of the specified sequence to out, whose matches
+ * and those of its reverse complement are m and rcm. */
+static void find(const FastaIndex& faIndex, const FMIndex& fmIndex,
+		const FastqRecord& rec, Match m, Match rcm, Mappings& out)
+{
 	if (opt::dup) {
-		printDuplicates(m, rcm, faIndex, fmIndex, rec);
+		printDuplicates(m, rcm, faIndex, fmIndex, rec, out);
 		return;
 	}
 
@@ -413,8 +544,9 @@ static void find(const FastaIndex& faIndex, const FMIndex& fmIndex,
 	}
 #endif
 
+	int tid;
 	SAMRecord sam = toSAM(faIndex, fmIndex, mm, rc,
-			rec.seq.size());
+			rec.seq.size(), tid);
 	if (rec.id[0] == '@') {
 		cerr << PROGRAM ": error: "
 			"the query ID `" << rec.id << "' is invalid since it "
@@ -430,38 +562,26 @@ static void find(const FastaIndex& faIndex, const FMIndex& fmIndex,
 		reverse(sam.qual.begin(), sam.qual.end());
 #endif
 
-	bool print = opt::order == 0;
-	do {
-#pragma omp critical(cout)
-		{
-#pragma omp critical(g_pq)
-			if (!print) {
-				print = g_pq.front() == rec.id;
-				if (print)
-					g_pq.pop();
-			}
-			if (print) {
-				cout << sam;
-				if (opt::appendComment && !rec.comment.empty()) {
-					// Output the FASTQ comment, which should be formatted as SAM tags.
-					cout << '\t' << rec.comment;
-				} else if (startsWith(rec.comment, "BX:Z:")) {
-					// Output the BX tag if it's the first tag.
-					size_t i = rec.comment.find_first_of("\t ");
-					if (i == string::npos)
-						i = rec.comment.size();
-					cout << '\t';
-					cout.write(rec.comment.data(), i);
-				}
+	string tags;
+	if (opt::appendComment && !rec.comment.empty()) {
+		// Output the FASTQ comment, which should be formatted as SAM tags.
+		tags = rec.comment;
+	} else if (startsWith(rec.comment, "BX:Z:")) {
+		// Output the BX tag if it's the first tag.
+		size_t i = rec.comment.find_first_of("\t ");
+		if (i == string::npos)
+			i = rec.comment.size();
+		tags.assign(rec.comment, 0, i);
+	}
 #if SAM_SEQ_QUAL
-				if (alts.size() > 0)
-					cout << "\tXA:Z:" << join(alts, ";");
+	if (alts.size() > 0) {
+		if (!tags.empty())
+			tags += '\t';
+		tags += "XA:Z:";
+		tags += join(alts, ";");
+	}
 #endif
-				cout << '\n';
-				assert_good(cout, "stdout");
-			}
-		}
-	} while (!print); // spinlock :(
+	append(faIndex, sam, tid, tags, out);
 
 	if (sam.isUnmapped())
 #pragma omp atomic
@@ -474,25 +594,159 @@ static void find(const FastaIndex& faIndex, const FMIndex& fmIndex,
 		g_count.unique++;
 }
 
-/** Map the sequences of the specified file. */
+/** Print the mappings of the specified batch of sequences to out. */
+static void find(const FastaIndex& faIndex, const FMIndex& fmIndex,
+		const vector<FastqRecord>& batch, Mappings& out)
+{
+	for_each(batch.begin(), batch.end(), checkSequence);
+	vector<Match> m, rcm;
+	if (opt::batch) {
+		findMatches(fmIndex, batch, m, rcm);
+	} else {
+		m.resize(batch.size());
+		rcm.resize(batch.size());
+		for (size_t i = 0; i < batch.size(); ++i)
+			tie(m[i], rcm[i]) = findMatch(fmIndex, batch[i].seq);
+	}
+	for (size_t i = 0; i < batch.size(); ++i)
+		find(faIndex, fmIndex, batch[i], m[i], rcm[i], out);
+}
+
+/** Write data to the output. */
+static void writeData(const string& data)
+{
+	g_out->write(data.data(), data.size());
+	assert_good(*g_out, g_outPath);
+}
+
+/** Compress data with BGZF, if the output is compressed. */
+static void compress(string& data)
+{
+	if (!g_bgzf || data.empty())
+		return;
+	string out;
+	bgzfCompress(data.data(), data.size(), out);
+	data.swap(out);
+}
+
+/** Write the mappings of a batch to the output. */
+static void write(const string& out)
+{
+#pragma omp critical(out)
+	writeData(out);
+}
+
+/** Add the mappings of the batch with the specified index to the
+ * sort. Its alignments are ordered by the index of the batch and
+ * their index within the batch, so that the output is the same for
+ * any number of threads. */
+static void addToSort(size_t index, const Mappings& out)
+{
+	assert(g_sorter != NULL);
+#pragma omp critical(out)
+	for (size_t i = 0, start = 0; i < out.records.size(); ++i) {
+		size_t end = out.records[i].second;
+		g_sorter->add(out.records[i].first, (uint64_t)index << 32 | i,
+				out.data.data() + start, end - start);
+		start = end;
+	}
+}
+
+/** Write the sorted alignments, and compress each sorted chunk with
+ * BGZF in parallel. */
+static void writeSorted()
+{
+	static const size_t SLICE_SIZE = 16 * BGZF_BLOCK_SIZE;
+	string data;
+	vector<string> slices;
+	while (g_sorter->read(data)) {
+		if (!g_bgzf) {
+			writeData(data);
+			continue;
+		}
+		ptrdiff_t n = (data.size() + SLICE_SIZE - 1) / SLICE_SIZE;
+		slices.assign(n, string());
+#pragma omp parallel for
+		for (ptrdiff_t i = 0; i < n; ++i)
+			bgzfCompress(data.data() + i * SLICE_SIZE,
+					min(SLICE_SIZE, data.size() - i * SLICE_SIZE),
+					slices[i]);
+		for_each(slices.begin(), slices.end(), writeData);
+	}
+}
+
+/** The number of bases of a batch of queries */
+static const size_t BATCH_SIZE = 100000;
+
+/** Map the sequences of the specified files. With --order, the
+ * batches, which the threads complete out of order, are written in
+ * their input order. */
 static void find(const FastaIndex& faIndex, const FMIndex& fmIndex,
 		FastaInterleave& in)
 {
+	OrderedWriter writer(*g_out);
+	size_t nextBatch = 0;
+
 #pragma omp parallel
-	for (FastqRecord rec;;) {
-		bool good;
+	{
+		vector<FastqRecord> batch;
+		Mappings out;
+		for (;;) {
+			size_t index;
+			batch.clear();
 #pragma omp critical(in)
-		{
-			good = in >> rec;
-			if (opt::order) {
-#pragma omp critical(g_pq)
-				g_pq.push(rec.id);
+			{
+				for (size_t bases = 0; bases < BATCH_SIZE;) {
+					batch.push_back(FastqRecord());
+					if (!(in >> batch.back())) {
+						batch.pop_back();
+						break;
+					}
+					bases += batch.back().seq.size();
+				}
+				index = nextBatch++;
+			}
+			if (batch.empty())
+				break;
+
+			out.clear();
+			find(faIndex, fmIndex, batch, out);
+			if (opt::sort) {
+				addToSort(index, out);
+				continue;
+			}
+			compress(out.data);
+			if (!opt::order) {
+				write(out.data);
+				continue;
+			}
+#pragma omp critical(out)
+			{
+				writer.write(index, out.data);
+				assert_good(*g_out, g_outPath);
 			}
 		}
-		if (good)
-			find(faIndex, fmIndex, rec);
-		else
-			break;
+	}
+	assert(in.eof());
+	assert(writer.pending() == 0);
+}
+
+/** Map the sequences of the specified file, whose partitions are
+ * read by the threads in parallel. */
+static void find(const FastaIndex& faIndex, const FMIndex& fmIndex,
+		ParallelFastaReader& in)
+{
+	assert(!opt::order && !opt::sort);
+#pragma omp parallel
+	{
+		vector<FastqRecord> batch;
+		Mappings out;
+		while (in.readBatch(batch, BATCH_SIZE) > 0) {
+			out.clear();
+			find(faIndex, fmIndex, batch, out);
+			compress(out.data);
+			write(out.data);
+		}
 	}
 	assert(in.eof());
 }
@@ -577,6 +831,13 @@ int main(int argc, char** argv)
 			case '?': die = true; break;
 			case 'C': opt::appendComment = 1; break;
 			case 'j': arg >> opt::threads; break;
+			case 'o': arg >> opt::outPath; break;
+			case OPT_SORT_MEMORY:
+				opt::sortMemory = SIToBytes(arg);
+				break;
+			case OPT_LOCATE_CACHE:
+				opt::locateCache = SIToBytes(arg);
+				break;
 			case 'k': case 'l':
 				arg >> opt::k;
 				break;
@@ -638,6 +899,12 @@ int main(int argc, char** argv)
 		die = true;
 	}
 
+	if (opt::dup && (opt::sort || endsWith(opt::outPath, ".bam"))) {
+		cerr << PROGRAM ": --dup does not print alignments, which "
+			"may not be sorted or written as BAM\n";
+		die = true;
+	}
+
 	if (argc - optind < 2) {
 		cerr << PROGRAM ": missing arguments\n";
 		die = true;
@@ -700,16 +967,15 @@ int main(int argc, char** argv)
 	FMIndex fmIndex;
 	in.open(fmPath.c_str());
 	if (in) {
+		in.close();
 		if (opt::verbose > 0)
 			cerr << "Reading `" << fmPath << "'...\n";
-		assert_good(in, fmPath);
-		in >> fmIndex;
-		assert_good(in, fmPath);
-		in.close();
+		fmIndex.load(fmPath);
 	} else
 		buildFMIndex(fmIndex, targetFile);
 	if (opt::sampleSA > 1)
 		fmIndex.sampleSA(opt::sampleSA);
+	fmIndex.setLocateCache(opt::locateCache);
 
 	if (opt::verbose > 0) {
 		size_t bp = fmIndex.size();
@@ -719,6 +985,13 @@ int main(int argc, char** argv)
 		if (bytes > 0)
 			cerr << "Using " << toSI(bytes) << "B of memory and "
 				<< setprecision(3) << (float)bytes / bp << " B/bp.\n";
+		cerr << "The suffix array sampled every "
+			<< fmIndex.sampleSAPeriod() << " uses "
+			<< toSI(fmIndex.saBytes()) << "B";
+		if (fmIndex.locateCache() != NULL)
+			cerr << ", and the locate cache uses "
+				<< toSI(fmIndex.locateCache()->bytes()) << "B";
+		cerr << ".\n";
 	}
 
 	if (!opt::db.empty())
@@ -727,20 +1000,88 @@ int main(int argc, char** argv)
 	// Check that the indexes are up to date.
 	checkIndexes(targetFile, fmIndex, faIndex);
 
+	ofstream outFile;
+	if (!opt::outPath.empty()) {
+		outFile.open(opt::outPath.c_str(), ios::binary);
+		assert_good(outFile, opt::outPath);
+		g_out = &outFile;
+		g_outPath = opt::outPath;
+		g_bam = endsWith(opt::outPath, ".bam");
+		g_bgzf = g_bam || endsWith(opt::outPath, ".gz");
+	}
+
 	if (!opt::dup) {
 		// Write the SAM header.
-		cout << "@HD\tVN:1.4\n"
+		ostringstream text;
+		text << "@HD\tVN:1.4" << (opt::sort ? "\tSO:coordinate" : "")
+			<< "\n"
 			"@PG\tID:" PROGRAM "\tPN:" PROGRAM "\tVN:" VERSION "\t"
 			"CL:" << commandLine << '\n';
-		faIndex.writeSAMHeader(cout);
-		cout.flush();
-		assert_good(cout, "stdout");
+		faIndex.writeSAMHeader(text);
+		string header = text.str();
+		if (g_bam) {
+			vector<string> names;
+			vector<uint32_t> lengths;
+			for (FastaIndex::const_iterator it = faIndex.begin();
+					it != faIndex.end(); ++it) {
+				names.push_back(it->id);
+				lengths.push_back(it->size);
+			}
+			header.clear();
+			appendBAMHeader(header, text.str(), names, lengths);
+		}
+		compress(header);
+		writeData(header);
+		g_out->flush();
+		assert_good(*g_out, g_outPath);
 	} else if (opt::verbose > 0)
 		cerr << "Identifying duplicates.\n";
 
-	FastaInterleave fa(argv + optind, argv + argc,
-			FastaReader::FOLD_CASE);
-	find(faIndex, fmIndex, fa);
+	if (opt::sort)
+		g_sorter = new BucketSorter(faIndex.fileSize(), SORT_BUCKETS,
+				opt::sortMemory);
+
+	if (argc - optind == 1 && !opt::order && !opt::sort) {
+		// The records of a single file need not be interleaved, so
+		// the threads read its partitions in parallel.
+#if _OPENMP
+		unsigned threads = omp_get_max_threads();
+#else
+		unsigned threads = 1;
+#endif
+		ParallelFastaReader fa(argv[optind], FastaReader::FOLD_CASE,
+				threads);
+		find(faIndex, fmIndex, fa);
+	} else {
+		FastaInterleave fa(argv + optind, argv + argc,
+				FastaReader::FOLD_CASE);
+		find(faIndex, fmIndex, fa);
+	}
+
+	if (opt::sort) {
+		if (opt::verbose > 0)
+			cerr << "Sorting the alignments, which were written to "
+				"temporary files " << g_sorter->spills() << " times.\n";
+		writeSorted();
+		delete g_sorter;
+		g_sorter = NULL;
+	}
+	if (g_bgzf)
+		writeData(bgzfEOF());
+
+	LocateCache::Stats locateStats;
+	if (fmIndex.locateCache() != NULL)
+		locateStats = fmIndex.locateCache()->stats();
+	if (opt::verbose > 0 && locateStats.locates > 0) {
+		const LocateCache::Stats& stats = locateStats;
+		cerr << "Located " << stats.locates << " positions in "
+			<< setprecision(3) << (float)stats.steps / stats.locates
+			<< " steps each on average, rather than "
+			<< fmIndex.sampleSAPeriod() - 1 << " without the cache. "
+			<< stats.hits << " ("
+			<< (float)100 * stats.hits / stats.locates
+			<< "%) were found in the cache.\n";
+	}
 
 	if (opt::verbose > 0) {
 		size_t unique = g_count.unique;
@@ -770,7 +1111,11 @@ int main(int argc, char** argv)
 		}
 	}
 
-	cout.flush();
-	assert_good(cout, "stdout");
+	g_out->flush();
+	assert_good(*g_out, g_outPath);
+	if (outFile.is_open()) {
+		outFile.close();
+		assert_good(outFile, opt::outPath);
+	}
 	return 0;
 }
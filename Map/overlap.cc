@@ -58,6 +58,10 @@ static const char USAGE_MESSAGE[] =
 "  -k, --max=N             find matches less than N bp [inf]\n"
 "  -j, --threads=N         use N parallel threads [1]\n"
 "  -s, --sample=N          sample the suffix array [1]\n"
+"      --batch             search for the overlaps of a batch of\n"
+"                          contigs in lockstep\n"
+"      --no-batch          search for the overlaps of one contig at\n"
+"                          a time [default]\n"
 "      --tred              remove transitive edges [default]\n"
 "      --no-tred           do not remove transitive edges\n"
 "      --adj             output the results in adj format\n"
@@ -81,6 +85,9 @@ namespace opt {
 	/** Sample the suffix array. */
 	static unsigned sampleSA;
 
+	/** Search for the overlaps of a batch of contigs in lockstep. */
+	static int batch;
+
 	/** Run a strand-specific overlaping algorithm. */
 	static int ss;
 
@@ -103,6 +110,8 @@ enum { OPT_HELP = 1, OPT_VERSION };
 
 static const struct option longopts[] = {
 	{ "adj", no_argument, &opt::format, ADJ },
+	{ "batch", no_argument, &opt::batch, 1 },
+	{ "no-batch", no_argument, &opt::batch, 0 },
 	{ "dot", no_argument, &opt::format, DOT },
 	{ "sam", no_argument, &opt::format, SAM },
 	{ "help", no_argument, NULL, OPT_HELP },
@@ -125,13 +134,29 @@ typedef ContigGraph<DG> Graph;
 
 typedef FMIndex::Match Match;
 
-/** Add suffix overlaps to the graph. */
-static void addSuffixOverlaps(Graph &g,
+/** An overlap found by the search of a batch of contigs. */
+struct Overlap
+{
+	typedef graph_traits<Graph>::vertex_descriptor V;
+	V u, v;
+	Distance ep;
+	/** Whether to add the complementary edge as well */
+	bool both;
+
+	Overlap(V u, V v, Distance ep, bool both)
+		: u(u), v(v), ep(ep), both(both) { }
+};
+
+typedef vector<Overlap> Overlaps;
+
+/** The number of contigs of a batch. */
+static const unsigned BATCH_SIZE = 256;
+
+/** Add suffix overlaps to the list of overlaps. */
+static void addSuffixOverlaps(Overlaps& overlaps, const Graph& g,
 		const FastaIndex& faIndex, const FMIndex& fmIndex,
 		const ContigNode& u, const Match& fmi)
 {
-	typedef edge_property<Graph>::type EP;
-	typedef graph_traits<Graph>::edge_descriptor E;
 	typedef graph_traits<Graph>::vertex_descriptor V;
 
 	Distance ep(-fmi.qspan());
@@ -149,34 +174,16 @@ static void addSuffixOverlaps(Graph &g,
 			continue;
 		}
 		V v = find_vertex(tseq.id, false, g);
-#pragma omp critical(g)
-		{
-			pair<E, bool> e = edge(u, v, g);
-			if (e.second) {
-				const EP& ep0 = g[e.first];
-				if (opt::verbose > 1)
-					cerr << "duplicate edge: "
-						<< get(edge_name, g, e.first) << ' '
-						<< ep0 << ' ' << ep << '\n';
-				assert(ep0.distance < ep.distance);
-			} else if(u.sense()) {
-				// Add u- -> v+
-				add_edge(u, v, ep, static_cast<DG&>(g));
-			} else {
-				// Add u+ -> v+ and v- -> u-
-				add_edge(u, v, ep, g);
-			}
-		}
+		// Add u- -> v+, or add u+ -> v+ and v- -> u-
+		overlaps.push_back(Overlap(u, v, ep, !u.sense()));
 	}
 }
 
-/** Add prefix overlaps to the graph. */
-static void addPrefixOverlaps(Graph &g,
+/** Add prefix overlaps to the list of overlaps. */
+static void addPrefixOverlaps(Overlaps& overlaps, const Graph& g,
 		const FastaIndex& faIndex, const FMIndex& fmIndex,
 		const ContigNode& v, const Match& fmi)
 {
-	typedef edge_property<Graph>::type EP;
-	typedef graph_traits<Graph>::edge_descriptor E;
 	typedef graph_traits<Graph>::vertex_descriptor V;
 
 	assert(v.sense());
@@ -195,94 +202,155 @@ static void addPrefixOverlaps(Graph &g,
 			continue;
 		}
 		V u = find_vertex(tseq.id, false, g);
-#pragma omp critical(g)
-		{
-			pair<E, bool> e = edge(u, v, g);
-			if (e.second) {
-				const EP& ep0 = g[e.first];
-				if (opt::verbose > 1)
-					cerr << "duplicate edge: "
-						<< get(edge_name, g, e.first) << ' '
-						<< ep0 << ' ' << ep << '\n';
-				assert(ep0.distance < ep.distance);
-			} else {
-				// Add u+ -> v-
-				add_edge(u, v, ep, static_cast<DG&>(g));
-			}
-		}
+		// Add u+ -> v-
+		overlaps.push_back(Overlap(u, v, ep, false));
 	}
 }
 
-/** Find suffix overlaps. */
-static void findOverlapsSuffix(Graph &g,
-		const FastaIndex& faIndex, const FMIndex& fmIndex,
-		const ContigNode& u, const string& seq)
+/** Add the overlaps to the graph. */
+static void addOverlaps(Graph& g, const Overlaps& overlaps)
 {
-	size_t pos = seq.size() > opt::maxOverlap
-		? seq.size() - opt::maxOverlap + 1 : 1;
-	string suffix(seq, pos);
-	typedef vector<Match> Matches;
-	Matches matches;
-	fmIndex.findOverlapSuffix(suffix, back_inserter(matches),
-			opt::minOverlap);
+	typedef edge_property<Graph>::type EP;
+	typedef graph_traits<Graph>::edge_descriptor E;
 
-	for (Matches::reverse_iterator it = matches.rbegin();
-			!(it == matches.rend()); ++it)
-		addSuffixOverlaps(g, faIndex, fmIndex, u, *it);
+	for (Overlaps::const_iterator it = overlaps.begin();
+			it != overlaps.end(); ++it) {
+		pair<E, bool> e = edge(it->u, it->v, g);
+		if (e.second) {
+			const EP& ep0 = g[e.first];
+			if (opt::verbose > 1)
+				cerr << "duplicate edge: "
+					<< get(edge_name, g, e.first) << ' '
+					<< ep0 << ' ' << it->ep << '\n';
+			assert(ep0.distance < it->ep.distance);
+		} else if (it->both)
+			add_edge(it->u, it->v, it->ep, g);
+		else
+			add_edge(it->u, it->v, it->ep, static_cast<DG&>(g));
+	}
 }
 
-/** Find prefix overlaps. */
-static void findOverlapsPrefix(Graph &g,
+/** Find the overlaps of a batch of contigs. With --batch, the
+ * suffixes and the prefixes of all the contigs of the batch are
+ * searched in lockstep. The overlaps are listed in the order of the
+ * contigs, and the overlaps of each search from longest to shortest. */
+static void findOverlaps(const Graph& g,
 		const FastaIndex& faIndex, const FMIndex& fmIndex,
-		const ContigNode& v, const string& seq)
+		const vector<FastqRecord>& recs, Overlaps& overlaps)
 {
-	assert(v.sense());
-	string prefix(seq, 0,
-			min((size_t)opt::maxOverlap, seq.size()) - 1);
-	typedef vector<Match> Matches;
-	Matches matches;
-	fmIndex.findOverlapPrefix(prefix, back_inserter(matches),
-			opt::minOverlap);
+	typedef graph_traits<Graph>::vertex_descriptor V;
 
-	for (Matches::reverse_iterator it = matches.rbegin();
-			!(it == matches.rend()); ++it)
-		addPrefixOverlaps(g, faIndex, fmIndex, v, *it);
-}
+	vector<string> queries;
+	vector<bool> prefix;
+	vector<V> nodes;
+	for (vector<FastqRecord>::const_iterator it = recs.begin();
+			it != recs.end(); ++it) {
+		const string& seq = it->seq;
+		V u = find_vertex(it->id, false, g);
+		V uc = get(vertex_complement, g, u);
+
+		// Add edges u+ -> v+ and v- -> u-
+		size_t pos = seq.size() > opt::maxOverlap
+			? seq.size() - opt::maxOverlap + 1 : 1;
+		queries.push_back(string(seq, min(pos, seq.size())));
+		prefix.push_back(false);
+		nodes.push_back(u);
+		if (opt::ss)
+			continue;
 
-static void findOverlaps(Graph& g,
-		const FastaIndex& faIndex, const FMIndex& fmIndex,
-		const FastqRecord& rec)
-{
-	typedef graph_traits<Graph>::vertex_descriptor V;
-	V u = find_vertex(rec.id, false, g);
-	V uc = get(vertex_complement, g, u);
-	// Add edges u+ -> v+ and v- -> u-
-	findOverlapsSuffix(g, faIndex, fmIndex, u, rec.seq);
-	if (!opt::ss) {
-		string rcseq = reverseComplement(rec.seq);
+		string rcseq = reverseComplement(seq);
 		// Add edges u- -> v+
-		findOverlapsSuffix(g, faIndex, fmIndex, uc, rcseq);
+		queries.push_back(string(rcseq, min(pos, rcseq.size())));
+		prefix.push_back(false);
+		nodes.push_back(uc);
 		// Add edges v+ -> u-
-		findOverlapsPrefix(g, faIndex, fmIndex, uc, rcseq);
+		queries.push_back(string(rcseq, 0,
+				min((size_t)opt::maxOverlap, rcseq.size()) - 1));
+		prefix.push_back(true);
+		nodes.push_back(uc);
+	}
+
+	typedef vector<Match> Matches;
+	vector<Matches> matches;
+	if (opt::batch) {
+		fmIndex.findOverlapBatch(queries, prefix, opt::minOverlap,
+				matches);
+	} else {
+		matches.resize(queries.size());
+		for (size_t i = 0; i < queries.size(); ++i) {
+			if (queries[i].empty())
+				continue;
+			if (prefix[i])
+				fmIndex.findOverlapPrefix(queries[i],
+						back_inserter(matches[i]), opt::minOverlap);
+			else
+				fmIndex.findOverlapSuffix(queries[i],
+						back_inserter(matches[i]), opt::minOverlap);
+		}
+	}
+
+	for (size_t i = 0; i < queries.size(); ++i) {
+		for (Matches::reverse_iterator it = matches[i].rbegin();
+				!(it == matches[i].rend()); ++it) {
+			if (prefix[i])
+				addPrefixOverlaps(overlaps, g,
+						faIndex, fmIndex, nodes[i], *it);
+			else
+				addSuffixOverlaps(overlaps, g,
+						faIndex, fmIndex, nodes[i], *it);
+		}
 	}
 }
 
-/** Map the sequences of the specified file. */
+/** Find the overlaps of the sequences of the specified file and add
+ * them to the graph. Each thread searches batches of contigs and
+ * lists their overlaps. The lists are added to the graph in the order
+ * of the batches once all are searched, so that the graph does not
+ * depend on the number of threads. */
 static void findOverlaps(Graph& g,
 		const FastaIndex& faIndex, const FMIndex& fmIndex,
 		FastaReader& in)
 {
+	typedef vector<pair<size_t, Overlaps> > Batches;
+	Batches batches;
+	size_t numBatches = 0;
 #pragma omp parallel
-	for (FastqRecord rec;;) {
-		bool good;
+	{
+		Batches local;
+		for (vector<FastqRecord> recs;;) {
+			size_t n;
+			recs.clear();
 #pragma omp critical(in)
-		good = in >> rec;
-		if (good)
-			findOverlaps(g, faIndex, fmIndex, rec);
-		else
-			break;
+			{
+				n = numBatches++;
+				for (FastqRecord rec;
+						recs.size() < BATCH_SIZE && in >> rec;)
+					recs.push_back(rec);
+			}
+			if (recs.empty())
+				break;
+			local.push_back(make_pair(n, Overlaps()));
+			findOverlaps(g, faIndex, fmIndex, recs,
+					local.back().second);
+		}
+#pragma omp critical(batches)
+		for (Batches::iterator it = local.begin();
+				it != local.end(); ++it) {
+			batches.push_back(make_pair(it->first, Overlaps()));
+			batches.back().second.swap(it->second);
+		}
 	}
 	assert(in.eof());
+
+	vector<Overlaps> overlaps(numBatches);
+	for (Batches::iterator it = batches.begin();
+			it != batches.end(); ++it)
+		overlaps[it->first].swap(it->second);
+	for (vector<Overlaps>::iterator it = overlaps.begin();
+			it != overlaps.end(); ++it) {
+		addOverlaps(g, *it);
+		Overlaps().swap(*it);
+	}
 }
 
 /** Build an FM index of the specified file. */
@@ -454,12 +522,10 @@ int main(int argc, char** argv)
 	FMIndex fmIndex;
 	in.open(fmPath.c_str());
 	if (in) {
+		in.close();
 		if (opt::verbose > 0)
 			cerr << "Reading `" << fmPath << "'...\n";
-		assert_good(in, fmPath);
-		in >> fmIndex;
-		assert_good(in, fmPath);
-		in.close();
+		fmIndex.load(fmPath);
 	} else
 		buildFMIndex(fmIndex, fastaFile);
 	if (opt::sampleSA > 1)
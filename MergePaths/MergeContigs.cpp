@@ -1,12 +1,13 @@
+#include "Common/BufferedWriter.h"
 #include "Common/Options.h"
 #include "ContigNode.h"
 #include "ContigPath.h"
 #include "ContigProperties.h"
 #include "DataBase/DB.h"
 #include "DataBase/Options.h"
+#include "DataLayer/ContigStore.h"
 #include "DataLayer/Options.h"
 #include "Dictionary.h"
-#include "FastaReader.h"
 #include "Graph/ContigGraph.h"
 #include "Graph/ContigGraphAlgorithms.h"
 #include "Graph/DirectedGraph.h"
@@ -142,16 +143,12 @@ struct Contig
 	  : comment(comment)
 	  , seq(seq)
 	{}
-	Contig(const FastaRecord& o)
-	  : comment(o.comment)
-	  , seq(o.seq)
-	{}
 	string comment;
 	string seq;
 };
 
 /** The contig sequences. */
-typedef vector<Contig> Contigs;
+typedef ContigStore Contigs;
 
 /** Return the sequence of the specified contig node. The sequence
  * may be ambiguous or reverse complemented.
@@ -165,7 +162,7 @@ sequence(const Contigs& contigs, const ContigNode& id)
 			transform(s.begin(), s.end(), s.begin(), ::tolower);
 		return string(opt::k - 1, 'N') + s;
 	} else {
-		const Sequence& seq = contigs[id.id()].seq;
+		Sequence seq = contigs.sequence(id.id()).str();
 		return id.sense() ? reverseComplement(seq) : seq;
 	}
 }
@@ -553,18 +550,18 @@ main(int argc, char** argv)
 	{
 		if (opt::verbose > 0)
 			cerr << "Reading `" << contigFile << "'..." << endl;
+		contigs.open(contigFile);
+		if (!adjPath.empty())
+			contigs.removeIf(IsNotContigName());
 		unsigned count = 0;
-		FastaReader in(contigFile, FastaReader::NO_FOLD_CASE);
-		for (FastaRecord rec; in >> rec;) {
-			if (!adjPath.empty() && g_contigNames.count(rec.id) == 0)
-				continue;
+		for (size_t i = 0; i < contigs.size(); ++i) {
+			const string& id = contigs.id(i);
 			if (adjPath.empty()) {
 				graph_traits<Graph>::vertex_descriptor u =
-				    add_vertex(ContigProperties(rec.seq.length(), 0), g);
-				put(vertex_name, g, u, rec.id);
+				    add_vertex(ContigProperties(contigs.sequence(i).size, 0), g);
+				put(vertex_name, g, u, id);
 			}
-			assert(get(g_contigNames, rec.id) == contigs.size());
-			contigs.push_back(rec);
+			assert(get(g_contigNames, id) == i);
 
 			++count;
 			if (opt::verbose > 1 && count % 1000000 == 0)
@@ -580,9 +577,8 @@ main(int argc, char** argv)
 			     << toSI(getMemoryUsage()) << "B of memory.\n";
 		if (!opt::db.empty())
 			addToDb(db, "Init_seq", count);
-		assert(in.eof());
 		assert(!contigs.empty());
-		opt::colourSpace = isdigit(contigs[0].seq[0]);
+		opt::colourSpace = isdigit(contigs.sequence(0)[0]);
 		g_contigNames.lock();
 	}
 
@@ -596,20 +592,21 @@ main(int argc, char** argv)
 
 	// Output those contigs that were not seen in a path.
 	Histogram lengthHistogram;
-	ofstream fout;
-	ostream& out = opt::out == "-" ? cout : (fout.open(opt::out.c_str()), fout);
-	assert_good(out, opt::out);
+	BufferedWriter out(opt::out);
 	if (!opt::onlyMerged) {
-		for (Contigs::const_iterator it = contigs.begin(); it != contigs.end(); ++it) {
-			ContigID id(it - contigs.begin());
+		for (size_t i = 0; i < contigs.size(); ++i) {
+			ContigID id(i);
 			if (!seen[id]) {
-				const Contig& contig = *it;
-				out << '>' << get(g_contigNames, id);
-				if (!contig.comment.empty())
-					out << ' ' << contig.comment;
-				out << '\n' << contig.seq << '\n';
+				StringView comment = contigs.comment(i);
+				StringView seq = contigs.sequence(i);
+				ostream& os = out.stream();
+				os << '>' << get(g_contigNames, id);
+				if (!comment.empty())
+					os << ' ' << comment;
+				os << '\n' << seq << '\n';
+				out.endRecord();
 				if (opt::verbose > 0)
-					lengthHistogram.insert(count_if(contig.seq.begin(), contig.seq.end(), isACGT));
+					lengthHistogram.insert(count_if(seq.begin(), seq.end(), isACGT));
 			}
 		}
 	}
@@ -620,14 +617,16 @@ main(int argc, char** argv)
 		if (path.empty())
 			continue;
 		Contig contig = mergePath(g, contigs, path);
-		out << '>' << pathIDs[it - paths.begin()] << ' ' << contig.comment << '\n'
+		out.stream() << '>' << pathIDs[it - paths.begin()] << ' ' << contig.comment << '\n'
 		    << contig.seq << '\n';
-		assert_good(out, opt::out);
+		out.endRecord();
 		npaths++;
 		if (opt::verbose > 0)
 			lengthHistogram.insert(count_if(contig.seq.begin(), contig.seq.end(), isACGT));
 	}
 
+	out.close();
+
 	if (!opt::graphPath.empty())
 		outputGraph(g, pathIDs, paths, commandLine);
 
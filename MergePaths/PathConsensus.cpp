@@ -5,7 +5,8 @@
 #include "ContigNode.h"
 #include "ContigPath.h"
 #include "Dictionary.h"
-#include "FastaReader.h"
+#include "DataLayer/ContigStore.h"
+#include "Sequence.h"
 #include "IOUtil.h"
 #include "StringUtil.h"
 #include "Uncompress.h"
@@ -181,7 +182,7 @@ typedef ContigPath Path;
 typedef vector<Path> ContigPaths;
 typedef map<AmbPathConstraint, ContigPath> AmbPath2Contig;
 
-typedef vector<const_string> Contigs;
+typedef ContigStore Contigs;
 static Contigs g_contigs;
 AmbPath2Contig g_ambpath_contig;
 
@@ -196,7 +197,7 @@ static const Sequence getSequence(ContigNode id)
 			transform(s.begin(), s.end(), s.begin(), ::tolower);
 		return string(opt::k - 1, 'N') + s;
 	} else {
-		string seq(g_contigs[id.id()]);
+		string seq(g_contigs.sequence(id.id()).str());
 		return id.sense() ? reverseComplement(seq) : seq;
 	}
 }
@@ -863,14 +864,11 @@ int main(int argc, char** argv)
 	{
 		if (opt::verbose > 0)
 			cerr << "Reading `" << contigFile << "'..." << endl;
-		FastaReader in(contigFile, FastaReader::NO_FOLD_CASE);
-		for (FastaRecord rec; in >> rec;) {
-			assert(contigs.size() == get(g_contigNames, rec.id));
-			contigs.push_back(rec.seq);
-		}
-		assert(in.eof());
+		contigs.open(contigFile);
+		for (size_t i = 0; i < contigs.size(); ++i)
+			assert(i == get(g_contigNames, contigs.id(i)));
 		assert(!contigs.empty());
-		opt::colourSpace = isdigit(contigs[0][0]);
+		opt::colourSpace = isdigit(contigs.sequence(0)[0]);
 	}
 
 	vector<string> pathIDs;
@@ -5,6 +5,7 @@
 #include "IOUtil.h"
 #include "MemoryUtil.h"
 #include "SAM.h"
+#include "SAMReader.h"
 #include "StringUtil.h"
 #include "Uncompress.h"
 #include "UnorderedMap.h"
@@ -228,18 +229,6 @@ handleAlignment(SAMRecord& sam, Alignments& map)
 	printProgress(map);
 }
 
-static void
-assert_eof(istream& in)
-{
-	if (in.eof())
-		return;
-	in.clear();
-	string line;
-	getline(in, line);
-	cerr << "error: `" << line << "'\n";
-	exit(EXIT_FAILURE);
-}
-
 /** Print physical coverage in wiggle format. */
 static void
 printCov(string file)
@@ -285,26 +274,28 @@ parseTag(string line)
 }
 
 static void
-readAlignments(istream& in, Alignments* pMap)
+readAlignments(SAMReader& in, Alignments* pMap)
 {
-	for (SAMRecord sam; in >> ws;) {
-		if (in.peek() == '@') {
-			string line;
-			getline(in, line);
-			assert(in);
-
-			if (!opt::covPath.empty())
-				parseTag(line);
-
-			cout << line << '\n';
-			if (!opt::fragPath.empty())
-				g_fragFile << line << '\n';
-		} else if (in >> sam)
-			handleAlignment(sam, *pMap);
+	const string& header = in.header();
+	for (size_t i = 0; i < header.size();) {
+		size_t j = header.find('\n', i);
+		assert(j != string::npos);
+		string line(header, i, j - i);
+		i = j + 1;
+
+		if (!opt::covPath.empty())
+			parseTag(line);
+
+		cout << line << '\n';
+		if (!opt::fragPath.empty())
+			g_fragFile << line << '\n';
 	}
+
+	for (SAMRecord sam; in.read(sam);)
+		handleAlignment(sam, *pMap);
 	if (!opt::covPath.empty())
 		printCov(opt::covPath);
-	assert_eof(in);
+	assert(in.eof());
 }
 
 static void
@@ -312,10 +303,8 @@ readAlignmentsFile(string path, Alignments* pMap)
 {
 	if (opt::verbose > 0)
 		cerr << "Reading `" << path << "'..." << endl;
-	ifstream fin(path.c_str());
-	assert_good(fin, path);
-	readAlignments(fin, pMap);
-	fin.close();
+	SAMReader in(path.c_str());
+	readAlignments(in, pMap);
 }
 
 /** Return the specified number formatted as a percent. */
@@ -450,7 +439,8 @@ main(int argc, char* const* argv)
 	} else {
 		if (opt::verbose > 0)
 			cerr << "Reading from standard input..." << endl;
-		readAlignments(cin, &alignments);
+		SAMReader in("-");
+		readAlignments(in, &alignments);
 	}
 	if (opt::verbose > 0)
 		cerr << "Read " << stats.alignments << " alignments" << endl;
@@ -8,7 +8,7 @@
 #include "ConstString.h"
 #include "ContigPath.h"
 #include "ContigProperties.h"
-#include "FastaReader.h"
+#include "DataLayer/ContigStore.h"
 #include "Graph/ContigGraph.h"
 #include "Graph/ContigGraphAlgorithms.h"
 #include "Graph/DepthFirstSearch.h"
@@ -230,7 +230,7 @@ static struct
 } g_count;
 
 /** Contig sequences. */
-typedef vector<const_string> Contigs;
+typedef ContigStore Contigs;
 static Contigs g_contigs;
 
 /** Return the sequence of vertex u. */
@@ -239,7 +239,7 @@ getSequence(const Graph* g, vertex_descriptor u)
 {
 	size_t i = get(vertex_contig_index, *g, u);
 	assert(i < g_contigs.size());
-	string seq(g_contigs[i]);
+	string seq(g_contigs.sequence(i).str());
 	return get(vertex_sense, *g, u) ? reverseComplement(seq) : seq;
 }
 
@@ -637,16 +637,12 @@ main(int argc, char** argv)
 	if (opt::identity > 0) {
 		if (opt::verbose > 0)
 			cerr << "Reading `" << contigsPath << "'...\n";
-		FastaReader in(contigsPath, FastaReader::NO_FOLD_CASE);
-		for (FastaRecord rec; in >> rec;) {
-			if (g_contigNames.count(rec.id) == 0)
-				continue;
-			assert(contigs.size() == get(g_contigNames, rec.id));
-			contigs.push_back(rec.seq);
-		}
-		assert(in.eof());
+		contigs.open(contigsPath);
+		contigs.removeIf(IsNotContigName());
+		for (size_t i = 0; i < contigs.size(); ++i)
+			assert(i == get(g_contigNames, contigs.id(i)));
 		assert(!contigs.empty());
-		opt::colourSpace = isdigit(contigs.front()[0]);
+		opt::colourSpace = isdigit(contigs.sequence(0)[0]);
 	}
 
 	// Remove contigs with insufficient coverage.
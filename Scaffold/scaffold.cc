@@ -581,6 +581,7 @@ readGraph(const string& path, Graph& g)
 {
 	if (opt::verbose > 0)
 		cerr << "Reading `" << path << "'...\n";
+	openContigNames(path);
 	ifstream fin(path.c_str());
 	istream& in = path == "-" ? cin : fin;
 	assert_good(in, path);
@@ -0,0 +1,94 @@
+#include "Bloom/MultiIndexBloomFilter.h"
+#include "BloomDBG/BloomIO.h"
+#include "BloomDBG/RollingHashIterator.h"
+
+#include <gtest/gtest.h>
+#include <sstream>
+
+using namespace std;
+
+static const unsigned k = 16;
+
+/** Insert a sequence into stage 2 of a multi-index Bloom filter. */
+static void
+insertIDs(MultiIndexBloomFilter& mibf, const string& seq, MultiIndexBloomFilter::id_t id)
+{
+	for (RollingHashIterator it(seq, mibf.getHashNum(), mibf.getKmerSize());
+	     it != RollingHashIterator::end();
+	     ++it)
+		mibf.insert(*it, id);
+}
+
+class MultiIndexBloomFilterTest : public ::testing::Test
+{
+  protected:
+	MultiIndexBloomFilter mibf;
+	string a, b, shared;
+
+	MultiIndexBloomFilterTest()
+	  : mibf(100000, 3, k)
+	  , a("AGATGTGCTGCCGCCTTGGACAGCGTTACCTCGGA")
+	  , b("TAATAACAGTCCCTATGATCGTGGCGGGCGATCTA")
+	  , shared("CATTGACCTGAAGTCCGTTTACGGACCACATCAG")
+	{
+		string seqA = a + shared, seqB = b + shared;
+		BloomDBG::loadSeq(mibf, seqA);
+		BloomDBG::loadSeq(mibf, seqB);
+		mibf.finalize();
+		insertIDs(mibf, seqA, mibf.addName("a"));
+		insertIDs(mibf, seqB, mibf.addName("b"));
+	}
+};
+
+TEST_F(MultiIndexBloomFilterTest, rank)
+{
+	EXPECT_EQ(mibf.rank(0), 0U);
+	EXPECT_GT(mibf.popCount(), 0U);
+
+	// the rank increases by one at each set bit
+	size_t setBits = 0;
+	for (size_t i = 0; i + 1 < mibf.size(); ++i) {
+		size_t delta = mibf.rank(i + 1) - mibf.rank(i);
+		ASSERT_LE(delta, 1U);
+		setBits += delta;
+	}
+	EXPECT_LE(mibf.popCount() - setBits, 1U);
+}
+
+TEST_F(MultiIndexBloomFilterTest, classify)
+{
+	unsigned hits, kmers;
+	EXPECT_EQ(mibf.classify(a, 1, hits, kmers), 1U);
+	EXPECT_EQ(kmers, a.length() - k + 1);
+	EXPECT_EQ(hits, kmers);
+	EXPECT_EQ(mibf.classify(b, 1, hits, kmers), 2U);
+	EXPECT_EQ(mibf.name(2), "b");
+
+	// require more hits than k-mers
+	EXPECT_EQ(mibf.classify(a, kmers + 1, hits, kmers), 0U);
+
+	// k-mers shared by both targets are saturated
+	EXPECT_EQ(mibf.classify(shared, 1, hits, kmers), 0U);
+	EXPECT_EQ(hits, 0U);
+
+	EXPECT_EQ(mibf.classify("GGGGGGGGGGGGGGGGGGGG", 1, hits, kmers), 0U);
+	EXPECT_EQ(kmers, 5U);
+}
+
+TEST_F(MultiIndexBloomFilterTest, readWrite)
+{
+	stringstream ss;
+	ss << mibf;
+	MultiIndexBloomFilter copy;
+	ss >> copy;
+	ASSERT_FALSE(ss.fail());
+	EXPECT_EQ(copy.size(), mibf.size());
+	EXPECT_EQ(copy.popCount(), mibf.popCount());
+	EXPECT_EQ(copy.getKmerSize(), k);
+	EXPECT_EQ(copy.numIDs(), 2U);
+	EXPECT_EQ(copy.name(1), "a");
+
+	unsigned hits, kmers;
+	EXPECT_EQ(copy.classify(b, 1, hits, kmers), 2U);
+	EXPECT_EQ(hits, kmers);
+}
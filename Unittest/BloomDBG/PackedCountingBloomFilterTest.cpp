@@ -0,0 +1,149 @@
+#include "Bloom/PackedCountingBloomFilter.h"
+#include "BloomDBG/RollingHashIterator.h"
+#include "Unittest/TempFile.h"
+#include "vendor/btl_bloomfilter/CountingBloomFilter.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+
+using namespace std;
+typedef uint64_t hash_t;
+
+TEST(PackedCountingBloomFilter, base)
+{
+	const unsigned bloomSize = 1000;
+	const unsigned numHashes = 1;
+	const unsigned threshold = 2;
+	const unsigned k = 16;
+
+	PackedCountingBloomFilter<8> x(bloomSize, numHashes, k, threshold);
+	EXPECT_EQ(x.sizeInBytes(), 1000U);
+	EXPECT_EQ(x.size(), 1000U);
+
+	RollingHashIterator itA("AGATGTGCTGCCGCCT", numHashes, k);
+	RollingHashIterator itB("TGGACAGCGTTACCTC", numHashes, k);
+	RollingHashIterator itC("TAATAACAGTCCCTAT", numHashes, k);
+	RollingHashIterator itD("GATCGTGGCGGGCGAT", numHashes, k);
+	RollingHashIterator itE("TTTTTTTTTTTTTTTT", numHashes, k);
+
+	x.insert(*itA);
+	EXPECT_EQ(x.filtered_popcount(), 0U);
+	EXPECT_FALSE(x.contains(*itE));
+	x.insert(*itA);
+	EXPECT_EQ(x.filtered_popcount(), 1U);
+	EXPECT_TRUE(x.contains(*itA));
+	x.insert(*itB);
+	EXPECT_EQ(x.filtered_popcount(), 1U);
+	EXPECT_FALSE(x.contains(*itB));
+	x.insert(*itC);
+	EXPECT_EQ(x.filtered_popcount(), 1U);
+	EXPECT_FALSE(x.contains(*itC));
+	x.insert(*itB);
+	EXPECT_EQ(x.filtered_popcount(), 2U);
+	EXPECT_TRUE(x.contains(*itB));
+	EXPECT_FALSE(x.contains(*itD));
+}
+
+TEST(PackedCountingBloomFilter, saturate)
+{
+	PackedCountingBloomFilter<4> x4(8, 5, 16, 1);
+	PackedCountingBloomFilter<8> x8(8, 5, 16, 1);
+	EXPECT_EQ(x4.size(), 16U);
+	EXPECT_EQ(x8.size(), 8U);
+
+	const hash_t hashes[] = { 3, 5, 7, 9, 11 };
+	for (unsigned i = 0; i < 300; ++i) {
+		x4.insert(hashes);
+		x8.insert(hashes);
+	}
+	EXPECT_EQ(x4.minCount(hashes), 15U);
+	EXPECT_EQ(x8.minCount(hashes), 255U);
+	EXPECT_EQ(x4.count(2), 0U);
+	EXPECT_EQ(x4.count(4), 0U);
+	EXPECT_EQ(x4.popCount(), 5U);
+}
+
+TEST(PackedCountingBloomFilter, conservativeUpdate)
+{
+	PackedCountingBloomFilter<4> x(8, 2, 16, 1);
+	const hash_t a[] = { 1, 2 };
+	const hash_t b[] = { 2, 3 };
+	const hash_t c[] = { 1, 1 };
+
+	x.insert(a);
+	x.insert(a);
+	x.insert(b);
+	// only the minimum counter of `b' is incremented
+	EXPECT_EQ(x.count(1), 2U);
+	EXPECT_EQ(x.count(2), 2U);
+	EXPECT_EQ(x.count(3), 1U);
+	EXPECT_EQ(x.minCount(b), 1U);
+
+	// repeated hash values are incremented once
+	x.insert(c);
+	EXPECT_EQ(x.count(1), 3U);
+}
+
+/** Check the minimum of more hash values than one SIMD vector. */
+TEST(PackedCountingBloomFilter, minCount)
+{
+	PackedCountingBloomFilter<8> x(64, 7, 16, 1);
+	const hash_t hashes[] = { 10, 20, 30, 40, 50, 60, 63 };
+	for (unsigned i = 0; i < 7; ++i) {
+		const hash_t one[] = { hashes[i], hashes[i], hashes[i], hashes[i],
+			                   hashes[i], hashes[i], hashes[i] };
+		for (unsigned j = 0; j < 10 - i; ++j)
+			x.insert(one);
+	}
+	EXPECT_EQ(x.minCount(hashes), 4U);
+}
+
+TEST(PackedCountingBloomFilter, readWrite)
+{
+	const unsigned k = 16;
+	PackedCountingBloomFilter<4> x(100, 3, k, 1);
+	CountingBloomFilter<uint8_t> btl(100, 3, k, 1);
+	PackedCountingBloomFilter<8> y(100, 3, k, 1);
+	for (RollingHashIterator it("AGATGTGCTGCCGCCTAGATGTGCTGCCGCCTGATCG", 3, k);
+	     it != RollingHashIterator::end();
+	     ++it) {
+		x.insert(*it);
+		y.insert(*it);
+		btl.insert(*it);
+	}
+
+	stringstream ss;
+	ss << x;
+	PackedCountingBloomFilter<4> x2;
+	ss >> x2;
+	ASSERT_FALSE(ss.fail());
+	EXPECT_EQ(x2.size(), x.size());
+	EXPECT_EQ(x2.getHashNum(), 3U);
+	EXPECT_EQ(x2.getKmerSize(), k);
+	for (size_t i = 0; i < x.size(); ++i)
+		EXPECT_EQ(x2.count(i), x.count(i));
+
+	// an 8-bit filter is compatible with the BTL counting Bloom filter
+	stringstream ssY, ssBtl;
+	ssY << y;
+	ssBtl << btl;
+	EXPECT_EQ(ssY.str(), ssBtl.str());
+}
+
+TEST(PackedCountingBloomFilter, checkBits)
+{
+	TempFile file4, file8;
+	{
+		ofstream out4(file4.path()), out8(file8.path());
+		out4 << PackedCountingBloomFilter<4>(100, 3, 16, 1);
+		out8 << PackedCountingBloomFilter<8>(100, 3, 16, 1);
+		ASSERT_TRUE(out4.good() && out8.good());
+	}
+
+	// The BTL counting Bloom filter may load only an 8-bit filter.
+	checkCountingBloomBits(file8.path(), 8);
+	EXPECT_EXIT(checkCountingBloomBits(file4.path(), 8),
+	            ::testing::ExitedWithCode(EXIT_FAILURE), "8 bits per counter and saw 4");
+}
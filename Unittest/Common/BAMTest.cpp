@@ -0,0 +1,112 @@
+#include "config.h"
+#include "Common/BAM.h"
+#include "Common/Gzip.h"
+#include "Common/SAMReader.h"
+#include "Unittest/TempFile.h"
+
+#include <cstdio>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <unistd.h>
+
+using namespace std;
+
+TEST(BAMTest, reg2bin)
+{
+	EXPECT_EQ(bamReg2bin(-1, 0), 4680u);
+	EXPECT_EQ(bamReg2bin(0, 1), 4681u);
+	EXPECT_EQ(bamReg2bin(1 << 14, (1 << 14) + 100), 4682u);
+	EXPECT_EQ(bamReg2bin(0, (1 << 14) + 1), 585u);
+	EXPECT_EQ(bamReg2bin(0, (1 << 26) + 1), 0u);
+}
+
+TEST(BAMTest, tags)
+{
+	string s;
+	string tags = "NM:i:1\tXN:i:-300\tXA:Z:a b\tXC:A:c";
+	ASSERT_TRUE(appendBAMTags(s, tags.data(), tags.data() + tags.size()));
+	EXPECT_EQ(s, string("NMC\1XNs\xd4\xfeXAZa b\0XCAc", 20));
+
+	s.clear();
+	tags = "XB:B:s,-1,2";
+	ASSERT_TRUE(appendBAMTags(s, tags.data(), tags.data() + tags.size()));
+	EXPECT_EQ(s, string("XBBs\2\0\0\0\xff\xff\2\0", 12));
+
+	static const char* const invalid[] = {
+		"NM", "NM:i:x", "NM:i:1x", "NM:A:ab", "NM:Q:1", "XB:B:q,1",
+		"XB:B:c,128", "XB:B:C,1,,2" };
+	for (unsigned i = 0; i < sizeof invalid / sizeof *invalid; ++i) {
+		tags = invalid[i];
+		EXPECT_FALSE(appendBAMTags(s, tags.data(),
+					tags.data() + tags.size())) << tags;
+	}
+}
+
+#if HAVE_ZLIB_H && HAVE_LIBZ
+
+static const char HEADER[] =
+	"@HD\tVN:1.4\n"
+	"@SQ\tSN:c1\tLN:100\n"
+	"@SQ\tSN:c2\tLN:200\n";
+
+TEST(BAMTest, roundTrip)
+{
+	vector<string> names;
+	names.push_back("c1");
+	names.push_back("c2");
+	vector<uint32_t> lengths;
+	lengths.push_back(100);
+	lengths.push_back(200);
+
+	string bam;
+	appendBAMHeader(bam, HEADER, names, lengths);
+
+	SAMRecord r1;
+	r1.qname = "r1";
+	r1.flag = 99;
+	r1.rname = "c2";
+	r1.pos = 10;
+	r1.mapq = 60;
+	r1.cigar = "2S6M1I1M";
+	r1.mrnm = "c2";
+	r1.mpos = 40;
+	r1.isize = 40;
+	ASSERT_TRUE(appendBAM(bam, r1, 1, 1,
+				"NM:i:1\tXA:Z:a b\tXF:f:1.5\tXB:B:S,1,65535"));
+
+	SAMRecord r2;
+	r2.qname = "r2";
+	r2.flag = 4;
+	r2.rname = "*";
+	r2.pos = -1;
+	r2.mapq = 0;
+	r2.cigar = "*";
+	ASSERT_TRUE(appendBAM(bam, r2, -1, -1, ""));
+	EXPECT_FALSE(appendBAM(bam, r2, -1, -1, "NM:i:x"));
+
+	TempFile file(".bam");
+	string bamPath = file.path();
+	{
+		string out;
+		bgzfCompress(bam.data(), bam.size(), out);
+		out += bgzfEOF();
+		ofstream file(bamPath.c_str());
+		file << out;
+		ASSERT_TRUE(file.good());
+	}
+
+	SAMReader in(bamPath.c_str());
+	EXPECT_EQ(in.header(), HEADER);
+	string s;
+	SAMRecordView rec;
+	while (in.read(rec))
+		rec.appendTo(s);
+	EXPECT_TRUE(in.eof());
+	EXPECT_EQ(s,
+		"r1\t99\tc2\t11\t60\t2S6M1I1M\t=\t41\t40\t*\t*\t"
+			"NM:i:1\tXA:Z:a b\tXF:f:1.5\tXB:B:S,1,65535\n"
+		"r2\t4\t*\t0\t0\t*\t*\t0\t0\t*\t*\n");
+}
+
+#endif
@@ -1,6 +1,7 @@
 #include "Common/BitUtil.h"
 #include "gtest/gtest.h"
 #include <boost/utility/binary.hpp>
+#include <vector>
 
 /** Test limits */
 TEST(popcountTest, boundaries)
@@ -245,3 +246,54 @@ TEST(readBitsTest, andBits)
 	EXPECT_EQ((char)BOOST_BINARY(01011111), dest[2]);
 	EXPECT_EQ((char)BOOST_BINARY(11111111), dest[3]);
 }
+
+TEST(combineBytesTest, orAndBits)
+{
+	// 70 bytes covers the 32-byte blocks, the 64-bit words and the
+	// trailing bytes
+	const size_t bytes = 70;
+	std::vector<char> a(bytes), b(bytes), dest(bytes);
+	for (size_t i = 0; i < bytes; i++) {
+		a[i] = (char)(i * 37 + 11);
+		b[i] = (char)(i * 101 + 7);
+	}
+
+	dest = a;
+	combineBytes(&dest[0], &b[0], bytes, BITWISE_OR);
+	for (size_t i = 0; i < bytes; i++)
+		EXPECT_EQ((char)(a[i] | b[i]), dest[i]);
+
+	dest = a;
+	combineBytes(&dest[0], &b[0], bytes, BITWISE_AND);
+	for (size_t i = 0; i < bytes; i++)
+		EXPECT_EQ((char)(a[i] & b[i]), dest[i]);
+}
+
+TEST(compareBitsTest, counts)
+{
+	const size_t bytes = 70;
+	std::vector<char> a(bytes), b(bytes);
+	for (size_t i = 0; i < bytes; i++) {
+		a[i] = (char)(i * 37 + 11);
+		b[i] = (char)(i * 101 + 7);
+	}
+
+	// count the expected values bit by bit, ignoring the last 3 bits
+	const size_t bits = bytes * 8 - 3;
+	uint64_t both = 0, first = 0, second = 0, neither = 0;
+	for (size_t i = 0; i < bits; i++) {
+		bool x = a[i / 8] & 1 << (7 - i % 8);
+		bool y = b[i / 8] & 1 << (7 - i % 8);
+		both += x && y;
+		first += x && !y;
+		second += !x && y;
+		neither += !x && !y;
+	}
+
+	BitCounts counts = compareBits(&a[0], &b[0], bits);
+	EXPECT_EQ(both, counts.both);
+	EXPECT_EQ(first, counts.first);
+	EXPECT_EQ(second, counts.second);
+	EXPECT_EQ(neither, counts.neither);
+	EXPECT_EQ(bits, counts.both + counts.first + counts.second + counts.neither);
+}
@@ -0,0 +1,113 @@
+#include "Common/BucketSorter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/** Add n records of random keys at most maxKey, and every tenth
+ * without a key, and check that they are read in order. */
+static void testSort(unsigned n, uint64_t maxKey, unsigned numBuckets,
+		size_t memory, bool spill)
+{
+	BucketSorter sorter(maxKey, numBuckets, memory);
+	vector<pair<uint64_t, unsigned> > expected;
+	vector<unsigned> unsorted;
+	srand(1);
+	for (unsigned i = 0; i < n; ++i) {
+		uint64_t key = i % 10 == 9 ? BucketSorter::NO_KEY
+			: (uint64_t)rand() % (maxKey + 1);
+		// Give the records of equal keys decreasing sequence numbers.
+		uint64_t seq = n - i;
+		ostringstream ss;
+		ss << i << ' ';
+		string data = ss.str();
+		sorter.add(key, seq, data.data(), data.size());
+		if (key == BucketSorter::NO_KEY)
+			unsorted.push_back(i);
+		else
+			expected.push_back(make_pair(key, seq));
+	}
+	EXPECT_EQ(sorter.spills() > 0, spill);
+
+	string s, chunk;
+	while (sorter.read(chunk))
+		s += chunk;
+	EXPECT_FALSE(sorter.read(chunk));
+
+	sort(expected.begin(), expected.end());
+	istringstream in(s);
+	for (size_t i = 0; i < expected.size(); ++i) {
+		unsigned x;
+		ASSERT_TRUE(bool(in >> x));
+		EXPECT_EQ(n - x, expected[i].second);
+	}
+	for (size_t i = 0; i < unsorted.size(); ++i) {
+		unsigned x;
+		ASSERT_TRUE(bool(in >> x));
+		EXPECT_EQ(x, unsorted[i]);
+	}
+	in >> ws;
+	EXPECT_TRUE(in.eof());
+}
+
+TEST(BucketSorterTest, memory)
+{
+	testSort(10000, 1000, 16, 1 << 30, false);
+}
+
+TEST(BucketSorterTest, spill)
+{
+	testSort(10000, 1000, 16, 4096, true);
+}
+
+TEST(BucketSorterTest, split)
+{
+	testSort(10000, 1000, 1, 4096, true);
+	testSort(10000, ~uint64_t(0) - 1, 2, 4096, true);
+
+	// A bucket larger than the memory limit is split until each
+	// bucket that is loaded fits.
+	const size_t memory = 4096;
+	BucketSorter sorter(1000, 1, memory);
+	srand(1);
+	for (unsigned i = 0; i < 10000; ++i) {
+		uint64_t key = rand() % 1001;
+		sorter.add(key, i, reinterpret_cast<const char*>(&key),
+				sizeof key);
+	}
+	EXPECT_GT(sorter.spills(), 0u);
+	uint64_t prev = 0;
+	size_t n = 0;
+	for (string chunk; sorter.read(chunk);) {
+		EXPECT_LE(chunk.size(), memory);
+		for (size_t i = 0; i < chunk.size(); i += sizeof prev) {
+			uint64_t key;
+			memcpy(&key, &chunk[i], sizeof key);
+			EXPECT_LE(prev, key);
+			prev = key;
+			n++;
+		}
+	}
+	EXPECT_EQ(n, 10000u);
+}
+
+TEST(BucketSorterTest, keys)
+{
+	// Keys at the end of the range and a single bucket
+	testSort(1000, ~uint64_t(0) - 1, 7, 1000, true);
+	testSort(1000, 10, 1, 1 << 20, false);
+}
+
+TEST(BucketSorterTest, empty)
+{
+	BucketSorter sorter(100, 4, 1000);
+	string s;
+	EXPECT_FALSE(sorter.read(s));
+	EXPECT_TRUE(s.empty());
+}
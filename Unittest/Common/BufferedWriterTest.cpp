@@ -0,0 +1,174 @@
+#include "config.h"
+#include "Common/BufferedWriter.h"
+#include "Common/GzipReader.h"
+#include "Unittest/TempFile.h"
+
+#include <cstdio>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+/** Read a file, which may be compressed. */
+static string
+readAll(const string& path)
+{
+	string s;
+	if (endsWith(path, ".gz")) {
+#if HAVE_ZLIB_H && HAVE_LIBZ
+		GzipReader in(path.c_str());
+		string buf(1 << 16, '\0');
+		for (size_t n; (n = in.read(&buf[0], buf.size())) > 0;)
+			s.append(buf, 0, n);
+#endif
+	} else {
+		ifstream in(path.c_str());
+		ostringstream ss;
+		ss << in.rdbuf();
+		s = ss.str();
+	}
+	return s;
+}
+
+static const unsigned NUM_THREADS = 4;
+static const unsigned NUM_RECORDS = 50000;
+
+struct WriterArgs
+{
+	BufferedWriter* out;
+	BufferedWriter* mate;
+	unsigned thread;
+};
+
+/** Write the records of one thread. */
+static void*
+writeRecords(void* arg)
+{
+	WriterArgs& a = *static_cast<WriterArgs*>(arg);
+	for (unsigned i = 0; i < NUM_RECORDS; ++i) {
+		ostream& os = a.out->stream();
+		os << '>' << a.thread << '_' << i << '\n';
+		os << "ACGTACGTACGTACGTACGTACGTACGTACGT\n";
+		a.out->endRecord();
+		if (a.mate != NULL) {
+			a.mate->stream() << '>' << a.thread << '_' << i << "/2\nTTTT\n";
+			a.mate->endRecord();
+		}
+	}
+	return NULL;
+}
+
+/** Write records from several threads. */
+static void
+runThreads(BufferedWriter& out, BufferedWriter* mate)
+{
+	pthread_t threads[NUM_THREADS];
+	WriterArgs args[NUM_THREADS];
+	for (unsigned t = 0; t < NUM_THREADS; ++t) {
+		args[t].out = &out;
+		args[t].mate = mate;
+		args[t].thread = t;
+		pthread_create(&threads[t], NULL, writeRecords, &args[t]);
+	}
+	for (unsigned t = 0; t < NUM_THREADS; ++t)
+		pthread_join(threads[t], NULL);
+}
+
+/** Check that each record is complete, and that the records of each
+ * thread are in order. */
+static void
+checkRecords(const string& data)
+{
+	istringstream in(data);
+	vector<unsigned> next(NUM_THREADS);
+	string id, seq;
+	size_t n = 0;
+	while (getline(in, id) && getline(in, seq)) {
+		unsigned t, i;
+		char c;
+		istringstream ss(id.substr(1));
+		ss >> t >> c >> i;
+		ASSERT_LT(t, NUM_THREADS);
+		ASSERT_EQ(next[t], i);
+		ASSERT_EQ(seq, "ACGTACGTACGTACGTACGTACGTACGTACGT");
+		next[t]++;
+		n++;
+	}
+	EXPECT_EQ(n, NUM_THREADS * NUM_RECORDS);
+}
+
+TEST(BufferedWriterTest, compressionOf)
+{
+	EXPECT_EQ(BufferedWriter::compressionOf("a.fa"), BufferedWriter::NONE);
+	EXPECT_EQ(BufferedWriter::compressionOf("a.fa.gz"), BufferedWriter::BGZF);
+}
+
+TEST(BufferedWriterTest, threads)
+{
+	TempFile file(".fa");
+	string path = file.path();
+	{
+		BufferedWriter out(path);
+		runThreads(out, NULL);
+	}
+	checkRecords(readAll(path));
+}
+
+TEST(BufferedWriterTest, append)
+{
+	TempFile file(".fa");
+	string path = file.path();
+	BufferedWriter(path).write(">1\nA\n");
+	BufferedWriter(path, true).write(">2\nC\n");
+	EXPECT_EQ(readAll(path), ">1\nA\n>2\nC\n");
+}
+
+#if HAVE_ZLIB_H && HAVE_LIBZ
+TEST(BufferedWriterTest, bgzf)
+{
+	TempFile file(".fa.gz");
+	string path = file.path();
+	{
+		BufferedWriter out(path, BufferedWriter::BGZF, false, 2);
+		runThreads(out, NULL);
+		out.close();
+	}
+	{
+		GzipReader in(path.c_str());
+		EXPECT_TRUE(in.isBGZF());
+	}
+	checkRecords(readAll(path));
+}
+#endif
+
+TEST(BufferedWriterTest, mate)
+{
+	TempFile file1("_1.fa"), file2("_2.fa");
+	string path1 = file1.path(), path2 = file2.path();
+	{
+		BufferedWriter out1(path1), out2(path2);
+		out1.setMate(out2);
+		runThreads(out1, &out2);
+		out1.close();
+		out2.close();
+	}
+	string data1 = readAll(path1), data2 = readAll(path2);
+	checkRecords(data1);
+
+	// The records of both files are in the same order.
+	istringstream in1(data1), in2(data2);
+	string id1, id2, seq;
+	size_t n = 0;
+	while (getline(in1, id1) && getline(in1, seq)) {
+		ASSERT_TRUE(getline(in2, id2) && getline(in2, seq));
+		ASSERT_EQ(id1 + "/2", id2);
+		n++;
+	}
+	EXPECT_FALSE(getline(in2, id2));
+	EXPECT_EQ(n, NUM_THREADS * NUM_RECORDS);
+}
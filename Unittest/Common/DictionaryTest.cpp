@@ -0,0 +1,171 @@
+#include "Common/Dictionary.h"
+#include "Unittest/TempFile.h"
+#include "gtest/gtest.h"
+#include <csignal>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+using namespace std;
+
+static string toString(unsigned i)
+{
+	ostringstream ss;
+	ss << i;
+	return ss.str();
+}
+
+/** Names that are the indices are looked up without a hash table. */
+TEST(DictionaryTest, numeric)
+{
+	Dictionary d;
+	EXPECT_TRUE(d.empty());
+	for (unsigned i = 0; i < 1000; ++i)
+		EXPECT_EQ(i, d.insert(toString(i)));
+	EXPECT_EQ(1000U, d.size());
+	EXPECT_EQ(123U, d.getIndex("123"));
+	EXPECT_EQ(string("999"), string(d.getName(999)));
+	EXPECT_EQ(string("999"), string(d.back()));
+	EXPECT_EQ(1U, d.count("0"));
+	EXPECT_EQ(0U, d.count("1000"));
+	EXPECT_EQ(0U, d.count("007"));
+	EXPECT_EQ(0U, d.count(""));
+	EXPECT_EQ(0U, d.count("99999999999"));
+}
+
+/** A name that is not its index switches to the hash table. */
+TEST(DictionaryTest, names)
+{
+	Dictionary d;
+	d.insert("0");
+	d.insert("1");
+	cstring one = d.getName(1);
+	d.insert("contig");
+	d.insert("07");
+	for (unsigned i = 4; i < 10000; ++i)
+		d.put(i, "c" + toString(i));
+	EXPECT_EQ(10000U, d.size());
+	EXPECT_EQ(0U, d.getIndex("0"));
+	EXPECT_EQ(1U, d.getIndex("1"));
+	EXPECT_EQ(2U, d.getIndex("contig"));
+	EXPECT_EQ(3U, d.getIndex("07"));
+	EXPECT_EQ(9999U, d.getIndex("c9999"));
+	EXPECT_EQ(0U, d.count("7"));
+	EXPECT_EQ(0U, d.count("c"));
+	EXPECT_EQ(0U, d.count("c99999"));
+	EXPECT_EQ(string("c4321"), string(d.getName(4321)));
+
+	// The names are not moved when the dictionary grows.
+	EXPECT_EQ(one.c_str(), d.getName(1).c_str());
+
+	Dictionary copy(d);
+	EXPECT_EQ(d.size(), copy.size());
+	EXPECT_EQ(4321U, copy.getIndex("c4321"));
+}
+
+TEST(DictionaryDeathTest, duplicate)
+{
+	// The uncompress module reports a child that exits with an error
+	// and exits itself, which would race with the death test.
+	signal(SIGCHLD, SIG_DFL);
+	Dictionary d;
+	d.insert("a");
+	EXPECT_DEATH(d.insert("a"), "duplicate ID");
+	Dictionary n;
+	n.insert("0");
+	EXPECT_DEATH(n.insert("0"), "duplicate ID");
+}
+
+/** A dictionary that is saved and mapped. */
+class DictionaryFileTest : public ::testing::Test
+{
+  protected:
+	virtual void SetUp()
+	{
+		m_path = m_file.path();
+	}
+
+	TempFile m_file;
+	string m_path;
+};
+
+TEST_F(DictionaryFileTest, names)
+{
+	{
+		Dictionary d;
+		for (unsigned i = 0; i < 1000; ++i)
+			d.insert("c" + toString(i));
+		d.save(m_path);
+	}
+
+	Dictionary d;
+	ASSERT_TRUE(d.open(m_path));
+	EXPECT_TRUE(d.isMapped());
+	EXPECT_EQ(1000U, d.size());
+	EXPECT_EQ(567U, d.getIndex("c567"));
+	EXPECT_EQ(string("c999"), string(d.getName(999)));
+	EXPECT_EQ(0U, d.count("c1000"));
+	d.put(10, "c10");
+
+	// Adding a name copies the mapped dictionary.
+	d.put(1000, "c1000");
+	EXPECT_FALSE(d.isMapped());
+	EXPECT_EQ(1000U, d.getIndex("c1000"));
+	EXPECT_EQ(567U, d.getIndex("c567"));
+}
+
+TEST_F(DictionaryFileTest, numeric)
+{
+	{
+		Dictionary d;
+		for (unsigned i = 0; i < 100; ++i)
+			d.insert(toString(i));
+		d.save(m_path);
+	}
+
+	Dictionary d;
+	ASSERT_TRUE(d.open(m_path));
+	EXPECT_EQ(100U, d.size());
+	EXPECT_EQ(42U, d.getIndex("42"));
+	EXPECT_EQ(string("42"), string(d.getName(42)));
+	d.insert("x");
+	EXPECT_EQ(100U, d.getIndex("x"));
+	EXPECT_EQ(42U, d.getIndex("42"));
+}
+
+TEST_F(DictionaryFileTest, invalid)
+{
+	FILE* f = fopen(m_path.c_str(), "w");
+	ASSERT_TRUE(f != NULL);
+	fputs(">0\nACGT\n", f);
+	fclose(f);
+	Dictionary d;
+	EXPECT_FALSE(d.open(m_path));
+	EXPECT_FALSE(d.isMapped());
+	EXPECT_TRUE(d.empty());
+}
+
+/** A file whose offsets point outside the names is rejected. */
+TEST_F(DictionaryFileTest, badOffset)
+{
+	{
+		Dictionary d;
+		for (unsigned i = 0; i < 3; ++i)
+			d.insert(toString(i));
+		d.save(m_path);
+	}
+
+	// The offsets of a dictionary without a hash table follow the
+	// header of 40 bytes.
+	FILE* f = fopen(m_path.c_str(), "r+");
+	ASSERT_TRUE(f != NULL);
+	uint64_t offset = 1000;
+	ASSERT_EQ(0, fseek(f, 40 + 2 * sizeof offset, SEEK_SET));
+	ASSERT_EQ(1U, fwrite(&offset, sizeof offset, 1, f));
+	fclose(f);
+
+	Dictionary d;
+	EXPECT_FALSE(d.open(m_path));
+	EXPECT_TRUE(d.empty());
+}
@@ -0,0 +1,101 @@
+#include "config.h"
+#if HAVE_ZLIB_H && HAVE_LIBZ
+
+#include "Common/Gzip.h"
+#include "Common/GzipReader.h"
+#include "Unittest/TempFile.h"
+
+#include <cstdio>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <zlib.h>
+
+using namespace std;
+
+/** Read a file with GzipReader. */
+static string
+readAll(const string& path, size_t bufSize)
+{
+	GzipReader in(path.c_str());
+	string s, buf(bufSize, '\0');
+	for (size_t n; (n = in.read(&buf[0], bufSize)) > 0;)
+		s.append(buf, 0, n);
+	return s;
+}
+
+/** Compress data as one BGZF block. */
+static string
+bgzfBlock(const string& data)
+{
+	z_stream z = z_stream();
+	deflateInit2(&z, 6, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+	string deflated(deflateBound(&z, data.size()), '\0');
+	z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+	z.avail_in = data.size();
+	z.next_out = reinterpret_cast<Bytef*>(&deflated[0]);
+	z.avail_out = deflated.size();
+	deflate(&z, Z_FINISH);
+	deflated.resize(z.total_out);
+	deflateEnd(&z);
+
+	size_t bsize = 18 + deflated.size() + 8 - 1;
+	uint32_t crc = crc32(0, reinterpret_cast<const Bytef*>(data.data()), data.size());
+	uint32_t isize = data.size();
+	const char header[] = { 31, (char)139, 8, 4, 0, 0, 0, 0, 0, (char)255, 6, 0, 'B', 'C', 2, 0 };
+	string s(header, sizeof header);
+	s += char(bsize & 0xff);
+	s += char(bsize >> 8);
+	s += deflated;
+	for (unsigned i = 0; i < 4; ++i)
+		s += char(crc >> (8 * i));
+	for (unsigned i = 0; i < 4; ++i)
+		s += char(isize >> (8 * i));
+	return s;
+}
+
+/** Return a string that is larger than a chunk of GzipReader. */
+static string
+largeString()
+{
+	ostringstream ss;
+	for (unsigned i = 0; i < 200000; ++i)
+		ss << "@read" << i << "\nACGT\n+\nIIII\n";
+	return ss.str();
+}
+
+TEST(GzipReaderTest, canReadGzip)
+{
+	EXPECT_TRUE(canReadGzip("reads.fq.gz"));
+	EXPECT_FALSE(canReadGzip("reads.fq"));
+	EXPECT_FALSE(canReadGzip("reads.tar.gz"));
+	EXPECT_FALSE(canReadGzip("http://example.com/reads.fq.gz"));
+}
+
+TEST(GzipReaderTest, multipleMembers)
+{
+	string a = largeString(), b = "@last\nGG\n+\nII\n";
+	TempFile file(".gz", gzipCompress(a) + gzipCompress(b));
+	EXPECT_EQ(readAll(file.path(), 4096), a + b);
+	EXPECT_EQ(readAll(file.path(), 3 << 20), a + b);
+}
+
+TEST(GzipReaderTest, bgzf)
+{
+	string data = largeString();
+	string compressed;
+	for (size_t i = 0; i < data.size(); i += 65280)
+		compressed += bgzfBlock(data.substr(i, 65280));
+	// the end-of-file marker is an empty block
+	compressed += bgzfBlock("");
+	TempFile file(".gz", compressed);
+	{
+		GzipReader in(file.path());
+		EXPECT_TRUE(in.isBGZF());
+	}
+	EXPECT_EQ(readAll(file.path(), 1000), data);
+}
+
+#endif
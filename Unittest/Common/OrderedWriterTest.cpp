@@ -0,0 +1,80 @@
+#include "Common/OrderedWriter.h"
+
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+TEST(OrderedWriterTest, inOrder)
+{
+	ostringstream out;
+	OrderedWriter writer(out);
+	string s = "a";
+	writer.write(0, s);
+	EXPECT_TRUE(s.empty());
+	s = "b";
+	writer.write(1, s);
+	EXPECT_EQ("ab", out.str());
+	EXPECT_EQ(2U, writer.next());
+	EXPECT_EQ(0U, writer.pending());
+}
+
+TEST(OrderedWriterTest, outOfOrder)
+{
+	ostringstream out;
+	OrderedWriter writer(out);
+	string s = "c";
+	writer.write(2, s);
+	EXPECT_TRUE(s.empty());
+	s = "b";
+	writer.write(1, s);
+	EXPECT_EQ("", out.str());
+	EXPECT_EQ(0U, writer.next());
+	EXPECT_EQ(2U, writer.pending());
+
+	// The first chunk drains the held chunks that follow it.
+	s = "a";
+	writer.write(0, s);
+	EXPECT_EQ("abc", out.str());
+	EXPECT_EQ(3U, writer.next());
+	EXPECT_EQ(0U, writer.pending());
+}
+
+TEST(OrderedWriterTest, gap)
+{
+	ostringstream out;
+	OrderedWriter writer(out);
+	string s = "b";
+	writer.write(1, s);
+	s = "d";
+	writer.write(3, s);
+	EXPECT_EQ(2U, writer.pending());
+
+	// A held chunk is written only when all of the chunks before it
+	// have been written.
+	s = "a";
+	writer.write(0, s);
+	EXPECT_EQ("ab", out.str());
+	EXPECT_EQ(2U, writer.next());
+	EXPECT_EQ(1U, writer.pending());
+
+	s = "c";
+	writer.write(2, s);
+	EXPECT_EQ("abcd", out.str());
+	EXPECT_EQ(4U, writer.next());
+	EXPECT_EQ(0U, writer.pending());
+}
+
+TEST(OrderedWriterTest, empty)
+{
+	ostringstream out;
+	OrderedWriter writer(out);
+	string s;
+	writer.write(1, s);
+	EXPECT_EQ(1U, writer.pending());
+	writer.write(0, s);
+	EXPECT_EQ("", out.str());
+	EXPECT_EQ(2U, writer.next());
+	EXPECT_EQ(0U, writer.pending());
+}
@@ -0,0 +1,157 @@
+#include "Common/RingBuffer.h"
+
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+typedef vector<uint64_t> Chunk;
+
+static const unsigned NUM_THREADS = 4;
+static const uint64_t NUM_CHUNKS = 2000;
+static const size_t CHUNK_SIZE = 10;
+
+TEST(RingBufferTest, capacity)
+{
+	EXPECT_EQ(2U, ringCapacity(1));
+	EXPECT_EQ(8U, ringCapacity(8));
+	EXPECT_EQ(16U, ringCapacity(9));
+
+	RingBuffer<int> ring(3);
+	EXPECT_EQ(4U, ring.capacity());
+}
+
+/** Test a queue of a single thread. */
+template <template <typename> class Ring>
+static void testFifo()
+{
+	RingBuffer<string, Ring> ring(4);
+	string s;
+	for (unsigned i = 0; i < 4; ++i) {
+		s = string(1, 'a' + i);
+		ASSERT_TRUE(ring.tryPush(s));
+	}
+	s = "e";
+	EXPECT_FALSE(ring.tryPush(s));
+	EXPECT_EQ("e", s);
+
+	for (unsigned i = 0; i < 4; ++i) {
+		ASSERT_TRUE(ring.tryPop(s));
+		EXPECT_EQ(string(1, 'a' + i), s);
+	}
+	EXPECT_FALSE(ring.tryPop(s));
+
+	s = "f";
+	ring.push(s);
+	ring.close();
+	ASSERT_TRUE(ring.pop(s));
+	EXPECT_EQ("f", s);
+	EXPECT_FALSE(ring.pop(s));
+	EXPECT_FALSE(ring.pop(s));
+}
+
+TEST(RingBufferTest, fifoSPSC)
+{
+	testFifo<SPSCRing>();
+}
+
+TEST(RingBufferTest, fifoMPMC)
+{
+	testFifo<MPMCRing>();
+}
+
+template <template <typename> class Ring>
+struct ThreadArg
+{
+	RingBuffer<Chunk, Ring>* ring;
+	unsigned thread;
+	unsigned numThreads;
+	vector<unsigned> seen;
+	bool ordered;
+};
+
+/** Push the chunks of one producer, which are numbered from `thread'
+ * in steps of `numThreads'. */
+template <template <typename> class Ring>
+static void* produce(void* arg)
+{
+	ThreadArg<Ring>& p = *static_cast<ThreadArg<Ring>*>(arg);
+	Chunk chunk;
+	for (uint64_t i = p.thread; i < NUM_CHUNKS; i += p.numThreads) {
+		chunk.assign(CHUNK_SIZE, i);
+		p.ring->push(chunk);
+	}
+	return NULL;
+}
+
+/** Pop the chunks, count each record, and check that the chunks of
+ * each producer arrive in order. */
+template <template <typename> class Ring>
+static void* consume(void* arg)
+{
+	ThreadArg<Ring>& p = *static_cast<ThreadArg<Ring>*>(arg);
+	p.seen.assign(NUM_CHUNKS, 0);
+	p.ordered = true;
+	vector<int64_t> last(p.numThreads, -1);
+	for (Chunk chunk; p.ring->pop(chunk);) {
+		for (size_t j = 0; j < chunk.size(); ++j)
+			p.seen[chunk[j]]++;
+		int64_t i = chunk.front();
+		int64_t& prev = last[i % p.numThreads];
+		if (i <= prev)
+			p.ordered = false;
+		prev = i;
+	}
+	return NULL;
+}
+
+/** Pass chunks between threads, and check that each record is popped
+ * exactly once. */
+template <template <typename> class Ring>
+static void testThreads(unsigned producers, unsigned consumers)
+{
+	// A small queue, so that the threads wait for each other.
+	RingBuffer<Chunk, Ring> ring(2);
+	vector<ThreadArg<Ring> > args(producers + consumers);
+	vector<pthread_t> threads(producers + consumers);
+	for (unsigned t = 0; t < producers + consumers; ++t) {
+		args[t].ring = &ring;
+		args[t].thread = t < producers ? t : t - producers;
+		args[t].numThreads = producers;
+		pthread_create(&threads[t], NULL,
+				t < producers ? produce<Ring> : consume<Ring>,
+				&args[t]);
+	}
+	for (unsigned t = 0; t < producers; ++t)
+		pthread_join(threads[t], NULL);
+	ring.close();
+	for (unsigned t = producers; t < producers + consumers; ++t)
+		pthread_join(threads[t], NULL);
+
+	for (uint64_t i = 0; i < NUM_CHUNKS; ++i) {
+		unsigned n = 0;
+		for (unsigned t = producers; t < producers + consumers; ++t)
+			n += args[t].seen[i];
+		EXPECT_EQ(CHUNK_SIZE, n) << "chunk " << i;
+	}
+	if (consumers == 1) {
+		// The chunks of each producer arrive in order.
+		EXPECT_TRUE(args[producers].ordered);
+	}
+}
+
+TEST(RingBufferTest, threadsSPSC)
+{
+	testThreads<SPSCRing>(1, 1);
+}
+
+TEST(RingBufferTest, threadsMPMC)
+{
+	testThreads<MPMCRing>(1, 1);
+	testThreads<MPMCRing>(NUM_THREADS, 1);
+	testThreads<MPMCRing>(1, NUM_THREADS);
+	testThreads<MPMCRing>(NUM_THREADS, NUM_THREADS);
+}
@@ -62,3 +62,31 @@ TEST(parseCigarDeath, invalid_cigar)
 	EXPECT_DEATH(SAMAlignment::parseCigar("20SS", false), "error: invalid CIGAR: `20SS'");
 	EXPECT_DEATH(SAMAlignment::parseCigar("20m", false), "error: invalid CIGAR: `20m'");
 }
+
+// Check that appendTo formats a record as operator<< does.
+TEST(SAMRecord, appendTo)
+{
+	SAMRecord a;
+	a.qname = "read/1";
+	a.rname = "7";
+	a.pos = 99;
+	a.flag = SAMAlignment::FREVERSE;
+	a.mapq = 60;
+	a.cigar = "10S90M";
+	string s;
+	a.appendTo(s);
+	EXPECT_EQ("read/1\t16\t7\t100\t60\t10S90M\t*\t0\t0\t*\t*", s);
+
+	SAMRecord b(a);
+	b.mrnm = b.rname;
+	b.mpos = 299;
+	b.isize = -200;
+	SAMRecord records[] = { a, b };
+	for (unsigned i = 0; i < 2; ++i) {
+		ostringstream expected;
+		expected << records[i];
+		string s = "prefix";
+		records[i].appendTo(s);
+		EXPECT_EQ("prefix" + expected.str(), s);
+	}
+}
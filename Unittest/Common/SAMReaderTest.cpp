@@ -0,0 +1,221 @@
+#include "config.h"
+#include "Common/Gzip.h"
+#include "Common/SAMReader.h"
+#include "Common/Uncompress.h"
+#include "Unittest/TempFile.h"
+
+#include <cstdio>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+using namespace std;
+
+static const char HEADER[] =
+	"@HD\tVN:1.4\n"
+	"@SQ\tSN:c1\tLN:100\n"
+	"@SQ\tSN:c2\tLN:200\n";
+
+static const char RECORDS[] =
+	"r1\t99\tc1\t11\t60\t2S6M1I1M\t=\t41\t40\tACGTACGTAC\tIIIIIIIIII\tNM:i:1\tXA:Z:a b\n"
+	"r2\t4\t*\t0\t0\t*\t*\t0\t0\tNNNN\t*\n";
+
+TEST(SAMRecordTest, extraction)
+{
+	istringstream in(string(RECORDS) + "r3/2 16 c2 5 0 4M * 0 0 * *");
+	SAMRecord sam;
+	ASSERT_TRUE(bool(in >> sam));
+	EXPECT_EQ(sam.qname, "r1");
+	EXPECT_EQ(sam.flag, 99);
+	EXPECT_EQ(sam.rname, "c1");
+	EXPECT_EQ(sam.pos, 10);
+	EXPECT_EQ(sam.mapq, 60);
+	EXPECT_EQ(sam.cigar, "2S6M1I1M");
+	EXPECT_EQ(sam.mrnm, "c1");
+	EXPECT_EQ(sam.mpos, 40);
+	EXPECT_EQ(sam.isize, 40);
+
+	ASSERT_TRUE(bool(in >> sam));
+	EXPECT_EQ(sam.qname, "r2");
+	EXPECT_TRUE(sam.isUnmapped());
+
+	// Fields may be separated by spaces, and the last line need not
+	// end with a newline.
+	ASSERT_TRUE(bool(in >> sam));
+	EXPECT_EQ(sam.qname, "r3");
+	EXPECT_TRUE(sam.isRead2());
+	EXPECT_EQ(sam.pos, 4);
+	EXPECT_FALSE(bool(in >> sam));
+	EXPECT_TRUE(in.eof());
+
+	istringstream bad("r1\t99\tc1\tx\t60\t2S6M1I1M\t=\t41\t40\n");
+	EXPECT_FALSE(bool(bad >> sam));
+}
+
+TEST(SAMRecordTest, cigar)
+{
+	vector<uint32_t> ops;
+	string cigar = "2S6M1I1M";
+	ASSERT_TRUE(SAMAlignment::decodeCigar(cigar.data(),
+				cigar.data() + cigar.size(), ops));
+	ASSERT_EQ(ops.size(), 4u);
+	EXPECT_EQ(ops[0], 2u << 4 | 4);
+	EXPECT_EQ(ops[1], 6u << 4 | 0);
+
+	SAMAlignment::CigarCoord a(cigar);
+	SAMAlignment::CigarCoord b(&ops[0], &ops[0] + ops.size());
+	EXPECT_EQ(a.qlen, 10u);
+	EXPECT_EQ(a.qstart, 2u);
+	EXPECT_EQ(a.qspan, 8u);
+	EXPECT_EQ(a.tspan, 7u);
+	EXPECT_EQ(b.qlen, a.qlen);
+	EXPECT_EQ(b.qstart, a.qstart);
+	EXPECT_EQ(b.qspan, a.qspan);
+	EXPECT_EQ(b.tspan, a.tspan);
+
+	string invalid = "2S6";
+	EXPECT_FALSE(SAMAlignment::decodeCigar(invalid.data(),
+				invalid.data() + invalid.size(), ops));
+}
+
+TEST(SAMReaderTest, sam)
+{
+	TempFile file(".sam", string(HEADER) + RECORDS);
+	SAMReader in(file.path());
+	EXPECT_FALSE(in.isBAM());
+	EXPECT_EQ(in.header(), HEADER);
+
+	SAMRecordView rec;
+	ASSERT_TRUE(in.read(rec));
+	EXPECT_EQ(rec.qname.str(), "r1");
+	EXPECT_EQ(rec.flag, 99u);
+	EXPECT_EQ(rec.pos, 11);
+	EXPECT_EQ(rec.ops.size(), 4u);
+	EXPECT_EQ(rec.tags.str(), "NM:i:1\tXA:Z:a b");
+	string s;
+	rec.appendTo(s);
+	EXPECT_EQ(s, string(RECORDS, strchr(RECORDS, '\n') + 1));
+
+	SAMRecord sam;
+	ASSERT_TRUE(in.read(sam));
+	EXPECT_EQ(sam.qname, "r2");
+	EXPECT_TRUE(sam.isUnmapped());
+	EXPECT_FALSE(in.read(sam));
+	EXPECT_TRUE(in.eof());
+}
+
+#if HAVE_ZLIB_H && HAVE_LIBZ
+
+/** Append a little-endian integer to s. */
+static void put32(string& s, uint32_t x)
+{
+	for (unsigned i = 0; i < 4; ++i)
+		s += char(x >> (8 * i));
+}
+
+static void put16(string& s, uint16_t x)
+{
+	s += char(x & 0xff);
+	s += char(x >> 8);
+}
+
+/** Encode a BAM record. */
+static string bamRecord(int32_t refID, int32_t pos, const string& name,
+		unsigned mapq, unsigned flag, const vector<uint32_t>& cigar,
+		const string& seq, const string& qual, int32_t mateRefID,
+		int32_t matePos, int32_t tlen, const string& tags)
+{
+	static const string BASES = "=ACMGRSVTWYHKDBN";
+	string r;
+	put32(r, refID);
+	put32(r, pos);
+	r += char(name.size() + 1);
+	r += char(mapq);
+	put16(r, 0);
+	put16(r, cigar.size());
+	put16(r, flag);
+	put32(r, seq.size());
+	put32(r, mateRefID);
+	put32(r, matePos);
+	put32(r, tlen);
+	r += name;
+	r += '\0';
+	for (size_t i = 0; i < cigar.size(); ++i)
+		put32(r, cigar[i]);
+	for (size_t i = 0; i < seq.size(); i += 2) {
+		unsigned hi = BASES.find(seq[i]);
+		unsigned lo = i + 1 < seq.size() ? BASES.find(seq[i + 1]) : 0;
+		r += char(hi << 4 | lo);
+	}
+	if (qual.empty())
+		r.append(seq.size(), char(0xff));
+	else
+		for (size_t i = 0; i < qual.size(); ++i)
+			r += char(qual[i] - 33);
+	r += tags;
+
+	string block;
+	put32(block, r.size());
+	return block + r;
+}
+
+/** Return a BAM file with the same contents as HEADER and RECORDS. */
+static string bamFile()
+{
+	string bam = "BAM\1";
+	put32(bam, strlen(HEADER));
+	bam += HEADER;
+	put32(bam, 2);
+	put32(bam, 3);
+	bam.append("c1", 3);
+	put32(bam, 100);
+	put32(bam, 3);
+	bam.append("c2", 3);
+	put32(bam, 200);
+
+	vector<uint32_t> cigar;
+	cigar.push_back(2 << 4 | 4);
+	cigar.push_back(6 << 4 | 0);
+	cigar.push_back(1 << 4 | 1);
+	cigar.push_back(1 << 4 | 0);
+	string tags("NMC\1", 4);
+	tags.append("XAZa b", 7);
+	bam += bamRecord(0, 10, "r1", 60, 99, cigar, "ACGTACGTAC",
+			"IIIIIIIIII", 0, 40, 40, tags);
+	bam += bamRecord(-1, -1, "r2", 0, 4, vector<uint32_t>(), "NNNN",
+			"", -1, -1, 0, "");
+
+	string out;
+	bgzfCompress(bam.data(), bam.size(), out);
+	return out + bgzfEOF();
+}
+
+TEST(SAMReaderTest, bam)
+{
+	TempFile file(".bam", bamFile());
+	SAMReader in(file.path());
+	EXPECT_TRUE(in.isBAM());
+	EXPECT_EQ(in.header(), HEADER);
+
+	string s;
+	SAMRecordView rec;
+	while (in.read(rec))
+		rec.appendTo(s);
+	EXPECT_EQ(s, RECORDS);
+	EXPECT_TRUE(in.eof());
+}
+
+TEST(SAMReaderTest, bamToSAM)
+{
+	// The uncompress module decodes a BAM file opened as a stream.
+	TempFile file(".bam", bamFile());
+	ifstream in(file.path());
+	ASSERT_TRUE(in.good());
+	ostringstream ss;
+	ss << in.rdbuf();
+	EXPECT_EQ(ss.str(), string(HEADER) + RECORDS);
+}
+
+#endif
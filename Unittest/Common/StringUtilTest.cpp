@@ -190,3 +190,13 @@ TEST(SIToBytes_test, error_handling)
 	EXPECT_EQ(524288000u, bytes);
 	EXPECT_TRUE(valid.eof());
 }
+
+TEST(isReadNamePair_test, mates)
+{
+	EXPECT_TRUE(isReadNamePair("r1/1", "r1/2"));
+	EXPECT_TRUE(isReadNamePair("r1", "r1"));
+	EXPECT_FALSE(isReadNamePair("r1/1", "r2/2"));
+	EXPECT_FALSE(isReadNamePair("r1/2", "r1/1"));
+	EXPECT_FALSE(isReadNamePair("r1/1", "r10/2"));
+	EXPECT_FALSE(isReadNamePair("r1", "r2"));
+}
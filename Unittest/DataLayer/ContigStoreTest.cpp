@@ -0,0 +1,99 @@
+#include "DataLayer/ContigStore.h"
+#include "Common/Uncompress.h"
+#include "DataLayer/Options.h"
+#include "Unittest/TempFile.h"
+
+#include <cstdio>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <unistd.h>
+
+using namespace std;
+
+/** Return whether an ID is odd. */
+static bool isOdd(const string& id)
+{
+	return (id[id.size() - 1] - '0') % 2 == 1;
+}
+
+static void checkContigs(const ContigStore& contigs)
+{
+	ASSERT_EQ(contigs.size(), 3u);
+	EXPECT_EQ(contigs.id(0), "0");
+	EXPECT_EQ(contigs.sequence(0).str(), "ACGTACGT");
+	EXPECT_EQ(contigs.comment(0).str(), "8 100");
+	EXPECT_EQ(contigs.id(1), "1");
+	EXPECT_EQ(contigs.sequence(1).str(), "");
+	EXPECT_EQ(contigs.comment(1).str(), "");
+	EXPECT_EQ(contigs.id(2), "2");
+	EXPECT_EQ(contigs.sequence(2).str(), "GGGaaaCCC");
+	EXPECT_EQ(contigs.comment(2).str(), "9 3");
+}
+
+TEST(ContigStoreTest, mapped)
+{
+	TempFile file(".fa", ">0 8 100\nACGTACGT\n>1\n>2\t9 3\r\nGGGaaaCCC\r\n");
+	ContigStore contigs(file.path());
+	EXPECT_TRUE(contigs.isMapped());
+	checkContigs(contigs);
+
+	contigs.removeIf(isOdd);
+	ASSERT_EQ(contigs.size(), 2u);
+	EXPECT_EQ(contigs.id(1), "2");
+	EXPECT_EQ(contigs.sequence(1).str(), "GGGaaaCCC");
+	EXPECT_EQ(contigs.comment(1).str(), "9 3");
+}
+
+TEST(ContigStoreTest, multiline)
+{
+	// A sequence that spans several lines is read into memory.
+	TempFile file(".fa", ">0 8 100\nACGT\nACGT\n>2 9 3\nGGGaaaCCC");
+	ContigStore contigs(file.path());
+	EXPECT_FALSE(contigs.isMapped());
+	ASSERT_EQ(contigs.size(), 2u);
+	EXPECT_EQ(contigs.sequence(0).str(), "ACGTACGT");
+	EXPECT_EQ(contigs.comment(0).str(), "8 100");
+	EXPECT_EQ(contigs.id(1), "2");
+	EXPECT_EQ(contigs.sequence(1).str(), "GGGaaaCCC");
+	EXPECT_EQ(contigs.comment(1).str(), "9 3");
+}
+
+TEST(ContigStoreTest, index)
+{
+	// The records are located by an up-to-date index.
+	TempFile file(".fa", ">0 8 100\nACGTACGT\n>1\n\n>2 9 3\nGGGaaaCCC\n");
+	string faiPath = string(file.path()) + ".fai";
+	{
+		ofstream out(faiPath.c_str());
+		out << "0\t8\t9\t8\t9\n"
+			"1\t0\t21\t0\t1\n"
+			"2\t9\t29\t9\t10\n";
+	}
+	ContigStore contigs(file.path());
+	remove(faiPath.c_str());
+	EXPECT_TRUE(contigs.isMapped());
+	checkContigs(contigs);
+}
+
+/** Masked bases are trimmed from the ends of the sequences, whether
+ * the file is mapped or read into memory. */
+TEST(ContigStoreTest, trimMasked)
+{
+	TempFile single(".fa", ">0\nacGTaCGtt\n>1\nGGGaaaCCC\n");
+	TempFile multi(".fa", ">0\nacGTa\nCGtt\n>1\nGGGaaa\nCCC\n");
+	int trimMasked = opt::trimMasked;
+	for (int trim = 0; trim < 2; ++trim) {
+		opt::trimMasked = trim;
+		ContigStore mapped(single.path());
+		ContigStore loaded(multi.path());
+		EXPECT_TRUE(mapped.isMapped());
+		EXPECT_FALSE(loaded.isMapped());
+		string expected = trim ? "GTaCG" : "acGTaCGtt";
+		EXPECT_EQ(expected, mapped.sequence(0).str());
+		EXPECT_EQ(expected, loaded.sequence(0).str());
+		EXPECT_EQ("GGGaaaCCC", mapped.sequence(1).str());
+		EXPECT_EQ("GGGaaaCCC", loaded.sequence(1).str());
+	}
+	opt::trimMasked = trimMasked;
+}
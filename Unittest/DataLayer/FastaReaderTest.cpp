@@ -0,0 +1,90 @@
+#include "DataLayer/FastaReader.h"
+#include "Unittest/TempFile.h"
+
+#include <cstdio>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+TEST(FastaReaderTest, multiLineFasta)
+{
+	TempFile file("", ">a first\nACGTacgt\nNNNN\n#ignored\n>b\r\nGG\r\nCC\r\n>c\nTT");
+	FastaReader in(file.path(), FastaReader::FOLD_CASE);
+	FastaRecord rec;
+	ASSERT_TRUE(in >> rec);
+	EXPECT_EQ(rec.id, "a");
+	EXPECT_EQ(rec.comment, "first");
+	EXPECT_EQ(rec.seq, "ACGTACGTNNNN");
+	ASSERT_TRUE(in >> rec);
+	EXPECT_EQ(rec.id, "b");
+	EXPECT_EQ(rec.comment, "");
+	EXPECT_EQ(rec.seq, "GGCC");
+	ASSERT_TRUE(in >> rec);
+	EXPECT_EQ(rec.id, "c");
+	EXPECT_EQ(rec.seq, "TT");
+	EXPECT_FALSE(in >> rec);
+	EXPECT_TRUE(in.eof());
+}
+
+TEST(FastaReaderTest, casava)
+{
+	TempFile file("", "@read1 1:N:0:AAA\nACGT\n+\nIIII\n"
+	              "@read2 2:Y:0:AAA\nACGT\n+\nIIII\n"
+	              "@read3/1 1:N:0:AAA\nACGT\n+\nIIII\n");
+	FastaReader in(file.path(), FastaReader::FOLD_CASE);
+	FastqRecord rec;
+	ASSERT_TRUE(in >> rec);
+	EXPECT_EQ(rec.id, "read1/1");
+	EXPECT_EQ(rec.comment, "1:N:0:AAA");
+	EXPECT_EQ(rec.qual, "IIII");
+	// read2 is unchaste
+	ASSERT_TRUE(in >> rec);
+	EXPECT_EQ(rec.id, "read3/1");
+	EXPECT_EQ(in.unchaste(), 1U);
+	EXPECT_FALSE(in >> rec);
+}
+
+TEST(FastaReaderTest, readBatch)
+{
+	// Write enough records to grow the buffer during a batch.
+	const unsigned n = 3 * FastaReader::BLOCK_SIZE / 64;
+	ostringstream ss;
+	for (unsigned i = 0; i < n; ++i)
+		ss << "@" << i << "\n" << string(20, "ACGT"[i % 4]) << "\n+\n" << string(20, 'I') << '\n';
+	TempFile file("", ss.str());
+
+	FastaReader in(file.path(), FastaReader::FOLD_CASE);
+	vector<RecordView> batch;
+	unsigned count = 0;
+	while (in.readBatch(batch, 2 * FastaReader::BLOCK_SIZE) > 0) {
+		for (size_t i = 0; i < batch.size(); ++i, ++count) {
+			ostringstream id;
+			id << count;
+			ASSERT_EQ(batch[i].id.str(), id.str());
+			ASSERT_EQ(batch[i].seq.str(), string(20, "ACGT"[count % 4]));
+			ASSERT_EQ(batch[i].qual.str(), string(20, 'I'));
+		}
+	}
+	EXPECT_EQ(count, n);
+	EXPECT_TRUE(in.eof());
+}
+
+TEST(FastaReaderTest, readView)
+{
+	TempFile file("", ">a\nACGT\n>b\nGGTT\n");
+	FastaReader in(file.path(), FastaReader::FOLD_CASE);
+	RecordView r;
+	ASSERT_TRUE(in.read(r));
+	EXPECT_EQ(r.id.str(), "a");
+	EXPECT_EQ(r.seq.str(), "ACGT");
+	EXPECT_TRUE(r.qual.empty());
+	ASSERT_TRUE(in.read(r));
+	EXPECT_EQ(r.seq.str(), "GGTT");
+	EXPECT_FALSE(in.read(r));
+	EXPECT_TRUE(r.seq.empty());
+}
@@ -0,0 +1,120 @@
+#include "DataLayer/PackedReads.h"
+#include "DataLayer/FastaReader.h"
+#include "Unittest/TempFile.h"
+
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+static StringView view(const string& s)
+{
+	return StringView(s.data(), s.size());
+}
+
+TEST(PackedReadsTest, roundTrip)
+{
+	TempFile pack(PackedFormat::EXTENSION);
+	{
+		PackedReadsWriter out(pack.path(), true);
+		out.write(view("r1/1"), view("1:N:0:AAA"),
+				view("ACGTNNACGTA"), view("!#%'+/5?ABC"));
+		out.write(view("r2"), view(""), view("NTTTN"), view(""));
+		out.write(view("r3"), view("x y"), view("GATTACA"),
+				view("IIIIIII"));
+		out.close();
+	}
+
+	PackedReads in(pack.path());
+	ASSERT_EQ(in.size(), 3u);
+	EXPECT_EQ(in.bases(), 23u);
+	EXPECT_TRUE(in.hasQuality());
+	EXPECT_EQ(in.length(1), 5u);
+
+	FastqRecord rec;
+	in.get(0, rec);
+	EXPECT_EQ(rec.id, "r1/1");
+	EXPECT_EQ(rec.comment, "1:N:0:AAA");
+	EXPECT_EQ(rec.seq, "ACGTNNACGTA");
+	// Each quality is rounded down to its bin.
+	EXPECT_EQ(rec.qual, "!#%&+.5????");
+	in.get(1, rec);
+	EXPECT_EQ(rec.id, "r2");
+	EXPECT_EQ(rec.comment, "");
+	EXPECT_EQ(rec.seq, "NTTTN");
+	EXPECT_EQ(rec.qual, "");
+	in.get(2, rec);
+	EXPECT_EQ(rec.comment, "x y");
+	EXPECT_EQ(rec.seq, "GATTACA");
+	EXPECT_EQ(rec.qual, "IIIIIII");
+}
+
+/** Write n records of the specified length. */
+static void writeRecords(const char* path, unsigned n, unsigned length)
+{
+	PackedReadsWriter out(path, false);
+	static const char bases[] = "ACGT";
+	for (unsigned i = 0; i < n; ++i) {
+		ostringstream id;
+		id << i;
+		string seq(length, 'A');
+		for (unsigned j = 0; j < length; ++j)
+			seq[j] = bases[(i + j) % 4];
+		out.write(view(id.str()), StringView(), view(seq),
+				StringView());
+	}
+}
+
+TEST(PackedReadsTest, partition)
+{
+	TempFile pack(PackedFormat::EXTENSION);
+	writeRecords(pack.path(), 1000, 13);
+	PackedReads in(pack.path());
+	EXPECT_FALSE(in.hasQuality());
+
+	size_t next = 0;
+	for (unsigned part = 0; part < 7; ++part) {
+		pair<size_t, size_t> range = in.partition(part, 7);
+		EXPECT_EQ(range.first, next);
+		EXPECT_NEAR(double(range.second - range.first), 1000 / 7., 1);
+		next = range.second;
+	}
+	EXPECT_EQ(next, 1000u);
+}
+
+TEST(PackedReadsTest, fastaReader)
+{
+	TempFile pack(PackedFormat::EXTENSION);
+	writeRecords(pack.path(), 100, 31);
+
+	// Read the sections, and check that together they are the
+	// whole file in order.
+	unsigned next = 0;
+	for (unsigned section = 1; section <= 3; ++section) {
+		FastaReader in(pack.path(), FastaReader::FOLD_CASE);
+		in.split(section, 3);
+		for (FastqRecord rec; in >> rec;) {
+			ostringstream id;
+			id << next++;
+			EXPECT_EQ(rec.id, id.str());
+			EXPECT_EQ(rec.seq.size(), 31u);
+			EXPECT_TRUE(rec.qual.empty());
+		}
+		EXPECT_TRUE(in.eof());
+	}
+	EXPECT_EQ(next, 100u);
+
+	FastaReader in(pack.path(), FastaReader::FOLD_CASE);
+	vector<RecordView> batch;
+	EXPECT_EQ(in.readBatch(batch, 31 * 10), 10u);
+	EXPECT_EQ(batch[0].id.str(), "0");
+	EXPECT_EQ(batch[9].id.str(), "9");
+	EXPECT_EQ(batch[9].seq.str().substr(0, 4), "CGTA");
+	while (in.readBatch(batch, 1000) > 0)
+		;
+	EXPECT_TRUE(in.eof());
+}
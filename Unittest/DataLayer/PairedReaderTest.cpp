@@ -0,0 +1,122 @@
+#include "DataLayer/PairedReader.h"
+#include "Unittest/TempFile.h"
+
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/** Return n FASTQ records of mate i. */
+static string mates(unsigned n, unsigned i, unsigned first = 0)
+{
+	ostringstream ss;
+	for (unsigned j = first; j < first + n; ++j)
+		ss << "@r" << j << '/' << i << "\nACGT\n+\nIIII\n";
+	return ss.str();
+}
+
+typedef vector<pair<FastqRecord, FastqRecord> > Batch;
+
+/** Read all the pairs, and return their number. */
+static size_t readAll(PairedReader& in, size_t batchSize)
+{
+	size_t n = 0;
+	for (Batch batch; in.readBatch(batch, batchSize) > 0;) {
+		EXPECT_LE(batch.size(), batchSize);
+		for (Batch::const_iterator it = batch.begin();
+				it != batch.end(); ++it) {
+			ostringstream id;
+			id << 'r' << n++;
+			EXPECT_EQ(it->first.id, id.str() + "/1");
+			EXPECT_EQ(it->second.id, id.str() + "/2");
+			EXPECT_EQ(it->second.seq, "ACGT");
+		}
+	}
+	EXPECT_TRUE(in.eof());
+	return n;
+}
+
+TEST(PairedReaderTest, mateFiles)
+{
+	TempFile a1(".fq", mates(10, 1)), a2(".fq", mates(10, 2));
+	TempFile b1(".fq", mates(5, 1, 10)), b2(".fq", mates(5, 2, 10));
+	char* paths[] = { a1.path(), a2.path(), b1.path(), b2.path() };
+	PairedReader in(paths, paths + 4, FastaReader::FOLD_CASE, false);
+	EXPECT_EQ(readAll(in, 3), 15u);
+}
+
+TEST(PairedReaderTest, interleaved)
+{
+	string s;
+	for (unsigned i = 0; i < 7; ++i)
+		s += mates(1, 1, i) + mates(1, 2, i);
+	TempFile a(".fq", s);
+	char* paths[] = { a.path() };
+	PairedReader in(paths, paths + 1, FastaReader::FOLD_CASE, false);
+	EXPECT_EQ(readAll(in, 4), 7u);
+}
+
+TEST(PairedReaderTest, unequal)
+{
+	TempFile a1(".fq", mates(3, 1)), a2(".fq", mates(2, 2));
+	char* paths[] = { a1.path(), a2.path() };
+	PairedReader in(paths, paths + 2, FastaReader::FOLD_CASE, false);
+	Batch batch;
+	// The uncompress module reports a child that exits with an error
+	// and exits itself, which would race with the death test.
+	signal(SIGCHLD, SIG_DFL);
+	EXPECT_EXIT(in.readBatch(batch, 10),
+			::testing::ExitedWithCode(EXIT_FAILURE), "more reads");
+}
+
+TEST(PairedReaderTest, fifos)
+{
+	// A writer of two named pipes in lockstep blocks when either pipe
+	// is full, so the reader must not wait for a full block.
+	const unsigned n = 20000;
+	TempFile a1(".fq"), a2(".fq");
+	ASSERT_EQ(mkfifo(a1.path(), 0600), 0);
+	ASSERT_EQ(mkfifo(a2.path(), 0600), 0);
+	signal(SIGCHLD, SIG_DFL);
+	// Fail rather than hang if the reader deadlocks.
+	alarm(60);
+	pid_t pid = fork();
+	ASSERT_GE(pid, 0);
+	if (pid == 0) {
+		// A pending alarm is not inherited.
+		alarm(60);
+		// The reader opens the second mate file after it reads the
+		// first record of the first.
+		FILE* out1 = fopen(a1.path(), "w");
+		fputs(mates(1, 1).c_str(), out1);
+		fflush(out1);
+		FILE* out2 = fopen(a2.path(), "w");
+		fputs(mates(1, 2).c_str(), out2);
+		for (unsigned i = 1; i < n; ++i) {
+			fputs(mates(1, 1, i).c_str(), out1);
+			fputs(mates(1, 2, i).c_str(), out2);
+		}
+		fclose(out1);
+		fclose(out2);
+		_exit(EXIT_SUCCESS);
+	}
+	{
+		char* paths[] = { a1.path(), a2.path() };
+		PairedReader in(paths, paths + 2, FastaReader::FOLD_CASE,
+				false);
+		EXPECT_EQ(readAll(in, 100), n);
+	}
+	alarm(0);
+	int status;
+	ASSERT_EQ(waitpid(pid, &status, 0), pid);
+	EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
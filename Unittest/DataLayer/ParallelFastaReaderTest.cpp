@@ -0,0 +1,141 @@
+#include "DataLayer/ParallelFastaReader.h"
+#include "Common/FileRange.h"
+#include "Unittest/TempFile.h"
+
+#include <cstdio>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+/** Write n FASTQ records, whose quality strings start with `@' to
+ * resemble a header. */
+static void writeFastq(const string& path, unsigned n)
+{
+	ofstream out(path.c_str());
+	for (unsigned i = 0; i < n; ++i) {
+		unsigned len = 50 + i % 50;
+		string seq(len, "ACGT"[i % 4]);
+		string qual(len, 'I');
+		qual[0] = '@';
+		out << "@r" << i << '\n' << seq << "\n+\n" << qual << '\n';
+	}
+	assert(out);
+}
+
+TEST(FileRangeTest, fastqBoundary)
+{
+	string s = "@a\nACGT\n+\n@III\n@b\nCG\n+\nII\n";
+	istringstream in(s);
+	EXPECT_EQ(findBoundary(in, 0, IsFastqBoundary::WINDOW,
+				IsFastqBoundary()), 0);
+	// The quality line of the first record starts with `@'.
+	EXPECT_EQ(findBoundary(in, 3, IsFastqBoundary::WINDOW,
+				IsFastqBoundary()), 15);
+	EXPECT_EQ(findBoundary(in, 16, IsFastqBoundary::WINDOW,
+				IsFastqBoundary()), (streamoff)s.size());
+}
+
+TEST(FileRangeTest, splitRange)
+{
+	string s = ">a\nAC\nGT\n>b\nCG\n>c\nTTTT\n";
+	istringstream in(s);
+	vector<streamoff> b = splitRange(in, 0, s.size(), 3,
+			IsFastaBoundary::WINDOW, IsFastaBoundary());
+	ASSERT_EQ(b.size(), 4u);
+	EXPECT_EQ(b[0], 0);
+	EXPECT_EQ(b[1], 9);
+	EXPECT_EQ(b[2], 15);
+	EXPECT_EQ(b[3], (streamoff)s.size());
+}
+
+TEST(FileRangeTest, samTargetBoundary)
+{
+	// The unmapped lines are interleaved with the alignments to the
+	// target 0, as sorted by `sort -snk3'.
+	string s = "a\t0\t0\t1\n" "b\t4\t*\t0\n" "c\t0\t0\t5\n"
+		"d\t4\t*\t0\n" "e\t0\t1\t1\n" "f\t0\t1\t9\n";
+	istringstream in(s);
+	for (streamoff x = 1; x <= 24; ++x)
+		EXPECT_EQ(findBoundary(in, x, IsSAMTargetBoundary::WINDOW,
+					IsSAMTargetBoundary()), 32);
+	// The search starts at an unmapped line, so the target that
+	// precedes the target 1 is unknown.
+	for (streamoff x = 25; x <= 32; ++x)
+		EXPECT_EQ(findBoundary(in, x, IsSAMTargetBoundary::WINDOW,
+					IsSAMTargetBoundary()), (streamoff)s.size());
+	EXPECT_EQ(findBoundary(in, 33, IsSAMTargetBoundary::WINDOW,
+				IsSAMTargetBoundary()), (streamoff)s.size());
+
+	vector<streamoff> b = splitRange(in, 0, s.size(), 6,
+			IsSAMTargetBoundary::WINDOW, IsSAMTargetBoundary());
+	ASSERT_EQ(b.size(), 7u);
+	for (size_t i = 1; i < b.size() - 1; ++i)
+		EXPECT_TRUE(b[i] == 32 || b[i] == (streamoff)s.size());
+}
+
+TEST(ParallelFastaReaderTest, partitions)
+{
+	const unsigned N = 40000;
+	TempFile file(".fq");
+	writeFastq(file.path(), N);
+
+	ParallelFastaReader in(file.path(), 0, 4);
+	EXPECT_GT(in.partitions(), 1u);
+
+	set<string> ids;
+	vector<FastqRecord> batch;
+	while (in.readBatch(batch, 10000) > 0) {
+		for (size_t i = 0; i < batch.size(); ++i) {
+			EXPECT_EQ(batch[i].qual[0], '@');
+			EXPECT_TRUE(ids.insert(batch[i].id).second);
+		}
+	}
+	EXPECT_TRUE(in.eof());
+	EXPECT_EQ(ids.size(), N);
+}
+
+struct ThreadArg
+{
+	ParallelFastaReader* in;
+	size_t records;
+};
+
+static void* readThread(void* arg)
+{
+	ThreadArg& a = *static_cast<ThreadArg*>(arg);
+	vector<string> batch;
+	while (a.in->readBatch(batch, 1000) > 0)
+		a.records += batch.size();
+	return NULL;
+}
+
+TEST(ParallelFastaReaderTest, threads)
+{
+	const unsigned N = 40000;
+	const unsigned THREADS = 4;
+	TempFile file(".fq");
+	writeFastq(file.path(), N);
+
+	ParallelFastaReader in(file.path(), 0, THREADS);
+	pthread_t threads[THREADS];
+	ThreadArg args[THREADS];
+	for (unsigned i = 0; i < THREADS; ++i) {
+		args[i].in = &in;
+		args[i].records = 0;
+		pthread_create(&threads[i], NULL, readThread, &args[i]);
+	}
+	size_t records = 0;
+	for (unsigned i = 0; i < THREADS; ++i) {
+		pthread_join(threads[i], NULL);
+		records += args[i].records;
+	}
+	EXPECT_TRUE(in.eof());
+	EXPECT_EQ(records, N);
+}
@@ -0,0 +1,80 @@
+#include "DataLayer/ReadBatchReader.h"
+#include "Unittest/TempFile.h"
+
+#include <csignal>
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/** Return n FASTQ records of mate i. */
+static string mates(unsigned n, unsigned i, unsigned first = 0)
+{
+	ostringstream ss;
+	for (unsigned j = first; j < first + n; ++j)
+		ss << "@r" << j << '/' << i << "\nACGT\n+\nIIII\n";
+	return ss.str();
+}
+
+TEST(ReadBatchReaderTest, paired)
+{
+	TempFile a1(".fq", mates(5, 1)), a2(".fq", mates(5, 2));
+	TempFile b1(".fq", mates(2, 1, 5)), b2(".fq", mates(2, 2, 5));
+	char* paths[] = { a1.path(), a2.path(), b1.path(), b2.path() };
+	ReadBatchReader in(paths, paths + 4, true);
+	vector<FastqRecord> reads[2];
+	size_t n = 0;
+	while (in.read(reads, 12)) {
+		// A batch is at least 12 bases, or the rest of the input.
+		EXPECT_LE(reads[0].size(), 2U);
+		ASSERT_EQ(reads[0].size(), reads[1].size());
+		for (size_t i = 0; i < reads[0].size(); ++i, ++n) {
+			ostringstream id;
+			id << 'r' << n;
+			EXPECT_EQ(id.str() + "/1", reads[0][i].id);
+			EXPECT_EQ(id.str() + "/2", reads[1][i].id);
+		}
+	}
+	EXPECT_EQ(7U, n);
+	EXPECT_TRUE(reads[0].empty());
+	EXPECT_TRUE(reads[1].empty());
+}
+
+TEST(ReadBatchReaderTest, oddFiles)
+{
+	TempFile a1(".fq", mates(1, 1)), a2(".fq", mates(1, 2));
+	TempFile b1(".fq", mates(1, 1, 1));
+	char* paths[] = { a1.path(), a2.path(), b1.path() };
+	EXPECT_EXIT(ReadBatchReader(paths, paths + 3, true),
+			::testing::ExitedWithCode(EXIT_FAILURE),
+			"even number of read files, but there are 3");
+}
+
+TEST(ReadBatchReaderTest, fewerFirstMates)
+{
+	TempFile a1(".fq", mates(2, 1)), a2(".fq", mates(3, 2));
+	char* paths[] = { a1.path(), a2.path() };
+	// The uncompress module reports a child that exits with an error
+	// and exits itself, which would race with the death test.
+	signal(SIGCHLD, SIG_DFL);
+	ReadBatchReader in(paths, paths + 2, true);
+	vector<FastqRecord> reads[2];
+	EXPECT_EXIT(in.read(reads, 1000),
+			::testing::ExitedWithCode(EXIT_FAILURE),
+			string("`") + a1.path() + "' has fewer reads");
+}
+
+TEST(ReadBatchReaderTest, fewerSecondMates)
+{
+	TempFile a1(".fq", mates(3, 1)), a2(".fq", mates(2, 2));
+	char* paths[] = { a1.path(), a2.path() };
+	signal(SIGCHLD, SIG_DFL);
+	ReadBatchReader in(paths, paths + 2, true);
+	vector<FastqRecord> reads[2];
+	EXPECT_EXIT(in.read(reads, 1000),
+			::testing::ExitedWithCode(EXIT_FAILURE),
+			string("`") + a2.path() + "' has fewer reads");
+}
@@ -0,0 +1,379 @@
+#include "FMIndex/FMIndex.h"
+#include "Unittest/TempFile.h"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+typedef FMIndex::value_type T;
+
+/** Return a random string of n symbols of the specified alphabet.
+ * The second half repeats the first half with few differences. */
+static vector<T> randomText(size_t n, const string& alphabet)
+{
+	srand(n + alphabet.size());
+	vector<T> s(n);
+	for (size_t i = 0; i < n; ++i)
+		s[i] = i < n / 2 || rand() % 100 == 0
+			? alphabet[rand() % alphabet.size()] : s[i - n / 2];
+	return s;
+}
+
+/** Return the serialized FM index of the text built by assign and
+ * sampled with the specified period. */
+static string buildWhole(const vector<T>& text, const string& alphabet,
+		unsigned sampleSA, FMIndex::OccLayout layout)
+{
+	vector<T> s(text);
+	FMIndex fm;
+	fm.setAlphabet(alphabet);
+	fm.setOccLayout(layout);
+	fm.assign(s.begin(), s.end());
+	fm.sampleSA(sampleSA);
+	ostringstream out;
+	out << fm;
+	return out.str();
+}
+
+/** Return the serialized FM index of the text built by
+ * assignBlockwise. */
+static string buildBlockwise(const vector<T>& text,
+		const string& alphabet, unsigned sampleSA,
+		FMIndex::OccLayout layout, size_t blockSize)
+{
+	vector<T> s(text);
+	FMIndex fm;
+	fm.setAlphabet(alphabet);
+	fm.setOccLayout(layout);
+	fm.sampleSA(sampleSA);
+	fm.assignBlockwise(s.begin(), s.end(), blockSize);
+	ostringstream out;
+	out << fm;
+	return out.str();
+}
+
+TEST(FMIndexTest, assignBlockwise)
+{
+	const string alphabet = "-ACGT";
+	vector<T> text = randomText(1000, "ACGTN\n");
+	string expected = buildWhole(text, alphabet, 1, FMIndex::BIT_ARRAYS);
+	const size_t blockSizes[] = { 1, 2, 7, 100, 999, 1000, 5000 };
+	for (unsigned i = 0; i < sizeof blockSizes / sizeof *blockSizes; ++i)
+		EXPECT_EQ(expected, buildBlockwise(text, alphabet, 1,
+					FMIndex::BIT_ARRAYS, blockSizes[i]))
+			<< "blockSize=" << blockSizes[i];
+}
+
+TEST(FMIndexTest, assignBlockwiseRepeat)
+{
+	// The suffixes of a block of a homopolymer differ only in length.
+	const string alphabet = "-ACGT";
+	vector<T> text(500, 'A');
+	text.push_back('C');
+	text.insert(text.end(), 500, 'A');
+	string expected = buildWhole(text, alphabet, 4, FMIndex::BIT_ARRAYS);
+	EXPECT_EQ(expected, buildBlockwise(text, alphabet, 4,
+				FMIndex::BIT_ARRAYS, 64));
+	EXPECT_EQ(expected, buildBlockwise(text, alphabet, 4,
+				FMIndex::BIT_ARRAYS, 333));
+}
+
+TEST(FMIndexTest, assignBlockwiseAnchors)
+{
+	// The text spans several periods of the anchors of the suffix
+	// array.
+	const string alphabet = "-ACGT";
+	vector<T> text = randomText(200000, "ACGT");
+	string expected = buildWhole(text, alphabet, 16,
+			FMIndex::INTERLEAVED);
+	EXPECT_EQ(expected, buildBlockwise(text, alphabet, 16,
+				FMIndex::INTERLEAVED, 30000));
+}
+
+TEST(FMIndexTest, assignBlockwiseProtein)
+{
+	// The alphabet is too large for the interleaved occurrence table.
+	const string alphabet = "#*ACDEFGHIKLMNPQRSTVWY";
+	vector<T> text = randomText(2000, alphabet.substr(2));
+	string expected = buildWhole(text, alphabet, 1, FMIndex::BIT_ARRAYS);
+	EXPECT_EQ(expected, buildBlockwise(text, alphabet, 1,
+				FMIndex::BIT_ARRAYS, 300));
+}
+
+/** An index that is stored in a file and loaded. */
+class FMIndexFileTest : public ::testing::Test
+{
+  protected:
+	virtual void SetUp()
+	{
+		m_path = m_file.path();
+
+		m_text = randomText(3000, "ACGT\n");
+		vector<T> s(m_text);
+		m_fm.setAlphabet("-ACGT");
+		m_fm.assign(s.begin(), s.end());
+	}
+
+	/** Store the index m_fm in the file. */
+	void write(bool mapped)
+	{
+		ofstream out(m_path.c_str());
+		if (mapped)
+			m_fm.writeMapped(out);
+		else
+			out << m_fm;
+		ASSERT_TRUE(out.good());
+	}
+
+	/** Return the serialized index. */
+	static string toString(const FMIndex& fm)
+	{
+		ostringstream out;
+		out << fm;
+		return out.str();
+	}
+
+	TempFile m_file;
+	string m_path;
+	vector<T> m_text;
+	FMIndex m_fm;
+};
+
+TEST_F(FMIndexFileTest, mapBitArrays)
+{
+	m_fm.sampleSA(4);
+	write(true);
+	FMIndex fm;
+	fm.load(m_path);
+	EXPECT_TRUE(fm.isMapped());
+	EXPECT_EQ(toString(m_fm), toString(fm));
+
+	// A copy shares the mapped file.
+	FMIndex copy(fm);
+	fm = FMIndex();
+	EXPECT_EQ(toString(m_fm), toString(copy));
+	string q(m_text.begin() + 1000, m_text.begin() + 1100);
+	FMIndex::Match a = m_fm.find(q, 1), b = copy.find(q, 1);
+	EXPECT_EQ(a.l, b.l);
+	EXPECT_EQ(a.u, b.u);
+	EXPECT_EQ(a.qspan(), b.qspan());
+	EXPECT_EQ(m_fm[a.l], copy[b.l]);
+}
+
+TEST_F(FMIndexFileTest, mapInterleaved)
+{
+	vector<T> s(m_text);
+	m_fm.setOccLayout(FMIndex::INTERLEAVED);
+	m_fm.assign(s.begin(), s.end());
+	write(true);
+	FMIndex fm;
+	fm.load(m_path);
+	EXPECT_TRUE(fm.isMapped());
+	EXPECT_EQ(FMIndex::INTERLEAVED, fm.occLayout());
+	EXPECT_EQ(toString(m_fm), toString(fm));
+
+	// Sampling the suffix array copies it from the file.
+	m_fm.sampleSA(8);
+	fm.sampleSA(8);
+	EXPECT_EQ(toString(m_fm), toString(fm));
+}
+
+TEST_F(FMIndexFileTest, loadStream)
+{
+	write(false);
+	FMIndex fm;
+	fm.load(m_path);
+	EXPECT_FALSE(fm.isMapped());
+	EXPECT_EQ(toString(m_fm), toString(fm));
+}
+
+TEST_F(FMIndexFileTest, truncated)
+{
+	// The uncompress module reports a child that exits with an error
+	// and exits itself, which would race with the death test.
+	signal(SIGCHLD, SIG_DFL);
+	write(true);
+	ASSERT_EQ(0, truncate(m_path.c_str(), 5000));
+	FMIndex fm;
+	EXPECT_DEATH(fm.load(m_path), "corrupt");
+}
+
+TEST(FMIndexTest, findBatch)
+{
+	const string alphabet = "-ACGT";
+	vector<T> text = randomText(5000, "ACGTN\n");
+	const FMIndex::OccLayout layouts[] = {
+		FMIndex::BIT_ARRAYS, FMIndex::INTERLEAVED };
+	for (unsigned layout = 0; layout < 2; ++layout) {
+		vector<T> s(text);
+		FMIndex fm;
+		fm.setAlphabet(alphabet);
+		fm.setOccLayout(layouts[layout]);
+		fm.assign(s.begin(), s.end());
+
+		// Queries of the text with substitutions, and queries that
+		// are empty, shorter than the minimum length or contain
+		// symbols outside the alphabet.
+		srand(1);
+		vector<string> queries;
+		vector<unsigned> minLen;
+		for (unsigned i = 0; i < 200; ++i) {
+			size_t n = 1 + rand() % 120;
+			size_t pos = rand() % (text.size() - n);
+			string q(text.begin() + pos, text.begin() + pos + n);
+			for (string::iterator it = q.begin(); it != q.end(); ++it)
+				if (rand() % 20 == 0)
+					*it = "ACGTN"[rand() % 5];
+			queries.push_back(q);
+			minLen.push_back(rand() % 4 == 0 ? rand() % 40 : 1);
+		}
+		queries.push_back("");
+		minLen.push_back(1);
+
+		vector<FMIndex::Match> matches;
+		fm.findBatch(queries, minLen, matches);
+		ASSERT_EQ(queries.size(), matches.size());
+		for (size_t i = 0; i < queries.size(); ++i) {
+			if (queries[i].empty())
+				continue;
+			FMIndex::Match m = fm.find(queries[i], minLen[i]);
+			EXPECT_EQ(m.l, matches[i].l) << i;
+			EXPECT_EQ(m.u, matches[i].u) << i;
+			EXPECT_EQ(m.qstart, matches[i].qstart) << i;
+			EXPECT_EQ(m.qend, matches[i].qend) << i;
+			EXPECT_EQ(m.num, matches[i].num) << i;
+		}
+	}
+}
+
+TEST(FMIndexTest, findOverlapBatch)
+{
+	const string alphabet = "-ACGT";
+	// Sequences separated by newlines, which share their ends.
+	srand(2);
+	vector<string> seqs;
+	string text;
+	for (unsigned i = 0; i < 100; ++i) {
+		string seq;
+		if (i > 0 && rand() % 2 == 0)
+			seq = seqs[rand() % i].substr(0, 10 + rand() % 20);
+		size_t n = 20 + rand() % 60;
+		while (seq.size() < n)
+			seq += "ACGTN"[rand() % (rand() % 50 == 0 ? 5 : 4)];
+		if (i > 0 && rand() % 2 == 0) {
+			const string& t = seqs[rand() % i];
+			seq += t.substr(t.size() - min(t.size(), size_t(10 + rand() % 20)));
+		}
+		seqs.push_back(seq);
+		text += seq + '\n';
+	}
+
+	const FMIndex::OccLayout layouts[] = {
+		FMIndex::BIT_ARRAYS, FMIndex::INTERLEAVED };
+	for (unsigned layout = 0; layout < 2; ++layout) {
+		vector<T> s(text.begin(), text.end());
+		FMIndex fm;
+		fm.setAlphabet(alphabet);
+		fm.setOccLayout(layouts[layout]);
+		fm.assign(s.begin(), s.end());
+
+		vector<string> queries;
+		vector<bool> prefix;
+		for (size_t i = 0; i < seqs.size(); ++i) {
+			queries.push_back(seqs[i].substr(1));
+			prefix.push_back(false);
+			queries.push_back(seqs[i].substr(0, seqs[i].size() - 1));
+			prefix.push_back(true);
+		}
+		queries.push_back("");
+		prefix.push_back(false);
+		queries.push_back("A");
+		prefix.push_back(true);
+
+		size_t numMatches = 0;
+		const unsigned minOverlaps[] = { 1, 5, 12 };
+		for (unsigned j = 0; j < 3; ++j) {
+			unsigned minOverlap = minOverlaps[j];
+			vector<vector<FMIndex::Match> > matches;
+			fm.findOverlapBatch(queries, prefix, minOverlap, matches);
+			ASSERT_EQ(queries.size(), matches.size());
+			for (size_t i = 0; i < queries.size(); ++i) {
+				if (queries[i].empty()) {
+					EXPECT_TRUE(matches[i].empty());
+					continue;
+				}
+				vector<FMIndex::Match> expected;
+				if (prefix[i])
+					fm.findOverlapPrefix(queries[i],
+							back_inserter(expected), minOverlap);
+				else
+					fm.findOverlapSuffix(queries[i],
+							back_inserter(expected), minOverlap);
+				ASSERT_EQ(expected.size(), matches[i].size()) << i;
+				numMatches += expected.size();
+				for (size_t k = 0; k < expected.size(); ++k) {
+					EXPECT_EQ(expected[k].l, matches[i][k].l) << i;
+					EXPECT_EQ(expected[k].u, matches[i][k].u) << i;
+					EXPECT_EQ(expected[k].qstart,
+							matches[i][k].qstart) << i;
+					EXPECT_EQ(expected[k].qend,
+							matches[i][k].qend) << i;
+				}
+			}
+		}
+		EXPECT_LT(0U, numMatches);
+	}
+}
+
+TEST(FMIndexTest, locateCache)
+{
+	const string alphabet = "-ACGT";
+	vector<T> text = randomText(20000, "ACGTN\n");
+	vector<T> s(text);
+	FMIndex fm;
+	fm.setAlphabet(alphabet);
+	fm.assign(s.begin(), s.end());
+	vector<size_t> expected(fm.size() + 1);
+	for (size_t i = 0; i < expected.size(); ++i)
+		expected[i] = fm[i];
+
+	fm.sampleSA(16);
+	fm.setLocateCache(0);
+	EXPECT_TRUE(fm.locateCache() == NULL);
+
+	// A cache smaller than the text causes collisions.
+	const size_t sizes[] = { 8, 1024, 1 << 20 };
+	for (unsigned k = 0; k < sizeof sizes / sizeof *sizes; ++k) {
+		fm.setLocateCache(sizes[k]);
+		ASSERT_TRUE(fm.locateCache() != NULL);
+		EXPECT_LE(fm.locateCache()->bytes(), sizes[k]);
+		srand(k);
+		for (unsigned pass = 0; pass < 3; ++pass) {
+			for (size_t j = 0; j < expected.size(); ++j) {
+				size_t i = rand() % expected.size();
+				ASSERT_EQ(expected[i], fm[i]) << "i=" << i;
+			}
+		}
+		LocateCache::Stats stats = fm.locateCache()->stats();
+		EXPECT_EQ(stats.locates, 3 * expected.size());
+		if (sizes[k] == 1 << 20) {
+			EXPECT_GT(stats.hits, stats.locates / 2);
+		}
+	}
+
+	// An unsampled suffix array needs no cache.
+	FMIndex unsampled;
+	unsampled.setAlphabet(alphabet);
+	s = text;
+	unsampled.assign(s.begin(), s.end());
+	unsampled.setLocateCache(1 << 20);
+	EXPECT_TRUE(unsampled.locateCache() == NULL);
+}
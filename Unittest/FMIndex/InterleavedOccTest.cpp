@@ -0,0 +1,128 @@
+#include "FMIndex/BitArrays.h"
+#include "FMIndex/FMIndex.h"
+#include "FMIndex/InterleavedOcc.h"
+#include "gtest/gtest.h"
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+typedef uint8_t T;
+
+/** Return a random string of n symbols of an alphabet of size
+ * sigma, with a sentinel at position n / 3. */
+static vector<T> randomString(size_t n, unsigned sigma)
+{
+	srand(n + sigma);
+	vector<T> s(n);
+	for (size_t i = 0; i < n; ++i)
+		s[i] = rand() % sigma;
+	s[n / 3] = numeric_limits<T>::max();
+	return s;
+}
+
+/** Compare InterleavedOcc with BitArrays. */
+static void compare(size_t n, unsigned sigma)
+{
+	vector<T> s = randomString(n, sigma);
+	// Ensure that the largest symbol is present.
+	s[n - 1] = sigma - 1;
+	BitArrays expected;
+	expected.assign(s.begin(), s.end());
+	InterleavedOcc occ;
+	occ.assign(s.begin(), s.end());
+
+	ASSERT_EQ(n, occ.size());
+	for (T c = 0; c < sigma; ++c) {
+		EXPECT_EQ(expected.count(c), occ.count(c));
+		for (size_t i = 0; i <= n; ++i)
+			ASSERT_EQ(expected.rank(c, i), occ.rank(c, i))
+				<< "n=" << n << " c=" << unsigned(c) << " i=" << i;
+	}
+	for (size_t i = 0; i < n; ++i)
+		ASSERT_EQ(expected.at(i), occ.at(i)) << "i=" << i;
+}
+
+TEST(InterleavedOccTest, twoBits)
+{
+	// A block of two-bit symbols stores 192 symbols.
+	compare(10, 4);
+	compare(192, 4);
+	compare(193, 4);
+	compare(5000, 3);
+}
+
+TEST(InterleavedOccTest, threeBits)
+{
+	// A block of three-bit symbols stores 105 symbols.
+	compare(10, 5);
+	compare(105, 5);
+	compare(106, 6);
+	compare(5000, 5);
+}
+
+TEST(InterleavedOccTest, alphabetSize)
+{
+	// The symbols 3 and 4 of the alphabet do not occur.
+	vector<T> s = randomString(1000, 3);
+	InterleavedOcc occ;
+	occ.assign(s.begin(), s.end(), 5);
+	for (T c = 3; c < 5; ++c) {
+		EXPECT_EQ(0u, occ.count(c));
+		EXPECT_EQ(0u, occ.rank(c, 500));
+		EXPECT_EQ(0u, occ.rank(c, 1000));
+	}
+	EXPECT_EQ(1000u, occ.count(0) + occ.count(1) + occ.count(2) + 1);
+}
+
+/** Build an FM index of the text with the specified layout. */
+static void build(FMIndex& fm, const string& text,
+		FMIndex::OccLayout layout)
+{
+	fm.setAlphabet("-ACGT");
+	fm.setOccLayout(layout);
+	vector<T> s(text.begin(), text.end());
+	fm.assign(s.begin(), s.end());
+}
+
+TEST(InterleavedOccTest, FMIndex)
+{
+	static const char ACGT[] = "ACGT";
+	srand(1);
+	string text;
+	for (unsigned i = 0; i < 3000; ++i)
+		text += i % 500 == 499 ? '\n' : ACGT[rand() % 4];
+
+	FMIndex a, b;
+	build(a, text, FMIndex::BIT_ARRAYS);
+	build(b, text, FMIndex::INTERLEAVED);
+	EXPECT_EQ(FMIndex::INTERLEAVED, b.occLayout());
+	ASSERT_EQ(a.size(), b.size());
+	for (size_t i = 0; i <= a.size(); ++i)
+		ASSERT_EQ(a[i], b[i]);
+
+	for (unsigned i = 0; i < 100; ++i) {
+		string q = text.substr(rand() % 2800, 100);
+		q[50] = ACGT[rand() % 4];
+		FMIndex::Match ma = a.find(q, 1), mb = b.find(q, 1);
+		EXPECT_EQ(ma.l, mb.l);
+		EXPECT_EQ(ma.u, mb.u);
+		EXPECT_EQ(ma.qstart, mb.qstart);
+		EXPECT_EQ(ma.qend, mb.qend);
+		EXPECT_EQ(ma.num, mb.num);
+	}
+
+	// Store and load the index.
+	stringstream ss;
+	ss << b;
+	FMIndex c;
+	ss >> c;
+	EXPECT_EQ(FMIndex::INTERLEAVED, c.occLayout());
+	string decompressed;
+	c.decompress(back_inserter(decompressed));
+	string expected;
+	b.decompress(back_inserter(expected));
+	EXPECT_EQ(expected, decompressed);
+	EXPECT_EQ(text.size(), decompressed.size());
+}
@@ -0,0 +1,177 @@
+#include "KAligner/SeedIndex.h"
+#include "Common/Options.h"
+#include "Kmer.h"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/** Return a random sequence of n bases, some of which are N. */
+static string randomSequence(size_t n)
+{
+	string s(n, 'A');
+	for (size_t i = 0; i < n; ++i)
+		s[i] = rand() % 50 == 0 ? 'N' : "ACGT"[rand() % 4];
+	return s;
+}
+
+/** The positions of each k-mer of the targets, in the order that
+ * they were added. */
+typedef map<string, vector<Position> > Expected;
+
+class SeedIndexTest : public testing::TestWithParam<unsigned>
+{
+  protected:
+	void SetUp()
+	{
+		m_k = GetParam();
+		Kmer::setLength(m_k);
+		srand(m_k);
+		// Targets that repeat parts of each other, in both
+		// orientations.
+		for (unsigned i = 0; i < 50; ++i) {
+			string seq = randomSequence(m_k + rand() % 200);
+			if (i > 0 && rand() % 2 == 0) {
+				const string& t = m_targets[rand() % i];
+				string part = t.substr(0, min(t.size(), size_t(m_k + 10)));
+				seq += rand() % 2 == 0 ? part : reverseComplement(part);
+			}
+			m_targets.push_back(seq);
+		}
+		for (unsigned i = 0; i < m_targets.size(); ++i) {
+			const string& seq = m_targets[i];
+			for (size_t j = 0; j + m_k <= seq.size(); ++j) {
+				string kmer = seq.substr(j, m_k);
+				if (kmer.find('N') == string::npos)
+					m_expected[kmer].push_back(Position(i, j));
+			}
+		}
+	}
+
+	void add(SeedIndex& index) const
+	{
+		for (unsigned i = 0; i < m_targets.size(); ++i)
+			index.add(m_targets[i], i);
+	}
+
+	unsigned m_k;
+	vector<string> m_targets;
+	Expected m_expected;
+};
+
+TEST_P(SeedIndexTest, reverseComplement)
+{
+	SeedIndex index;
+	string kmer = randomSequence(m_k);
+	replace(kmer.begin(), kmer.end(), 'N', 'A');
+	uint64_t key, rc;
+	ASSERT_TRUE(index.pack(kmer.data(), key));
+	EXPECT_EQ(kmer, index.unpack(key));
+	string rcKmer = reverseComplement(kmer);
+	ASSERT_TRUE(index.pack(rcKmer.data(), rc));
+	EXPECT_EQ(rc, index.reverseComplement(key));
+	EXPECT_FALSE(index.pack(string(m_k, 'N').data(), key));
+}
+
+TEST_P(SeedIndexTest, multimap)
+{
+	SeedIndex index;
+	add(index);
+	index.build(false);
+	EXPECT_EQ(index.size(), size_t(index.end() - index.begin()));
+
+	size_t n = 0;
+	for (Expected::const_iterator it = m_expected.begin();
+			it != m_expected.end(); ++it) {
+		uint64_t key;
+		ASSERT_TRUE(index.pack(it->first.data(), key));
+		pair<SeedIndex::const_iterator, SeedIndex::const_iterator>
+			range = index.equal_range(key);
+		ASSERT_EQ(it->second.size(), size_t(range.second - range.first));
+		for (size_t i = 0; i < it->second.size(); ++i) {
+			EXPECT_EQ(key, range.first[i].first);
+			EXPECT_EQ(it->second[i].contig, range.first[i].second.contig);
+			EXPECT_EQ(it->second[i].pos, range.first[i].second.pos);
+		}
+		n += it->second.size();
+	}
+	EXPECT_EQ(n, index.size());
+}
+
+TEST_P(SeedIndexTest, unique)
+{
+	SeedIndex index;
+	add(index);
+	index.build(true);
+
+	// The expected seed of each k-mer is its first occurrence or that
+	// of its reverse complement, and is a duplicate if either occurs
+	// more than once.
+	size_t keys = 0, duplicates = 0;
+	Position firstDup, secondDup;
+	for (Expected::const_iterator it = m_expected.begin();
+			it != m_expected.end(); ++it) {
+		string rc = reverseComplement(it->first);
+		vector<Position> all = it->second;
+		if (rc != it->first) {
+			Expected::const_iterator rcIt = m_expected.find(rc);
+			if (rcIt != m_expected.end()) {
+				if (rc < it->first)
+					continue;
+				all.insert(all.end(),
+						rcIt->second.begin(), rcIt->second.end());
+			}
+		}
+		keys++;
+		sort(all.begin(), all.end(), [](const Position& a,
+					const Position& b) {
+				return a.contig != b.contig ? a.contig < b.contig
+					: a.pos < b.pos;
+			});
+		const string& kmer = all[0].contig == it->second[0].contig
+			&& all[0].pos == it->second[0].pos ? it->first : rc;
+		const string& other = kmer == it->first ? rc : it->first;
+
+		uint64_t key;
+		ASSERT_TRUE(index.pack(kmer.data(), key));
+		pair<SeedIndex::const_iterator, SeedIndex::const_iterator>
+			range = index.equal_range(key);
+		ASSERT_EQ(1, range.second - range.first) << kmer;
+		if (all.size() > 1) {
+			duplicates++;
+			EXPECT_TRUE(range.first->second.isDuplicate());
+			if (firstDup.isDuplicate() || all[1].contig < secondDup.contig
+					|| (all[1].contig == secondDup.contig
+						&& all[1].pos < secondDup.pos)) {
+				firstDup = all[0];
+				secondDup = all[1];
+			}
+		} else {
+			EXPECT_EQ(all[0].contig, range.first->second.contig);
+			EXPECT_EQ(all[0].pos, range.first->second.pos);
+		}
+		if (other != kmer) {
+			ASSERT_TRUE(index.pack(other.data(), key));
+			range = index.equal_range(key);
+			EXPECT_EQ(0, range.second - range.first) << other;
+		}
+	}
+	EXPECT_EQ(keys, index.size());
+	EXPECT_LT(0U, duplicates);
+
+	Position first, second;
+	string kmer;
+	ASSERT_TRUE(index.firstDuplicate(first, second, kmer));
+	EXPECT_EQ(firstDup.contig, first.contig);
+	EXPECT_EQ(firstDup.pos, first.pos);
+	EXPECT_EQ(secondDup.contig, second.contig);
+	EXPECT_EQ(secondDup.pos, second.pos);
+	EXPECT_EQ(m_targets[second.contig].substr(second.pos, m_k), kmer);
+}
+
+INSTANTIATE_TEST_CASE_P(KmerLengths, SeedIndexTest,
+		testing::Values(5U, 16U, 25U, 32U));
@@ -0,0 +1,71 @@
+#ifndef UNITTEST_TEMPFILE_H
+#define UNITTEST_TEMPFILE_H 1
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+/**
+ * A temporary file, which is removed when destroyed. Its path is a
+ * unique name created by mkstemp followed by a suffix, such as `.gz',
+ * which may select the format of the file. The unique file is kept
+ * until this object is destroyed, so that mkstemp does not return its
+ * name again to another test.
+ */
+class TempFile
+{
+  public:
+	/** Create a unique name. The file with the suffix is not
+	 * created. */
+	explicit TempFile(const std::string& suffix = std::string())
+	{
+		create(suffix);
+	}
+
+	/** Create a file with the specified suffix and contents. */
+	TempFile(const std::string& suffix, const std::string& data)
+	{
+		create(suffix);
+		std::ofstream out(m_path.c_str());
+		out << data;
+		assert(out);
+	}
+
+	~TempFile()
+	{
+		remove(m_path.c_str());
+		if (m_path != m_unique)
+			remove(m_unique.c_str());
+	}
+
+	const char* path() const { return m_path.c_str(); }
+
+	/** Return the path for a function that takes a char*, such as a
+	 * list of command line arguments. */
+	char* path() { return &m_path[0]; }
+
+  private:
+	TempFile(const TempFile&);
+	TempFile& operator=(const TempFile&);
+
+	void create(const std::string& suffix)
+	{
+		char path[] = "/tmp/ABySSTest.XXXXXX";
+		int fd = mkstemp(path);
+		assert(fd >= 0);
+		close(fd);
+		m_unique = path;
+		m_path = m_unique + suffix;
+	}
+
+	/** The file created by mkstemp */
+	std::string m_unique;
+
+	/** The path of this file */
+	std::string m_path;
+};
+
+#endif
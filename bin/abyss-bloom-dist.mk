@@ -33,7 +33,7 @@ override files:=$(strip $(files))
 b_gb:=$(shell echo '$b / 1024^3' | bc -l)
 l1_mem_gb:=$(shell echo '$(b_gb) / $w + 1.05' | bc -l | xargs printf '%.1f')
 l2_mem_gb:=$(shell echo '2 * $(l1_mem_gb)' | bc -l)
-union_mem_gb:=$(shell echo '$(b_gb) + 2.05' | bc -l | xargs printf '%.1f')
+concat_mem_gb:=1.0
 
 # a single space character
 space:=$(noop) $(noop)
@@ -157,11 +157,9 @@ $(name).bloom.gz: $(l2_bloom_files)
 	cp $< $@
 else
 $(name).bloom.gz: $(l2_bloom_files)
-	SGE_RREQ="-N $(name)_union -l mem_token=$(union_mem_gb)G,mem_free=$(union_mem_gb)G,h_vmem=$(union_mem_gb)G" \
+	SGE_RREQ="-N $(name)_concat -l mem_token=$(concat_mem_gb)G,mem_free=$(concat_mem_gb)G,h_vmem=$(concat_mem_gb)G" \
 	$(BEGIN_SHELL) \
-		zcat $(l2_bloom_files) | \
-			abyss-bloom union -v -k$k - \
-			$(foreach i,$(l2_bloom_files),-) | \
+		abyss-bloom concat -v -k$k - $(l2_bloom_files) | \
 				gzip -c > $@.incomplete && \
 		mv $@.incomplete $@ \
 	$(END_SHELL)
@@ -178,7 +176,7 @@ debug:
 	@echo 'b_gb=$(b_gb)'
 	@echo 'l1_mem_gb=$(l1_mem_gb)'
 	@echo 'l2_mem_gb=$(l2_mem_gb)'
-	@echo 'union_mem_gb=$(union_mem_gb)'
+	@echo 'concat_mem_gb=$(concat_mem_gb)'
 	@echo 'l1_bloom_files="$(l1_bloom_files)"'
 	@echo 'l2_bloom_files="$(l2_bloom_files)"'
 	@echo '$$(call getWindow, $(word 1,$(l1_bloom_files))): $(call getWindow,$(word 1,$(l1_bloom_files)))'